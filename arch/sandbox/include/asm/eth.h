@@ -39,6 +39,166 @@ int sandbox_eth_arp_req_to_reply(struct udevice *dev, void *packet,
 int sandbox_eth_ping_req_to_reply(struct udevice *dev, void *packet,
 				  unsigned int len);
 
+/**
+ * struct sandbox_eth_tftp - state of the mock TFTP server
+ *
+ * data - contents of the file served for any read request
+ * size - size of the file in bytes
+ * windowsize - largest window granted to the client, 0 to ignore the option
+ * drop_block - block number to drop the first time it is sent, 0 for none
+ * client_port - UDP port of the client
+ * blksize - block size negotiated with the client
+ * window - window size negotiated with the client
+ * acked - last block acknowledged by the client, or to it on a write
+ * acks - number of ACKs received from the client, or sent to it on a write
+ * blocks - number of DATA packets sent to the client, or received from it
+ * dropped - number of DATA packets dropped
+ * next - file served to a client port with no file yet, NULL if none
+ * name - name of the file, NULL to serve it for any name. When named, a read
+ *	request gets the file of that name in the chain, or an error
+ * latency - milliseconds added to the sandbox timer for each round trip
+ * requests - number of read or write requests received
+ * round_trips - number of requests received with no reply in flight
+ * put_data - buffer of @size bytes for a file written by the client, NULL to
+ *	ignore writes
+ * put_size - number of bytes written by the client
+ * received - last block received in order from the client
+ *
+ * The latency, requests and round_trips are only kept in the first file of
+ * the chain.
+ */
+struct sandbox_eth_tftp {
+	const uchar *data;
+	ulong size;
+	int windowsize;
+	ulong drop_block;
+	int client_port;
+	int blksize;
+	int window;
+	ulong acked;
+	int acks;
+	int blocks;
+	int dropped;
+	struct sandbox_eth_tftp *next;
+	const char *name;
+	ulong latency;
+	int requests;
+	int round_trips;
+	uchar *put_data;
+	ulong put_size;
+	ulong received;
+};
+
+/*
+ * sandbox_eth_tftp_req_to_reply()
+ *
+ * Check for a TFTP request, ACK or DATA block to be sent. If so, inject the
+ * OACK, the next window of DATA blocks or an ACK. priv->priv must point to a
+ * struct sandbox_eth_tftp describing the file to serve. Further files
+ * chained through its next member are handed out in turn to read requests
+ * from new client ports, which lets a client load several files at once.
+ *
+ * @dev: device that received the packet
+ * @packet: pointer to the received pacaket buffer
+ * @len: length of received packet
+ * @return 0 if injected, -EAGAIN if not
+ */
+int sandbox_eth_tftp_req_to_reply(struct udevice *dev, void *packet,
+				  unsigned int len);
+
+/**
+ * struct sandbox_eth_nfs - state of the mock NFSv2 server
+ *
+ * data - contents of the file served for any path
+ * size - size of the file in bytes
+ * latency - milliseconds added to the sandbox timer for each round trip
+ * drop_read - number of the READ request to drop, 0 for none
+ * reads - number of READ requests received
+ * round_trips - number of READ requests sent with no reply in flight
+ * dropped - number of READ requests dropped
+ */
+struct sandbox_eth_nfs {
+	const uchar *data;
+	ulong size;
+	ulong latency;
+	int drop_read;
+	int reads;
+	int round_trips;
+	int dropped;
+};
+
+/*
+ * sandbox_eth_nfs_req_to_reply()
+ *
+ * Check for a portmap, mount or NFS call to be sent. If so, inject the reply.
+ * priv->priv must point to a struct sandbox_eth_nfs describing the file to
+ * serve.
+ *
+ * @dev: device that received the packet
+ * @packet: pointer to the received pacaket buffer
+ * @len: length of received packet
+ * @return 0 if injected, -EAGAIN if not
+ */
+int sandbox_eth_nfs_req_to_reply(struct udevice *dev, void *packet,
+				 unsigned int len);
+
+/**
+ * struct sandbox_eth_tcp - state of the mock TCP server
+ *
+ * data - bytes sent on a connection once the request (up to an empty line)
+ *	is in, e.g. an HTTP response; the server then closes the connection
+ * size - number of bytes to send
+ * port - TCP port the server listens on
+ * drop_seg - number of the data segment to drop the first time it is sent,
+ *	0 for none
+ * client_port - TCP port of the client
+ * client_wscale - window scale asked for by the client, -1 for none
+ * client_wnd - last window advertised by the client, in bytes
+ * iss, snd_una, snd_nxt, rcv_nxt - sequence numbers of the connection
+ * request - start of the request received
+ * request_len - number of bytes of request received
+ * segs - number of data segments sent
+ * acks - number of segments received acknowledging data
+ * dupacks - number of duplicate ACKs in a row
+ * retransmits - number of fast retransmits
+ * dropped - number of data segments dropped
+ */
+struct sandbox_eth_tcp {
+	const uchar *data;
+	ulong size;
+	int port;
+	int drop_seg;
+	int client_port;
+	int client_wscale;
+	ulong client_wnd;
+	u32 iss;
+	u32 snd_una;
+	u32 snd_nxt;
+	u32 rcv_nxt;
+	char request[256];
+	int request_len;
+	int segs;
+	int acks;
+	int dupacks;
+	int retransmits;
+	int dropped;
+};
+
+/*
+ * sandbox_eth_tcp_req_to_reply()
+ *
+ * Check for a TCP segment to the mock server. If so, inject its answer and
+ * as much of the data as the client window allows. priv->priv must point to
+ * a struct sandbox_eth_tcp describing what to send.
+ *
+ * @dev: device that received the packet
+ * @packet: pointer to the received pacaket buffer
+ * @len: length of received packet
+ * @return 0 if injected, -EAGAIN if not
+ */
+int sandbox_eth_tcp_req_to_reply(struct udevice *dev, void *packet,
+				 unsigned int len);
+
 /*
  * sandbox_eth_recv_arp_req()
  *
@@ -78,6 +238,9 @@ typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
  * recv_packet_buffer - buffers of the packet returned as received
  * recv_packet_length - lengths of the packet returned as received
  * recv_packets - number of packets returned
+ * batch_buffer - packets being processed after a batch receive, moved out of
+ *	recv_packet_buffer so that replies can be queued meanwhile
+ * batch_packets - number of those not freed yet
  * tx_handler - function to generate responses to sent packets
  * priv - a pointer to some structure a test may want to keep track of
  */
@@ -88,6 +251,8 @@ struct eth_sandbox_priv {
 	uchar * recv_packet_buffer[PKTBUFSRX];
 	int recv_packet_length[PKTBUFSRX];
 	int recv_packets;
+	uchar batch_buffer[PKTBUFSRX][PKTSIZE_ALIGN];
+	int batch_packets;
 	sandbox_eth_tx_hand_f *tx_handler;
 	void *priv;
 };
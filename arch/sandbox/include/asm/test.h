@@ -90,6 +90,22 @@ long sandbox_i2c_rtc_get_set_base_time(struct udevice *dev, long base_time);
 
 int sandbox_usb_keyb_add_string(struct udevice *dev, const char *str);
 
+/**
+ * sandbox_flash_get_altsetting() - get the interface setting of a flash stick
+ *
+ * @dev:	USB flash stick emulator
+ * @return selected alternate setting: 0 for BBB, 1 for UAS
+ */
+int sandbox_flash_get_altsetting(struct udevice *dev);
+
+/**
+ * sandbox_flash_get_streams() - get the number of UAS streams of a flash stick
+ *
+ * @dev:	USB flash stick emulator
+ * @return number of bulk streams set up by the host, 0 for none
+ */
+int sandbox_flash_get_streams(struct udevice *dev);
+
 /**
  * sandbox_osd_get_mem() - get the internal memory of a sandbox OSD
  *
@@ -121,4 +137,71 @@ int sandbox_pwm_get_config(struct udevice *dev, uint channel, uint *period_nsp,
  */
 void sandbox_sf_set_block_protect(struct udevice *dev, int bp_mask);
 
+/**
+ * struct sandbox_mmc_stats - what a sandbox MMC card has been asked to do
+ *
+ * @time_us:	Time the card has been busy, following a simple timing model
+ * @set_count:	Number of SET_BLOCK_COUNT (CMD23) commands
+ * @pre_erase:	Number of SET_WR_BLK_ERASE_COUNT (ACMD23) commands
+ * @stops:	Number of STOP_TRANSMISSION (CMD12) commands
+ * @op_cond_polls:	Number of SD_SEND_OP_COND (ACMD41) commands
+ * @power_up_overlap:	Largest number of cards seen powering up at once by
+ *			this card while it was powering up
+ */
+struct sandbox_mmc_stats {
+	ulong time_us;
+	uint set_count;
+	uint pre_erase;
+	uint stops;
+	uint op_cond_polls;
+	uint power_up_overlap;
+};
+
+/**
+ * sandbox_mmc_get_stats() - Get the statistics of a sandbox MMC card
+ *
+ * This also resets them, ready for the next measurement.
+ *
+ * @dev:	MMC device to check
+ * @stats:	Returns the statistics
+ */
+void sandbox_mmc_get_stats(struct udevice *dev,
+			   struct sandbox_mmc_stats *stats);
+
+/**
+ * struct sandbox_virtio_stats - what a sandbox virtio device has been asked
+ *
+ * @notify_count:	Number of times the driver notified a queue
+ * @req_count:		Number of requests carried out
+ * @indirect_count:	Number of requests using an indirect descriptor table
+ * @max_batch:		Largest number of requests seen by one notification
+ */
+struct sandbox_virtio_stats {
+	uint notify_count;
+	uint req_count;
+	uint indirect_count;
+	uint max_batch;
+};
+
+/**
+ * sandbox_virtio_set_features() - Set the features a sandbox device offers
+ *
+ * These are negotiated when the virtio device below it is next probed.
+ *
+ * @dev:	Virtio transport device
+ * @features:	Device features to offer
+ */
+void sandbox_virtio_set_features(struct udevice *dev, u64 features);
+
+/**
+ * sandbox_virtio_get_stats() - Get the statistics of a sandbox virtio device
+ *
+ * This also resets them, ready for the next measurement.
+ *
+ * @dev:	Virtio transport device
+ * @stats:	Returns the statistics
+ */
+void sandbox_virtio_get_stats(struct udevice *dev,
+			      struct sandbox_virtio_stats *stats);
+
 #endif
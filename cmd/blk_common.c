@@ -10,8 +10,25 @@
 
 #include <common.h>
 #include <blk.h>
+#include <linux/math64.h>
 
 #ifdef CONFIG_HAVE_BLOCK_DEVICE
+/* Show how long a read or write of @blkcnt blocks took, and its throughput */
+static void blk_show_speed(enum if_type if_type, int devnum, ulong blkcnt,
+			   ulong start)
+{
+	ulong elapsed = max(get_timer(start), 1UL);
+	struct blk_desc *desc;
+	u64 bytes;
+
+	desc = blk_get_devnum_by_type(if_type, devnum);
+	if (!desc)
+		return;
+	bytes = (u64)blkcnt * desc->blksz;
+	printf("%llu bytes in %lu ms, ", bytes, elapsed);
+	print_size(div_u64(bytes * 1000, elapsed), "/s\n");
+}
+
 int blk_common_cmd(int argc, char * const argv[], enum if_type if_type,
 		   int *cur_devnump)
 {
@@ -65,31 +82,37 @@ int blk_common_cmd(int argc, char * const argv[], enum if_type if_type,
 			ulong addr = simple_strtoul(argv[2], NULL, 16);
 			lbaint_t blk = simple_strtoul(argv[3], NULL, 16);
 			ulong cnt = simple_strtoul(argv[4], NULL, 16);
-			ulong n;
+			ulong n, start;
 
 			printf("\n%s read: device %d block # "LBAFU", count %lu ... ",
 			       if_name, *cur_devnump, blk, cnt);
 
+			start = get_timer(0);
 			n = blk_read_devnum(if_type, *cur_devnump, blk, cnt,
 					    (ulong *)addr);
 
 			printf("%ld blocks read: %s\n", n,
 			       n == cnt ? "OK" : "ERROR");
+			if (n == cnt)
+				blk_show_speed(if_type, *cur_devnump, n, start);
 			return n == cnt ? 0 : 1;
 		} else if (strcmp(argv[1], "write") == 0) {
 			ulong addr = simple_strtoul(argv[2], NULL, 16);
 			lbaint_t blk = simple_strtoul(argv[3], NULL, 16);
 			ulong cnt = simple_strtoul(argv[4], NULL, 16);
-			ulong n;
+			ulong n, start;
 
 			printf("\n%s write: device %d block # "LBAFU", count %lu ... ",
 			       if_name, *cur_devnump, blk, cnt);
 
+			start = get_timer(0);
 			n = blk_write_devnum(if_type, *cur_devnump, blk, cnt,
 					     (ulong *)addr);
 
 			printf("%ld blocks written: %s\n", n,
 			       n == cnt ? "OK" : "ERROR");
+			if (n == cnt)
+				blk_show_speed(if_type, *cur_devnump, n, start);
 			return n == cnt ? 0 : 1;
 		} else {
 			return CMD_RET_USAGE;
@@ -17,11 +17,16 @@ static int blkc_show(cmd_tbl_t *cmdtp, int flag,
 
 	printf("hits: %u\n"
 	       "misses: %u\n"
+	       "prefetched lines: %u\n"
+	       "prefetch hits: %u\n"
+	       "prefetch unused: %u\n"
+	       "evictions: %u\n"
 	       "entries: %u\n"
 	       "max blocks/entry: %u\n"
 	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       stats.hits, stats.misses, stats.prefetches,
+	       stats.prefetch_hits, stats.prefetch_unused, stats.evictions,
+	       stats.entries, stats.max_blocks_per_entry, stats.max_entries);
 	return 0;
 }
 
@@ -82,5 +87,6 @@ U_BOOT_CMD(
 	blkcache, 4, 0, do_blkcache,
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
-	"blkcache configure blocks entries\n"
+	"blkcache configure blocks entries - cache lines of 'blocks' blocks,\n"
+	"    a power of two, and at most 'entries' lines\n"
 );
@@ -5,7 +5,71 @@
  */
 #include <common.h>
 #include <command.h>
+#include <mapmem.h>
 #include <part.h>
+#include <sink.h>
+#include <linux/sizes.h>
+
+/* Bytes to load at a time, so each piece is handled while the next loads */
+#define DISKBOOT_CHUNK_SIZE	SZ_1M
+
+/*
+ * Finish with a piece just loaded: flush it from the cache and pass the
+ * part of it which belongs to the image to @hash, if not NULL. @sizep holds
+ * the number of image bytes still to be hashed.
+ */
+static int diskboot_done(ulong addr, ulong len, struct sink *hash,
+			 ulong *sizep)
+{
+	void *buf;
+	int ret;
+
+	flush_cache(addr, len);
+	if (!CONFIG_IS_ENABLED(SINK) || !hash)
+		return 0;
+
+	len = min(len, *sizep);
+	*sizep -= len;
+	buf = map_sysmem(addr, len);
+	ret = sink_write(hash, buf, len);
+	unmap_sysmem(buf);
+
+	return ret;
+}
+
+static int diskboot_read(struct blk_desc *dev_desc, lbaint_t start,
+			 lbaint_t cnt, ulong addr, struct sink *hash,
+			 ulong size)
+{
+	lbaint_t chunk = max_t(lbaint_t, DISKBOOT_CHUNK_SIZE / dev_desc->blksz, 1);
+	ulong done_addr = 0, done_size = 0;
+	struct blk_req req;
+	lbaint_t n;
+
+	while (cnt) {
+		n = min(cnt, chunk);
+		if (blk_dread_submit(dev_desc, start, n,
+				     map_sysmem(addr, n * dev_desc->blksz),
+				     &req))
+			return -EIO;
+		if (done_size &&
+		    diskboot_done(done_addr, done_size, hash, &size)) {
+			blk_dread_wait(&req);
+			return -EIO;
+		}
+		if (blk_dread_wait(&req) != n)
+			return -EIO;
+		done_addr = addr;
+		done_size = n * dev_desc->blksz;
+		start += n;
+		cnt -= n;
+		addr += done_size;
+	}
+	if (done_size)
+		return diskboot_done(done_addr, done_size, hash, &size);
+
+	return 0;
+}
 
 int common_diskboot(cmd_tbl_t *cmdtp, const char *intf, int argc,
 		    char *const argv[])
@@ -15,6 +79,9 @@ int common_diskboot(cmd_tbl_t *cmdtp, const char *intf, int argc,
 	ulong addr = CONFIG_SYS_LOAD_ADDR;
 	ulong cnt;
 	disk_partition_t info;
+	struct sink *hash;
+	ulong size;
+	int ret;
 #if defined(CONFIG_IMAGE_FORMAT_LEGACY)
 	image_header_t *hdr;
 #endif
@@ -54,17 +121,18 @@ int common_diskboot(cmd_tbl_t *cmdtp, const char *intf, int argc,
 	      ", Block Size: %ld\n",
 	      info.start, info.size, info.blksz);
 
-	if (blk_dread(dev_desc, info.start, 1, (ulong *)addr) != 1) {
+	if (blk_dread(dev_desc, info.start, 1, map_sysmem(addr, info.blksz)) !=
+	    1) {
 		printf("** Read error on %d:%d\n", dev, part);
 		bootstage_error(BOOTSTAGE_ID_IDE_PART_READ);
 		return 1;
 	}
 	bootstage_mark(BOOTSTAGE_ID_IDE_PART_READ);
 
-	switch (genimg_get_format((void *) addr)) {
+	switch (genimg_get_format(map_sysmem(addr, 0))) {
 #if defined(CONFIG_IMAGE_FORMAT_LEGACY)
 	case IMAGE_FORMAT_LEGACY:
-		hdr = (image_header_t *) addr;
+		hdr = map_sysmem(addr, 0);
 
 		bootstage_mark(BOOTSTAGE_ID_IDE_FORMAT);
 
@@ -82,7 +150,7 @@ int common_diskboot(cmd_tbl_t *cmdtp, const char *intf, int argc,
 #endif
 #if CONFIG_IS_ENABLED(FIT)
 	case IMAGE_FORMAT_FIT:
-		fit_hdr = (const void *) addr;
+		fit_hdr = map_sysmem(addr, 0);
 		puts("Fit image detected...\n");
 
 		cnt = fit_get_size(fit_hdr);
@@ -94,12 +162,19 @@ int common_diskboot(cmd_tbl_t *cmdtp, const char *intf, int argc,
 		return 1;
 	}
 
+	size = cnt;
 	cnt += info.blksz - 1;
 	cnt /= info.blksz;
 	cnt -= 1;
 
-	if (blk_dread(dev_desc, info.start + 1, cnt,
-		      (ulong *)(addr + info.blksz)) != cnt) {
+	if (sink_hash_env_new("diskhash", &hash))
+		return 1;
+	ret = diskboot_done(addr, info.blksz, hash, &size);
+	if (!ret)
+		ret = diskboot_read(dev_desc, info.start + 1, cnt,
+				    addr + info.blksz, hash, size);
+	ret = sink_hash_env_end("diskhash", hash, ret);
+	if (ret) {
 		printf("** Read error on %d:%d\n", dev, part);
 		bootstage_error(BOOTSTAGE_ID_IDE_READ);
 		return 1;
@@ -109,7 +184,7 @@ int common_diskboot(cmd_tbl_t *cmdtp, const char *intf, int argc,
 #if CONFIG_IS_ENABLED(FIT)
 	/* This cannot be done earlier,
 	 * we need complete FIT image in RAM first */
-	if (genimg_get_format((void *) addr) == IMAGE_FORMAT_FIT) {
+	if (genimg_get_format(map_sysmem(addr, 0)) == IMAGE_FORMAT_FIT) {
 		if (!fit_check_format(fit_hdr)) {
 			bootstage_error(BOOTSTAGE_ID_IDE_FIT_READ);
 			puts("** Bad FIT image format\n");
@@ -120,7 +195,7 @@ int common_diskboot(cmd_tbl_t *cmdtp, const char *intf, int argc,
 	}
 #endif
 
-	flush_cache(addr, (cnt+1)*info.blksz);
+	flush_cache(addr, info.blksz);
 
 	/* Loading ok, update default load address */
 	load_addr = addr;
@@ -88,3 +88,24 @@ U_BOOT_CMD(
 	"fstype <interface> <dev>:<part> <varname>\n"
 	"- set environment variable to filesystem type\n"
 );
+
+#ifdef CONFIG_FS_CACHE
+static int do_fscache(cmd_tbl_t *cmdtp, int flag, int argc,
+		      char * const argv[])
+{
+	struct fs_cache_stats stats;
+
+	fs_cache_stats(&stats);
+	printf("File lookups: %u hits, %u misses, %u paths\n",
+	       stats.hits, stats.misses, stats.entries);
+
+	return 0;
+}
+
+U_BOOT_CMD(
+	fscache, 1, 1, do_fscache,
+	"show the use of the file lookup cache",
+	"\n"
+	"    - print hits and misses of 'test -e', 'size' and 'load' lookups"
+);
+#endif
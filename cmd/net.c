@@ -9,9 +9,12 @@
  */
 #include <common.h>
 #include <command.h>
+#include <dm.h>
 #include <net.h>
+#include <net/tftp.h>
 
 static int netboot_common(enum proto_t, cmd_tbl_t *, int, char * const []);
+static void netboot_update_env(void);
 
 #ifdef CONFIG_CMD_BOOTP
 static int do_bootp(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
@@ -27,20 +30,76 @@ U_BOOT_CMD(
 #endif
 
 #ifdef CONFIG_CMD_TFTPBOOT
+#ifdef CONFIG_TFTP_MULTI
+/* Load the files given as address and name pairs, all at once */
+static int netboot_multi(int argc, char * const argv[])
+{
+	ulong addr;
+	int size;
+	int ret;
+	int i;
+
+	if (!argc || argc % 2)
+		return CMD_RET_USAGE;
+
+	tftp_multi_clear();
+	for (i = 0; i < argc; i += 2) {
+		if (strict_strtoul(argv[i], 16, &addr) < 0) {
+			tftp_multi_clear();
+			return CMD_RET_USAGE;
+		}
+		ret = tftp_multi_add(addr, argv[i + 1]);
+		if (ret) {
+			printf("Cannot load '%s' (err=%d)\n", argv[i + 1], ret);
+			tftp_multi_clear();
+			return CMD_RET_FAILURE;
+		}
+	}
+	net_boot_file_name_explicit = true;
+	bootstage_mark(BOOTSTAGE_ID_NET_START);
+
+	size = net_loop(TFTPGET);
+	tftp_multi_clear();
+	if (size < 0) {
+		bootstage_error(BOOTSTAGE_ID_NET_NETLOOP_OK);
+		return CMD_RET_FAILURE;
+	}
+	bootstage_mark(BOOTSTAGE_ID_NET_NETLOOP_OK);
+
+	/* filesize and fileaddr describe the last file */
+	netboot_update_env();
+
+	return CMD_RET_SUCCESS;
+}
+
+#define TFTPBOOT_MAXARGS	(2 + 2 * TFTP_MULTI_MAX)
+#else
+#define TFTPBOOT_MAXARGS	3
+#endif
+
 int do_tftpb(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 {
 	int ret;
 
 	bootstage_mark_name(BOOTSTAGE_KERNELREAD_START, "tftp_start");
-	ret = netboot_common(TFTPGET, cmdtp, argc, argv);
+#ifdef CONFIG_TFTP_MULTI
+	if (argc > 1 && !strcmp(argv[1], "-m"))
+		ret = netboot_multi(argc - 2, argv + 2);
+	else
+#endif
+		ret = netboot_common(TFTPGET, cmdtp, argc, argv);
 	bootstage_mark_name(BOOTSTAGE_KERNELREAD_STOP, "tftp_done");
 	return ret;
 }
 
 U_BOOT_CMD(
-	tftpboot,	3,	1,	do_tftpb,
+	tftpboot,	TFTPBOOT_MAXARGS,	1,	do_tftpb,
 	"boot image via network using TFTP protocol",
 	"[loadAddress] [[hostIPaddr:]bootfilename]"
+#ifdef CONFIG_TFTP_MULTI
+	"\ntftpboot -m loadAddress bootfilename [loadAddress bootfilename...]\n"
+	"    - load up to " __stringify(TFTP_MULTI_MAX) " files from serverip at once"
+#endif
 );
 #endif
 
@@ -113,6 +172,20 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_WGET)
+static int do_wget(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	return netboot_common(WGET, cmdtp, argc, argv);
+}
+
+U_BOOT_CMD(
+	wget,	3,	1,	do_wget,
+	"boot image via network using HTTP protocol",
+	"[loadAddress] [[hostIPaddr:]path]\n"
+	"wget [loadAddress] http://hostIPaddr[:port]/path"
+);
+#endif
+
 static void netboot_update_env(void)
 {
 	char tmp[22];
@@ -296,6 +369,111 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_ARP)
+static int do_arp(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	if (argc == 1) {
+		arp_cache_print();
+		return CMD_RET_SUCCESS;
+	}
+
+	if (argc == 2 && !strcmp(argv[1], "-d")) {
+		arp_cache_flush();
+		return CMD_RET_SUCCESS;
+	}
+
+	return CMD_RET_USAGE;
+}
+
+U_BOOT_CMD(
+	arp,	2,	1,	do_arp,
+	"show or flush the ARP cache",
+	"\n"
+	"    - show cached neighbours with hit and miss counters\n"
+	"arp -d\n"
+	"    - flush the cache and reset the counters"
+);
+#endif
+
+#if defined(CONFIG_CMD_NET_STATS)
+static void net_stats_show(struct udevice *dev)
+{
+	struct eth_stats *stats = eth_get_stats(dev);
+
+	printf("%s:\n", dev->name);
+	printf("  rx: %lu packets, %lu bytes, %lu errors, %lu dropped, %lu bad checksum\n",
+	       stats->rx_packets, stats->rx_bytes, stats->rx_errors,
+	       stats->rx_dropped, stats->rx_csum_errors);
+	if (stats->rx_polls)
+		printf("  rx: %lu.%lu packets per poll, up to %lu\n",
+		       stats->rx_packets / stats->rx_polls,
+		       stats->rx_packets * 10 / stats->rx_polls % 10,
+		       stats->rx_batch_max);
+	printf("  tx: %lu packets, %lu bytes, %lu errors\n",
+	       stats->tx_packets, stats->tx_bytes, stats->tx_errors);
+	printf("  %lu timeouts, %lu retransmits, %lu duplicate blocks\n",
+	       stats->timeouts, stats->retransmits, stats->dup_blocks);
+	if (stats->xfer_bytes) {
+		printf("  last file: %lu bytes in %lu ms", stats->xfer_bytes,
+		       stats->xfer_ms);
+		if (stats->xfer_ms) {
+			puts(", ");
+			print_size((u64)stats->xfer_bytes * 1000 /
+				   stats->xfer_ms, "/s");
+		}
+		putc('\n');
+	}
+}
+
+static int do_net(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	struct udevice *dev;
+	struct uclass *uc;
+	bool clear = false;
+	const char *name = NULL;
+	int ret;
+
+	if (argc < 2 || strcmp(argv[1], "stats"))
+		return CMD_RET_USAGE;
+	if (argc > 2 && !strcmp(argv[2], "clear")) {
+		clear = true;
+		argc--;
+		argv++;
+	}
+	if (argc > 3)
+		return CMD_RET_USAGE;
+	if (argc == 3)
+		name = argv[2];
+
+	ret = uclass_get(UCLASS_ETH, &uc);
+	if (ret)
+		return CMD_RET_FAILURE;
+	uclass_foreach_dev(dev, uc) {
+		/* only probed devices have counters */
+		if (!eth_get_stats(dev))
+			continue;
+		if (name && strcmp(name, dev->name))
+			continue;
+		if (clear)
+			memset(eth_get_stats(dev), '\0',
+			       sizeof(struct eth_stats));
+		else
+			net_stats_show(dev);
+	}
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	net,	4,	1,	do_net,
+	"show network statistics",
+	"stats [dev]\n"
+	"    - show the traffic counters of dev, or of all devices\n"
+	"net stats clear [dev]\n"
+	"    - reset the counters"
+);
+#endif
+
 #if defined(CONFIG_CMD_CDP)
 
 static void cdp_update_env(void)
@@ -55,6 +55,7 @@ static int do_part_list(int argc, char * const argv[])
 	struct blk_desc *desc;
 	char *var = NULL;
 	bool bootable = false;
+	bool verbose = false;
 	int i;
 
 	if (argc < 2)
@@ -65,6 +66,8 @@ static int do_part_list(int argc, char * const argv[])
 			if (argv[i][0] == '-') {
 				if (!strcmp(argv[i], "-bootable")) {
 					bootable = true;
+				} else if (!strcmp(argv[i], "-v")) {
+					verbose = true;
 				} else {
 					printf("Unknown option %s\n", argv[i]);
 					return CMD_RET_USAGE;
@@ -77,7 +80,7 @@ static int do_part_list(int argc, char * const argv[])
 
 		/* Loops should have been exited at the last argument, which
 		 * as it contained the variable */
-		if (argc != i + 1)
+		if (var && argc != i + 1)
 			return CMD_RET_USAGE;
 	}
 
@@ -108,6 +111,13 @@ static int do_part_list(int argc, char * const argv[])
 	}
 
 	part_print(desc);
+	if (CONFIG_IS_ENABLED(EFI_PARTITION_CACHE) && verbose) {
+		struct gpt_cache_stats stats;
+
+		gpt_cache_stats(&stats);
+		printf("GPT cache: %u hits, %u misses, %u tables\n",
+		       stats.hits, stats.misses, stats.entries);
+	}
 
 	return 0;
 }
@@ -196,8 +206,9 @@ U_BOOT_CMD(
 	"    - print partition UUID\n"
 	"part uuid <interface> <dev>:<part> <varname>\n"
 	"    - set environment variable to partition UUID\n"
-	"part list <interface> <dev>\n"
+	"part list <interface> <dev> [-v]\n"
 	"    - print a device's partition table\n"
+	"      -v also shows the use of the GPT cache\n"
 	"part list <interface> <dev> [flags] <varname>\n"
 	"    - set environment variable to the list of partitions\n"
 	"      flags can be -bootable (list only bootable partitions)\n"
@@ -13,6 +13,7 @@
 #include <errno.h>
 #include <linux/list.h>
 #include <fs.h>
+#include <net/tftp.h>
 #include <asm/io.h>
 
 #include "menu.h"
@@ -288,66 +289,102 @@ static int get_pxelinux_path(cmd_tbl_t *cmdtp, const char *file,
 	return get_pxe_file(cmdtp, path, pxefile_addr_r);
 }
 
+/* Most names 'pxe get' tries: UUID, MAC, eight IP prefixes, defaults */
+#define PXE_MAX_NAMES	(2 + 8 + ARRAY_SIZE(pxe_default_paths) - 1)
+
 /*
- * Looks for a pxe file with a name based on the pxeuuid environment variable.
+ * Lists the names of the pxe files to look for, most specific first: one
+ * based on the pxeuuid environment variable, one based on the 'ethaddr'
+ * environment variable, those based on our IP address and the defaults. See
+ * pxelinux documentation for details on what these file names look like.
+ * We match that exactly.
  *
- * Returns 1 on success or < 0 on error.
+ * Returns the number of names.
  */
-static int pxe_uuid_path(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
+static int pxe_get_names(char names[][MAX_TFTP_PATH_LEN + 1])
 {
 	char *uuid_str;
+	int mask_pos, count = 0;
+	int i;
 
 	uuid_str = from_env("pxeuuid");
+	if (uuid_str && strlen(uuid_str) <= MAX_TFTP_PATH_LEN)
+		strcpy(names[count++], uuid_str);
 
-	if (!uuid_str)
-		return -ENOENT;
+	if (format_mac_pxe(names[count], sizeof(names[count])) > 0)
+		count++;
+
+	sprintf(names[count], "%08X", ntohl(env_get_ip("ipaddr").s_addr));
+	for (mask_pos = 7; mask_pos > 0; mask_pos--) {
+		strcpy(names[count + 1], names[count]);
+		names[++count][mask_pos] = '\0';
+	}
+	count++;
+
+	for (i = 0; pxe_default_paths[i]; i++)
+		strcpy(names[count++], pxe_default_paths[i]);
 
-	return get_pxelinux_path(cmdtp, uuid_str, pxefile_addr_r);
+	return count;
 }
 
+#ifdef CONFIG_TFTP_MULTI
 /*
- * Looks for a pxe file with a name based on the 'ethaddr' environment
- * variable.
+ * Asks the server for all the pxe files at once, rather than waiting for
+ * each miss in turn. The names are sent in batches of TFTP_MULTI_MAX.
  *
- * Returns 1 on success or < 0 on error.
+ * Returns the index of the most specific name the server has, -ENOENT if it
+ * has none, or some other value < 0 on error.
  */
-static int pxe_mac_path(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
+static int pxe_probe_names(char names[][MAX_TFTP_PATH_LEN + 1], int count)
 {
-	char mac_str[21];
-	int err;
-
-	err = format_mac_pxe(mac_str, sizeof(mac_str));
+	char path[MAX_TFTP_PATH_LEN + 1];
+	size_t base_len;
+	int first, n, i, err;
 
+	err = get_bootfile_path(PXELINUX_DIR, path, sizeof(path));
 	if (err < 0)
 		return err;
+	strcat(path, PXELINUX_DIR);
+	base_len = strlen(path);
+
+	for (first = 0; first < count; first += n) {
+		n = min(count - first, TFTP_MULTI_MAX);
+		tftp_multi_clear();
+		for (i = 0, err = 0; i < n && !err; i++) {
+			if (base_len + strlen(names[first + i]) >
+			    MAX_TFTP_PATH_LEN) {
+				err = -ENAMETOOLONG;
+				break;
+			}
+			strcpy(path + base_len, names[first + i]);
+			err = tftp_multi_add(0, path);
+		}
+		if (!err)
+			err = tftp_multi_probe();
+		tftp_multi_clear();
+		if (err >= 0)
+			return first + err;
+		if (err != -ENOENT)
+			return err;
+	}
 
-	return get_pxelinux_path(cmdtp, mac_str, pxefile_addr_r);
+	return -ENOENT;
 }
+#endif
 
 /*
- * Looks for pxe files with names based on our IP address. See pxelinux
- * documentation for details on what these file names look like.  We match
- * that exactly.
- *
- * Returns 1 on success or < 0 on error.
+ * Remembers the name of the pxe file found in the pxecfg environment
+ * variable, so that the next 'pxe get' tries it first.
  */
-static int pxe_ipaddr_paths(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
+static int pxe_found(const char *name)
 {
-	char ip_addr[9];
-	int mask_pos, err;
+	const char *cached = env_get("pxecfg");
 
-	sprintf(ip_addr, "%08X", ntohl(net_ip.s_addr));
+	if (!cached || strcmp(cached, name))
+		env_set("pxecfg", name);
+	printf("Config file found\n");
 
-	for (mask_pos = 7; mask_pos >= 0;  mask_pos--) {
-		err = get_pxelinux_path(cmdtp, ip_addr, pxefile_addr_r);
-
-		if (err > 0)
-			return err;
-
-		ip_addr[mask_pos] = '\0';
-	}
-
-	return -ENOENT;
+	return 0;
 }
 
 /*
@@ -356,6 +393,7 @@ static int pxe_ipaddr_paths(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
  * The file is stored at the location given by the pxefile_addr_r environment
  * variable, which must be set.
  *
+ * pxecfg env variable, if defined, from the last successful 'pxe get'
  * UUID comes from pxeuuid env variable, if defined
  * MAC addr comes from ethaddr env variable, if defined
  * IP
@@ -367,9 +405,11 @@ static int pxe_ipaddr_paths(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
 static int
 do_pxe_get(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 {
+	char names[PXE_MAX_NAMES][MAX_TFTP_PATH_LEN + 1];
 	char *pxefile_addr_str;
 	unsigned long pxefile_addr_r;
-	int err, i = 0;
+	char *cached;
+	int err, i, count;
 
 	do_getfile = do_get_tftp;
 
@@ -386,27 +426,34 @@ do_pxe_get(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	if (err < 0)
 		return 1;
 
-	/*
-	 * Keep trying paths until we successfully get a file we're looking
-	 * for.
-	 */
-	if (pxe_uuid_path(cmdtp, pxefile_addr_r) > 0 ||
-	    pxe_mac_path(cmdtp, pxefile_addr_r) > 0 ||
-	    pxe_ipaddr_paths(cmdtp, pxefile_addr_r) > 0) {
+	/* The file found last time is most likely the right one */
+	cached = env_get("pxecfg");
+	if (cached && get_pxelinux_path(cmdtp, cached, pxefile_addr_r) > 0) {
 		printf("Config file found\n");
-
 		return 0;
 	}
 
-	while (pxe_default_paths[i]) {
-		if (get_pxelinux_path(cmdtp, pxe_default_paths[i],
-				      pxefile_addr_r) > 0) {
-			printf("Config file found\n");
-			return 0;
-		}
-		i++;
+	count = pxe_get_names(names);
+
+#ifdef CONFIG_TFTP_MULTI
+	i = pxe_probe_names(names, count);
+	if (i >= 0 && get_pxelinux_path(cmdtp, names[i], pxefile_addr_r) > 0)
+		return pxe_found(names[i]);
+	/* If the probe failed, fall back to one name at a time */
+	if (i == -ENOENT)
+		count = 0;
+#endif
+
+	/*
+	 * Keep trying paths until we successfully get a file we're looking
+	 * for.
+	 */
+	for (i = 0; i < count; i++) {
+		if (get_pxelinux_path(cmdtp, names[i], pxefile_addr_r) > 0)
+			return pxe_found(names[i]);
 	}
 
+	env_set("pxecfg", NULL);
 	printf("Config file not found\n");
 
 	return 1;
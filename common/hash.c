@@ -15,6 +15,7 @@
 #include <malloc.h>
 #include <mapmem.h>
 #include <hw_sha.h>
+#include <sink.h>
 #include <asm/io.h>
 #include <linux/errno.h>
 #else
@@ -247,6 +248,140 @@ int hash_progressive_lookup_algo(const char *algo_name,
 	return -EPROTONOSUPPORT;
 }
 
+#ifndef USE_HOSTCC
+#if CONFIG_IS_ENABLED(SINK)
+struct sink_hash {
+	struct sink sink;
+	struct hash_algo *algo;
+	void *ctx;			/* NULL once finished */
+	uint8_t digest[HASH_MAX_DIGEST_SIZE];
+	bool done;
+};
+
+static int sink_hash_write(struct sink *sink, const void *buf, ulong len)
+{
+	struct sink_hash *hash = container_of(sink, struct sink_hash, sink);
+	int ret;
+
+	ret = hash->algo->hash_update(hash->algo, hash->ctx, buf, len, 0);
+	if (ret) {
+		/* the context is gone */
+		hash->ctx = NULL;
+		return -EIO;
+	}
+
+	return sink->next ? sink_write(sink->next, buf, len) : 0;
+}
+
+static int sink_hash_close(struct sink *sink)
+{
+	struct sink_hash *hash = container_of(sink, struct sink_hash, sink);
+	void *ctx = hash->ctx;
+
+	if (!ctx)
+		return -EIO;
+	hash->ctx = NULL;
+	if (hash->algo->hash_update(hash->algo, ctx, NULL, 0, 1))
+		return -EIO;
+	if (hash->algo->hash_finish(hash->algo, ctx, hash->digest,
+				    sizeof(hash->digest)))
+		return -EIO;
+	hash->done = true;
+
+	return 0;
+}
+
+static void sink_hash_free(struct sink *sink)
+{
+	struct sink_hash *hash = container_of(sink, struct sink_hash, sink);
+
+	/* finishing is the only way to free the context */
+	if (hash->ctx)
+		hash->algo->hash_finish(hash->algo, hash->ctx, hash->digest,
+					sizeof(hash->digest));
+}
+
+static const struct sink_ops sink_hash_ops = {
+	.write	= sink_hash_write,
+	.close	= sink_hash_close,
+	.free	= sink_hash_free,
+};
+
+struct sink *sink_hash_new(const char *algo_name, struct sink *next)
+{
+	struct sink_hash *hash;
+	struct hash_algo *algo;
+
+	if (hash_progressive_lookup_algo(algo_name, &algo))
+		return NULL;
+	hash = calloc(1, sizeof(*hash));
+	if (!hash)
+		return NULL;
+	if (algo->hash_init(algo, &hash->ctx)) {
+		free(hash);
+		return NULL;
+	}
+	hash->sink.ops = &sink_hash_ops;
+	hash->sink.next = next;
+	hash->algo = algo;
+
+	return &hash->sink;
+}
+
+const uint8_t *sink_hash_digest(struct sink *sink, int *sizep)
+{
+	struct sink_hash *hash = container_of(sink, struct sink_hash, sink);
+
+	if (!hash->done)
+		return NULL;
+	*sizep = hash->algo->digest_size;
+
+	return hash->digest;
+}
+
+int sink_hash_env_new(const char *var, struct sink **sinkp)
+{
+	const char *algo = env_get(var);
+
+	*sinkp = NULL;
+	if (!algo)
+		return 0;
+	*sinkp = sink_hash_new(algo, NULL);
+	if (!*sinkp) {
+		printf("Unsupported %s '%s'\n", var, algo);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int sink_hash_env_end(const char *var, struct sink *sink, int err)
+{
+	char sum[HASH_MAX_DIGEST_SIZE * 2 + 1];
+	char name[32];
+	const uint8_t *digest;
+	int size, i;
+	char *p;
+
+	if (!sink)
+		return err;
+	if (!err && sink_close(sink))
+		err = -EIO;
+	if (!err) {
+		digest = sink_hash_digest(sink, &size);
+		for (i = 0, p = sum; i < size; i++, p += 2)
+			sprintf(p, "%02x", digest[i]);
+		printf("%s = %s\n", env_get(var), sum);
+		snprintf(name, sizeof(name), "%ssum", var);
+		err = env_set(name, sum);
+	}
+	sink_free(sink);
+
+	return err;
+}
+#endif
+#endif
+
 #ifndef USE_HOSTCC
 int hash_parse_string(const char *algo_name, const char *str, uint8_t *result)
 {
@@ -301,15 +301,17 @@ int spl_boot_partition(const u32 boot_device)
 }
 #endif
 
-int spl_mmc_load_image(struct spl_image_info *spl_image,
-		       struct spl_boot_device *bootdev)
+static int __spl_mmc_load_image(struct spl_image_info *spl_image,
+				struct spl_boot_device *bootdev,
+				struct mmc **mmcp)
 {
 	struct mmc *mmc = NULL;
 	u32 boot_mode;
 	int err = 0;
 	__maybe_unused int part;
 
-	err = spl_mmc_find_device(&mmc, bootdev->boot_device);
+	err = spl_mmc_find_device(mmcp, bootdev->boot_device);
+	mmc = *mmcp;
 	if (err)
 		return err;
 
@@ -388,6 +390,20 @@ int spl_mmc_load_image(struct spl_image_info *spl_image,
 	return err;
 }
 
+int spl_mmc_load_image(struct spl_image_info *spl_image,
+		       struct spl_boot_device *bootdev)
+{
+	struct mmc *mmc = NULL;
+	int err;
+
+	err = __spl_mmc_load_image(spl_image, bootdev, &mmc);
+	/* Let U-Boot proper carry on with the card without enumerating it */
+	if (!err && mmc)
+		mmc_handoff_save(mmc);
+
+	return err;
+}
+
 SPL_LOAD_IMAGE_METHOD("MMC1", 0, BOOT_DEVICE_MMC1, spl_mmc_load_image);
 SPL_LOAD_IMAGE_METHOD("MMC2", 0, BOOT_DEVICE_MMC2, spl_mmc_load_image);
 SPL_LOAD_IMAGE_METHOD("MMC2_2", 0, BOOT_DEVICE_MMC2_2, spl_mmc_load_image);
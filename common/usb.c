@@ -261,14 +261,9 @@ int usb_control_msg(struct usb_device *dev, unsigned int pipe,
  * negative if Error.
  * synchronous behavior
  */
-int usb_bulk_msg(struct usb_device *dev, unsigned int pipe,
-			void *data, int len, int *actual_length, int timeout)
+static int usb_bulk_wait(struct usb_device *dev, int *actual_length,
+			 int timeout)
 {
-	if (len < 0)
-		return -EINVAL;
-	dev->status = USB_ST_NOT_PROC; /*not yet processed */
-	if (submit_bulk_msg(dev, pipe, data, len) < 0)
-		return -EIO;
 	while (timeout--) {
 		if (!((volatile unsigned long)dev->status & USB_ST_NOT_PROC))
 			break;
@@ -281,6 +276,36 @@ int usb_bulk_msg(struct usb_device *dev, unsigned int pipe,
 		return -EIO;
 }
 
+int usb_bulk_msg(struct usb_device *dev, unsigned int pipe,
+			void *data, int len, int *actual_length, int timeout)
+{
+	if (len < 0)
+		return -EINVAL;
+	dev->status = USB_ST_NOT_PROC; /*not yet processed */
+	if (submit_bulk_msg(dev, pipe, data, len) < 0)
+		return -EIO;
+
+	return usb_bulk_wait(dev, actual_length, timeout);
+}
+
+#if CONFIG_IS_ENABLED(DM_USB)
+/*
+ * As usb_bulk_msg(), on a stream set up with usb_alloc_streams()
+ */
+int usb_bulk_msg_stream(struct usb_device *dev, unsigned int pipe,
+			unsigned int stream_id, void *data, int len,
+			int *actual_length, int timeout)
+{
+	if (len < 0)
+		return -EINVAL;
+	dev->status = USB_ST_NOT_PROC; /*not yet processed */
+	if (submit_bulk_stream_msg(dev, pipe, stream_id, data, len) < 0)
+		return -EIO;
+
+	return usb_bulk_wait(dev, actual_length, timeout);
+}
+#endif
+
 
 /*-------------------------------------------------------------------
  * Max Packet stuff
@@ -42,6 +42,7 @@
 #include <asm/processor.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
+#include <linux/math64.h>
 
 #include <part.h>
 #include <usb.h>
@@ -83,6 +84,11 @@ struct us_data {
 	unsigned char	ep_in;			/* in endpoint */
 	unsigned char	ep_out;			/* out ....... */
 	unsigned char	ep_int;			/* interrupt . */
+	unsigned char	ep_cmd;			/* UAS command pipe */
+	unsigned char	ep_status;		/* UAS status pipe */
+	unsigned char	altsetting;		/* interface alternate setting */
+	unsigned short	uas_streams;		/* UAS bulk streams, 0 for none */
+	unsigned short	uas_tag;		/* UAS tag of the last command */
 	unsigned char	subclass;		/* as in overview */
 	unsigned char	protocol;		/* .............. */
 	unsigned char	attention_done;		/* force attn on first cmd */
@@ -97,6 +103,9 @@ struct us_data {
 	trans_reset	transport_reset;	/* reset routine */
 	trans_cmnd	transport;		/* transport routine */
 	unsigned short	max_xfer_blk;		/* maximum transfer blocks */
+	ulong		cmd_count;		/* read/write commands sent */
+	u64		xfer_bytes;		/* bytes read and written */
+	ulong		xfer_time;		/* ms spent reading and writing */
 };
 
 #if !CONFIG_IS_ENABLED(BLK)
@@ -129,6 +138,41 @@ static void usb_show_progress(void)
 	debug(".");
 }
 
+static const char *usb_stor_transport_name(struct us_data *ss)
+{
+	switch (ss->protocol) {
+	case US_PR_CB:
+		return "CB";
+	case US_PR_CBI:
+		return "CBI";
+	case US_PR_BULK:
+		return "BBB";
+	case US_PR_UAS:
+		return "UAS";
+	default:
+		return "?";
+	}
+}
+
+/* Show the transport and the read/write counters of a device */
+static void usb_stor_show_stats(struct usb_device *udev)
+{
+	struct us_data *ss = udev ? udev->privptr : NULL;
+
+	if (!ss)
+		return;
+	printf("            Transport: %s, %u blocks/command, %lu commands, ",
+	       usb_stor_transport_name(ss), ss->max_xfer_blk, ss->cmd_count);
+	print_size(ss->xfer_bytes, "");
+	printf(" in %lu ms", ss->xfer_time);
+	if (ss->xfer_time) {
+		puts(", ");
+		print_size(div_u64(ss->xfer_bytes * 1000, ss->xfer_time),
+			   "/s");
+	}
+	puts("\n");
+}
+
 /*******************************************************************************
  * show info on storage devices; 'usb start/init' must be invoked earlier
  * as we only retrieve structures populated during devices initialization
@@ -146,6 +190,7 @@ int usb_stor_info(void)
 
 		printf("  Device %d: ", desc->devnum);
 		dev_print(desc);
+		usb_stor_show_stats(dev_get_parent_priv(dev_get_parent(dev)));
 		count++;
 	}
 #else
@@ -155,6 +200,7 @@ int usb_stor_info(void)
 		for (i = 0; i < usb_max_devs; i++) {
 			printf("  Device %d: ", i);
 			dev_print(&usb_dev_desc[i]);
+			usb_stor_show_stats(usb_dev_desc[i].priv);
 		}
 		return 0;
 	}
@@ -171,6 +217,10 @@ static unsigned int usb_get_max_lun(struct us_data *us)
 {
 	int len;
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, result, 1);
+
+	/* UAS has no class request for this, only REPORT LUNS */
+	if (us->protocol == US_PR_UAS)
+		return 0;
 	len = usb_control_msg(us->pusb_dev,
 			      usb_rcvctrlpipe(us->pusb_dev, 0),
 			      US_BBB_GET_MAX_LUN,
@@ -935,8 +985,242 @@ do_retry:
 	return USB_STOR_TRANSPORT_FAILED;
 }
 
+#ifdef CONFIG_USB_STORAGE_UAS
+/*
+ * Only one command is outstanding at a time. Without bulk streams all
+ * commands use the same tag and the device announces each data phase with a
+ * ready IU on the status pipe. With streams each command takes the next tag
+ * in turn, and its data and status use the stream with that number.
+ */
+#define UAS_TAG		1
+#define UAS_MAX_STREAMS	16
+
+static int usb_stor_UAS_bulk(struct us_data *us, unsigned int pipe,
+			     unsigned int tag, void *data, int len,
+			     int *actlen)
+{
+	struct usb_device *udev = us->pusb_dev;
+
+	if (us->uas_streams)
+		return usb_bulk_msg_stream(udev, pipe, tag, data, len, actlen,
+					   USB_CNTL_TIMEOUT * 5);
+
+	return usb_bulk_msg(udev, pipe, data, len, actlen,
+			    USB_CNTL_TIMEOUT * 5);
+}
+
+static int usb_stor_UAS_reset(struct us_data *us)
+{
+	struct usb_device *udev = us->pusb_dev;
+
+	debug("UAS RESET\n");
+	usb_clear_halt(udev, usb_sndbulkpipe(udev, us->ep_cmd));
+	usb_clear_halt(udev, usb_rcvbulkpipe(udev, us->ep_status));
+	usb_clear_halt(udev, usb_rcvbulkpipe(udev, us->ep_in));
+	usb_clear_halt(udev, usb_sndbulkpipe(udev, us->ep_out));
+
+	return 0;
+}
+
+static int usb_stor_UAS_transport(struct scsi_cmd *srb, struct us_data *us)
+{
+	struct usb_device *udev = us->pusb_dev;
+	ALLOC_CACHE_ALIGN_BUFFER(struct uas_command_iu, cmd, 1);
+	ALLOC_CACHE_ALIGN_BUFFER(struct uas_sense_iu, iu, 1);
+	unsigned int stpipe, pipe, tag;
+	int result, actlen, len;
+	int dir_in;
+
+	dir_in = US_DIRECTION(srb->cmd[0]);
+	stpipe = usb_rcvbulkpipe(udev, us->ep_status);
+	if (dir_in)
+		pipe = usb_rcvbulkpipe(udev, us->ep_in);
+	else
+		pipe = usb_sndbulkpipe(udev, us->ep_out);
+	tag = UAS_TAG;
+	if (us->uas_streams) {
+		us->uas_tag = us->uas_tag % us->uas_streams + 1;
+		tag = us->uas_tag;
+	}
+
+	/* COMMAND phase */
+	memset(cmd, '\0', sizeof(*cmd));
+	cmd->iu_id = UAS_IU_COMMAND;
+	cmd->tag = cpu_to_be16(tag);
+	cmd->lun[1] = srb->lun;
+	memcpy(cmd->cdb, srb->cmd, min_t(int, srb->cmdlen, sizeof(cmd->cdb)));
+	result = usb_bulk_msg(udev, usb_sndbulkpipe(udev, us->ep_cmd), cmd,
+			      sizeof(*cmd), &actlen, USB_CNTL_TIMEOUT * 5);
+	if (result < 0)
+		goto err;
+
+	if (us->uas_streams) {
+		/* DATA phase, on the stream of the command */
+		if (srb->datalen) {
+			result = usb_stor_UAS_bulk(us, pipe, tag, srb->pdata,
+						   srb->datalen, &actlen);
+			if (result < 0)
+				goto err;
+		}
+		result = usb_stor_UAS_bulk(us, stpipe, tag, iu, sizeof(*iu),
+					   &actlen);
+		if (result < 0)
+			goto err;
+	} else {
+		result = usb_stor_UAS_bulk(us, stpipe, tag, iu, sizeof(*iu),
+					   &actlen);
+		if (result < 0)
+			goto err;
+
+		/* DATA phase, once the device is ready for it */
+		if (srb->datalen &&
+		    iu->iu_id == (dir_in ? UAS_IU_READ_READY :
+				  UAS_IU_WRITE_READY)) {
+			if (be16_to_cpu(iu->tag) != tag)
+				goto err;
+			result = usb_stor_UAS_bulk(us, pipe, tag, srb->pdata,
+						   srb->datalen, &actlen);
+			if (result < 0)
+				goto err;
+			result = usb_stor_UAS_bulk(us, stpipe, tag, iu,
+						   sizeof(*iu), &actlen);
+			if (result < 0)
+				goto err;
+		}
+	}
+
+	/* STATUS phase */
+	if (iu->iu_id != UAS_IU_SENSE || be16_to_cpu(iu->tag) != tag ||
+	    actlen < UAS_SENSE_IU_SIZE) {
+		debug("UAS: unexpected IU %x\n", iu->iu_id);
+		goto err;
+	}
+	if (iu->status == 0)
+		return USB_STOR_TRANSPORT_GOOD;
+
+	/* keep the sense data, there is no contingent allegiance to read */
+	debug("UAS: status %x\n", iu->status);
+	len = min3((int)be16_to_cpu(iu->len), actlen - UAS_SENSE_IU_SIZE,
+		   (int)sizeof(srb->sense_buf));
+	memset(srb->sense_buf, '\0', sizeof(srb->sense_buf));
+	if (len > 0)
+		memcpy(srb->sense_buf, iu->sense, len);
+
+	return USB_STOR_TRANSPORT_FAILED;
+err:
+	debug("UAS: transport error, status %lx\n", udev->status);
+	memset(srb->sense_buf, '\0', sizeof(srb->sense_buf));
+	usb_stor_UAS_reset(us);
+
+	return USB_STOR_TRANSPORT_FAILED;
+}
+
+/*
+ * usb_stor_find_uas() - look for a UAS alternate setting we can use
+ *
+ * Fill in the UAS pipes and alternate setting of @ss if the interface
+ * offers UAS with all four pipes, and set up bulk streams on the status and
+ * data pipes if the host controller and the device have them.
+ *
+ * @return 0 if found, -ve if UAS cannot be used
+ */
+static int usb_stor_find_uas(struct usb_device *dev,
+			     struct usb_interface *iface, struct us_data *ss)
+{
+	struct usb_interface_descriptor *ifd = NULL;
+	struct usb_endpoint_descriptor *ep = NULL;
+	u8 pipes[UAS_PIPE_DATA_OUT + 1] = { 0 };
+	unsigned long stream_pipes[3];
+	int alt = -1;
+	unsigned char *buf;
+	int len, pos;
+	int streams;
+
+	if (iface->num_altsetting < 2)
+		return -ENOENT;
+
+	len = usb_get_configuration_len(dev, 0);
+	if (len < 0)
+		return len;
+	buf = malloc_cache_aligned(len);
+	if (!buf)
+		return -ENOMEM;
+	len = usb_get_configuration_no(dev, 0, buf, len);
+
+	/* the parsed config has no pipe usage, so walk the descriptors */
+	for (pos = 0; pos + 2 <= len && buf[pos]; pos += buf[pos]) {
+		struct usb_pipe_usage_descriptor *pu = (void *)buf + pos;
+
+		if (pos + buf[pos] > len)
+			break;
+		switch (pu->bDescriptorType) {
+		case USB_DT_INTERFACE:
+			ifd = (void *)pu;
+			ep = NULL;
+			if (alt == -1 && ifd->bInterfaceNumber ==
+			    iface->desc.bInterfaceNumber &&
+			    ifd->bInterfaceProtocol == US_PR_UAS)
+				alt = ifd->bAlternateSetting;
+			break;
+		case USB_DT_ENDPOINT:
+			ep = (void *)pu;
+			break;
+		case USB_DT_PIPE_USAGE:
+			if (!ifd || !ep || alt != ifd->bAlternateSetting ||
+			    ifd->bInterfaceNumber !=
+			    iface->desc.bInterfaceNumber ||
+			    pu->bPipeID < UAS_PIPE_CMD ||
+			    pu->bPipeID > UAS_PIPE_DATA_OUT)
+				break;
+			pipes[pu->bPipeID] = ep->bEndpointAddress;
+			break;
+		}
+	}
+	free(buf);
+
+	if (alt == -1 || !(pipes[UAS_PIPE_CMD] & USB_ENDPOINT_NUMBER_MASK) ||
+	    (pipes[UAS_PIPE_CMD] & USB_DIR_IN) ||
+	    !(pipes[UAS_PIPE_STATUS] & USB_DIR_IN) ||
+	    !(pipes[UAS_PIPE_DATA_IN] & USB_DIR_IN) ||
+	    !(pipes[UAS_PIPE_DATA_OUT] & USB_ENDPOINT_NUMBER_MASK) ||
+	    (pipes[UAS_PIPE_DATA_OUT] & USB_DIR_IN))
+		return -ENOENT;
+
+	for (pos = UAS_PIPE_CMD; pos <= UAS_PIPE_DATA_OUT; pos++)
+		pipes[pos] &= USB_ENDPOINT_NUMBER_MASK;
+	stream_pipes[0] = usb_rcvbulkpipe(dev, pipes[UAS_PIPE_STATUS]);
+	stream_pipes[1] = usb_rcvbulkpipe(dev, pipes[UAS_PIPE_DATA_IN]);
+	stream_pipes[2] = usb_sndbulkpipe(dev, pipes[UAS_PIPE_DATA_OUT]);
+	streams = usb_alloc_streams(dev, stream_pipes,
+				    ARRAY_SIZE(stream_pipes), UAS_MAX_STREAMS);
+	if (streams <= 0) {
+		/* SuperSpeed UAS cannot work without streams */
+		if (dev->speed >= USB_SPEED_SUPER) {
+			debug("UAS needs streams (err=%d), using BBB\n",
+			      streams);
+			return -ENOSYS;
+		}
+		streams = 0;
+	}
+
+	ss->uas_streams = streams;
+	ss->uas_tag = 0;
+	ss->altsetting = alt;
+	ss->ep_cmd = pipes[UAS_PIPE_CMD];
+	ss->ep_status = pipes[UAS_PIPE_STATUS];
+	ss->ep_in = pipes[UAS_PIPE_DATA_IN];
+	ss->ep_out = pipes[UAS_PIPE_DATA_OUT];
+
+	return 0;
+}
+#endif
+
+/*
+ * Set the number of blocks per command from the largest transfer the host
+ * controller can do, for a block size of @blksz
+ */
 static void usb_stor_set_max_xfer_blk(struct usb_device *udev,
-				      struct us_data *us)
+				      struct us_data *us, u32 blksz)
 {
 	unsigned short blk;
 	size_t __maybe_unused size;
@@ -959,9 +1243,9 @@ static void usb_stor_set_max_xfer_blk(struct usb_device *udev,
 		/* unimplemented, let's use default 20 */
 		blk = 20;
 	} else {
-		if (size > USHRT_MAX * 512)
-			size = USHRT_MAX * 512;
-		blk = size / 512;
+		if (size > (size_t)USHRT_MAX * blksz)
+			size = (size_t)USHRT_MAX * blksz;
+		blk = max_t(size_t, size / blksz, 1);
 	}
 #endif
 
@@ -996,6 +1280,9 @@ static int usb_request_sense(struct scsi_cmd *srb, struct us_data *ss)
 {
 	char *ptr;
 
+	/* UAS returns the sense data with the status of the failed command */
+	if (ss->protocol == US_PR_UAS)
+		return 0;
 	ptr = (char *)srb->pdata;
 	memset(&srb->cmd[0], 0, 12);
 	srb->cmd[0] = SCSI_REQ_SENSE;
@@ -1133,6 +1420,7 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 	struct usb_device *udev;
 	struct us_data *ss;
 	int retry;
+	ulong time_start;
 	struct scsi_cmd *srb = &usb_ccb;
 #if CONFIG_IS_ENABLED(BLK)
 	struct blk_desc *block_dev;
@@ -1156,6 +1444,7 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 	ss = (struct us_data *)udev->privptr;
 
 	usb_disable_asynch(1); /* asynch transfer not allowed */
+	time_start = get_timer(0);
 	srb->lun = block_dev->lun;
 	buf_addr = (uintptr_t)buffer;
 	start = blknr;
@@ -1177,6 +1466,7 @@ retry_it:
 			usb_show_progress();
 		srb->datalen = block_dev->blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
+		ss->cmd_count++;
 		if (usb_read_10(srb, ss, start, smallblks)) {
 			debug("Read ERROR\n");
 			usb_request_sense(srb, ss);
@@ -1190,6 +1480,8 @@ retry_it:
 		buf_addr += srb->datalen;
 	} while (blks != 0);
 	ss->flags &= ~USB_READY;
+	ss->xfer_bytes += (u64)blkcnt * block_dev->blksz;
+	ss->xfer_time += get_timer(time_start);
 
 	debug("usb_read: end startblk " LBAF ", blccnt %x buffer %lx\n",
 	      start, smallblks, buf_addr);
@@ -1214,6 +1506,7 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 	struct usb_device *udev;
 	struct us_data *ss;
 	int retry;
+	ulong time_start;
 	struct scsi_cmd *srb = &usb_ccb;
 #if CONFIG_IS_ENABLED(BLK)
 	struct blk_desc *block_dev;
@@ -1239,6 +1532,7 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 
 	usb_disable_asynch(1); /* asynch transfer not allowed */
 
+	time_start = get_timer(0);
 	srb->lun = block_dev->lun;
 	buf_addr = (uintptr_t)buffer;
 	start = blknr;
@@ -1262,6 +1556,7 @@ retry_it:
 			usb_show_progress();
 		srb->datalen = block_dev->blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
+		ss->cmd_count++;
 		if (usb_write_10(srb, ss, start, smallblks)) {
 			debug("Write ERROR\n");
 			usb_request_sense(srb, ss);
@@ -1275,6 +1570,8 @@ retry_it:
 		buf_addr += srb->datalen;
 	} while (blks != 0);
 	ss->flags &= ~USB_READY;
+	ss->xfer_bytes += (u64)blkcnt * block_dev->blksz;
+	ss->xfer_time += get_timer(time_start);
 
 	debug("usb_write: end startblk " LBAF ", blccnt %x buffer %lx\n",
 	      start, smallblks, buf_addr);
@@ -1375,8 +1672,22 @@ int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
 	debug("Endpoints In %d Out %d Int %d\n",
 	      ss->ep_in, ss->ep_out, ss->ep_int);
 
+#ifdef CONFIG_USB_STORAGE_UAS
+	/* Prefer UAS if the device offers it as an alternate setting */
+	if (!usb_stor_find_uas(dev, iface, ss)) {
+		debug("UAS: alternate setting %d, Cmd %d Status %d In %d Out %d\n",
+		      ss->altsetting, ss->ep_cmd, ss->ep_status, ss->ep_in,
+		      ss->ep_out);
+		debug("UAS: %d streams\n", ss->uas_streams);
+		ss->protocol = US_PR_UAS;
+		ss->transport = usb_stor_UAS_transport;
+		ss->transport_reset = usb_stor_UAS_reset;
+	}
+#endif
+
 	/* Do some basic sanity checks, and bail if we find a problem */
-	if (usb_set_interface(dev, iface->desc.bInterfaceNumber, 0) ||
+	if (usb_set_interface(dev, iface->desc.bInterfaceNumber,
+			      ss->altsetting) ||
 	    !ss->ep_in || !ss->ep_out ||
 	    (ss->protocol == US_PR_CBI && ss->ep_int == 0)) {
 		debug("Problems with device\n");
@@ -1403,7 +1714,7 @@ int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
 	}
 
 	/* Set the maximum transfer size per host controller setting */
-	usb_stor_set_max_xfer_blk(dev, ss);
+	usb_stor_set_max_xfer_blk(dev, ss, 512);
 
 	dev->privptr = (void *)ss;
 	return 1;
@@ -1490,6 +1801,8 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 	dev_desc->blksz = blksz;
 	dev_desc->log2blksz = LOG2(dev_desc->blksz);
 	dev_desc->type = perq;
+	if (blksz)
+		usb_stor_set_max_xfer_blk(dev, ss, blksz);
 	debug(" address %d\n", dev_desc->target);
 
 	return 1;
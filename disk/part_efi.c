@@ -19,6 +19,7 @@
 #include <part_efi.h>
 #include <linux/compiler.h>
 #include <linux/ctype.h>
+#include <linux/list.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -177,63 +178,244 @@ static void prepare_backup_gpt_header(gpt_header *gpt_h)
 }
 
 #if CONFIG_IS_ENABLED(EFI_PARTITION)
-/*
- * Public Functions (include/part.h)
+#if CONFIG_IS_ENABLED(EFI_PARTITION_CACHE)
+/**
+ * struct gpt_cache_name - name of a partition, for the name index
+ *
+ * @name:	Name as returned by print_efiname()
+ * @part:	Partition number (1 = first)
  */
+struct gpt_cache_name {
+	char name[PARTNAME_SZ + 1];
+	int part;
+};
 
-/*
- * UUID is displayed as 32 hexadecimal digits, in 5 groups,
- * separated by hyphens, in the form 8-4-4-4-12 for a total of 36 characters
+/**
+ * struct gpt_cache - a checked GPT of one device
+ *
+ * @list:	Node in gpt_cache_list
+ * @if_type:	Interface type of the device
+ * @devnum:	Device number of the device
+ * @hwpart:	Hardware partition the table was read from
+ * @lba:	Size of the device in blocks, to notice a changed medium
+ * @blksz:	Block size of the device
+ * @head:	GPT header (the primary, or the backup if that is invalid)
+ * @pte:	Partition table entries
+ * @count:	Number of entries before the first unused one
+ * @by_name:	Names of those entries, sorted by name and then number
  */
-int get_disk_guid(struct blk_desc * dev_desc, char *guid)
+struct gpt_cache {
+	struct list_head list;
+	int if_type;
+	int devnum;
+	int hwpart;
+	lbaint_t lba;
+	unsigned long blksz;
+	gpt_header *head;
+	gpt_entry *pte;
+	int count;
+	struct gpt_cache_name *by_name;
+};
+
+static LIST_HEAD(gpt_cache_list);
+static struct gpt_cache_stats _stats;
+
+static void gpt_cache_free(struct gpt_cache *gc)
 {
-	ALLOC_CACHE_ALIGN_BUFFER_PAD(gpt_header, gpt_head, 1, dev_desc->blksz);
-	gpt_entry *gpt_pte = NULL;
-	unsigned char *guid_bin;
+	list_del(&gc->list);
+	free(gc->by_name);
+	free(gc->pte);
+	free(gc->head);
+	free(gc);
+	_stats.entries--;
+}
+
+/* Find the table read from a device, dropping it if the medium changed */
+static struct gpt_cache *gpt_cache_find(struct blk_desc *dev_desc)
+{
+	struct gpt_cache *gc;
+
+	list_for_each_entry(gc, &gpt_cache_list, list) {
+		if (gc->if_type != dev_desc->if_type ||
+		    gc->devnum != dev_desc->devnum ||
+		    gc->hwpart != dev_desc->hwpart)
+			continue;
+		if (gc->lba == dev_desc->lba && gc->blksz == dev_desc->blksz)
+			return gc;
+		gpt_cache_free(gc);
+		break;
+	}
+
+	return NULL;
+}
+
+static int gpt_cache_name_cmp(const void *a, const void *b)
+{
+	const struct gpt_cache_name *na = a, *nb = b;
+	int ret;
+
+	ret = strcmp(na->name, nb->name);
+
+	return ret ? ret : na->part - nb->part;
+}
+
+/* Keep a table which has just been read, taking over its buffers */
+static void gpt_cache_add(struct blk_desc *dev_desc, gpt_header *gpt_head,
+			  gpt_entry *gpt_pte)
+{
+	struct gpt_cache *gc;
+	int n, i;
+
+	gc = calloc(1, sizeof(*gc));
+	if (!gc)
+		return;
+	n = le32_to_cpu(gpt_head->num_partition_entries);
+	while (gc->count < n && is_pte_valid(&gpt_pte[gc->count]))
+		gc->count++;
+	gc->by_name = malloc(max(gc->count, 1) * sizeof(*gc->by_name));
+	if (!gc->by_name) {
+		free(gc);
+		return;
+	}
+	for (i = 0; i < gc->count; i++) {
+		strcpy(gc->by_name[i].name, print_efiname(&gpt_pte[i]));
+		gc->by_name[i].part = i + 1;
+	}
+	qsort(gc->by_name, gc->count, sizeof(*gc->by_name),
+	      gpt_cache_name_cmp);
+
+	gc->if_type = dev_desc->if_type;
+	gc->devnum = dev_desc->devnum;
+	gc->hwpart = dev_desc->hwpart;
+	gc->lba = dev_desc->lba;
+	gc->blksz = dev_desc->blksz;
+	gc->head = gpt_head;
+	gc->pte = gpt_pte;
+	list_add(&gc->list, &gpt_cache_list);
+	_stats.entries++;
+}
+
+void gpt_cache_invalidate(int iftype, int dev)
+{
+	struct gpt_cache *gc, *next;
+
+	list_for_each_entry_safe(gc, next, &gpt_cache_list, list) {
+		if (gc->if_type == iftype && gc->devnum == dev)
+			gpt_cache_free(gc);
+	}
+}
+
+void gpt_cache_stats(struct gpt_cache_stats *stats)
+{
+	memcpy(stats, &_stats, sizeof(*stats));
+}
+#endif
+
+/**
+ * get_gpt() - get the GPT header and entries of a device
+ *
+ * The primary GPT is used if it is valid, otherwise the backup. Once read,
+ * the table is kept in the GPT cache if that is enabled.
+ *
+ * @dev_desc: block device descriptor
+ * @pgpt_head: returns the GPT header
+ * @pgpt_pte: returns the partition table entries
+ *
+ * Return: 0 if OK, -ve on error. On success put_gpt() must be called once
+ * the table is no longer needed.
+ */
+static int get_gpt(struct blk_desc *dev_desc, gpt_header **pgpt_head,
+		   gpt_entry **pgpt_pte)
+{
+	gpt_header *gpt_head;
+#if CONFIG_IS_ENABLED(EFI_PARTITION_CACHE)
+	struct gpt_cache *gc = gpt_cache_find(dev_desc);
+
+	if (gc) {
+		_stats.hits++;
+		*pgpt_head = gc->head;
+		*pgpt_pte = gc->pte;
+		return 0;
+	}
+	_stats.misses++;
+#endif
+
+	gpt_head = memalign(ARCH_DMA_MINALIGN,
+			    PAD_TO_BLOCKSIZE(sizeof(gpt_header), dev_desc));
+	if (!gpt_head)
+		return -ENOMEM;
 
 	/* This function validates AND fills in the GPT header and PTE */
 	if (is_gpt_valid(dev_desc, GPT_PRIMARY_PARTITION_TABLE_LBA,
-			 gpt_head, &gpt_pte) != 1) {
+			 gpt_head, pgpt_pte) != 1) {
 		printf("%s: *** ERROR: Invalid GPT ***\n", __func__);
-		if (is_gpt_valid(dev_desc, dev_desc->lba - 1,
-				 gpt_head, &gpt_pte) != 1) {
+		if (is_gpt_valid(dev_desc, (dev_desc->lba - 1),
+				 gpt_head, pgpt_pte) != 1) {
 			printf("%s: *** ERROR: Invalid Backup GPT ***\n",
 			       __func__);
+			free(gpt_head);
 			return -EINVAL;
 		} else {
 			printf("%s: ***        Using Backup GPT ***\n",
 			       __func__);
 		}
 	}
+	*pgpt_head = gpt_head;
+#if CONFIG_IS_ENABLED(EFI_PARTITION_CACHE)
+	gpt_cache_add(dev_desc, gpt_head, *pgpt_pte);
+#endif
+
+	return 0;
+}
+
+/* Release a table returned by get_gpt() */
+static void put_gpt(struct blk_desc *dev_desc, gpt_header *gpt_head,
+		    gpt_entry *gpt_pte)
+{
+#if CONFIG_IS_ENABLED(EFI_PARTITION_CACHE)
+	struct gpt_cache *gc = gpt_cache_find(dev_desc);
+
+	if (gc && gc->pte == gpt_pte)
+		return;
+#endif
+	free(gpt_pte);
+	free(gpt_head);
+}
+
+/*
+ * Public Functions (include/part.h)
+ */
+
+/*
+ * UUID is displayed as 32 hexadecimal digits, in 5 groups,
+ * separated by hyphens, in the form 8-4-4-4-12 for a total of 36 characters
+ */
+int get_disk_guid(struct blk_desc * dev_desc, char *guid)
+{
+	gpt_header *gpt_head;
+	gpt_entry *gpt_pte;
+	unsigned char *guid_bin;
+
+	if (get_gpt(dev_desc, &gpt_head, &gpt_pte))
+		return -EINVAL;
 
 	guid_bin = gpt_head->disk_guid.b;
 	uuid_bin_to_str(guid_bin, guid, UUID_STR_FORMAT_GUID);
+	put_gpt(dev_desc, gpt_head, gpt_pte);
 
 	return 0;
 }
 
 void part_print_efi(struct blk_desc *dev_desc)
 {
-	ALLOC_CACHE_ALIGN_BUFFER_PAD(gpt_header, gpt_head, 1, dev_desc->blksz);
-	gpt_entry *gpt_pte = NULL;
+	gpt_header *gpt_head;
+	gpt_entry *gpt_pte;
 	int i = 0;
 	char uuid[UUID_STR_LEN + 1];
 	unsigned char *uuid_bin;
 
-	/* This function validates AND fills in the GPT header and PTE */
-	if (is_gpt_valid(dev_desc, GPT_PRIMARY_PARTITION_TABLE_LBA,
-			 gpt_head, &gpt_pte) != 1) {
-		printf("%s: *** ERROR: Invalid GPT ***\n", __func__);
-		if (is_gpt_valid(dev_desc, (dev_desc->lba - 1),
-				 gpt_head, &gpt_pte) != 1) {
-			printf("%s: *** ERROR: Invalid Backup GPT ***\n",
-			       __func__);
-			return;
-		} else {
-			printf("%s: ***        Using Backup GPT ***\n",
-			       __func__);
-		}
-	}
+	if (get_gpt(dev_desc, &gpt_head, &gpt_pte))
+		return;
 
 	debug("%s: gpt-entry at %p\n", __func__, gpt_pte);
 
@@ -264,43 +446,18 @@ void part_print_efi(struct blk_desc *dev_desc)
 		printf("\tguid:\t%s\n", uuid);
 	}
 
-	/* Remember to free pte */
-	free(gpt_pte);
+	put_gpt(dev_desc, gpt_head, gpt_pte);
 	return;
 }
 
-int part_get_info_efi(struct blk_desc *dev_desc, int part,
-		      disk_partition_t *info)
+/* Fill in @info for partition @part of a table returned by get_gpt() */
+static int gpt_get_info(struct blk_desc *dev_desc, gpt_header *gpt_head,
+			gpt_entry *gpt_pte, int part, disk_partition_t *info)
 {
-	ALLOC_CACHE_ALIGN_BUFFER_PAD(gpt_header, gpt_head, 1, dev_desc->blksz);
-	gpt_entry *gpt_pte = NULL;
-
-	/* "part" argument must be at least 1 */
-	if (part < 1) {
-		printf("%s: Invalid Argument(s)\n", __func__);
-		return -1;
-	}
-
-	/* This function validates AND fills in the GPT header and PTE */
-	if (is_gpt_valid(dev_desc, GPT_PRIMARY_PARTITION_TABLE_LBA,
-			gpt_head, &gpt_pte) != 1) {
-		printf("%s: *** ERROR: Invalid GPT ***\n", __func__);
-		if (is_gpt_valid(dev_desc, (dev_desc->lba - 1),
-				 gpt_head, &gpt_pte) != 1) {
-			printf("%s: *** ERROR: Invalid Backup GPT ***\n",
-			       __func__);
-			return -1;
-		} else {
-			printf("%s: ***        Using Backup GPT ***\n",
-			       __func__);
-		}
-	}
-
 	if (part > le32_to_cpu(gpt_head->num_partition_entries) ||
 	    !is_pte_valid(&gpt_pte[part - 1])) {
 		debug("%s: *** ERROR: Invalid partition number %d ***\n",
 			__func__, part);
-		free(gpt_pte);
 		return -1;
 	}
 
@@ -327,11 +484,80 @@ int part_get_info_efi(struct blk_desc *dev_desc, int part,
 	debug("%s: start 0x" LBAF ", size 0x" LBAF ", name %s\n", __func__,
 	      info->start, info->size, info->name);
 
-	/* Remember to free pte */
-	free(gpt_pte);
 	return 0;
 }
 
+int part_get_info_efi(struct blk_desc *dev_desc, int part,
+		      disk_partition_t *info)
+{
+	gpt_header *gpt_head;
+	gpt_entry *gpt_pte;
+	int ret;
+
+	/* "part" argument must be at least 1 */
+	if (part < 1) {
+		printf("%s: Invalid Argument(s)\n", __func__);
+		return -1;
+	}
+
+	if (get_gpt(dev_desc, &gpt_head, &gpt_pte))
+		return -1;
+
+	ret = gpt_get_info(dev_desc, gpt_head, gpt_pte, part, info);
+	put_gpt(dev_desc, gpt_head, gpt_pte);
+
+	return ret;
+}
+
+#if CONFIG_IS_ENABLED(EFI_PARTITION_CACHE)
+static int part_get_info_by_name_efi(struct blk_desc *dev_desc,
+				     const char *name, disk_partition_t *info)
+{
+	struct gpt_cache *gc;
+	gpt_header *gpt_head;
+	gpt_entry *gpt_pte;
+	int lo, hi, mid, part;
+
+	if (get_gpt(dev_desc, &gpt_head, &gpt_pte))
+		return -1;
+	gc = gpt_cache_find(dev_desc);
+	if (!gc) {
+		/* Out of memory for the cache, so look at each entry */
+		hi = le32_to_cpu(gpt_head->num_partition_entries);
+		for (part = 1; part <= hi; part++) {
+			if (!is_pte_valid(&gpt_pte[part - 1]))
+				break;
+			if (!strcmp(print_efiname(&gpt_pte[part - 1]), name))
+				break;
+		}
+		if (part > hi ||
+		    gpt_get_info(dev_desc, gpt_head, gpt_pte, part, info))
+			part = -1;
+		put_gpt(dev_desc, gpt_head, gpt_pte);
+
+		return part;
+	}
+
+	/* Find the first entry with the name, i.e. the lowest number */
+	lo = 0;
+	hi = gc->count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strcmp(gc->by_name[mid].name, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == gc->count || strcmp(gc->by_name[lo].name, name))
+		return -1;
+	part = gc->by_name[lo].part;
+
+	/* The table came from the cache, so put_gpt() is not needed */
+	return gpt_get_info(dev_desc, gpt_head, gpt_pte, part, info) ?
+	       -1 : part;
+}
+#endif
+
 static int part_test_efi(struct blk_desc *dev_desc)
 {
 	ALLOC_CACHE_ALIGN_BUFFER_PAD(legacy_mbr, legacymbr, 1, dev_desc->blksz);
@@ -1075,6 +1301,9 @@ U_BOOT_PART_TYPE(a_efi) = {
 	.part_type	= PART_TYPE_EFI,
 	.max_entries	= GPT_ENTRY_NUMBERS,
 	.get_info	= part_get_info_ptr(part_get_info_efi),
+#if CONFIG_IS_ENABLED(EFI_PARTITION_CACHE)
+	.get_info_by_name = part_get_info_by_name_efi,
+#endif
 	.print		= part_print_ptr(part_print_efi),
 	.test		= part_test_efi,
 };
@@ -500,14 +500,21 @@ static int ahci_init_one(struct ahci_uc_priv *uc_priv, pci_dev_t dev)
 
 #define MAX_DATA_BYTE_COUNT  (4*1024*1024)
 
-static int ahci_fill_sg(struct ahci_uc_priv *uc_priv, u8 port,
+/* Command table for command slot @tag, followed by its scatter-gather list */
+static ulong ahci_cmd_tbl(struct ahci_ioports *pp, int tag)
+{
+	return pp->cmd_tbl + tag * AHCI_CMD_TBL_SZ;
+}
+
+static int ahci_fill_sg(struct ahci_uc_priv *uc_priv, u8 port, int tag,
 			unsigned char *buf, int buf_len)
 {
 	struct ahci_ioports *pp = &(uc_priv->port[port]);
-	struct ahci_sg *ahci_sg = pp->cmd_tbl_sg;
+	struct ahci_sg *ahci_sg;
 	u32 sg_count;
 	int i;
 
+	ahci_sg = (struct ahci_sg *)(ahci_cmd_tbl(pp, tag) + AHCI_CMD_TBL_HDR);
 	sg_count = ((buf_len - 1) / MAX_DATA_BYTE_COUNT) + 1;
 	if (sg_count > AHCI_MAX_SG) {
 		printf("Error:Too much sg!\n");
@@ -530,14 +537,16 @@ static int ahci_fill_sg(struct ahci_uc_priv *uc_priv, u8 port,
 }
 
 
-static void ahci_fill_cmd_slot(struct ahci_ioports *pp, u32 opts)
+static void ahci_fill_cmd_slot(struct ahci_ioports *pp, int tag, u32 opts)
 {
-	pp->cmd_slot->opts = cpu_to_le32(opts);
-	pp->cmd_slot->status = 0;
-	pp->cmd_slot->tbl_addr = cpu_to_le32((u32)pp->cmd_tbl & 0xffffffff);
+	struct ahci_cmd_hdr *cmd_slot = &pp->cmd_slot[tag];
+	ulong cmd_tbl = ahci_cmd_tbl(pp, tag);
+
+	cmd_slot->opts = cpu_to_le32(opts);
+	cmd_slot->status = 0;
+	cmd_slot->tbl_addr = cpu_to_le32((u32)cmd_tbl & 0xffffffff);
 #ifdef CONFIG_PHYS_64BIT
-	pp->cmd_slot->tbl_addr_hi =
-	    cpu_to_le32((u32)(((pp->cmd_tbl) >> 16) >> 16));
+	cmd_slot->tbl_addr_hi = cpu_to_le32((u32)((cmd_tbl >> 16) >> 16));
 #endif
 }
 
@@ -598,8 +607,8 @@ static int ahci_port_start(struct ahci_uc_priv *uc_priv, u8 port)
 	mem += AHCI_RX_FIS_SZ;
 
 	/*
-	 * Third item: data area for storing a single command
-	 * and its scatter-gather table
+	 * Third item: data area for storing the commands, one for each
+	 * command slot in use, and their scatter-gather tables
 	 */
 	pp->cmd_tbl = virt_to_phys((void *)mem);
 	debug("cmd_tbl_dma = %lx\n", pp->cmd_tbl);
@@ -656,9 +665,9 @@ static int ahci_device_data_io(struct ahci_uc_priv *uc_priv, u8 port, u8 *fis,
 
 	memcpy((unsigned char *)pp->cmd_tbl, fis, fis_len);
 
-	sg_count = ahci_fill_sg(uc_priv, port, buf, buf_len);
+	sg_count = ahci_fill_sg(uc_priv, port, 0, buf, buf_len);
 	opts = (fis_len >> 2) | (sg_count << 16) | (is_write << 6);
-	ahci_fill_cmd_slot(pp, opts);
+	ahci_fill_cmd_slot(pp, 0, opts);
 
 	ahci_dcache_flush_sata_cmd(pp);
 	ahci_dcache_flush_range((unsigned long)buf, (unsigned long)buf_len);
@@ -678,6 +687,163 @@ static int ahci_device_data_io(struct ahci_uc_priv *uc_priv, u8 port, u8 *fis,
 	return 0;
 }
 
+#ifdef CONFIG_AHCI_NCQ
+/* Number of NCQ commands to keep in flight on a port, 0 to not use NCQ */
+static int ahci_ncq_depth(struct ahci_uc_priv *uc_priv, u16 *id)
+{
+	int depth;
+
+	if (!(uc_priv->cap & HOST_CAP_NCQ) || !ata_id_has_ncq(id))
+		return 0;
+	depth = min(ata_id_queue_depth(id), (int)HOST_CAP_NCS(uc_priv->cap));
+	depth = min(depth, AHCI_NCQ_SLOTS);
+
+	return depth > 1 ? depth : 0;
+}
+
+/* Queue a READ FPDMA QUEUED command in command slot @tag */
+static int ahci_ncq_issue(struct ahci_uc_priv *uc_priv, u8 port, int tag,
+			  lbaint_t lba, u8 *buf, u16 blocks)
+{
+	struct ahci_ioports *pp = &uc_priv->port[port];
+	void __iomem *port_mmio = pp->port_mmio;
+	u8 *fis = (u8 *)ahci_cmd_tbl(pp, tag);
+	int buf_len = blocks * ATA_SECT_SIZE;
+	int sg_count;
+
+	memset(fis, 0, 20);
+	fis[0] = 0x27;		/* Host to device FIS. */
+	fis[1] = 1 << 7;	/* Command FIS. */
+	fis[2] = ATA_CMD_FPDMA_READ;
+	fis[3] = blocks & 0xff;	/* features: block count */
+	fis[4] = (lba >> 0) & 0xff;
+	fis[5] = (lba >> 8) & 0xff;
+	fis[6] = (lba >> 16) & 0xff;
+	fis[7] = 1 << 6;	/* device reg: set LBA mode */
+	fis[8] = (lba >> 24) & 0xff;
+#ifdef CONFIG_SYS_64BIT_LBA
+	fis[9] = (lba >> 32) & 0xff;
+	fis[10] = (lba >> 40) & 0xff;
+#endif
+	fis[11] = blocks >> 8;
+	fis[12] = tag << 3;	/* sector count: tag */
+
+	sg_count = ahci_fill_sg(uc_priv, port, tag, buf, buf_len);
+	if (sg_count < 0)
+		return -EIO;
+	ahci_fill_cmd_slot(pp, tag, 5 | (sg_count << 16));
+
+	ahci_dcache_flush_sata_cmd(pp);
+	ahci_dcache_flush_range((unsigned long)buf, buf_len);
+
+	writel(1 << tag, port_mmio + PORT_SCR_ACT);
+	writel_with_flush(1 << tag, port_mmio + PORT_CMD_ISSUE);
+
+	return 0;
+}
+
+/*
+ * Restart the command list after a failed NCQ command and stop using NCQ on
+ * the port. Reading the NCQ error log takes the device out of its error
+ * state so that it accepts commands again.
+ */
+static void ahci_ncq_recover(struct ahci_uc_priv *uc_priv, u8 port)
+{
+	struct ahci_ioports *pp = &uc_priv->port[port];
+	void __iomem *port_mmio = pp->port_mmio;
+	ALLOC_CACHE_ALIGN_BUFFER(u8, log, ATA_SECT_SIZE);
+	u8 fis[20];
+	u32 tmp;
+
+	tmp = readl(port_mmio + PORT_CMD);
+	writel_with_flush(tmp & ~PORT_CMD_START, port_mmio + PORT_CMD);
+	waiting_for_cmd_completed(port_mmio + PORT_CMD, 500, PORT_CMD_LIST_ON);
+	writel(readl(port_mmio + PORT_SCR_ERR), port_mmio + PORT_SCR_ERR);
+	writel(readl(port_mmio + PORT_IRQ_STAT), port_mmio + PORT_IRQ_STAT);
+	writel_with_flush(tmp | PORT_CMD_START, port_mmio + PORT_CMD);
+	pp->ncq_depth = 0;
+
+	memset(fis, 0, sizeof(fis));
+	fis[0] = 0x27;		/* Host to device FIS. */
+	fis[1] = 1 << 7;	/* Command FIS. */
+	fis[2] = ATA_CMD_READ_LOG_EXT;
+	fis[4] = ATA_LOG_SATA_NCQ;
+	fis[7] = 1 << 6;	/* device reg: set LBA mode */
+	fis[12] = 1;		/* one page */
+	if (ahci_device_data_io(uc_priv, port, fis, sizeof(fis), log,
+				ATA_SECT_SIZE, 0))
+		debug("%s: cannot read NCQ error log\n", __func__);
+}
+
+/*
+ * Read @blocks blocks with up to ncq_depth commands in flight. The device
+ * clears the bit of each command in SActive as it completes, in any order,
+ * and the slot is then reused for the next part of the transfer.
+ */
+static int ahci_ncq_read(struct ahci_uc_priv *uc_priv, u8 port,
+			 lbaint_t lba, u8 *buf, u32 blocks)
+{
+	struct ahci_ioports *pp = &uc_priv->port[port];
+	void __iomem *port_mmio = pp->port_mmio;
+	u8 *tag_buf[AHCI_NCQ_SLOTS];
+	int tag_len[AHCI_NCQ_SLOTS];
+	u32 busy = 0, done;
+	ulong start;
+	int tag;
+
+	writel(readl(port_mmio + PORT_IRQ_STAT), port_mmio + PORT_IRQ_STAT);
+	start = get_timer(0);
+	while (blocks || busy) {
+		for (tag = 0; blocks && tag < pp->ncq_depth; tag++) {
+			u16 now_blocks;
+
+			if (busy & (1 << tag))
+				continue;
+			now_blocks = min_t(u32, MAX_SATA_BLOCKS_READ_WRITE,
+					   blocks);
+			if (ahci_ncq_issue(uc_priv, port, tag, lba, buf,
+					   now_blocks))
+				goto err;
+			tag_buf[tag] = buf;
+			tag_len[tag] = now_blocks * ATA_SECT_SIZE;
+			busy |= 1 << tag;
+			buf += tag_len[tag];
+			lba += now_blocks;
+			blocks -= now_blocks;
+		}
+
+		if (readl(port_mmio + PORT_IRQ_STAT) & (PORT_IRQ_FATAL)) {
+			printf("scsi_ahci: NCQ read error on port %d\n", port);
+			goto err;
+		}
+		done = busy & ~readl(port_mmio + PORT_SCR_ACT);
+		if (!done) {
+			if (get_timer(start) > WAIT_MS_DATAIO) {
+				printf("scsi_ahci: NCQ read timeout on port %d\n",
+				       port);
+				goto err;
+			}
+			continue;
+		}
+		for (tag = 0; tag < pp->ncq_depth; tag++) {
+			if (done & (1 << tag))
+				ahci_dcache_invalidate_range(
+					(unsigned long)tag_buf[tag],
+					tag_len[tag]);
+		}
+		busy &= ~done;
+		start = get_timer(0);
+	}
+
+	return 0;
+
+err:
+	ahci_ncq_recover(uc_priv, port);
+
+	return -EIO;
+}
+#endif
+
 
 static char *ata_id_strcpy(u16 *target, u16 *src, int len)
 {
@@ -740,6 +906,11 @@ static int ata_scsiop_inquiry(struct ahci_uc_priv *uc_priv,
 
 	memcpy(idbuf, tmpid, ATA_ID_WORDS * 2);
 	ata_swap_buf_le16(idbuf, ATA_ID_WORDS);
+#ifdef CONFIG_AHCI_NCQ
+	uc_priv->port[port].ncq_depth = ahci_ncq_depth(uc_priv, idbuf);
+	debug("scsi_ahci: port %d NCQ depth %d\n", port,
+	      uc_priv->port[port].ncq_depth);
+#endif
 
 	memcpy(&pccb->pdata[8], "ATA     ", 8);
 	ata_id_strcpy((u16 *)&pccb->pdata[16], &idbuf[ATA_ID_PROD], 16);
@@ -793,6 +964,19 @@ static int ata_scsiop_read_write(struct ahci_uc_priv *uc_priv,
 	debug("scsi_ahci: %s %u blocks starting from lba 0x" LBAFU "\n",
 	      is_write ?  "write" : "read", blocks, lba);
 
+#ifdef CONFIG_AHCI_NCQ
+	if (!is_write && uc_priv->port[pccb->target].ncq_depth) {
+		if (blocks * ATA_SECT_SIZE > user_buffer_size) {
+			printf("scsi_ahci: Error: buffer too small.\n");
+			return -EIO;
+		}
+		if (!ahci_ncq_read(uc_priv, pccb->target, lba, user_buffer,
+				   blocks))
+			return 0;
+		/* NCQ is now off for the port; retry with single commands */
+	}
+#endif
+
 	/* Preset the FIS */
 	memset(fis, 0, sizeof(fis));
 	fis[0] = 0x27;		 /* Host to device FIS. */
@@ -1125,7 +1309,7 @@ static int ata_io_flush(struct ahci_uc_priv *uc_priv, u8 port)
 	fis[2] = ATA_CMD_FLUSH_EXT;
 
 	memcpy((unsigned char *)pp->cmd_tbl, fis, 20);
-	ahci_fill_cmd_slot(pp, cmd_fis_len);
+	ahci_fill_cmd_slot(pp, 0, cmd_fis_len);
 	ahci_dcache_flush_sata_cmd(pp);
 	writel_with_flush(1, port_mmio + PORT_CMD_ISSUE);
 
@@ -426,12 +426,29 @@ int blk_get_device(int if_type, int devnum, struct udevice **devp)
 	return device_probe(*devp);
 }
 
+/* Read blocks which are not in the cache, filling it as we go */
+static ulong blk_dread_uncached(struct blk_desc *block_dev, lbaint_t start,
+				lbaint_t blkcnt, void *buffer)
+{
+	struct udevice *dev = block_dev->bdev;
+	const struct blk_ops *ops = blk_get_ops(dev);
+	ulong blks_read;
+
+	if (blkcache_read_lines(block_dev, start, blkcnt, buffer))
+		return blkcnt;
+	blks_read = ops->read(dev, start, blkcnt, buffer);
+	if (blks_read == blkcnt)
+		blkcache_fill(block_dev->if_type, block_dev->devnum,
+			      start, blkcnt, block_dev->blksz, buffer);
+
+	return blks_read;
+}
+
 unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 			lbaint_t blkcnt, void *buffer)
 {
 	struct udevice *dev = block_dev->bdev;
 	const struct blk_ops *ops = blk_get_ops(dev);
-	ulong blks_read;
 
 	if (!ops->read)
 		return -ENOSYS;
@@ -439,12 +456,74 @@ unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 	if (blkcache_read(block_dev->if_type, block_dev->devnum,
 			  start, blkcnt, block_dev->blksz, buffer))
 		return blkcnt;
-	blks_read = ops->read(dev, start, blkcnt, buffer);
-	if (blks_read == blkcnt)
+
+	return blk_dread_uncached(block_dev, start, blkcnt, buffer);
+}
+
+int blk_dread_submit(struct blk_desc *block_dev, lbaint_t start,
+		     lbaint_t blkcnt, void *buffer, struct blk_req *req)
+{
+	struct udevice *dev = block_dev->bdev;
+	const struct blk_ops *ops = blk_get_ops(dev);
+	int ret;
+
+	if (!ops->read)
+		return -ENOSYS;
+
+	req->desc = block_dev;
+	req->start = start;
+	req->blkcnt = blkcnt;
+	req->buffer = buffer;
+	req->done = false;
+	if (blkcache_read(block_dev->if_type, block_dev->devnum,
+			  start, blkcnt, block_dev->blksz, buffer)) {
+		req->ret = blkcnt;
+		req->done = true;
+		return 0;
+	}
+
+	if (ops->read_submit) {
+		ret = ops->read_submit(dev, req);
+		if (ret != -ENOSYS)
+			return ret;
+	}
+
+	/* The device cannot do this in the background, so do it now */
+	req->ret = blk_dread_uncached(block_dev, start, blkcnt, buffer);
+	req->done = true;
+
+	return 0;
+}
+
+int blk_dread_poll(struct blk_req *req)
+{
+	struct blk_desc *block_dev = req->desc;
+	struct udevice *dev = block_dev->bdev;
+	int ret;
+
+	if (req->done)
+		return 0;
+
+	ret = blk_get_ops(dev)->read_poll(dev, req);
+	if (ret == -EBUSY)
+		return ret;
+	if (ret)
+		req->ret = ret;
+	req->done = true;
+	if (req->ret == req->blkcnt)
 		blkcache_fill(block_dev->if_type, block_dev->devnum,
-			      start, blkcnt, block_dev->blksz, buffer);
+			      req->start, req->blkcnt, block_dev->blksz,
+			      req->buffer);
 
-	return blks_read;
+	return 0;
+}
+
+unsigned long blk_dread_wait(struct blk_req *req)
+{
+	while (blk_dread_poll(req) == -EBUSY)
+		;
+
+	return req->ret;
 }
 
 unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
@@ -457,6 +536,8 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 		return -ENOSYS;
 
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	gpt_cache_invalidate(block_dev->if_type, block_dev->devnum);
+	fs_cache_invalidate(block_dev->if_type, block_dev->devnum);
 	return ops->write(dev, start, blkcnt, buffer);
 }
 
@@ -470,6 +551,8 @@ unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 		return -ENOSYS;
 
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	gpt_cache_invalidate(block_dev->if_type, block_dev->devnum);
+	fs_cache_invalidate(block_dev->if_type, block_dev->devnum);
 	return ops->erase(dev, start, blkcnt);
 }
 
@@ -3,157 +3,392 @@
  * Copyright (C) Nelson Integration, LLC 2016
  * Author: Eric Nelson<eric@nelint.com>
  *
+ * The cache holds lines of a fixed number of blocks, aligned on that number,
+ * found through a hash of (iftype, devnum, start) and evicted in LRU order.
+ * A miss reads the whole lines around the blocks asked for, plus a growing
+ * window of lines after them when the reads look sequential.
  */
 #include <config.h>
 #include <common.h>
+#include <blk.h>
+#include <dm.h>
 #include <malloc.h>
 #include <part.h>
 #include <linux/ctype.h>
 #include <linux/list.h>
 
+/* Reads spanning more lines than this go to the device directly */
+#define BLKCACHE_MAX_READ_LINES	4
+/* Largest number of lines read ahead of a sequential read */
+#define BLKCACHE_MAX_RA_LINES	16
+/* Number of sequential readers followed at once, over all devices */
+#define BLKCACHE_STREAMS	8
+
 struct block_cache_node {
-	struct list_head lh;
+	struct list_head lh;	/* LRU list, most recently used first */
+	struct hlist_node hn;	/* hash chain */
 	int iftype;
 	int devnum;
-	lbaint_t start;
-	lbaint_t blkcnt;
+	lbaint_t start;		/* a multiple of the line size */
+	lbaint_t blkcnt;	/* less than a line at the end of the device */
 	unsigned long blksz;
+	bool prefetched;	/* read ahead and not used yet */
 	char *cache;
 };
 
+/*
+ * A reader going through a device in order: @next is the block after its
+ * last read and @window the number of lines to read ahead of it
+ */
+struct block_cache_stream {
+	int iftype;
+	int devnum;
+	lbaint_t next;
+	unsigned window;
+};
+
 static LIST_HEAD(block_cache);
+static struct hlist_head *block_cache_hash;
+static unsigned block_cache_hash_bits;
+static struct block_cache_stream streams[BLKCACHE_STREAMS];
+static unsigned stream_victim;
+static char *bounce;
+static size_t bounce_size;
+
+#define BLKCACHE_LINE_BLOCKS	CONFIG_BLOCK_CACHE_LINE_BLOCKS
+#define BLKCACHE_LINES		(CONFIG_BLOCK_CACHE_SIZE * 1024 / \
+				 (BLKCACHE_LINE_BLOCKS * 512))
 
 static struct block_cache_stats _stats = {
-	.max_blocks_per_entry = 2,
-	.max_entries = 32
+	.max_blocks_per_entry = BLKCACHE_LINE_BLOCKS,
+	.max_entries = BLKCACHE_LINES,
 };
 
+static inline lbaint_t line_start(lbaint_t start)
+{
+	return start & ~(lbaint_t)(_stats.max_blocks_per_entry - 1);
+}
+
+static inline lbaint_t line_end(lbaint_t end)
+{
+	return line_start(end + _stats.max_blocks_per_entry - 1);
+}
+
+/* Check that a read is small enough to go through the cache */
+static bool cacheable(lbaint_t start, lbaint_t blkcnt)
+{
+	if (!_stats.max_entries || !_stats.max_blocks_per_entry || !blkcnt)
+		return false;
+
+	return line_end(start + blkcnt) - line_start(start) <=
+	       (lbaint_t)_stats.max_blocks_per_entry * BLKCACHE_MAX_READ_LINES;
+}
+
+static unsigned cache_hash(int iftype, int devnum, lbaint_t start)
+{
+	u32 key = (u32)(start >> (fls(_stats.max_blocks_per_entry) - 1)) +
+		  (iftype << 24) + (devnum << 16);
+
+	return (key * 0x9e3779b9) >> (32 - block_cache_hash_bits);
+}
+
 static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
+					   lbaint_t start,
 					   unsigned long blksz)
 {
 	struct block_cache_node *node;
+	struct hlist_node *pos;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
-			}
+	if (!block_cache_hash)
+		return NULL;
+
+	hlist_for_each(pos, &block_cache_hash[cache_hash(iftype, devnum,
+							 start)]) {
+		node = hlist_entry(pos, struct block_cache_node, hn);
+		if (node->start == start && node->devnum == devnum &&
+		    node->iftype == iftype && node->blksz == blksz)
 			return node;
-		}
-	return 0;
+	}
+
+	return NULL;
 }
 
-int blkcache_read(int iftype, int devnum,
-		  lbaint_t start, lbaint_t blkcnt,
-		  unsigned long blksz, void *buffer)
+static void cache_remove(struct block_cache_node *node)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
-		debug("hit: start " LBAF ", count " LBAFU "\n",
-		      start, blkcnt);
-		++_stats.hits;
-		return 1;
-	}
+	list_del(&node->lh);
+	hlist_del(&node->hn);
+	free(node->cache);
+	free(node);
+	_stats.entries--;
+}
 
-	debug("miss: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
-	++_stats.misses;
-	return 0;
+static void cache_flush(void)
+{
+	while (!list_empty(&block_cache))
+		cache_remove(list_first_entry(&block_cache,
+					      struct block_cache_node, lh));
+	free(block_cache_hash);
+	block_cache_hash = NULL;
+	memset(streams, '\0', sizeof(streams));
 }
 
-void blkcache_fill(int iftype, int devnum,
-		   lbaint_t start, lbaint_t blkcnt,
-		   unsigned long blksz, void const *buffer)
+/* Store the line at @start, evicting the least recently used if need be */
+static void cache_fill_line(int iftype, int devnum, lbaint_t start,
+			    lbaint_t blkcnt, unsigned long blksz,
+			    const void *buffer, bool prefetched)
 {
-	lbaint_t bytes;
+	size_t bytes = _stats.max_blocks_per_entry * blksz;
 	struct block_cache_node *node;
 
-	/* don't cache big stuff */
-	if (blkcnt > _stats.max_blocks_per_entry)
-		return;
-
-	if (_stats.max_entries == 0)
-		return;
+	if (!block_cache_hash) {
+		block_cache_hash_bits = 1;
+		while ((1U << block_cache_hash_bits) < _stats.max_entries)
+			block_cache_hash_bits++;
+		block_cache_hash = calloc(1U << block_cache_hash_bits,
+					  sizeof(*block_cache_hash));
+		if (!block_cache_hash)
+			return;
+	}
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
+	node = cache_find(iftype, devnum, start, blksz);
+	if (node) {
 		list_del(&node->lh);
-		_stats.entries--;
+		hlist_del(&node->hn);
+	} else if (_stats.entries >= _stats.max_entries) {
+		node = list_last_entry(&block_cache, struct block_cache_node,
+				       lh);
 		debug("drop: start " LBAF ", count " LBAFU "\n",
 		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
+		list_del(&node->lh);
+		hlist_del(&node->hn);
+		if (node->prefetched)
+			_stats.prefetch_unused++;
+		_stats.evictions++;
+		if (node->blksz != blksz) {
 			free(node->cache);
-			node->cache = 0;
+			node->cache = NULL;
 		}
 	} else {
 		node = malloc(sizeof(*node));
 		if (!node)
 			return;
-		node->cache = 0;
+		node->cache = NULL;
+		_stats.entries++;
 	}
 
 	if (!node->cache) {
 		node->cache = malloc(bytes);
 		if (!node->cache) {
 			free(node);
+			_stats.entries--;
 			return;
 		}
 	}
 
-	debug("fill: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
+	debug("fill: start " LBAF ", count " LBAFU "%s\n",
+	      start, blkcnt, prefetched ? " (ahead)" : "");
 
 	node->iftype = iftype;
 	node->devnum = devnum;
 	node->start = start;
 	node->blkcnt = blkcnt;
 	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
+	node->prefetched = prefetched;
+	memcpy(node->cache, buffer, blkcnt * blksz);
 	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	hlist_add_head(&node->hn,
+		       &block_cache_hash[cache_hash(iftype, devnum, start)]);
 }
 
-void blkcache_invalidate(int iftype, int devnum)
+/*
+ * Find the reader whose next block is @start. If there is none, make room for
+ * a new one when @create is set, else return NULL.
+ */
+static struct block_cache_stream *stream_find(int iftype, int devnum,
+					      lbaint_t start, bool create,
+					      bool *seq)
+{
+	struct block_cache_stream *s;
+	int i;
+
+	for (i = 0; i < BLKCACHE_STREAMS; i++) {
+		s = &streams[i];
+		if (s->iftype == iftype && s->devnum == devnum &&
+		    start >= s->next &&
+		    start - s->next < _stats.max_blocks_per_entry) {
+			*seq = true;
+			return s;
+		}
+	}
+
+	*seq = false;
+	if (!create)
+		return NULL;
+	s = &streams[stream_victim++ % BLKCACHE_STREAMS];
+	s->iftype = iftype;
+	s->devnum = devnum;
+	s->window = 0;
+
+	return s;
+}
+
+int blkcache_read(int iftype, int devnum,
+		  lbaint_t start, lbaint_t blkcnt,
+		  unsigned long blksz, void *buffer)
 {
-	struct list_head *entry, *n;
 	struct block_cache_node *node;
+	struct block_cache_stream *s;
+	lbaint_t pos, end = start + blkcnt;
+	lbaint_t from, count;
+	bool seq;
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
+	if (!cacheable(start, blkcnt))
+		return 0;
+
+	/* Every line must be there before anything is copied */
+	for (pos = line_start(start); pos < end;
+	     pos += _stats.max_blocks_per_entry) {
+		node = cache_find(iftype, devnum, pos, blksz);
+		if (!node || node->start + node->blkcnt < min(end,
+				pos + _stats.max_blocks_per_entry)) {
+			debug("miss: start " LBAF ", count " LBAFU "\n",
+			      start, blkcnt);
+			++_stats.misses;
+			return 0;
+		}
+	}
+
+	for (pos = start; pos < end; pos += count) {
+		node = cache_find(iftype, devnum, line_start(pos), blksz);
+		from = pos - node->start;
+		count = min(end - pos, node->blkcnt - from);
+		memcpy(buffer, node->cache + from * blksz, count * blksz);
+		buffer += count * blksz;
+		if (node->prefetched) {
+			node->prefetched = false;
+			++_stats.prefetch_hits;
+		}
+		if (block_cache.next != &node->lh) {
+			/* maintain MRU ordering */
+			list_del(&node->lh);
+			list_add(&node->lh, &block_cache);
 		}
 	}
+
+	/* A reader going through data read ahead is still sequential */
+	s = stream_find(iftype, devnum, start, false, &seq);
+	if (s)
+		s->next = end;
+
+	debug("hit: start " LBAF ", count " LBAFU "\n", start, blkcnt);
+	++_stats.hits;
+	return 1;
+}
+
+int blkcache_read_lines(struct blk_desc *block_dev, lbaint_t start,
+			lbaint_t blkcnt, void *buffer)
+{
+	const struct blk_ops *ops = blk_get_ops(block_dev->bdev);
+	int iftype = block_dev->if_type;
+	int devnum = block_dev->devnum;
+	unsigned long blksz = block_dev->blksz;
+	lbaint_t line = _stats.max_blocks_per_entry;
+	struct block_cache_stream *s;
+	lbaint_t first, end, ra_end, pos, last;
+	unsigned window;
+	size_t bytes;
+	bool seq;
+
+	if (!cacheable(start, blkcnt) || start + blkcnt > block_dev->lba)
+		return 0;
+
+	/* Double the read-ahead as long as the reader stays sequential */
+	s = stream_find(iftype, devnum, start, true, &seq);
+	window = seq ? min(max(s->window * 2, 1U),
+			   min((unsigned)BLKCACHE_MAX_RA_LINES,
+			       _stats.max_entries / 4)) : 0;
+
+	first = line_start(start);
+	end = min(line_end(start + blkcnt), block_dev->lba);
+	ra_end = min(end + window * line, block_dev->lba);
+	/* Stop reading ahead at data already there */
+	for (pos = end; pos < ra_end; pos += line) {
+		if (cache_find(iftype, devnum, pos, blksz)) {
+			ra_end = pos;
+			break;
+		}
+	}
+
+	bytes = (ra_end - first) * blksz;
+	if (bytes > bounce_size) {
+		free(bounce);
+		bounce = memalign(ARCH_DMA_MINALIGN, bytes);
+		bounce_size = bounce ? bytes : 0;
+		if (!bounce)
+			return 0;
+	}
+	if (ops->read(block_dev->bdev, first, ra_end - first, bounce) !=
+	    ra_end - first)
+		return 0;
+
+	for (pos = first; pos < ra_end; pos += line) {
+		last = min(pos + line, ra_end);
+		cache_fill_line(iftype, devnum, pos, last - pos, blksz,
+				bounce + (pos - first) * blksz, pos >= end);
+		if (pos >= end)
+			++_stats.prefetches;
+	}
+	memcpy(buffer, bounce + (start - first) * blksz, blkcnt * blksz);
+
+	s->next = start + blkcnt;
+	s->window = window;
+
+	return 1;
+}
+
+void blkcache_fill(int iftype, int devnum,
+		   lbaint_t start, lbaint_t blkcnt,
+		   unsigned long blksz, void const *buffer)
+{
+	lbaint_t line = _stats.max_blocks_per_entry;
+	lbaint_t pos;
+
+	/* don't cache big stuff */
+	if (!cacheable(start, blkcnt))
+		return;
+
+	/* Only whole lines can be stored */
+	for (pos = line_end(start); pos + line <= start + blkcnt; pos += line)
+		cache_fill_line(iftype, devnum, pos, line, blksz,
+				buffer + (pos - start) * blksz, false);
+}
+
+void blkcache_invalidate(int iftype, int devnum)
+{
+	struct block_cache_node *node, *n;
+	int i;
+
+	list_for_each_entry_safe(node, n, &block_cache, lh) {
+		if ((node->iftype == iftype) &&
+		    (node->devnum == devnum))
+			cache_remove(node);
+	}
+	for (i = 0; i < BLKCACHE_STREAMS; i++) {
+		if (streams[i].iftype == iftype && streams[i].devnum == devnum)
+			streams[i].window = 0;
+	}
 }
 
 void blkcache_configure(unsigned blocks, unsigned entries)
 {
-	struct block_cache_node *node;
+	/* Lines are aligned on their size, which must be a power of two */
+	if (blocks)
+		blocks = 1U << (fls(blocks) - 1);
+
 	if ((blocks != _stats.max_blocks_per_entry) ||
 	    (entries != _stats.max_entries)) {
 		/* invalidate cache */
-		while (!list_empty(&block_cache)) {
-			node = (struct block_cache_node *)block_cache.next;
-			list_del(&node->lh);
-			free(node->cache);
-			free(node);
-		}
+		cache_flush();
 		_stats.entries = 0;
 	}
 
@@ -162,6 +397,10 @@ void blkcache_configure(unsigned blocks, unsigned entries)
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.prefetches = 0;
+	_stats.prefetch_hits = 0;
+	_stats.prefetch_unused = 0;
+	_stats.evictions = 0;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
@@ -169,4 +408,8 @@ void blkcache_stats(struct block_cache_stats *stats)
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.prefetches = 0;
+	_stats.prefetch_hits = 0;
+	_stats.prefetch_unused = 0;
+	_stats.evictions = 0;
 }
@@ -87,6 +87,33 @@ static unsigned long host_block_write(struct blk_desc *block_dev,
 }
 
 #ifdef CONFIG_BLK
+/*
+ * Reads are started by recording the request, and the data is transferred
+ * when it is polled, much as a DMA controller would have done it meanwhile.
+ */
+static int host_block_read_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct host_block_dev *host_dev = dev_get_platdata(dev);
+
+	if (host_dev->req)
+		return -EBUSY;
+	host_dev->req = req;
+
+	return 0;
+}
+
+static int host_block_read_poll(struct udevice *dev, struct blk_req *req)
+{
+	struct host_block_dev *host_dev = dev_get_platdata(dev);
+
+	if (host_dev->req != req)
+		return -EINVAL;
+	req->ret = host_block_read(dev, req->start, req->blkcnt, req->buffer);
+	host_dev->req = NULL;
+
+	return 0;
+}
+
 int host_dev_bind(int devnum, char *filename)
 {
 	struct host_block_dev *host_dev;
@@ -219,8 +246,10 @@ int host_get_dev_err(int devnum, struct blk_desc **blk_devp)
 
 #ifdef CONFIG_BLK
 static const struct blk_ops sandbox_host_blk_ops = {
-	.read	= host_block_read,
-	.write	= host_block_write,
+	.read		= host_block_read,
+	.write		= host_block_write,
+	.read_submit	= host_block_read_submit,
+	.read_poll	= host_block_read_poll,
 };
 
 U_BOOT_DRIVER(sandbox_host_blk) = {
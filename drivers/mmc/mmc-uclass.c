@@ -5,6 +5,7 @@
  */
 
 #include <common.h>
+#include <malloc.h>
 #include <mmc.h>
 #include <dm.h>
 #include <dm/device-internal.h>
@@ -18,6 +19,11 @@ int dm_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	struct dm_mmc_ops *ops = mmc_get_ops(dev);
 	int ret;
 
+#if CONFIG_IS_ENABLED(BLK)
+	/* The card is busy with a read started by mmc_bread_submit() */
+	if (mmc->read_req)
+		return -EBUSY;
+#endif
 	mmmc_trace_before_send(mmc, cmd);
 	if (ops->send_cmd)
 		ret = ops->send_cmd(dev, cmd, data);
@@ -76,6 +82,31 @@ int mmc_wait_dat0(struct mmc *mmc, int state, int timeout)
 }
 #endif
 
+int dm_mmc_send_cmd_async(struct udevice *dev, struct mmc_cmd *cmd,
+			  struct mmc_data *data)
+{
+	struct mmc *mmc = mmc_get_mmc_dev(dev);
+	struct dm_mmc_ops *ops = mmc_get_ops(dev);
+	int ret;
+
+	if (!ops->send_cmd_async || !ops->poll_data)
+		return -ENOSYS;
+	mmmc_trace_before_send(mmc, cmd);
+	ret = ops->send_cmd_async(dev, cmd, data);
+	mmmc_trace_after_send(mmc, cmd, ret);
+
+	return ret;
+}
+
+int dm_mmc_poll_data(struct udevice *dev, struct mmc_data *data)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(dev);
+
+	if (!ops->poll_data)
+		return -ENOSYS;
+	return ops->poll_data(dev, data);
+}
+
 int dm_mmc_get_wp(struct udevice *dev)
 {
 	struct dm_mmc_ops *ops = mmc_get_ops(dev);
@@ -229,6 +260,30 @@ struct blk_desc *mmc_get_blk_desc(struct mmc *mmc)
 	return desc;
 }
 
+#if CONFIG_IS_ENABLED(MMC_PARALLEL_INIT)
+static void mmc_init_all(struct uclass *uc)
+{
+	struct udevice *dev;
+	struct mmc **mmcs;
+	int count = 0;
+
+	uclass_foreach_dev(dev, uc)
+		count++;
+	mmcs = calloc(count, sizeof(*mmcs));
+	if (!mmcs)
+		return;
+	count = 0;
+	uclass_foreach_dev(dev, uc) {
+		struct mmc *m = mmc_get_mmc_dev(dev);
+
+		if (m)
+			mmcs[count++] = m;
+	}
+	mmc_init_devices(mmcs, count);
+	free(mmcs);
+}
+#endif
+
 void mmc_do_preinit(void)
 {
 	struct udevice *dev;
@@ -238,6 +293,10 @@ void mmc_do_preinit(void)
 	ret = uclass_get(UCLASS_MMC, &uc);
 	if (ret)
 		return;
+#if CONFIG_IS_ENABLED(MMC_PARALLEL_INIT)
+	mmc_init_all(uc);
+	return;
+#endif
 	uclass_foreach_dev(dev, uc) {
 		struct mmc *m = mmc_get_mmc_dev(dev);
 
@@ -375,6 +434,8 @@ static const struct blk_ops mmc_blk_ops = {
 	.erase	= mmc_berase,
 #endif
 	.select_hwpart	= mmc_select_hwpart,
+	.read_submit	= mmc_bread_submit,
+	.read_poll	= mmc_bread_poll,
 };
 
 U_BOOT_DRIVER(mmc_blk) = {
@@ -8,6 +8,8 @@
 
 #include <config.h>
 #include <common.h>
+#include <bloblist.h>
+#include <bootstage.h>
 #include <command.h>
 #include <dm.h>
 #include <dm/device-internal.h>
@@ -353,89 +355,128 @@ int mmc_send_tuning(struct mmc *mmc, u32 opcode, int *cmd_error)
 }
 #endif
 
-static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
-			   lbaint_t blkcnt)
+int mmc_set_block_count(struct mmc *mmc, lbaint_t blkcnt)
 {
 	struct mmc_cmd cmd;
-	struct mmc_data data;
 
+	cmd.cmdidx = MMC_CMD_SET_BLOCK_COUNT;
+	cmd.cmdarg = blkcnt;
+	cmd.resp_type = MMC_RSP_R1;
+
+	return mmc_send_cmd(mmc, &cmd, NULL);
+}
+
+static void mmc_read_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
+			 struct mmc_data *data, void *dst, lbaint_t start,
+			 lbaint_t blkcnt)
+{
 	if (blkcnt > 1)
-		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
+		cmd->cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
 	else
-		cmd.cmdidx = MMC_CMD_READ_SINGLE_BLOCK;
+		cmd->cmdidx = MMC_CMD_READ_SINGLE_BLOCK;
 
 	if (mmc->high_capacity)
-		cmd.cmdarg = start;
+		cmd->cmdarg = start;
 	else
-		cmd.cmdarg = start * mmc->read_bl_len;
+		cmd->cmdarg = start * mmc->read_bl_len;
 
-	cmd.resp_type = MMC_RSP_R1;
+	cmd->resp_type = MMC_RSP_R1;
 
-	data.dest = dst;
-	data.blocks = blkcnt;
-	data.blocksize = mmc->read_bl_len;
-	data.flags = MMC_DATA_READ;
+	data->dest = dst;
+	data->blocks = blkcnt;
+	data->blocksize = mmc->read_bl_len;
+	data->flags = MMC_DATA_READ;
+}
 
-	if (mmc_send_cmd(mmc, &cmd, &data))
-		return 0;
+static int mmc_read_stop(struct mmc *mmc)
+{
+	struct mmc_cmd cmd;
 
-	if (blkcnt > 1) {
-		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
-		cmd.cmdarg = 0;
-		cmd.resp_type = MMC_RSP_R1b;
-		if (mmc_send_cmd(mmc, &cmd, NULL)) {
+	cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
+	cmd.cmdarg = 0;
+	cmd.resp_type = MMC_RSP_R1b;
+	if (mmc_send_cmd(mmc, &cmd, NULL)) {
 #if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
-			pr_err("mmc fail to send stop cmd\n");
+		pr_err("mmc fail to send stop cmd\n");
 #endif
-			return 0;
-		}
+		return -EIO;
 	}
 
-	return blkcnt;
+	return 0;
 }
 
-#if CONFIG_IS_ENABLED(BLK)
-ulong mmc_bread(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *dst)
-#else
-ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
-		void *dst)
-#endif
+static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
+			   lbaint_t blkcnt)
 {
-#if CONFIG_IS_ENABLED(BLK)
-	struct blk_desc *block_dev = dev_get_uclass_platdata(dev);
-#endif
-	int dev_num = block_dev->devnum;
-	int err;
-	lbaint_t cur, blocks_todo = blkcnt;
+	struct mmc_cmd cmd;
+	struct mmc_data data;
 
-	if (blkcnt == 0)
+	if (mmc_use_cmd23(mmc, blkcnt) && mmc_set_block_count(mmc, blkcnt))
 		return 0;
 
-	struct mmc *mmc = find_mmc_device(dev_num);
-	if (!mmc)
+	mmc_read_cmd(mmc, &cmd, &data, dst, start, blkcnt);
+	if (mmc_send_cmd(mmc, &cmd, &data))
+		return 0;
+
+	if (blkcnt > 1 && !mmc_use_cmd23(mmc, blkcnt) && mmc_read_stop(mmc))
 		return 0;
 
+	return blkcnt;
+}
+
+/* Select the hardware partition and check the range of a read */
+static int mmc_bread_prepare(struct mmc *mmc, struct blk_desc *block_dev,
+			     lbaint_t start, lbaint_t blkcnt)
+{
+	int err;
+
 	if (CONFIG_IS_ENABLED(MMC_TINY))
 		err = mmc_switch_part(mmc, block_dev->hwpart);
 	else
 		err = blk_dselect_hwpart(block_dev, block_dev->hwpart);
 
 	if (err < 0)
-		return 0;
+		return err;
 
 	if ((start + blkcnt) > block_dev->lba) {
 #if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
 		pr_err("MMC: block number 0x" LBAF " exceeds max(0x" LBAF ")\n",
 		       start + blkcnt, block_dev->lba);
 #endif
-		return 0;
+		return -EINVAL;
 	}
 
 	if (mmc_set_blocklen(mmc, mmc->read_bl_len)) {
 		pr_debug("%s: Failed to set blocklen\n", __func__);
-		return 0;
+		return -EIO;
 	}
 
+	return 0;
+}
+
+#if CONFIG_IS_ENABLED(BLK)
+ulong mmc_bread(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *dst)
+#else
+ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
+		void *dst)
+#endif
+{
+#if CONFIG_IS_ENABLED(BLK)
+	struct blk_desc *block_dev = dev_get_uclass_platdata(dev);
+#endif
+	int dev_num = block_dev->devnum;
+	lbaint_t cur, blocks_todo = blkcnt;
+
+	if (blkcnt == 0)
+		return 0;
+
+	struct mmc *mmc = find_mmc_device(dev_num);
+	if (!mmc)
+		return 0;
+
+	if (mmc_bread_prepare(mmc, block_dev, start, blkcnt))
+		return 0;
+
 	do {
 		cur = (blocks_todo > mmc->cfg->b_max) ?
 			mmc->cfg->b_max : blocks_todo;
@@ -451,6 +492,62 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 	return blkcnt;
 }
 
+#if CONFIG_IS_ENABLED(BLK) && CONFIG_IS_ENABLED(DM_MMC)
+int mmc_bread_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct blk_desc *block_dev = dev_get_uclass_platdata(dev);
+	struct mmc *mmc = find_mmc_device(block_dev->devnum);
+	struct mmc_cmd cmd;
+	int err;
+
+	if (!mmc)
+		return -ENODEV;
+	if (mmc->read_req)
+		return -EBUSY;
+
+	/* Only a read which the controller can do in one go by itself */
+	if (!mmc_get_ops(mmc->dev)->send_cmd_async || !req->blkcnt ||
+	    req->blkcnt > mmc->cfg->b_max)
+		return -ENOSYS;
+
+	err = mmc_bread_prepare(mmc, block_dev, req->start, req->blkcnt);
+	if (!err && mmc_use_cmd23(mmc, req->blkcnt))
+		err = mmc_set_block_count(mmc, req->blkcnt);
+	if (err)
+		return err;
+
+	mmc_read_cmd(mmc, &cmd, &mmc->read_data, req->buffer, req->start,
+		     req->blkcnt);
+	err = dm_mmc_send_cmd_async(mmc->dev, &cmd, &mmc->read_data);
+	if (err)
+		return err;
+	mmc->read_req = req;
+
+	return 0;
+}
+
+int mmc_bread_poll(struct udevice *dev, struct blk_req *req)
+{
+	struct blk_desc *block_dev = dev_get_uclass_platdata(dev);
+	struct mmc *mmc = find_mmc_device(block_dev->devnum);
+	int err;
+
+	if (!mmc || mmc->read_req != req)
+		return -EINVAL;
+
+	err = dm_mmc_poll_data(mmc->dev, &mmc->read_data);
+	if (err == -EBUSY)
+		return err;
+	mmc->read_req = NULL;
+
+	if (!err && req->blkcnt > 1 && !mmc_use_cmd23(mmc, req->blkcnt))
+		err = mmc_read_stop(mmc);
+	req->ret = err ? 0 : req->blkcnt;
+
+	return 0;
+}
+#endif
+
 static int mmc_go_idle(struct mmc *mmc)
 {
 	struct mmc_cmd cmd;
@@ -534,54 +631,53 @@ static int mmc_switch_voltage(struct mmc *mmc, int signal_voltage)
 }
 #endif
 
-static int sd_send_op_cond(struct mmc *mmc, bool uhs_en)
+static int sd_send_op_cond_iter(struct mmc *mmc, bool uhs_en)
 {
-	int timeout = 1000;
-	int err;
 	struct mmc_cmd cmd;
+	int err;
 
-	while (1) {
-		cmd.cmdidx = MMC_CMD_APP_CMD;
-		cmd.resp_type = MMC_RSP_R1;
-		cmd.cmdarg = 0;
-
-		err = mmc_send_cmd(mmc, &cmd, NULL);
+	cmd.cmdidx = MMC_CMD_APP_CMD;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
 
-		if (err)
-			return err;
+	err = mmc_send_cmd(mmc, &cmd, NULL);
 
-		cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
-		cmd.resp_type = MMC_RSP_R3;
+	if (err)
+		return err;
 
-		/*
-		 * Most cards do not answer if some reserved bits
-		 * in the ocr are set. However, Some controller
-		 * can set bit 7 (reserved for low voltages), but
-		 * how to manage low voltages SD card is not yet
-		 * specified.
-		 */
-		cmd.cmdarg = mmc_host_is_spi(mmc) ? 0 :
-			(mmc->cfg->voltages & 0xff8000);
+	cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
+	cmd.resp_type = MMC_RSP_R3;
 
-		if (mmc->version == SD_VERSION_2)
-			cmd.cmdarg |= OCR_HCS;
+	/*
+	 * Most cards do not answer if some reserved bits
+	 * in the ocr are set. However, Some controller
+	 * can set bit 7 (reserved for low voltages), but
+	 * how to manage low voltages SD card is not yet
+	 * specified.
+	 */
+	cmd.cmdarg = mmc_host_is_spi(mmc) ? 0 :
+		(mmc->cfg->voltages & 0xff8000);
 
-		if (uhs_en)
-			cmd.cmdarg |= OCR_S18R;
+	if (mmc->version == SD_VERSION_2)
+		cmd.cmdarg |= OCR_HCS;
 
-		err = mmc_send_cmd(mmc, &cmd, NULL);
+	if (uhs_en)
+		cmd.cmdarg |= OCR_S18R;
 
-		if (err)
-			return err;
+	err = mmc_send_cmd(mmc, &cmd, NULL);
 
-		if (cmd.response[0] & OCR_BUSY)
-			break;
+	if (err)
+		return err;
+	mmc->ocr = cmd.response[0];
 
-		if (timeout-- <= 0)
-			return -EOPNOTSUPP;
+	return 0;
+}
 
-		udelay(1000);
-	}
+/* Finish off once the card has reported that it is no longer busy */
+static int sd_complete_op_cond(struct mmc *mmc, bool uhs_en)
+{
+	struct mmc_cmd cmd;
+	int err;
 
 	if (mmc->version != SD_VERSION_2)
 		mmc->version = SD_VERSION_1_0;
@@ -595,12 +691,12 @@ static int sd_send_op_cond(struct mmc *mmc, bool uhs_en)
 
 		if (err)
 			return err;
-	}
 
-	mmc->ocr = cmd.response[0];
+		mmc->ocr = cmd.response[0];
+	}
 
 #if CONFIG_IS_ENABLED(MMC_UHS_SUPPORT)
-	if (uhs_en && !(mmc_host_is_spi(mmc)) && (cmd.response[0] & 0x41000000)
+	if (uhs_en && !(mmc_host_is_spi(mmc)) && (mmc->ocr & 0x41000000)
 	    == 0x41000000) {
 		err = mmc_switch_voltage(mmc, MMC_SIGNAL_VOLTAGE_180);
 		if (err)
@@ -614,6 +710,28 @@ static int sd_send_op_cond(struct mmc *mmc, bool uhs_en)
 	return 0;
 }
 
+static int sd_send_op_cond(struct mmc *mmc, bool uhs_en)
+{
+	int timeout = 1000;
+	int err;
+
+	while (1) {
+		err = sd_send_op_cond_iter(mmc, uhs_en);
+		if (err)
+			return err;
+
+		if (mmc->ocr & OCR_BUSY)
+			break;
+
+		if (timeout-- <= 0)
+			return -EOPNOTSUPP;
+
+		udelay(1000);
+	}
+
+	return sd_complete_op_cond(mmc, uhs_en);
+}
+
 static int mmc_send_op_cond_iter(struct mmc *mmc, int use_arg)
 {
 	struct mmc_cmd cmd;
@@ -702,6 +820,37 @@ static int mmc_complete_op_cond(struct mmc *mmc)
 	return 0;
 }
 
+#define MMC_OP_COND_TIMEOUT	1000
+
+/*
+ * Ask a card that is powering up whether it is ready, once. This returns
+ * -EBUSY while it is still busy, else finishes off its operating condition.
+ */
+static int mmc_poll_op_cond(struct mmc *mmc)
+{
+	bool sd = mmc->sd_op_cond_pending;
+	int err;
+
+	if (sd)
+		err = sd_send_op_cond_iter(mmc, mmc->op_cond_uhs);
+	else
+		err = mmc_send_op_cond_iter(mmc, 1);
+	if (!err && !(mmc->ocr & OCR_BUSY)) {
+		if (get_timer(mmc->op_cond_start) <= MMC_OP_COND_TIMEOUT)
+			return -EBUSY;
+		err = -EOPNOTSUPP;
+	}
+
+	mmc->sd_op_cond_pending = 0;
+	if (err) {
+		mmc->op_cond_pending = 0;
+		return err;
+	}
+
+	return sd ? sd_complete_op_cond(mmc, mmc->op_cond_uhs) :
+		    mmc_complete_op_cond(mmc);
+}
+
 
 static int mmc_send_ext_csd(struct mmc *mmc, u8 *ext_csd)
 {
@@ -812,6 +961,9 @@ static int mmc_get_capabilities(struct mmc *mmc)
 	if (mmc_host_is_spi(mmc))
 		return 0;
 
+	if (mmc->version >= MMC_VERSION_3)
+		mmc->card_caps |= MMC_MODE_CMD23;
+
 	/* Only version 4 supports high-speed */
 	if (mmc->version < MMC_VERSION_4)
 		return 0;
@@ -1239,6 +1391,8 @@ retry_scr:
 
 	if (mmc->scr[0] & SD_DATA_4BIT)
 		mmc->card_caps |= MMC_MODE_4BIT;
+	if (mmc->scr[0] & SD_CMD23_SUPPORT)
+		mmc->card_caps |= MMC_MODE_CMD23;
 
 	/* Version 1.0 doesn't support switching */
 	if (mmc->version == SD_VERSION_1_0)
@@ -2012,7 +2166,11 @@ error:
 DEFINE_CACHE_ALIGN_BUFFER(u8, ext_csd_bkup, MMC_MAX_BLOCK_LEN);
 #endif
 
-static int mmc_startup_v4(struct mmc *mmc)
+/*
+ * Set up from the EXT_CSD of an MMC v4 card, which is read from the card
+ * unless @saved_ext_csd provides a copy
+ */
+static int mmc_startup_v4(struct mmc *mmc, const u8 *saved_ext_csd)
 {
 	int err, i;
 	u64 capacity;
@@ -2039,9 +2197,13 @@ static int mmc_startup_v4(struct mmc *mmc)
 	if (!mmc->ext_csd)
 		memset(ext_csd_bkup, 0, sizeof(ext_csd_bkup));
 
-	err = mmc_send_ext_csd(mmc, ext_csd);
-	if (err)
-		goto error;
+	if (saved_ext_csd) {
+		memcpy(ext_csd, saved_ext_csd, MMC_MAX_BLOCK_LEN);
+	} else {
+		err = mmc_send_ext_csd(mmc, ext_csd);
+		if (err)
+			goto error;
+	}
 
 	/* store the ext csd for future reference */
 	if (!mmc->ext_csd)
@@ -2053,9 +2215,13 @@ static int mmc_startup_v4(struct mmc *mmc)
 		return 0;
 
 	/* check  ext_csd version and capacity */
-	err = mmc_send_ext_csd(mmc, ext_csd);
-	if (err)
-		goto error;
+	if (saved_ext_csd) {
+		memcpy(ext_csd, saved_ext_csd, MMC_MAX_BLOCK_LEN);
+	} else {
+		err = mmc_send_ext_csd(mmc, ext_csd);
+		if (err)
+			goto error;
+	}
 
 	/* store the ext csd for future reference */
 	if (!mmc->ext_csd)
@@ -2210,40 +2376,162 @@ error:
 	return err;
 }
 
-static int mmc_startup(struct mmc *mmc)
+/* Work out the speed, block lengths and capacity from the CSD */
+static void mmc_decode_csd(struct mmc *mmc)
 {
-	int err, i;
 	uint mult, freq;
 	u64 cmult, csize;
-	struct mmc_cmd cmd;
-	struct blk_desc *bdesc;
+	int i;
 
-#ifdef CONFIG_MMC_SPI_CRC_ON
-	if (mmc_host_is_spi(mmc)) { /* enable CRC check for spi */
-		cmd.cmdidx = MMC_CMD_SPI_CRC_ON_OFF;
-		cmd.resp_type = MMC_RSP_R1;
-		cmd.cmdarg = 1;
-		err = mmc_send_cmd(mmc, &cmd, NULL);
-		if (err)
-			return err;
+	if (mmc->version == MMC_VERSION_UNKNOWN) {
+		int version = (mmc->csd[0] >> 26) & 0xf;
+
+		switch (version) {
+		case 0:
+			mmc->version = MMC_VERSION_1_2;
+			break;
+		case 1:
+			mmc->version = MMC_VERSION_1_4;
+			break;
+		case 2:
+			mmc->version = MMC_VERSION_2_2;
+			break;
+		case 3:
+			mmc->version = MMC_VERSION_3;
+			break;
+		case 4:
+			mmc->version = MMC_VERSION_4;
+			break;
+		default:
+			mmc->version = MMC_VERSION_1_2;
+			break;
+		}
 	}
-#endif
 
-	/* Put the Card in Identify Mode */
-	cmd.cmdidx = mmc_host_is_spi(mmc) ? MMC_CMD_SEND_CID :
-		MMC_CMD_ALL_SEND_CID; /* cmd not supported in spi */
-	cmd.resp_type = MMC_RSP_R2;
-	cmd.cmdarg = 0;
+	/* divide frequency by 10, since the mults are 10x bigger */
+	freq = fbase[(mmc->csd[0] & 0x7)];
+	mult = multipliers[((mmc->csd[0] >> 3) & 0xf)];
 
-	err = mmc_send_cmd(mmc, &cmd, NULL);
+	mmc->legacy_speed = freq * mult;
+	mmc_select_mode(mmc, MMC_LEGACY);
 
-#ifdef CONFIG_MMC_QUIRKS
-	if (err && (mmc->quirks & MMC_QUIRK_RETRY_SEND_CID)) {
-		int retries = 4;
-		/*
-		 * It has been seen that SEND_CID may fail on the first
-		 * attempt, let's try a few more time
-		 */
+	mmc->dsr_imp = ((mmc->csd[1] >> 12) & 0x1);
+	mmc->read_bl_len = 1 << ((mmc->csd[1] >> 16) & 0xf);
+#if CONFIG_IS_ENABLED(MMC_WRITE)
+
+	if (IS_SD(mmc))
+		mmc->write_bl_len = mmc->read_bl_len;
+	else
+		mmc->write_bl_len = 1 << ((mmc->csd[3] >> 22) & 0xf);
+#endif
+
+	if (mmc->high_capacity) {
+		csize = (mmc->csd[1] & 0x3f) << 16
+			| (mmc->csd[2] & 0xffff0000) >> 16;
+		cmult = 8;
+	} else {
+		csize = (mmc->csd[1] & 0x3ff) << 2
+			| (mmc->csd[2] & 0xc0000000) >> 30;
+		cmult = (mmc->csd[2] & 0x00038000) >> 15;
+	}
+
+	mmc->capacity_user = (csize + 1) << (cmult + 2);
+	mmc->capacity_user *= mmc->read_bl_len;
+	mmc->capacity_boot = 0;
+	mmc->capacity_rpmb = 0;
+	for (i = 0; i < 4; i++)
+		mmc->capacity_gp[i] = 0;
+
+	if (mmc->read_bl_len > MMC_MAX_BLOCK_LEN)
+		mmc->read_bl_len = MMC_MAX_BLOCK_LEN;
+
+#if CONFIG_IS_ENABLED(MMC_WRITE)
+	if (mmc->write_bl_len > MMC_MAX_BLOCK_LEN)
+		mmc->write_bl_len = MMC_MAX_BLOCK_LEN;
+#endif
+}
+
+/* Note the mode the card ended up in and describe it as a block device */
+static void mmc_startup_finish(struct mmc *mmc)
+{
+	struct blk_desc *bdesc;
+
+	mmc->best_mode = mmc->selected_mode;
+
+	/* Fix the block length for DDR mode */
+	if (mmc->ddr_mode) {
+		mmc->read_bl_len = MMC_MAX_BLOCK_LEN;
+#if CONFIG_IS_ENABLED(MMC_WRITE)
+		mmc->write_bl_len = MMC_MAX_BLOCK_LEN;
+#endif
+	}
+
+	/* fill in device description */
+	bdesc = mmc_get_blk_desc(mmc);
+	bdesc->lun = 0;
+	bdesc->hwpart = 0;
+	bdesc->type = 0;
+	bdesc->blksz = mmc->read_bl_len;
+	bdesc->log2blksz = LOG2(bdesc->blksz);
+	bdesc->lba = lldiv(mmc->capacity, mmc->read_bl_len);
+#if !defined(CONFIG_SPL_BUILD) || \
+		(defined(CONFIG_SPL_LIBCOMMON_SUPPORT) && \
+		!defined(CONFIG_USE_TINY_PRINTF))
+	sprintf(bdesc->vendor, "Man %06x Snr %04x%04x",
+		mmc->cid[0] >> 24, (mmc->cid[2] & 0xffff),
+		(mmc->cid[3] >> 16) & 0xffff);
+	sprintf(bdesc->product, "%c%c%c%c%c%c", mmc->cid[0] & 0xff,
+		(mmc->cid[1] >> 24), (mmc->cid[1] >> 16) & 0xff,
+		(mmc->cid[1] >> 8) & 0xff, mmc->cid[1] & 0xff,
+		(mmc->cid[2] >> 24) & 0xff);
+	sprintf(bdesc->revision, "%d.%d", (mmc->cid[2] >> 20) & 0xf,
+		(mmc->cid[2] >> 16) & 0xf);
+#else
+	bdesc->vendor[0] = 0;
+	bdesc->product[0] = 0;
+	bdesc->revision[0] = 0;
+#endif
+
+	/*
+	 * This may be a different card of the same size, e.g. after 'mmc
+	 * rescan', so drop anything cached from the one seen before
+	 */
+	blkcache_invalidate(bdesc->if_type, bdesc->devnum);
+	gpt_cache_invalidate(bdesc->if_type, bdesc->devnum);
+	fs_cache_invalidate(bdesc->if_type, bdesc->devnum);
+}
+
+static int mmc_startup(struct mmc *mmc)
+{
+	int err;
+	struct mmc_cmd cmd;
+
+#ifdef CONFIG_MMC_SPI_CRC_ON
+	if (mmc_host_is_spi(mmc)) { /* enable CRC check for spi */
+		cmd.cmdidx = MMC_CMD_SPI_CRC_ON_OFF;
+		cmd.resp_type = MMC_RSP_R1;
+		cmd.cmdarg = 1;
+		err = mmc_send_cmd(mmc, &cmd, NULL);
+		if (err)
+			return err;
+	}
+#endif
+
+	/* Put the Card in Identify Mode */
+	cmd.cmdidx = mmc_host_is_spi(mmc) ? MMC_CMD_SEND_CID :
+		MMC_CMD_ALL_SEND_CID; /* cmd not supported in spi */
+	cmd.resp_type = MMC_RSP_R2;
+	cmd.cmdarg = 0;
+
+	err = mmc_send_cmd(mmc, &cmd, NULL);
+
+#ifdef CONFIG_MMC_QUIRKS
+	if (err && (mmc->quirks & MMC_QUIRK_RETRY_SEND_CID)) {
+		int retries = 4;
+		/*
+		 * It has been seen that SEND_CID may fail on the first
+		 * attempt, let's try a few more time
+		 */
 		do {
 			err = mmc_send_cmd(mmc, &cmd, NULL);
 			if (!err)
@@ -2291,72 +2579,7 @@ static int mmc_startup(struct mmc *mmc)
 	mmc->csd[2] = cmd.response[2];
 	mmc->csd[3] = cmd.response[3];
 
-	if (mmc->version == MMC_VERSION_UNKNOWN) {
-		int version = (cmd.response[0] >> 26) & 0xf;
-
-		switch (version) {
-		case 0:
-			mmc->version = MMC_VERSION_1_2;
-			break;
-		case 1:
-			mmc->version = MMC_VERSION_1_4;
-			break;
-		case 2:
-			mmc->version = MMC_VERSION_2_2;
-			break;
-		case 3:
-			mmc->version = MMC_VERSION_3;
-			break;
-		case 4:
-			mmc->version = MMC_VERSION_4;
-			break;
-		default:
-			mmc->version = MMC_VERSION_1_2;
-			break;
-		}
-	}
-
-	/* divide frequency by 10, since the mults are 10x bigger */
-	freq = fbase[(cmd.response[0] & 0x7)];
-	mult = multipliers[((cmd.response[0] >> 3) & 0xf)];
-
-	mmc->legacy_speed = freq * mult;
-	mmc_select_mode(mmc, MMC_LEGACY);
-
-	mmc->dsr_imp = ((cmd.response[1] >> 12) & 0x1);
-	mmc->read_bl_len = 1 << ((cmd.response[1] >> 16) & 0xf);
-#if CONFIG_IS_ENABLED(MMC_WRITE)
-
-	if (IS_SD(mmc))
-		mmc->write_bl_len = mmc->read_bl_len;
-	else
-		mmc->write_bl_len = 1 << ((cmd.response[3] >> 22) & 0xf);
-#endif
-
-	if (mmc->high_capacity) {
-		csize = (mmc->csd[1] & 0x3f) << 16
-			| (mmc->csd[2] & 0xffff0000) >> 16;
-		cmult = 8;
-	} else {
-		csize = (mmc->csd[1] & 0x3ff) << 2
-			| (mmc->csd[2] & 0xc0000000) >> 30;
-		cmult = (mmc->csd[2] & 0x00038000) >> 15;
-	}
-
-	mmc->capacity_user = (csize + 1) << (cmult + 2);
-	mmc->capacity_user *= mmc->read_bl_len;
-	mmc->capacity_boot = 0;
-	mmc->capacity_rpmb = 0;
-	for (i = 0; i < 4; i++)
-		mmc->capacity_gp[i] = 0;
-
-	if (mmc->read_bl_len > MMC_MAX_BLOCK_LEN)
-		mmc->read_bl_len = MMC_MAX_BLOCK_LEN;
-
-#if CONFIG_IS_ENABLED(MMC_WRITE)
-	if (mmc->write_bl_len > MMC_MAX_BLOCK_LEN)
-		mmc->write_bl_len = MMC_MAX_BLOCK_LEN;
-#endif
+	mmc_decode_csd(mmc);
 
 	if ((mmc->dsr_imp) && (0xffffffff != mmc->dsr)) {
 		cmd.cmdidx = MMC_CMD_SET_DSR;
@@ -2385,7 +2608,7 @@ static int mmc_startup(struct mmc *mmc)
 #endif
 	mmc->part_config = MMCPART_NOAVAILABLE;
 
-	err = mmc_startup_v4(mmc);
+	err = mmc_startup_v4(mmc, NULL);
 	if (err)
 		return err;
 
@@ -2413,41 +2636,7 @@ static int mmc_startup(struct mmc *mmc)
 	if (err)
 		return err;
 
-	mmc->best_mode = mmc->selected_mode;
-
-	/* Fix the block length for DDR mode */
-	if (mmc->ddr_mode) {
-		mmc->read_bl_len = MMC_MAX_BLOCK_LEN;
-#if CONFIG_IS_ENABLED(MMC_WRITE)
-		mmc->write_bl_len = MMC_MAX_BLOCK_LEN;
-#endif
-	}
-
-	/* fill in device description */
-	bdesc = mmc_get_blk_desc(mmc);
-	bdesc->lun = 0;
-	bdesc->hwpart = 0;
-	bdesc->type = 0;
-	bdesc->blksz = mmc->read_bl_len;
-	bdesc->log2blksz = LOG2(bdesc->blksz);
-	bdesc->lba = lldiv(mmc->capacity, mmc->read_bl_len);
-#if !defined(CONFIG_SPL_BUILD) || \
-		(defined(CONFIG_SPL_LIBCOMMON_SUPPORT) && \
-		!defined(CONFIG_USE_TINY_PRINTF))
-	sprintf(bdesc->vendor, "Man %06x Snr %04x%04x",
-		mmc->cid[0] >> 24, (mmc->cid[2] & 0xffff),
-		(mmc->cid[3] >> 16) & 0xffff);
-	sprintf(bdesc->product, "%c%c%c%c%c%c", mmc->cid[0] & 0xff,
-		(mmc->cid[1] >> 24), (mmc->cid[1] >> 16) & 0xff,
-		(mmc->cid[1] >> 8) & 0xff, mmc->cid[1] & 0xff,
-		(mmc->cid[2] >> 24) & 0xff);
-	sprintf(bdesc->revision, "%d.%d", (mmc->cid[2] >> 20) & 0xf,
-		(mmc->cid[2] >> 16) & 0xf);
-#else
-	bdesc->vendor[0] = 0;
-	bdesc->product[0] = 0;
-	bdesc->revision[0] = 0;
-#endif
+	mmc_startup_finish(mmc);
 
 	return 0;
 }
@@ -2575,7 +2764,147 @@ static int mmc_power_cycle(struct mmc *mmc)
 	return mmc_power_on(mmc);
 }
 
-int mmc_get_op_cond(struct mmc *mmc)
+#if defined(CONFIG_MMC_HANDOFF) && CONFIG_IS_ENABLED(BLOBLIST)
+int mmc_handoff_save(struct mmc *mmc)
+{
+	struct mmc_handoff *ho;
+
+	ho = bloblist_ensure(BLOBLISTT_MMC_HANDOFF, sizeof(*ho));
+	if (!ho)
+		return -ENOSPC;
+	memset(ho, '\0', sizeof(*ho));
+	ho->devnum = mmc_get_blk_desc(mmc)->devnum;
+	ho->version = mmc->version;
+	ho->ocr = mmc->ocr;
+	memcpy(ho->scr, mmc->scr, sizeof(ho->scr));
+	memcpy(ho->csd, mmc->csd, sizeof(ho->csd));
+	memcpy(ho->cid, mmc->cid, sizeof(ho->cid));
+	ho->card_caps = mmc->card_caps;
+	ho->clock = mmc->clock;
+#if CONFIG_IS_ENABLED(MMC_WRITE)
+	ho->ssr_au = mmc->ssr.au;
+	ho->ssr_erase_timeout = mmc->ssr.erase_timeout;
+	ho->ssr_erase_offset = mmc->ssr.erase_offset;
+#endif
+	ho->rca = mmc->rca;
+	ho->high_capacity = mmc->high_capacity;
+	ho->bus_width = mmc->bus_width;
+	ho->selected_mode = mmc->selected_mode;
+	ho->signal_voltage = mmc->signal_voltage;
+	ho->hwpart = mmc_get_blk_desc(mmc)->hwpart;
+	ho->part_config = mmc->part_config;
+	if (mmc->ext_csd) {
+		memcpy(ho->ext_csd, mmc->ext_csd, MMC_MAX_BLOCK_LEN);
+		ho->has_ext_csd = 1;
+	}
+	ho->valid = 1;
+
+	return 0;
+}
+
+static bool mmc_mode_needs_tuning(enum bus_mode mode)
+{
+	return mode == UHS_SDR104 || mode == MMC_HS_200 || mode == MMC_HS_400;
+}
+
+/*
+ * Carry on with a card set up by the previous phase, if it left a record
+ * of it. The host is set up to match and the card must answer in the
+ * transfer state. Returns 0 if the card is ready for use.
+ */
+static int mmc_handoff_resume(struct mmc *mmc)
+{
+	struct mmc_handoff *ho;
+	struct mmc_cmd cmd;
+	int err;
+
+	ho = bloblist_find(BLOBLISTT_MMC_HANDOFF, sizeof(*ho));
+	if (!ho || !ho->valid ||
+	    ho->devnum != mmc_get_blk_desc(mmc)->devnum)
+		return -ENOENT;
+	/* Only use it once, so that a rescan starts from scratch */
+	ho->valid = 0;
+	if (mmc_host_is_spi(mmc) || mmc_mode_needs_tuning(ho->selected_mode))
+		return -ENOTSUPP;
+
+	err = mmc_power_init(mmc);
+	if (!err)
+		err = mmc_power_on(mmc);
+	if (err)
+		return err;
+#ifdef CONFIG_MMC_QUIRKS
+	mmc->quirks = MMC_QUIRK_RETRY_SET_BLOCKLEN |
+		      MMC_QUIRK_RETRY_SEND_CID;
+#endif
+	mmc->host_caps = mmc->cfg->host_caps | MMC_CAP(SD_LEGACY) |
+			 MMC_CAP(MMC_LEGACY) | MMC_MODE_1BIT;
+	mmc->version = ho->version;
+	mmc->ocr = ho->ocr;
+	memcpy(mmc->scr, ho->scr, sizeof(mmc->scr));
+	memcpy(mmc->csd, ho->csd, sizeof(mmc->csd));
+	memcpy(mmc->cid, ho->cid, sizeof(mmc->cid));
+	mmc->rca = ho->rca;
+	mmc->high_capacity = ho->high_capacity;
+	mmc_decode_csd(mmc);
+
+	/* Put the host back to where the previous phase left it */
+	err = mmc_set_signal_voltage(mmc, ho->signal_voltage);
+	if (err)
+		return err;
+	mmc_select_mode(mmc, ho->selected_mode);
+	mmc_set_bus_width(mmc, ho->bus_width);
+	mmc_set_clock(mmc, ho->clock, MMC_CLK_ENABLE);
+
+	/* Check that the same card is still selected and waiting for us */
+	cmd.cmdidx = MMC_CMD_SEND_STATUS;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = mmc->rca << 16;
+	err = mmc_send_cmd(mmc, &cmd, NULL);
+	if (err)
+		return err;
+	if ((cmd.response[0] & MMC_STATUS_CURR_STATE) != MMC_STATE_TRANS ||
+	    !(cmd.response[0] & MMC_STATUS_RDY_FOR_DATA))
+		return -ENODEV;
+
+#if CONFIG_IS_ENABLED(MMC_WRITE)
+	mmc->erase_grp_size = 1;
+	mmc->ssr.au = ho->ssr_au;
+	mmc->ssr.erase_timeout = ho->ssr_erase_timeout;
+	mmc->ssr.erase_offset = ho->ssr_erase_offset;
+#endif
+	mmc->part_config = MMCPART_NOAVAILABLE;
+	err = mmc_startup_v4(mmc, ho->has_ext_csd ? ho->ext_csd : NULL);
+	if (err)
+		return err;
+	mmc->part_config = ho->part_config;
+
+	/* A new phase expects to start in the user partition */
+	if (ho->hwpart)
+		err = mmc_switch_part(mmc, 0);
+	else
+		err = mmc_set_capacity(mmc, 0);
+	if (err)
+		return err;
+	mmc->card_caps = ho->card_caps;
+	mmc_startup_finish(mmc);
+	debug("%s: Resumed %s from the previous phase\n", __func__,
+	      mmc->cfg->name);
+
+	return 0;
+}
+#else
+static inline int mmc_handoff_resume(struct mmc *mmc)
+{
+	return -ENOSYS;
+}
+#endif
+
+/*
+ * Start the card powering up. If @wait is false, an SD card that is still
+ * busy is left with sd_op_cond_pending set, and an MMC card is left with
+ * op_cond_pending set, for mmc_poll_op_cond() to finish off.
+ */
+static int __mmc_get_op_cond(struct mmc *mmc, bool wait)
 {
 	bool uhs_en = supports_uhs(mmc->cfg->host_caps);
 	int err;
@@ -2637,7 +2966,18 @@ retry:
 	err = mmc_send_if_cond(mmc);
 
 	/* Now try to get the SD card's operating condition */
-	err = sd_send_op_cond(mmc, uhs_en);
+	if (wait) {
+		err = sd_send_op_cond(mmc, uhs_en);
+	} else {
+		err = sd_send_op_cond_iter(mmc, uhs_en);
+		if (!err && (mmc->ocr & OCR_BUSY)) {
+			err = sd_complete_op_cond(mmc, uhs_en);
+		} else if (!err) {
+			mmc->sd_op_cond_pending = 1;
+			mmc->op_cond_uhs = uhs_en;
+			mmc->op_cond_start = get_timer(0);
+		}
+	}
 	if (err && uhs_en) {
 		uhs_en = false;
 		mmc_power_cycle(mmc);
@@ -2654,12 +2994,23 @@ retry:
 #endif
 			return -EOPNOTSUPP;
 		}
+		if (!wait) {
+			/* As mmc_complete_op_cond() would before polling */
+			if (!(mmc->ocr & OCR_BUSY))
+				mmc_go_idle(mmc);
+			mmc->op_cond_start = get_timer(0);
+		}
 	}
 
 	return err;
 }
 
-int mmc_start_init(struct mmc *mmc)
+int mmc_get_op_cond(struct mmc *mmc)
+{
+	return __mmc_get_op_cond(mmc, true);
+}
+
+static int __mmc_start_init(struct mmc *mmc, bool wait)
 {
 	bool no_card;
 	int err = 0;
@@ -2688,7 +3039,7 @@ int mmc_start_init(struct mmc *mmc)
 		return -ENOMEDIUM;
 	}
 
-	err = mmc_get_op_cond(mmc);
+	err = __mmc_get_op_cond(mmc, wait);
 
 	if (!err)
 		mmc->init_in_progress = 1;
@@ -2696,13 +3047,22 @@ int mmc_start_init(struct mmc *mmc)
 	return err;
 }
 
+int mmc_start_init(struct mmc *mmc)
+{
+	return __mmc_start_init(mmc, true);
+}
+
 static int mmc_complete_init(struct mmc *mmc)
 {
 	int err = 0;
 
 	mmc->init_in_progress = 0;
-	if (mmc->op_cond_pending)
+	if (mmc->sd_op_cond_pending) {
+		while ((err = mmc_poll_op_cond(mmc)) == -EBUSY)
+			udelay(1000);
+	} else if (mmc->op_cond_pending) {
 		err = mmc_complete_op_cond(mmc);
+	}
 
 	if (!err)
 		err = mmc_startup(mmc);
@@ -2727,6 +3087,10 @@ int mmc_init(struct mmc *mmc)
 
 	start = get_timer(0);
 
+	if (!mmc->init_in_progress && !mmc_handoff_resume(mmc)) {
+		mmc->has_init = 1;
+		return 0;
+	}
 	if (!mmc->init_in_progress)
 		err = mmc_start_init(mmc);
 
@@ -2738,6 +3102,69 @@ int mmc_init(struct mmc *mmc)
 	return err;
 }
 
+static const char *mmc_dev_name(struct mmc *mmc)
+{
+#if CONFIG_IS_ENABLED(DM_MMC)
+	return mmc->dev->name;
+#else
+	return mmc->cfg->name;
+#endif
+}
+
+int mmc_init_devices(struct mmc **mmcs, int count)
+{
+	ulong start = get_timer(0);
+	int ret = 0;
+	int i, err, busy;
+
+	bootstage_start(BOOTSTAGE_ID_ACCUM_MMC, "mmc_init");
+
+	/* Kick off the power-up of every card before waiting for any */
+	for (i = 0; i < count; i++) {
+		if (mmcs[i]->has_init || mmcs[i]->init_in_progress)
+			continue;
+		err = __mmc_start_init(mmcs[i], false);
+		if (err)
+			ret = err;
+	}
+
+	/* Poll them in turn, finishing each one off once it is ready */
+	do {
+		busy = 0;
+		for (i = 0; i < count; i++) {
+			struct mmc *mmc = mmcs[i];
+
+			if (!mmc->init_in_progress)
+				continue;
+			if (mmc->sd_op_cond_pending || mmc->op_cond_pending) {
+				err = mmc_poll_op_cond(mmc);
+				if (err == -EBUSY) {
+					busy++;
+					continue;
+				}
+				/* Start again the slow way, e.g. without UHS */
+				if (err)
+					mmc->init_in_progress = 0;
+			}
+			err = mmc_init(mmc);
+			if (err) {
+				ret = err;
+				continue;
+			}
+			debug("%s: %s ready after %lu ms\n", __func__,
+			      mmc_dev_name(mmc), get_timer(start));
+			bootstage_mark_name(BOOTSTAGE_ID_ALLOC,
+					    mmc_dev_name(mmc));
+		}
+		if (busy)
+			udelay(1000);
+	} while (busy);
+
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_MMC);
+
+	return ret;
+}
+
 int mmc_set_dsr(struct mmc *mmc, u16 val)
 {
 	mmc->dsr = val;
@@ -68,11 +68,35 @@ int get_mmc_num(void)
 	return cur_dev_num;
 }
 
+#if CONFIG_IS_ENABLED(MMC_PARALLEL_INIT)
+static void mmc_init_all(void)
+{
+	struct list_head *entry;
+	struct mmc **mmcs;
+	int count = 0;
+
+	list_for_each(entry, &mmc_devices)
+		count++;
+	mmcs = calloc(count, sizeof(*mmcs));
+	if (!mmcs)
+		return;
+	count = 0;
+	list_for_each(entry, &mmc_devices)
+		mmcs[count++] = list_entry(entry, struct mmc, link);
+	mmc_init_devices(mmcs, count);
+	free(mmcs);
+}
+#endif
+
 void mmc_do_preinit(void)
 {
 	struct mmc *m;
 	struct list_head *entry;
 
+#if CONFIG_IS_ENABLED(MMC_PARALLEL_INIT)
+	mmc_init_all();
+	return;
+#endif
 	list_for_each(entry, &mmc_devices) {
 		m = list_entry(entry, struct mmc, link);
 
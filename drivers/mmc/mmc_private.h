@@ -15,6 +15,17 @@ extern int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd,
 			struct mmc_data *data);
 extern int mmc_send_status(struct mmc *mmc, int timeout);
 extern int mmc_set_blocklen(struct mmc *mmc, int len);
+int mmc_set_block_count(struct mmc *mmc, lbaint_t blkcnt);
+
+/*
+ * Check whether a multi-block transfer of @blkcnt blocks should be announced
+ * with SET_BLOCK_COUNT, so that it ends by itself without STOP_TRANSMISSION
+ */
+static inline bool mmc_use_cmd23(struct mmc *mmc, lbaint_t blkcnt)
+{
+	return blkcnt > 1 && blkcnt <= 0xffff &&
+		(mmc->card_caps & mmc->host_caps & MMC_MODE_CMD23);
+}
 #ifdef CONFIG_FSL_ESDHC_ADAPTER_IDENT
 void mmc_adapter_card_type_ident(void);
 #endif
@@ -22,6 +33,8 @@ void mmc_adapter_card_type_ident(void);
 #if CONFIG_IS_ENABLED(BLK)
 ulong mmc_bread(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
 		void *dst);
+int mmc_bread_submit(struct udevice *dev, struct blk_req *req);
+int mmc_bread_poll(struct udevice *dev, struct blk_req *req);
 #else
 ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 		void *dst);
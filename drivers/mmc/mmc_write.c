@@ -126,12 +126,37 @@ ulong mmc_berase(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt)
 	return blk;
 }
 
+/* Writes of at least this many blocks to an SD card are pre-erased */
+#define SD_PRE_ERASE_MIN_BLOCKS		64
+
+/*
+ * Tell an SD card how many blocks are coming (ACMD23), so it can erase them
+ * ahead of the write. This is only a hint, so failure is not an error.
+ */
+static void sd_pre_erase(struct mmc *mmc, lbaint_t blkcnt)
+{
+	struct mmc_cmd cmd;
+
+	cmd.cmdidx = MMC_CMD_APP_CMD;
+	cmd.cmdarg = mmc->rca << 16;
+	cmd.resp_type = MMC_RSP_R1;
+	if (mmc_send_cmd(mmc, &cmd, NULL))
+		return;
+
+	cmd.cmdidx = SD_CMD_APP_SET_WR_BLK_ERASE_COUNT;
+	cmd.cmdarg = blkcnt & 0x7fffff;
+	cmd.resp_type = MMC_RSP_R1;
+	if (mmc_send_cmd(mmc, &cmd, NULL))
+		debug("%s: pre-erase failed\n", __func__);
+}
+
 static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 		lbaint_t blkcnt, const void *src)
 {
 	struct mmc_cmd cmd;
 	struct mmc_data data;
 	int timeout = 1000;
+	bool cmd23 = mmc_use_cmd23(mmc, blkcnt);
 
 	if ((start + blkcnt) > mmc_get_blk_desc(mmc)->lba) {
 		printf("MMC: block number 0x" LBAF " exceeds max(0x" LBAF ")\n",
@@ -158,15 +183,21 @@ static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 	data.blocksize = mmc->write_bl_len;
 	data.flags = MMC_DATA_WRITE;
 
-	if (mmc_send_cmd(mmc, &cmd, &data)) {
+	if (IS_SD(mmc) && !mmc_host_is_spi(mmc) &&
+	    blkcnt >= SD_PRE_ERASE_MIN_BLOCKS)
+		sd_pre_erase(mmc, blkcnt);
+
+	if ((cmd23 && mmc_set_block_count(mmc, blkcnt)) ||
+	    mmc_send_cmd(mmc, &cmd, &data)) {
 		printf("mmc write failed\n");
 		return 0;
 	}
 
 	/* SPI multiblock writes terminate using a special
-	 * token, not a STOP_TRANSMISSION request.
+	 * token, not a STOP_TRANSMISSION request, and ones announced with
+	 * SET_BLOCK_COUNT end by themselves.
 	 */
-	if (!mmc_host_is_spi(mmc) && blkcnt > 1) {
+	if (!mmc_host_is_spi(mmc) && blkcnt > 1 && !cmd23) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
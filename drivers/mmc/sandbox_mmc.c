@@ -11,34 +11,112 @@
 #include <mmc.h>
 #include <asm/test.h>
 
+/*
+ * A rough timing model of the card, so that different ways of driving it
+ * can be compared. Each command takes SB_MMC_CMD_US and each block
+ * SB_MMC_BLOCK_US on the bus. Written data is programmed a page at a time,
+ * taking SB_MMC_PROG_US per page, or SB_MMC_PROG_ERASED_US if the blocks
+ * were pre-erased with ACMD23. An open-ended write costs another
+ * SB_MMC_STOP_US when it is stopped, since the card could not prepare for
+ * its end. After GO_IDLE the card reports itself busy in the first
+ * SB_MMC_POWER_UP_POLLS - 1 replies to ACMD41, as real cards do while they
+ * power up.
+ */
+#define SB_MMC_CMD_US		20
+#define SB_MMC_BLOCK_US		10
+#define SB_MMC_PAGE_BLOCKS	32
+#define SB_MMC_PROG_US		500
+#define SB_MMC_PROG_ERASED_US	350
+#define SB_MMC_STOP_US		2000
+#define SB_MMC_POWER_UP_POLLS	10
+
 struct sandbox_mmc_plat {
 	struct mmc_config cfg;
 	struct mmc mmc;
+	bool busy;	/* a data transfer is in progress */
+	bool app_cmd;	/* the last command was APP_CMD */
+	uint block_count;	/* blocks announced with CMD23 */
+	uint erase_count;	/* blocks pre-erased with ACMD23 */
+	bool open_write;	/* an open-ended write is in progress */
+	bool powering_up;	/* GO_IDLE seen, not ready in ACMD41 yet */
+	uint power_up_polls;	/* ACMD41s answered since GO_IDLE */
+	bool selected;		/* in the transfer state after SELECT_CARD */
+	struct sandbox_mmc_stats stats;
 };
 
+static void sandbox_mmc_write(struct sandbox_mmc_plat *plat,
+			      struct mmc_cmd *cmd, struct mmc_data *data)
+{
+	uint prog_us = SB_MMC_PROG_US;
+
+	if (plat->erase_count >= data->blocks)
+		prog_us = SB_MMC_PROG_ERASED_US;
+	plat->stats.time_us += DIV_ROUND_UP(data->blocks, SB_MMC_PAGE_BLOCKS) *
+		prog_us;
+	plat->open_write = cmd->cmdidx == MMC_CMD_WRITE_MULTIPLE_BLOCK &&
+		!plat->block_count;
+	plat->erase_count = 0;
+}
+
+/* Count the sandbox cards which are powering up, including this one */
+static uint sandbox_mmc_powering_up(void)
+{
+	struct sandbox_mmc_plat *plat;
+	struct udevice *dev;
+	struct uclass *uc;
+	uint count = 0;
+
+	if (uclass_get(UCLASS_MMC, &uc))
+		return 0;
+	uclass_foreach_dev(dev, uc) {
+		if (dev->driver != DM_GET_DRIVER(mmc_sandbox))
+			continue;
+		plat = dev_get_platdata(dev);
+		if (plat->powering_up)
+			count++;
+	}
+
+	return count;
+}
+
 /**
  * sandbox_mmc_send_cmd() - Emulate SD commands
  *
  * This emulate an SD card version 2. Single-block reads result in zero data.
- * Multiple-block reads return a test string.
+ * Multiple-block reads return a test string. Writes are accepted and
+ * discarded.
  */
 static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 				struct mmc_data *data)
 {
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	bool app_cmd = plat->app_cmd;
+
+	plat->app_cmd = false;
+	plat->stats.time_us += SB_MMC_CMD_US;
+	if (data)
+		plat->stats.time_us += data->blocks * SB_MMC_BLOCK_US;
+
 	switch (cmd->cmdidx) {
 	case MMC_CMD_ALL_SEND_CID:
 		break;
 	case SD_CMD_SEND_RELATIVE_ADDR:
 		cmd->response[0] = 0 << 16; /* mmc->rca */
+		break;
 	case MMC_CMD_GO_IDLE_STATE:
+		plat->powering_up = true;
+		plat->power_up_polls = 0;
+		plat->selected = false;
 		break;
 	case SD_CMD_SEND_IF_COND:
 		cmd->response[0] = 0xaa;
 		break;
 	case MMC_CMD_SEND_STATUS:
-		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA;
+		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA |
+			(plat->selected ? MMC_STATE_TRANS : 0);
 		break;
 	case MMC_CMD_SELECT_CARD:
+		plat->selected = true;
 		break;
 	case MMC_CMD_SEND_CSD:
 		cmd->response[0] = 0;
@@ -60,13 +138,42 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		strcpy(data->dest, "this is a test");
 		break;
 	case MMC_CMD_STOP_TRANSMISSION:
+		plat->stats.stops++;
+		if (plat->open_write)
+			plat->stats.time_us += SB_MMC_STOP_US;
+		plat->open_write = false;
+		break;
+	case MMC_CMD_SET_BLOCK_COUNT:
+		if (app_cmd) {
+			plat->stats.pre_erase++;
+			plat->erase_count = cmd->cmdarg;
+		} else {
+			plat->stats.set_count++;
+			plat->block_count = cmd->cmdarg & 0xffff;
+		}
+		break;
+	case MMC_CMD_WRITE_SINGLE_BLOCK:
+	case MMC_CMD_WRITE_MULTIPLE_BLOCK:
+		sandbox_mmc_write(plat, cmd, data);
 		break;
 	case SD_CMD_APP_SEND_OP_COND:
-		cmd->response[0] = OCR_BUSY | OCR_HCS;
+		cmd->response[0] = OCR_HCS;
+		plat->stats.op_cond_polls++;
+		/* the busy bit is set once the card has powered up */
+		if (plat->powering_up) {
+			plat->stats.power_up_overlap =
+				max(plat->stats.power_up_overlap,
+				    sandbox_mmc_powering_up());
+			if (++plat->power_up_polls >= SB_MMC_POWER_UP_POLLS)
+				plat->powering_up = false;
+		}
+		if (!plat->powering_up)
+			cmd->response[0] |= OCR_BUSY;
 		cmd->response[1] = 0;
 		cmd->response[2] = 0;
 		break;
 	case MMC_CMD_APP_CMD:
+		plat->app_cmd = true;
 		break;
 	case MMC_CMD_SET_BLOCKLEN:
 		debug("block len %d\n", cmd->cmdarg);
@@ -74,17 +181,55 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	case SD_CMD_APP_SEND_SCR: {
 		u32 *scr = (u32 *)data->dest;
 
-		scr[0] = cpu_to_be32(2 << 24 | 1 << 15);  /* SD version 3 */
+		/* SD version 3, supporting CMD23 */
+		scr[0] = cpu_to_be32(2 << 24 | 1 << 15 | SD_CMD23_SUPPORT);
 		break;
 	}
 	default:
 		debug("%s: Unknown command %d\n", __func__, cmd->cmdidx);
 		break;
 	}
+	/* A block count only applies to the next data transfer */
+	if (data)
+		plat->block_count = 0;
 
 	return 0;
 }
 
+/* The data is ready at once but the transfer ends on the first poll */
+static int sandbox_mmc_send_cmd_async(struct udevice *dev,
+				      struct mmc_cmd *cmd,
+				      struct mmc_data *data)
+{
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+
+	if (plat->busy)
+		return -EBUSY;
+	plat->busy = true;
+
+	return sandbox_mmc_send_cmd(dev, cmd, data);
+}
+
+static int sandbox_mmc_poll_data(struct udevice *dev, struct mmc_data *data)
+{
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+
+	if (!plat->busy)
+		return 0;
+	plat->busy = false;
+
+	return -EBUSY;
+}
+
+void sandbox_mmc_get_stats(struct udevice *dev,
+			   struct sandbox_mmc_stats *stats)
+{
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+
+	*stats = plat->stats;
+	memset(&plat->stats, '\0', sizeof(plat->stats));
+}
+
 static int sandbox_mmc_set_ios(struct udevice *dev)
 {
 	return 0;
@@ -99,6 +244,8 @@ static const struct dm_mmc_ops sandbox_mmc_ops = {
 	.send_cmd = sandbox_mmc_send_cmd,
 	.set_ios = sandbox_mmc_set_ios,
 	.get_cd = sandbox_mmc_get_cd,
+	.send_cmd_async = sandbox_mmc_send_cmd_async,
+	.poll_data = sandbox_mmc_poll_data,
 };
 
 int sandbox_mmc_probe(struct udevice *dev)
@@ -114,7 +261,8 @@ int sandbox_mmc_bind(struct udevice *dev)
 	struct mmc_config *cfg = &plat->cfg;
 
 	cfg->name = dev->name;
-	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT;
+	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT |
+			 MMC_MODE_CMD23;
 	cfg->voltages = MMC_VDD_165_195 | MMC_VDD_32_33 | MMC_VDD_33_34;
 	cfg->f_min = 1000000;
 	cfg->f_max = 52000000;
@@ -67,95 +67,205 @@ static void sdhci_transfer_pio(struct sdhci_host *host, struct mmc_data *data)
 	}
 }
 
-static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
-				unsigned int start_addr)
-{
-	unsigned int stat, rdy, mask, timeout, block = 0;
-	bool transfer_done = false;
+/*
+ * No command will be sent by driver if card is busy, so driver must wait
+ * for card ready state.
+ * Every time when card is busy after timeout then (last) timeout value will be
+ * increased twice but only if it doesn't exceed global defined maximum.
+ * Each function call will use last timeout value.
+ */
+#define SDHCI_CMD_MAX_TIMEOUT			3200
+#define SDHCI_CMD_DEFAULT_TIMEOUT		100
+#define SDHCI_READ_STATUS_TIMEOUT		1000
+#define SDHCI_DATA_TIMEOUT			10000
+
 #ifdef CONFIG_MMC_SDHCI_SDMA
-	unsigned char ctrl;
+/* Select the kind of DMA the next data transfer uses */
+static void sdhci_set_dma_select(struct sdhci_host *host)
+{
+	u8 ctrl;
+
 	ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
 	ctrl &= ~SDHCI_CTRL_DMA_MASK;
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	if (host->use_adma)
+		ctrl |= host->adma_64 ? SDHCI_CTRL_ADMA64 : SDHCI_CTRL_ADMA32;
+#endif
 	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
+}
 #endif
 
-	timeout = 1000000;
+#ifdef CONFIG_MMC_SDHCI_ADMA
+static void sdhci_adma_write_desc(struct sdhci_host *host, int index,
+				  dma_addr_t addr, int len, bool end)
+{
+	int size = host->adma_64 ? SDHCI_ADMA_DESC_64_SZ :
+				   SDHCI_ADMA_DESC_32_SZ;
+	struct sdhci_adma_desc *desc = host->adma_table + index * size;
+
+	desc->attr = ADMA_DESC_ATTR_VALID | ADMA_DESC_TRANSFER_DATA;
+	if (end)
+		desc->attr |= ADMA_DESC_ATTR_END;
+	desc->reserved = 0;
+	desc->len = cpu_to_le16(len);
+	desc->addr_lo = cpu_to_le32(lower_32_bits(addr));
+	if (host->adma_64)
+		desc->addr_hi = cpu_to_le32(upper_32_bits(addr));
+}
+
+/*
+ * Describe the whole buffer of a transfer in the descriptor table, so that
+ * the controller moves it without stopping at SDMA buffer boundaries
+ */
+static void sdhci_prepare_adma_table(struct sdhci_host *host)
+{
+	dma_addr_t addr = host->start_addr;
+	int left = host->trans_bytes;
+	int i, len;
+
+	for (i = 0; left; i++) {
+		len = min(left, SDHCI_ADMA_MAX_LEN);
+		left -= len;
+		sdhci_adma_write_desc(host, i, addr, len, !left);
+		addr += len;
+	}
+	flush_cache((unsigned long)host->adma_table,
+		    ALIGN(SDHCI_ADMA_TABLE_SZ, CONFIG_SYS_CACHELINE_SIZE));
+
+	sdhci_writel(host, lower_32_bits((dma_addr_t)(unsigned long)
+					 host->adma_table),
+		     SDHCI_ADMA_ADDRESS);
+	if (host->adma_64)
+		sdhci_writel(host, upper_32_bits((dma_addr_t)(unsigned long)
+						 host->adma_table),
+			     SDHCI_ADMA_ADDRESS_HI);
+}
+#endif
+
+/* Get ready to move the data of a command whose response is in */
+static void sdhci_start_data(struct sdhci_host *host)
+{
+	host->xfer_block = 0;
+	host->xfer_done = false;
+	host->xfer_start = get_timer(0);
+}
+
+/*
+ * Move the data along as far as the controller lets us, returning -EBUSY
+ * until the whole transfer is complete
+ */
+static int sdhci_data_step(struct sdhci_host *host, struct mmc_data *data)
+{
+	unsigned int stat, rdy, mask;
+
 	rdy = SDHCI_INT_SPACE_AVAIL | SDHCI_INT_DATA_AVAIL;
 	mask = SDHCI_DATA_AVAILABLE | SDHCI_SPACE_AVAILABLE;
-	do {
-		stat = sdhci_readl(host, SDHCI_INT_STATUS);
-		if (stat & SDHCI_INT_ERROR) {
-			pr_debug("%s: Error detected in status(0x%X)!\n",
-				 __func__, stat);
-			return -EIO;
-		}
-		if (!transfer_done && (stat & rdy)) {
-			if (!(sdhci_readl(host, SDHCI_PRESENT_STATE) & mask))
-				continue;
-			sdhci_writel(host, rdy, SDHCI_INT_STATUS);
-			sdhci_transfer_pio(host, data);
-			data->dest += data->blocksize;
-			if (++block >= data->blocks) {
-				/* Keep looping until the SDHCI_INT_DATA_END is
-				 * cleared, even if we finished sending all the
-				 * blocks.
-				 */
-				transfer_done = true;
-				continue;
-			}
-		}
+	stat = sdhci_readl(host, SDHCI_INT_STATUS);
+	if (stat & SDHCI_INT_ERROR) {
+		pr_debug("%s: Error detected in status(0x%X)!\n",
+			 __func__, stat);
+		if (stat & SDHCI_INT_ADMA_ERROR)
+			pr_debug("%s: ADMA error status 0x%x\n", __func__,
+				 sdhci_readb(host, SDHCI_ADMA_ERROR));
+		return -EIO;
+	}
+	if (!host->xfer_done && (stat & rdy) &&
+	    (sdhci_readl(host, SDHCI_PRESENT_STATE) & mask)) {
+		sdhci_writel(host, rdy, SDHCI_INT_STATUS);
+		sdhci_transfer_pio(host, data);
+		data->dest += data->blocksize;
+		/*
+		 * Keep going until the SDHCI_INT_DATA_END is set, even if we
+		 * finished sending all the blocks.
+		 */
+		if (++host->xfer_block >= data->blocks)
+			host->xfer_done = true;
+	}
 #ifdef CONFIG_MMC_SDHCI_SDMA
-		if (!transfer_done && (stat & SDHCI_INT_DMA_END)) {
-			sdhci_writel(host, SDHCI_INT_DMA_END, SDHCI_INT_STATUS);
-			start_addr &= ~(SDHCI_DEFAULT_BOUNDARY_SIZE - 1);
-			start_addr += SDHCI_DEFAULT_BOUNDARY_SIZE;
-			sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
-		}
+	/* ADMA2 runs to the end of its table without stopping */
+	if (!host->xfer_done && (stat & SDHCI_INT_DMA_END)) {
+		sdhci_writel(host, SDHCI_INT_DMA_END, SDHCI_INT_STATUS);
+		host->start_addr &= ~(SDHCI_DEFAULT_BOUNDARY_SIZE - 1);
+		host->start_addr += SDHCI_DEFAULT_BOUNDARY_SIZE;
+		sdhci_writel(host, host->start_addr, SDHCI_DMA_ADDRESS);
+	}
 #endif
-		if (timeout-- > 0)
-			udelay(10);
-		else {
-			printf("%s: Transfer data timeout\n", __func__);
-			return -ETIMEDOUT;
-		}
-	} while (!(stat & SDHCI_INT_DATA_END));
-	return 0;
+
+	return stat & SDHCI_INT_DATA_END ? 0 : -EBUSY;
 }
 
-/*
- * No command will be sent by driver if card is busy, so driver must wait
- * for card ready state.
- * Every time when card is busy after timeout then (last) timeout value will be
- * increased twice but only if it doesn't exceed global defined maximum.
- * Each function call will use last timeout value.
- */
-#define SDHCI_CMD_MAX_TIMEOUT			3200
-#define SDHCI_CMD_DEFAULT_TIMEOUT		100
-#define SDHCI_READ_STATUS_TIMEOUT		1000
+static bool sdhci_data_timed_out(struct sdhci_host *host)
+{
+	if (get_timer(host->xfer_start) < SDHCI_DATA_TIMEOUT)
+		return false;
+	printf("%s: Transfer data timeout\n", __func__);
 
-#ifdef CONFIG_DM_MMC
-static int sdhci_send_command(struct udevice *dev, struct mmc_cmd *cmd,
-			      struct mmc_data *data)
+	return true;
+}
+
+static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data)
 {
-	struct mmc *mmc = mmc_get_mmc_dev(dev);
+	int ret;
 
-#else
-static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
-			      struct mmc_data *data)
+	while ((ret = sdhci_data_step(host, data)) == -EBUSY) {
+		if (sdhci_data_timed_out(host))
+			return -ETIMEDOUT;
+		udelay(10);
+	}
+
+	return ret;
+}
+
+/* Tidy up after a command, given the result of its data transfer */
+static int sdhci_finish_command(struct sdhci_host *host,
+				struct mmc_data *data, int ret)
+{
+	unsigned int stat;
+
+	if (host->quirks & SDHCI_QUIRK_WAIT_SEND_CMD)
+		udelay(1000);
+
+	stat = sdhci_readl(host, SDHCI_INT_STATUS);
+	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
+	if (!ret) {
+		if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
+		    !host->is_aligned && (data->flags == MMC_DATA_READ))
+			memcpy(data->dest, aligned_buffer, host->trans_bytes);
+		return 0;
+	}
+
+	sdhci_reset(host, SDHCI_RESET_CMD);
+	sdhci_reset(host, SDHCI_RESET_DATA);
+	if (stat & SDHCI_INT_TIMEOUT)
+		return -ETIMEDOUT;
+	else
+		return -ECOMM;
+}
+
+/*
+ * Send a command and wait for its response. This returns 0 when the data
+ * transfer, if any, is left to do, 1 if the command is to be taken as
+ * complete, or -ve on error.
+ */
+static int sdhci_start_command(struct mmc *mmc, struct mmc_cmd *cmd,
+			       struct mmc_data *data)
 {
-#endif
 	struct sdhci_host *host = mmc->priv;
 	unsigned int stat = 0;
-	int ret = 0;
-	int trans_bytes = 0, is_aligned = 1;
 	u32 mask, flags, mode;
-	unsigned int time = 0, start_addr = 0;
+	unsigned int time = 0;
 	int mmc_dev = mmc_get_blk_desc(mmc)->devnum;
 	ulong start = get_timer(0);
+#ifdef CONFIG_MMC_SDHCI_SDMA
+	unsigned long align;
+#endif
 
 	/* Timeout unit - ms */
 	static unsigned int cmd_timeout = SDHCI_CMD_DEFAULT_TIMEOUT;
 
+	host->trans_bytes = 0;
+	host->is_aligned = 1;
+	host->start_addr = 0;
 	mask = SDHCI_CMD_INHIBIT | SDHCI_DATA_INHIBIT;
 
 	/* We shouldn't wait for data inihibit for stop commands, even
@@ -211,7 +321,7 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 	if (data) {
 		sdhci_writeb(host, 0xe, SDHCI_TIMEOUT_CONTROL);
 		mode = SDHCI_TRNS_BLK_CNT_EN;
-		trans_bytes = data->blocks * data->blocksize;
+		host->trans_bytes = data->blocks * data->blocksize;
 		if (data->blocks > 1)
 			mode |= SDHCI_TRNS_MULTI;
 
@@ -220,15 +330,22 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 
 #ifdef CONFIG_MMC_SDHCI_SDMA
 		if (data->flags == MMC_DATA_READ)
-			start_addr = (unsigned long)data->dest;
+			host->start_addr = (unsigned long)data->dest;
 		else
-			start_addr = (unsigned long)data->src;
+			host->start_addr = (unsigned long)data->src;
+		/* ADMA2 only asks for 32-bit alignment, SDMA for 64-bit */
+		align = 0x7;
+#ifdef CONFIG_MMC_SDHCI_ADMA
+		if (host->use_adma)
+			align = 0x3;
+#endif
 		if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
-				(start_addr & 0x7) != 0x0) {
-			is_aligned = 0;
-			start_addr = (unsigned long)aligned_buffer;
+				(host->start_addr & align) != 0x0) {
+			host->is_aligned = 0;
+			host->start_addr = (unsigned long)aligned_buffer;
 			if (data->flags != MMC_DATA_READ)
-				memcpy(aligned_buffer, data->src, trans_bytes);
+				memcpy(aligned_buffer, data->src,
+				       host->trans_bytes);
 		}
 
 #if defined(CONFIG_FIXED_SDHCI_ALIGNED_BUFFER)
@@ -236,13 +353,19 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 		 * Always use this bounce-buffer when
 		 * CONFIG_FIXED_SDHCI_ALIGNED_BUFFER is defined
 		 */
-		is_aligned = 0;
-		start_addr = (unsigned long)aligned_buffer;
+		host->is_aligned = 0;
+		host->start_addr = (unsigned long)aligned_buffer;
 		if (data->flags != MMC_DATA_READ)
-			memcpy(aligned_buffer, data->src, trans_bytes);
+			memcpy(aligned_buffer, data->src, host->trans_bytes);
 #endif
 
-		sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
+#ifdef CONFIG_MMC_SDHCI_ADMA
+		if (host->use_adma)
+			sdhci_prepare_adma_table(host);
+		else
+#endif
+			sdhci_writel(host, host->start_addr, SDHCI_DMA_ADDRESS);
+		sdhci_set_dma_select(host);
 		mode |= SDHCI_TRNS_DMA;
 #endif
 		sdhci_writew(host, SDHCI_MAKE_BLKSZ(SDHCI_DEFAULT_BOUNDARY_ARG,
@@ -257,8 +380,10 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 	sdhci_writel(host, cmd->cmdarg, SDHCI_ARGUMENT);
 #ifdef CONFIG_MMC_SDHCI_SDMA
 	if (data) {
-		trans_bytes = ALIGN(trans_bytes, CONFIG_SYS_CACHELINE_SIZE);
-		flush_cache(start_addr, trans_bytes);
+		host->trans_bytes = ALIGN(host->trans_bytes,
+					  CONFIG_SYS_CACHELINE_SIZE);
+		flush_cache((unsigned long)host->start_addr,
+			    host->trans_bytes);
 	}
 #endif
 	sdhci_writew(host, SDHCI_MAKE_CMD(cmd->cmdidx, flags), SDHCI_COMMAND);
@@ -270,7 +395,7 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 
 		if (get_timer(start) >= SDHCI_READ_STATUS_TIMEOUT) {
 			if (host->quirks & SDHCI_QUIRK_BROKEN_R1B) {
-				return 0;
+				return 1;
 			} else {
 				printf("%s: Timeout for status update!\n",
 				       __func__);
@@ -279,34 +404,73 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 		}
 	} while ((stat & mask) != mask);
 
-	if ((stat & (SDHCI_INT_ERROR | mask)) == mask) {
-		sdhci_cmd_done(host, cmd);
-		sdhci_writel(host, mask, SDHCI_INT_STATUS);
-	} else
-		ret = -1;
+	if ((stat & (SDHCI_INT_ERROR | mask)) != mask)
+		return sdhci_finish_command(host, data, -1);
 
-	if (!ret && data)
-		ret = sdhci_transfer_data(host, data, start_addr);
+	sdhci_cmd_done(host, cmd);
+	sdhci_writel(host, mask, SDHCI_INT_STATUS);
+	if (data)
+		sdhci_start_data(host);
 
-	if (host->quirks & SDHCI_QUIRK_WAIT_SEND_CMD)
-		udelay(1000);
+	return 0;
+}
 
-	stat = sdhci_readl(host, SDHCI_INT_STATUS);
-	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
-	if (!ret) {
-		if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
-				!is_aligned && (data->flags == MMC_DATA_READ))
-			memcpy(data->dest, aligned_buffer, trans_bytes);
-		return 0;
+#ifdef CONFIG_DM_MMC
+static int sdhci_send_command(struct udevice *dev, struct mmc_cmd *cmd,
+			      struct mmc_data *data)
+{
+	struct mmc *mmc = mmc_get_mmc_dev(dev);
+
+#else
+static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
+			      struct mmc_data *data)
+{
+#endif
+	struct sdhci_host *host = mmc->priv;
+	int ret;
+
+	ret = sdhci_start_command(mmc, cmd, data);
+	if (ret)
+		return ret > 0 ? 0 : ret;
+
+	if (data)
+		ret = sdhci_transfer_data(host, data);
+
+	return sdhci_finish_command(host, data, ret);
+}
+
+#if defined(CONFIG_DM_MMC) && defined(CONFIG_MMC_SDHCI_SDMA)
+/*
+ * With DMA the controller moves the data by itself, so the caller can get
+ * on with something else until it is done
+ */
+static int sdhci_send_command_async(struct udevice *dev, struct mmc_cmd *cmd,
+				    struct mmc_data *data)
+{
+	struct mmc *mmc = mmc_get_mmc_dev(dev);
+	int ret;
+
+	ret = sdhci_start_command(mmc, cmd, data);
+
+	return ret > 0 ? -EIO : ret;
+}
+
+static int sdhci_poll_data(struct udevice *dev, struct mmc_data *data)
+{
+	struct mmc *mmc = mmc_get_mmc_dev(dev);
+	struct sdhci_host *host = mmc->priv;
+	int ret;
+
+	ret = sdhci_data_step(host, data);
+	if (ret == -EBUSY) {
+		if (!sdhci_data_timed_out(host))
+			return ret;
+		ret = -ETIMEDOUT;
 	}
 
-	sdhci_reset(host, SDHCI_RESET_CMD);
-	sdhci_reset(host, SDHCI_RESET_DATA);
-	if (stat & SDHCI_INT_TIMEOUT)
-		return -ETIMEDOUT;
-	else
-		return -ECOMM;
+	return sdhci_finish_command(host, data, ret);
 }
+#endif
 
 #if defined(CONFIG_DM_MMC) && defined(MMC_SUPPORTS_TUNING)
 static int sdhci_execute_tuning(struct udevice *dev, uint opcode)
@@ -520,6 +684,17 @@ static int sdhci_init(struct mmc *mmc)
 		}
 	}
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	if (host->use_adma && !host->adma_table) {
+		host->adma_table = memalign(ARCH_DMA_MINALIGN,
+					    SDHCI_ADMA_TABLE_SZ);
+		if (!host->adma_table) {
+			printf("%s: ADMA table alloc failed!!!\n", __func__);
+			return -ENOMEM;
+		}
+	}
+#endif
+
 	sdhci_set_power(host, fls(mmc->cfg->voltages) - 1);
 
 	if (host->ops && host->ops->get_cd)
@@ -548,6 +723,10 @@ const struct dm_mmc_ops sdhci_ops = {
 #ifdef MMC_SUPPORTS_TUNING
 	.execute_tuning	= sdhci_execute_tuning,
 #endif
+#ifdef CONFIG_MMC_SDHCI_SDMA
+	.send_cmd_async	= sdhci_send_command_async,
+	.poll_data	= sdhci_poll_data,
+#endif
 };
 #else
 static const struct mmc_ops sdhci_ops = {
@@ -561,11 +740,20 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 		u32 f_max, u32 f_min)
 {
 	u32 caps, caps_1 = 0;
+	u32 __maybe_unused dma_caps = SDHCI_CAN_DO_SDMA;
 
 	caps = sdhci_readl(host, SDHCI_CAPABILITIES);
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	host->use_adma = !!(caps & SDHCI_CAN_DO_ADMA2);
+	host->adma_64 = host->use_adma && (caps & SDHCI_CAN_64BIT) &&
+			sizeof(dma_addr_t) > 4;
+	if (!host->use_adma)
+		debug("%s: No ADMA2, falling back to SDMA\n", __func__);
+	dma_caps |= SDHCI_CAN_DO_ADMA2;
+#endif
 #ifdef CONFIG_MMC_SDHCI_SDMA
-	if (!(caps & SDHCI_CAN_DO_SDMA)) {
+	if (!(caps & dma_caps)) {
 		printf("%s: Your controller doesn't support SDMA!!\n",
 		       __func__);
 		return -EINVAL;
@@ -629,6 +817,8 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 		cfg->voltages |= host->voltages;
 
 	cfg->host_caps |= MMC_MODE_HS | MMC_MODE_HS_52MHz | MMC_MODE_4BIT;
+	/* Each command is sent by itself, so SET_BLOCK_COUNT just works */
+	cfg->host_caps |= MMC_MODE_CMD23;
 
 	/* Since Host Controller Version3.0 */
 	if (SDHCI_GET_VERSION(host) >= SDHCI_SPEC_300) {
@@ -10,7 +10,9 @@
 #include <dm.h>
 #include <malloc.h>
 #include <net.h>
+#include <net/tcp.h>
 #include <asm/eth.h>
+#include <asm/unaligned.h>
 #include <asm/test.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -252,6 +254,625 @@ int sandbox_eth_recv_ping_req(struct udevice *dev)
 	return 0;
 }
 
+/* TFTP opcodes and ports used by the mock server */
+#define SB_TFTP_RRQ		1
+#define SB_TFTP_WRQ		2
+#define SB_TFTP_DATA		3
+#define SB_TFTP_ACK		4
+#define SB_TFTP_ERROR		5
+#define SB_TFTP_OACK		6
+#define SB_TFTP_SERVER_PORT	69
+#define SB_TFTP_XFER_PORT	2000
+
+/*
+ * sb_udp_inject()
+ *
+ * Queue a UDP packet from a mock server to the client which sent @req. The
+ *	payload is written by the caller to the returned buffer.
+ *
+ * returns pointer to the payload, or NULL if the receive buffer is full
+ */
+static uchar *sb_udp_inject(struct udevice *dev, void *req, int sport,
+			    int dport, unsigned int payload_len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = req;
+	struct ip_udp_hdr *ip = req + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ipr;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return NULL;
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	ipr = (void *)eth_recv + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)ipr, net_read_ip(&ip->ip_src),
+			  net_read_ip(&ip->ip_dst),
+			  IP_UDP_HDR_SIZE + payload_len, IPPROTO_UDP);
+	ipr->udp_src = htons(sport);
+	ipr->udp_dst = htons(dport);
+	ipr->udp_len = htons(UDP_HDR_SIZE + payload_len);
+	ipr->udp_xsum = 0;
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + payload_len;
+	++priv->recv_packets;
+
+	return (uchar *)ipr + IP_UDP_HDR_SIZE;
+}
+
+/*
+ * sb_tftp_send_window()
+ *
+ * Send the window of DATA blocks following block @acked, dropping the block
+ *	selected by the test the first time it comes up
+ */
+static void sb_tftp_send_window(struct udevice *dev, void *req,
+				struct sandbox_eth_tftp *tftp, ulong acked)
+{
+	ulong last = tftp->size / tftp->blksize + 1;
+	ulong block;
+	int i;
+
+	for (i = 0, block = acked + 1; i < tftp->window && block <= last;
+	     i++, block++) {
+		ulong offset = (block - 1) * tftp->blksize;
+		unsigned int len = min(tftp->size - offset,
+				       (ulong)tftp->blksize);
+		uchar *pkt;
+
+		if (block == tftp->drop_block && !tftp->dropped) {
+			tftp->dropped++;
+			continue;
+		}
+
+		pkt = sb_udp_inject(dev, req, SB_TFTP_XFER_PORT,
+				    tftp->client_port, 4 + len);
+		if (!pkt)
+			return;
+		put_unaligned_be16(SB_TFTP_DATA, pkt);
+		put_unaligned_be16(block, pkt + 2);
+		memcpy(pkt + 4, tftp->data + offset, len);
+		tftp->blocks++;
+	}
+}
+
+/*
+ * sb_tftp_find()
+ *
+ * Find the file being served to client port @port. A read request from a
+ *	new port takes the first file not yet handed out, or else the first
+ */
+static struct sandbox_eth_tftp *sb_tftp_find(struct sandbox_eth_tftp *head,
+					     int port, bool request)
+{
+	struct sandbox_eth_tftp *tftp;
+
+	for (tftp = head; tftp; tftp = tftp->next) {
+		if (tftp->client_port == port)
+			return tftp;
+	}
+	for (tftp = head; request && tftp; tftp = tftp->next) {
+		if (!tftp->client_port)
+			return tftp;
+	}
+
+	return head;
+}
+
+/*
+ * sandbox_eth_tftp_req_to_reply()
+ *
+ * Check for a TFTP request, ACK or DATA block to be sent. If so, inject the
+ *	OACK, next window of DATA blocks or ACK from the mock server in
+ *	priv->priv
+ *
+ * returns 0 if handled, -EAGAIN if not
+ */
+int sandbox_eth_tftp_req_to_reply(struct udevice *dev, void *packet,
+				  unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sandbox_eth_tftp *tftp = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip;
+	uchar *pkt, *end;
+	ulong acked;
+
+	if (ntohs(eth->et_protlen) != PROT_IP)
+		return -EAGAIN;
+
+	ip = packet + ETHER_HDR_SIZE;
+	if (ip->ip_p != IPPROTO_UDP)
+		return -EAGAIN;
+
+	pkt = (uchar *)ip + IP_UDP_HDR_SIZE;
+	end = (uchar *)ip + IP_HDR_SIZE + ntohs(ip->udp_len);
+
+	switch (get_unaligned_be16(pkt)) {
+	case SB_TFTP_RRQ:
+	case SB_TFTP_WRQ: {
+		char oack[64];
+		int oack_len;
+		uchar *opt;
+
+		if (ntohs(ip->udp_dst) != SB_TFTP_SERVER_PORT)
+			return -EAGAIN;
+
+		/* As for NFS, only charge a round trip when nothing is queued */
+		tftp->requests++;
+		if (priv->recv_packets + priv->batch_packets <= 1) {
+			tftp->round_trips++;
+			sandbox_timer_add_offset(tftp->latency);
+		}
+
+		if (tftp->name) {
+			const char *name = (char *)pkt + 2;
+
+			while (tftp && strcmp(tftp->name, name))
+				tftp = tftp->next;
+			if (!tftp) {
+				pkt = sb_udp_inject(dev, packet,
+						    SB_TFTP_XFER_PORT,
+						    ntohs(ip->udp_src),
+						    4 + sizeof("File not found"));
+				if (!pkt)
+					return 0;
+				put_unaligned_be16(SB_TFTP_ERROR, pkt);
+				put_unaligned_be16(1, pkt + 2);
+				strcpy((char *)pkt + 4, "File not found");
+				return 0;
+			}
+		} else {
+			tftp = sb_tftp_find(tftp, ntohs(ip->udp_src), true);
+		}
+		tftp->client_port = ntohs(ip->udp_src);
+		tftp->acked = 0;
+		tftp->received = 0;
+		tftp->put_size = 0;
+		tftp->blksize = 512;
+		tftp->window = 1;
+
+		/* Grant the block and window size the client asks for */
+		oack_len = 0;
+		for (opt = pkt + 2; opt < end; opt += strlen((char *)opt) + 1) {
+			char *val = (char *)opt + strlen((char *)opt) + 1;
+
+			if (!strcmp((char *)opt, "blksize")) {
+				tftp->blksize = simple_strtoul(val, NULL, 10);
+				oack_len += sprintf(oack + oack_len,
+						    "blksize%c%s%c", 0, val, 0);
+			} else if (!strcmp((char *)opt, "windowsize") &&
+				   tftp->windowsize) {
+				tftp->window = min(tftp->windowsize,
+					(int)simple_strtoul(val, NULL, 10));
+				oack_len += sprintf(oack + oack_len,
+						    "windowsize%c%d%c", 0,
+						    tftp->window, 0);
+			}
+		}
+
+		pkt = sb_udp_inject(dev, packet, SB_TFTP_XFER_PORT,
+				    tftp->client_port, 2 + oack_len);
+		if (!pkt)
+			return 0;
+		put_unaligned_be16(SB_TFTP_OACK, pkt);
+		memcpy(pkt + 2, oack, oack_len);
+		return 0;
+	}
+	case SB_TFTP_ACK:
+		if (ntohs(ip->udp_dst) != SB_TFTP_XFER_PORT)
+			return -EAGAIN;
+		tftp = sb_tftp_find(tftp, ntohs(ip->udp_src), false);
+		tftp->acks++;
+
+		/* Extend the 16-bit block number from the last ACK seen */
+		acked = tftp->acked +
+			(u16)(get_unaligned_be16(pkt + 2) - tftp->acked);
+		tftp->acked = acked;
+		sb_tftp_send_window(dev, packet, tftp, acked);
+		return 0;
+	case SB_TFTP_DATA: {
+		unsigned int data_len = end - pkt - 4;
+		ulong block, offset;
+
+		if (ntohs(ip->udp_dst) != SB_TFTP_XFER_PORT)
+			return -EAGAIN;
+		tftp = sb_tftp_find(tftp, ntohs(ip->udp_src), false);
+		if (!tftp->put_data)
+			return -EAGAIN;
+		tftp->blocks++;
+
+		/* Only take blocks in order, and ACK at the end of a window */
+		block = tftp->received +
+			(u16)(get_unaligned_be16(pkt + 2) - tftp->received);
+		if (block != tftp->received + 1)
+			return 0;
+		offset = (block - 1) * tftp->blksize;
+		data_len = min(data_len, (unsigned int)(tftp->size - offset));
+		memcpy(tftp->put_data + offset, pkt + 4, data_len);
+		tftp->received = block;
+		tftp->put_size = offset + data_len;
+		if (block - tftp->acked < tftp->window &&
+		    data_len == tftp->blksize)
+			return 0;
+
+		pkt = sb_udp_inject(dev, packet, SB_TFTP_XFER_PORT,
+				    tftp->client_port, 4);
+		if (!pkt)
+			return 0;
+		put_unaligned_be16(SB_TFTP_ACK, pkt);
+		put_unaligned_be16(block, pkt + 2);
+		tftp->acked = block;
+		tftp->acks++;
+		return 0;
+	}
+	}
+
+	return -EAGAIN;
+}
+
+/* Ports and RPC programs of the mock NFSv2 server */
+#define SB_NFS_PORTMAP_PORT	111
+#define SB_NFS_MOUNT_PORT	635
+#define SB_NFS_PORT		2049
+#define SB_RPC_PROG_NFS		100003
+#define SB_RPC_PROG_MOUNT	100005
+#define SB_RPC_MOUNT_ADDENTRY	1
+#define SB_RPC_NFS_LOOKUP	4
+#define SB_RPC_NFS_READ		6
+/* Words of an RPC call before the arguments, and of the credentials */
+#define SB_RPC_CALL_HDR		6
+#define SB_RPC_CRED		9
+#define SB_RPC_REPLY_HDR	6
+#define SB_NFS_FHSIZE		32
+#define SB_NFS_FATTR		17
+
+/*
+ * sb_nfs_reply()
+ *
+ * Queue an accepted RPC reply to the call in @req, with @words of results
+ *	followed by @len bytes of @data
+ */
+static void sb_nfs_reply(struct udevice *dev, void *req, const u32 *words,
+			 int nwords, const uchar *data, int len)
+{
+	struct ip_udp_hdr *ip = req + ETHER_HDR_SIZE;
+	uchar *call = (uchar *)ip + IP_UDP_HDR_SIZE;
+	int payload_len = (SB_RPC_REPLY_HDR + nwords) * 4 + ALIGN(len, 4);
+	uchar *pkt;
+	int i;
+
+	pkt = sb_udp_inject(dev, req, ntohs(ip->udp_dst), ntohs(ip->udp_src),
+			    payload_len);
+	if (!pkt)
+		return;
+	memset(pkt, '\0', payload_len);
+	memcpy(pkt, call, 4);			/* XID */
+	put_unaligned_be32(1, pkt + 4);		/* MSG_REPLY */
+	for (i = 0; i < nwords; i++)
+		put_unaligned_be32(words[i], pkt + (SB_RPC_REPLY_HDR + i) * 4);
+	memcpy(pkt + (SB_RPC_REPLY_HDR + nwords) * 4, data, len);
+}
+
+/*
+ * sandbox_eth_nfs_req_to_reply()
+ *
+ * Check for a portmap, mount or NFSv2 call to be sent. If so, inject the
+ *	reply of the mock server in priv->priv
+ *
+ * returns 0 if handled, -EAGAIN if not
+ */
+int sandbox_eth_nfs_req_to_reply(struct udevice *dev, void *packet,
+				 unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sandbox_eth_nfs *nfs = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip;
+	u32 words[SB_NFS_FATTR + 2];
+	ulong offset, count;
+	uchar *call;
+
+	if (ntohs(eth->et_protlen) != PROT_IP)
+		return -EAGAIN;
+
+	ip = packet + ETHER_HDR_SIZE;
+	if (ip->ip_p != IPPROTO_UDP)
+		return -EAGAIN;
+
+	call = (uchar *)ip + IP_UDP_HDR_SIZE;
+	memset(words, '\0', sizeof(words));
+
+	switch (ntohs(ip->udp_dst)) {
+	case SB_NFS_PORTMAP_PORT:
+		/* GETPORT: prog follows the empty credential and verifier */
+		if (get_unaligned_be32(call + (SB_RPC_CALL_HDR + 4) * 4) ==
+		    SB_RPC_PROG_MOUNT)
+			words[0] = SB_NFS_MOUNT_PORT;
+		else
+			words[0] = SB_NFS_PORT;
+		sb_nfs_reply(dev, packet, words, 1, NULL, 0);
+		return 0;
+	case SB_NFS_MOUNT_PORT:
+		/* Any export mounts, with an all-zero handle */
+		if (get_unaligned_be32(call + 5 * 4) == SB_RPC_MOUNT_ADDENTRY)
+			sb_nfs_reply(dev, packet, words,
+				     1 + SB_NFS_FHSIZE / 4, NULL, 0);
+		else
+			sb_nfs_reply(dev, packet, words, 0, NULL, 0);
+		return 0;
+	case SB_NFS_PORT:
+		break;
+	default:
+		return -EAGAIN;
+	}
+
+	switch (get_unaligned_be32(call + 5 * 4)) {
+	case SB_RPC_NFS_LOOKUP:
+		/* Any name is the file */
+		sb_nfs_reply(dev, packet, words, 1 + SB_NFS_FHSIZE / 4,
+			     NULL, 0);
+		return 0;
+	case SB_RPC_NFS_READ:
+		break;
+	default:
+		return -EAGAIN;
+	}
+
+	nfs->reads++;
+	if (nfs->reads == nfs->drop_read) {
+		nfs->dropped++;
+		/* make the client give up waiting for this one */
+		skip_timeout = true;
+		return 0;
+	}
+
+	/*
+	 * A reply still queued, or not yet processed, means the client sent
+	 * this request without waiting for it: only charge a round trip when
+	 * nothing is in flight
+	 */
+	if (priv->recv_packets + priv->batch_packets <= 1) {
+		nfs->round_trips++;
+		sandbox_timer_add_offset(nfs->latency);
+	}
+
+	call += (SB_RPC_CALL_HDR + SB_RPC_CRED + SB_NFS_FHSIZE / 4) * 4;
+	offset = min(nfs->size, (ulong)get_unaligned_be32(call));
+	count = min(nfs->size - offset, (ulong)get_unaligned_be32(call + 4));
+	words[SB_NFS_FATTR + 1] = count;
+	sb_nfs_reply(dev, packet, words, SB_NFS_FATTR + 2,
+		     nfs->data + offset, count);
+
+	return 0;
+}
+
+#ifdef CONFIG_PROT_TCP
+#define SB_TCP_MSS		1460
+#define SB_TCP_ISS		0x12345678
+#define SB_TCP_WINDOW		8192
+
+/*
+ * sb_tcp_inject()
+ *
+ * Queue a TCP segment from the mock server to the client which sent @req,
+ *	carrying @len bytes of @data. A SYN also carries the MSS and, if the
+ *	client asked for it, a window scale option.
+ *
+ * returns 0 if queued, -ENOSPC if the receive buffer is full
+ */
+static int sb_tcp_inject(struct udevice *dev, void *req, u8 flags, u32 seq,
+			 const uchar *data, unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sandbox_eth_tcp *tcp = priv->priv;
+	struct ethernet_hdr *eth = req;
+	struct ip_udp_hdr *ip = req + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ipr;
+	struct tcp_hdr *th;
+	int hlen = TCP_HDR_SIZE;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -ENOSPC;
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	ipr = (void *)eth_recv + ETHER_HDR_SIZE;
+	th = (void *)ipr + IP_HDR_SIZE;
+	if (flags & TCP_SYN) {
+		uchar *opt = (uchar *)(th + 1);
+
+		opt[0] = TCP_OPT_MSS;
+		opt[1] = 4;
+		put_unaligned_be16(SB_TCP_MSS, opt + 2);
+		opt[4] = TCP_OPT_NOP;
+		if (tcp->client_wscale >= 0) {
+			opt[5] = TCP_OPT_WS;
+			opt[6] = 3;
+			opt[7] = 0;
+		} else {
+			memset(opt + 5, TCP_OPT_NOP, 3);
+		}
+		hlen += TCP_SYN_OPT_SIZE;
+	}
+	memcpy((uchar *)th + hlen, data, len);
+
+	net_set_ip_header((uchar *)ipr, net_read_ip(&ip->ip_src),
+			  net_read_ip(&ip->ip_dst), IP_HDR_SIZE + hlen + len,
+			  IPPROTO_TCP);
+	th->tcp_src = htons(tcp->port);
+	th->tcp_dst = htons(tcp->client_port);
+	th->tcp_seq = htonl(seq);
+	th->tcp_ack = htonl(tcp->rcv_nxt);
+	th->tcp_hlen = hlen / 4 << 4;
+	th->tcp_flags = flags | TCP_ACK;
+	th->tcp_win = htons(SB_TCP_WINDOW);
+	th->tcp_xsum = 0;
+	th->tcp_urg = 0;
+	th->tcp_xsum = tcp_checksum(net_read_ip(&ip->ip_dst),
+				    net_read_ip(&ip->ip_src), th, hlen + len);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_HDR_SIZE + hlen + len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+/*
+ * sb_tcp_send_data()
+ *
+ * Send as much of the data, then the FIN, as the client window and the
+ *	receive buffer allow, dropping the segment selected by the test the
+ *	first time it comes up
+ *
+ * returns true if anything was sent
+ */
+static bool sb_tcp_send_data(struct udevice *dev, void *req)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sandbox_eth_tcp *tcp = priv->priv;
+	u32 end = SB_TCP_ISS + 1 + tcp->size;
+	bool sent = false;
+	u32 len;
+
+	while ((s32)(end - tcp->snd_nxt) > 0) {
+		len = min(end - tcp->snd_nxt, (u32)SB_TCP_MSS);
+		if ((s32)(tcp->snd_una + tcp->client_wnd -
+			  (tcp->snd_nxt + len)) < 0)
+			return sent;
+		if (++tcp->segs == tcp->drop_seg && !tcp->dropped) {
+			tcp->dropped++;
+		} else if (sb_tcp_inject(dev, req, TCP_PUSH, tcp->snd_nxt,
+					 tcp->data + tcp->snd_nxt -
+					 (SB_TCP_ISS + 1), len)) {
+			tcp->segs--;
+			return sent;
+		}
+		tcp->snd_nxt += len;
+		sent = true;
+	}
+
+	if (tcp->snd_nxt == end &&
+	    !sb_tcp_inject(dev, req, TCP_FIN, tcp->snd_nxt, NULL, 0)) {
+		tcp->snd_nxt++;
+		sent = true;
+	}
+
+	return sent;
+}
+
+/*
+ * sandbox_eth_tcp_req_to_reply()
+ *
+ * Check for a TCP segment to the mock server in priv->priv. If so, inject
+ *	its answer: data once the whole request is in, with a go-back-N resend
+ *	after three duplicate ACKs
+ *
+ * returns 0 if handled, -EAGAIN if not
+ */
+int sandbox_eth_tcp_req_to_reply(struct udevice *dev, void *packet,
+				 unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sandbox_eth_tcp *tcp = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip;
+	struct tcp_hdr *th;
+	int hlen, dlen, n;
+	u32 seq, ack;
+	uchar *opt;
+	u8 flags;
+
+	if (ntohs(eth->et_protlen) != PROT_IP)
+		return -EAGAIN;
+
+	ip = packet + ETHER_HDR_SIZE;
+	if (ip->ip_p != IPPROTO_TCP)
+		return -EAGAIN;
+	th = (void *)ip + IP_HDR_SIZE;
+	if (ntohs(th->tcp_dst) != tcp->port)
+		return -EAGAIN;
+
+	hlen = (th->tcp_hlen >> 4) * 4;
+	dlen = ntohs(ip->ip_len) - IP_HDR_SIZE - hlen;
+	flags = th->tcp_flags;
+	seq = ntohl(th->tcp_seq);
+	ack = ntohl(th->tcp_ack);
+
+	if (flags & TCP_RST)
+		return 0;
+
+	if (flags & TCP_SYN) {
+		tcp->client_port = ntohs(th->tcp_src);
+		tcp->client_wscale = -1;
+		for (opt = (uchar *)(th + 1); opt < (uchar *)th + hlen;
+		     opt += opt[0] == TCP_OPT_NOP ? 1 : opt[1]) {
+			if (opt[0] == TCP_OPT_END)
+				break;
+			if (opt[0] == TCP_OPT_WS)
+				tcp->client_wscale = opt[2];
+		}
+		tcp->client_wnd = ntohs(th->tcp_win);
+		tcp->snd_una = SB_TCP_ISS + 1;
+		tcp->snd_nxt = SB_TCP_ISS + 1;
+		tcp->rcv_nxt = seq + 1;
+		tcp->request[0] = '\0';
+		tcp->request_len = 0;
+		tcp->dupacks = 0;
+		sb_tcp_inject(dev, packet, TCP_SYN, SB_TCP_ISS, NULL, 0);
+		return 0;
+	}
+	if (!(flags & TCP_ACK) || ntohs(th->tcp_src) != tcp->client_port)
+		return 0;
+
+	tcp->client_wnd = ntohs(th->tcp_win) << max(tcp->client_wscale, 0);
+	if (dlen && seq == tcp->rcv_nxt) {
+		n = min(dlen, (int)sizeof(tcp->request) - 1 -
+			tcp->request_len);
+		memcpy(tcp->request + tcp->request_len, (uchar *)th + hlen, n);
+		tcp->request_len += n;
+		tcp->request[tcp->request_len] = '\0';
+		tcp->rcv_nxt += dlen;
+	}
+	if ((flags & TCP_FIN) && seq + dlen == tcp->rcv_nxt)
+		tcp->rcv_nxt++;
+
+	if ((s32)(ack - tcp->snd_una) > 0) {
+		tcp->snd_una = ack;
+		tcp->dupacks = 0;
+		tcp->acks++;
+	} else if (ack == tcp->snd_una && tcp->snd_una != tcp->snd_nxt &&
+		   !dlen && !(flags & TCP_FIN)) {
+		if (++tcp->dupacks == 3) {
+			tcp->snd_nxt = tcp->snd_una;
+			tcp->retransmits++;
+		}
+	}
+
+	if (strstr(tcp->request, "\r\n\r\n") &&
+	    sb_tcp_send_data(dev, packet))
+		return 0;
+
+	/* Acknowledge the request, or the FIN, when there is nothing to send */
+	if (dlen || (flags & TCP_FIN))
+		sb_tcp_inject(dev, packet, 0, tcp->snd_nxt, NULL, 0);
+
+	return 0;
+}
+#endif
+
 /*
  * sb_default_handler()
  *
@@ -325,6 +946,7 @@ static int sb_eth_start(struct udevice *dev)
 	debug("eth_sandbox: Start\n");
 
 	priv->recv_packets = 0;
+	priv->batch_packets = 0;
 	for (int i = 0; i < PKTBUFSRX; i++) {
 		priv->recv_packet_buffer[i] = net_rx_packets[i];
 		priv->recv_packet_length[i] = 0;
@@ -345,6 +967,23 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 	return priv->tx_handler(dev, packet, length);
 }
 
+/* Drop the @count oldest packets from the receive queue */
+static void sb_eth_dequeue(struct eth_sandbox_priv *priv, int count)
+{
+	int i;
+
+	priv->recv_packets -= count;
+	for (i = 0; i < priv->recv_packets; i++) {
+		priv->recv_packet_length[i] =
+			priv->recv_packet_length[i + count];
+		memcpy(priv->recv_packet_buffer[i],
+		       priv->recv_packet_buffer[i + count],
+		       priv->recv_packet_length[i]);
+	}
+	for (; i < priv->recv_packets + count; i++)
+		priv->recv_packet_length[i] = 0;
+}
+
 static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
@@ -365,22 +1004,50 @@ static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 	return 0;
 }
 
+static int sb_eth_recv_batch(struct udevice *dev, int flags, uchar **packets,
+			     int *lengths, int budget)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int i, n;
+
+	if (skip_timeout) {
+		sandbox_timer_add_offset(11000UL);
+		skip_timeout = false;
+	}
+
+	/*
+	 * Like a DMA ring handing its buffers over, move the packets out of
+	 * the queue, which the mock servers can then fill again with replies
+	 */
+	n = min(budget, priv->recv_packets);
+	for (i = 0; i < n; i++) {
+		lengths[i] = priv->recv_packet_length[i];
+		memcpy(priv->batch_buffer[i], priv->recv_packet_buffer[i],
+		       lengths[i]);
+		packets[i] = priv->batch_buffer[i];
+	}
+	sb_eth_dequeue(priv, n);
+	priv->batch_packets = n;
+	debug("eth_sandbox: received %d packets, %d waiting\n", n,
+	      priv->recv_packets);
+
+	return n;
+}
+
 static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
-	int i;
 
+	/* A batch was already taken off the queue */
+	if (packet >= priv->batch_buffer[0] &&
+	    packet < priv->batch_buffer[PKTBUFSRX]) {
+		priv->batch_packets--;
+		return 0;
+	}
 	if (!priv->recv_packets)
 		return 0;
 
-	--priv->recv_packets;
-	for (i = 0; i < priv->recv_packets; i++) {
-		priv->recv_packet_length[i] = priv->recv_packet_length[i + 1];
-		memcpy(priv->recv_packet_buffer[i],
-		       priv->recv_packet_buffer[i + 1],
-		       priv->recv_packet_length[i + 1]);
-	}
-	priv->recv_packet_length[priv->recv_packets] = 0;
+	sb_eth_dequeue(priv, 1);
 
 	return 0;
 }
@@ -403,6 +1070,7 @@ static const struct eth_ops sb_eth_ops = {
 	.start			= sb_eth_start,
 	.send			= sb_eth_send,
 	.recv			= sb_eth_recv,
+	.recv_batch		= sb_eth_recv_batch,
 	.free_pkt		= sb_eth_free_pkt,
 	.stop			= sb_eth_stop,
 	.write_hwaddr		= sb_eth_write_hwaddr,
@@ -10,15 +10,15 @@
 #include <memalign.h>
 #include <pci.h>
 #include <dm/device-internal.h>
+#include <linux/log2.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
+#define NVME_Q_DEPTH		16
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
 #define ADMIN_TIMEOUT		60
 #define IO_TIMEOUT		30
-#define MAX_PRP_POOL		512
 
 enum nvme_queue_id {
 	NVME_ADMIN_Q,
@@ -26,27 +26,6 @@ enum nvme_queue_id {
 	NVME_Q_NUM,
 };
 
-/*
- * An NVM Express queue. Each device has at least two (one for admin
- * commands and one for I/O commands).
- */
-struct nvme_queue {
-	struct nvme_dev *dev;
-	struct nvme_command *sq_cmds;
-	struct nvme_completion *cqes;
-	wait_queue_head_t sq_full;
-	u32 __iomem *q_db;
-	u16 q_depth;
-	s16 cq_vector;
-	u16 sq_head;
-	u16 sq_tail;
-	u16 cq_head;
-	u16 qid;
-	u8 cq_phase;
-	u8 cqe_seen;
-	unsigned long cmdid_data[];
-};
-
 static int nvme_wait_ready(struct nvme_dev *dev, bool enabled)
 {
 	u32 bit = enabled ? NVME_CSTS_RDY : 0;
@@ -65,16 +44,40 @@ static int nvme_wait_ready(struct nvme_dev *dev, bool enabled)
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
-			   int total_len, u64 dma_addr)
+int nvme_init_prp_pool(struct nvme_dev *dev)
+{
+	free(dev->prp_pool);
+	dev->prp_pool = memalign(dev->page_size,
+				 NVME_PRP_LISTS * dev->page_size);
+	if (!dev->prp_pool)
+		return -ENOMEM;
+	dev->prp_free = (1 << NVME_PRP_LISTS) - 1;
+
+	return 0;
+}
+
+static u64 *nvme_prp_list(struct nvme_dev *dev, int list)
+{
+	return dev->prp_pool + list * (dev->page_size >> 3);
+}
+
+static void nvme_free_prp_list(struct nvme_dev *dev, int list)
+{
+	if (list >= 0)
+		dev->prp_free |= 1 << list;
+}
+
+int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2, int *prp_list,
+		    int total_len, u64 dma_addr)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
 	u64 *prp_pool;
 	int length = total_len;
-	int i, nprps;
+	int list, i, nprps;
 	length -= (page_size - offset);
 
+	*prp_list = -1;
 	if (length <= 0) {
 		*prp2 = 0;
 		return 0;
@@ -88,32 +91,25 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 		return 0;
 	}
 
+	/* Transfers are limited so that one list is always enough */
 	nprps = DIV_ROUND_UP(length, page_size);
-
-	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
-		dev->prp_pool = malloc(nprps << 3);
-		if (!dev->prp_pool) {
-			printf("Error: malloc prp_pool fail\n");
-			return -ENOMEM;
-		}
-		dev->prp_entry_num = nprps;
-	}
-
-	prp_pool = dev->prp_pool;
-	i = 0;
-	while (nprps) {
-		if (i == ((page_size >> 3) - 1)) {
-			*(prp_pool + i) = cpu_to_le64((ulong)prp_pool +
-					page_size);
-			i = 0;
-			prp_pool += page_size;
-		}
-		*(prp_pool + i++) = cpu_to_le64(dma_addr);
+	if (nprps > page_size >> 3)
+		return -EINVAL;
+	if (!dev->prp_free)
+		return -EBUSY;
+	list = ffs(dev->prp_free) - 1;
+	dev->prp_free &= ~(1 << list);
+
+	prp_pool = nvme_prp_list(dev, list);
+	for (i = 0; i < nprps; i++) {
+		prp_pool[i] = cpu_to_le64(dma_addr);
 		dma_addr += page_size;
-		nprps--;
 	}
-	*prp2 = (ulong)dev->prp_pool;
+	flush_dcache_range((ulong)prp_pool,
+			   (ulong)prp_pool + roundup(nprps << 3,
+						     ARCH_DMA_MINALIGN));
+	*prp2 = (ulong)prp_pool;
+	*prp_list = list;
 
 	return 0;
 }
@@ -132,7 +128,20 @@ static u16 nvme_read_completion_status(struct nvme_queue *nvmeq, u16 index)
 
 	invalidate_dcache_range(start, stop);
 
-	return le16_to_cpu(readw(&(nvmeq->cqes[index].status)));
+	return le16_to_cpu(nvmeq->cqes[index].status);
+}
+
+/* Move past the completion at the head of the queue */
+static void nvme_advance_cq(struct nvme_queue *nvmeq)
+{
+	u16 head = nvmeq->cq_head;
+
+	if (++head == nvmeq->q_depth) {
+		head = 0;
+		nvmeq->cq_phase = !nvmeq->cq_phase;
+	}
+	writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
+	nvmeq->cq_head = head;
 }
 
 /**
@@ -183,30 +192,77 @@ static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 	if (status) {
 		printf("ERROR: status = %x, phase = %d, head = %d\n",
 		       status, phase, head);
-		status = 0;
-		if (++head == nvmeq->q_depth) {
-			head = 0;
-			phase = !phase;
-		}
-		writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
-		nvmeq->cq_head = head;
-		nvmeq->cq_phase = phase;
+		nvme_advance_cq(nvmeq);
 
 		return -EIO;
 	}
 
 	if (result)
 		*result = le32_to_cpu(readl(&(nvmeq->cqes[head].result)));
+	nvme_advance_cq(nvmeq);
 
-	if (++head == nvmeq->q_depth) {
-		head = 0;
-		phase = !phase;
+	return status;
+}
+
+int nvme_submit_async_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd,
+			  int prp_list, ulong ctx)
+{
+	struct nvme_cmd_info *info;
+	int id;
+
+	/* Keep one entry free so that a full queue is not seen as empty */
+	if (nvmeq->inflight >= nvmeq->q_depth - 1)
+		return -EBUSY;
+	for (id = 0; nvmeq->cmds[id].busy; id++)
+		;
+	info = &nvmeq->cmds[id];
+	info->busy = true;
+	info->prp_list = prp_list;
+	info->ctx = ctx;
+	nvmeq->inflight++;
+
+	cmd->common.command_id = cpu_to_le16(id);
+	nvme_submit_cmd(nvmeq, cmd);
+
+	return 0;
+}
+
+int nvme_reap_cmd(struct nvme_queue *nvmeq, ulong *ctxp, unsigned timeout)
+{
+	struct nvme_cmd_info *info;
+	ulong timeout_us = timeout * 100000;
+	ulong start_time;
+	u16 status, id;
+
+	start_time = timer_get_us();
+	for (;;) {
+		status = nvme_read_completion_status(nvmeq, nvmeq->cq_head);
+		if ((status & 0x01) == nvmeq->cq_phase)
+			break;
+		if (timeout_us > 0 && (timer_get_us() - start_time)
+		    >= timeout_us)
+			return -ETIMEDOUT;
 	}
-	writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
-	nvmeq->cq_head = head;
-	nvmeq->cq_phase = phase;
 
-	return status;
+	id = le16_to_cpu(nvmeq->cqes[nvmeq->cq_head].command_id);
+	nvme_advance_cq(nvmeq);
+	if (id >= nvmeq->q_depth || !nvmeq->cmds[id].busy) {
+		printf("ERROR: completion for unknown command %d\n", id);
+		return -EPROTO;
+	}
+	info = &nvmeq->cmds[id];
+	info->busy = false;
+	nvme_free_prp_list(nvmeq->dev, info->prp_list);
+	nvmeq->inflight--;
+	*ctxp = info->ctx;
+
+	status >>= 1;
+	if (status) {
+		printf("ERROR: status = %x, command = %d\n", status, id);
+		return -EIO;
+	}
+
+	return 0;
 }
 
 static int nvme_submit_admin_cmd(struct nvme_dev *dev, struct nvme_command *cmd,
@@ -216,13 +272,14 @@ static int nvme_submit_admin_cmd(struct nvme_dev *dev, struct nvme_command *cmd,
 				    result, ADMIN_TIMEOUT);
 }
 
-static struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev,
-					   int qid, int depth)
+struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev, int qid, int depth)
 {
-	struct nvme_queue *nvmeq = malloc(sizeof(*nvmeq));
+	int size = sizeof(struct nvme_queue) +
+		   depth * sizeof(struct nvme_cmd_info);
+	struct nvme_queue *nvmeq = malloc(size);
 	if (!nvmeq)
 		return NULL;
-	memset(nvmeq, 0, sizeof(*nvmeq));
+	memset(nvmeq, 0, size);
 
 	nvmeq->cqes = (void *)memalign(4096, NVME_CQ_SIZE(depth));
 	if (!nvmeq->cqes)
@@ -293,7 +350,7 @@ static int nvme_disable_ctrl(struct nvme_dev *dev)
 	return nvme_wait_ready(dev, false);
 }
 
-static void nvme_free_queue(struct nvme_queue *nvmeq)
+void nvme_free_queue(struct nvme_queue *nvmeq)
 {
 	free((void *)nvmeq->cqes);
 	free(nvmeq->sq_cmds);
@@ -319,6 +376,8 @@ static void nvme_init_queue(struct nvme_queue *nvmeq, u16 qid)
 	nvmeq->sq_tail = 0;
 	nvmeq->cq_head = 0;
 	nvmeq->cq_phase = 1;
+	nvmeq->inflight = 0;
+	memset(nvmeq->cmds, '\0', nvmeq->q_depth * sizeof(nvmeq->cmds[0]));
 	nvmeq->q_db = &dev->dbs[qid * 2 * dev->db_stride];
 	memset((void *)nvmeq->cqes, 0, NVME_CQ_SIZE(nvmeq->q_depth));
 	flush_dcache_range((ulong)nvmeq->cqes,
@@ -609,6 +668,9 @@ static int nvme_get_info_from_identify(struct nvme_dev *dev)
 		 */
 		dev->max_transfer_shift = 20;
 	}
+	/* Each command needs at most one PRP list */
+	dev->max_transfer_shift = min_t(u32, dev->max_transfer_shift,
+					2 * ilog2(dev->page_size) - 3);
 
 	return 0;
 }
@@ -673,60 +735,74 @@ static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
 	struct nvme_dev *dev = ns->dev;
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
 	struct nvme_command c;
 	struct blk_desc *desc = dev_get_uclass_platdata(udev);
 	int status;
 	u64 prp2;
 	u64 total_len = blkcnt << desc->log2blksz;
-	u64 temp_len = total_len;
+	int prp_list;
+	ulong failed = blkcnt;
+	ulong offset, start;
 
-	u64 slba = blknr;
-	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
-	u64 total_lbas = blkcnt;
+	lbaint_t next = 0;
+	u16 lbas, max_lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
 
 	if (!read)
 		flush_dcache_range((unsigned long)buffer,
 				   (unsigned long)buffer + total_len);
 
+	memset(&c, '\0', sizeof(c));
 	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
-	c.rw.flags = 0;
 	c.rw.nsid = cpu_to_le32(ns->ns_id);
-	c.rw.control = 0;
-	c.rw.dsmgmt = 0;
-	c.rw.reftag = 0;
-	c.rw.apptag = 0;
-	c.rw.appmask = 0;
-	c.rw.metadata = 0;
-
-	while (total_lbas) {
-		if (total_lbas < lbas) {
-			lbas = (u16)total_lbas;
-			total_lbas = 0;
-		} else {
-			total_lbas -= lbas;
+
+	/*
+	 * Keep the queue full, splitting the transfer into commands which
+	 * the controller can work on together. They may complete in any
+	 * order, so each one carries its offset into the transfer.
+	 */
+	while (next < blkcnt || nvmeq->inflight) {
+		while (next < blkcnt && failed == blkcnt &&
+		       nvmeq->inflight < nvmeq->q_depth - 1) {
+			lbas = min_t(lbaint_t, blkcnt - next, max_lbas);
+			offset = next << ns->lba_shift;
+			status = nvme_setup_prps(dev, &prp2, &prp_list,
+						 lbas << ns->lba_shift,
+						 (ulong)buffer + offset);
+			if (status == -EBUSY && nvmeq->inflight)
+				break;
+			if (status) {
+				failed = next;
+				break;
+			}
+			c.rw.slba = cpu_to_le64(blknr + next);
+			c.rw.length = cpu_to_le16(lbas - 1);
+			c.rw.prp1 = cpu_to_le64((ulong)buffer + offset);
+			c.rw.prp2 = cpu_to_le64(prp2);
+			nvme_submit_async_cmd(nvmeq, &c, prp_list, next);
+			next += lbas;
 		}
+		if (!nvmeq->inflight)
+			break;
 
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, (ulong)buffer))
-			return -EIO;
-		c.rw.slba = cpu_to_le64(slba);
-		slba += lbas;
-		c.rw.length = cpu_to_le16(lbas - 1);
-		c.rw.prp1 = cpu_to_le64((ulong)buffer);
-		c.rw.prp2 = cpu_to_le64(prp2);
-		status = nvme_submit_sync_cmd(dev->queues[NVME_IO_Q],
-				&c, NULL, IO_TIMEOUT);
-		if (status)
+		status = nvme_reap_cmd(nvmeq, &start, IO_TIMEOUT);
+		if (status == -ETIMEDOUT) {
+			/*
+			 * Leave the commands in flight, so that they are still
+			 * matched up if they complete later
+			 */
+			failed = 0;
 			break;
-		temp_len -= (u32)lbas << ns->lba_shift;
-		buffer += lbas << ns->lba_shift;
+		}
+		if (status)
+			failed = min(failed, start);
 	}
 
 	if (read)
 		invalidate_dcache_range((unsigned long)buffer,
 					(unsigned long)buffer + total_len);
 
-	return (total_len - temp_len) >> desc->log2blksz;
+	return failed;
 }
 
 static ulong nvme_blk_read(struct udevice *udev, lbaint_t blknr,
@@ -788,14 +864,6 @@ static int nvme_probe(struct udevice *udev)
 	}
 	memset(ndev->queues, 0, NVME_Q_NUM * sizeof(struct nvme_queue *));
 
-	ndev->prp_pool = malloc(MAX_PRP_POOL);
-	if (!ndev->prp_pool) {
-		ret = -ENOMEM;
-		printf("Error: %s: Out of memory!\n", udev->name);
-		goto free_nvme;
-	}
-	ndev->prp_entry_num = MAX_PRP_POOL >> 3;
-
 	ndev->cap = nvme_readq(&ndev->bar->cap);
 	ndev->q_depth = min_t(int, NVME_CAP_MQES(ndev->cap) + 1, NVME_Q_DEPTH);
 	ndev->db_stride = 1 << NVME_CAP_STRIDE(ndev->cap);
@@ -805,6 +873,12 @@ static int nvme_probe(struct udevice *udev)
 	if (ret)
 		goto free_queue;
 
+	ret = nvme_init_prp_pool(ndev);
+	if (ret) {
+		printf("Error: %s: Out of memory!\n", udev->name);
+		goto free_queue;
+	}
+
 	ret = nvme_setup_io_queues(ndev);
 	if (ret)
 		goto free_queue;
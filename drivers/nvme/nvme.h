@@ -624,11 +624,42 @@ struct nvme_dev {
 	u32 stripe_size;
 	u32 page_size;
 	u8 vwc;
-	u64 *prp_pool;
-	u32 prp_entry_num;
+	u64 *prp_pool;		/* NVME_PRP_LISTS page-sized PRP lists */
+	u32 prp_free;		/* bitmap of the free lists in prp_pool */
 	u32 nn;
 };
 
+/* Number of PRP lists, which limits the large commands in flight */
+#define NVME_PRP_LISTS		8
+
+/* An I/O command in flight, indexed by its command ID */
+struct nvme_cmd_info {
+	bool busy;
+	int prp_list;		/* PRP list used, or -1 if none */
+	ulong ctx;		/* caller's value, returned on completion */
+};
+
+/*
+ * An NVM Express queue. Each device has at least two (one for admin
+ * commands and one for I/O commands).
+ */
+struct nvme_queue {
+	struct nvme_dev *dev;
+	struct nvme_command *sq_cmds;
+	struct nvme_completion *cqes;
+	u32 __iomem *q_db;
+	u16 q_depth;
+	s16 cq_vector;
+	u16 sq_head;
+	u16 sq_tail;
+	u16 cq_head;
+	u16 qid;
+	u8 cq_phase;
+	u8 cqe_seen;
+	u16 inflight;		/* I/O commands submitted but not reaped */
+	struct nvme_cmd_info cmds[];
+};
+
 /*
  * An NVM Express namespace is equivalent to a SCSI LUN.
  * Each namespace is operated as an independent "device".
@@ -644,4 +675,83 @@ struct nvme_ns {
 	u32 mode_select_block_len;
 };
 
+/*
+ * The functions below are used to keep several I/O commands in flight.
+ * They only touch memory and doorbells, so they can be tested without a
+ * controller.
+ */
+
+/**
+ * nvme_alloc_queue() - allocate a submission and completion queue pair
+ *
+ * @dev:	NVMe device
+ * @qid:	queue ID, 0 for the admin queue
+ * @depth:	number of entries in each queue
+ * @return the queue, or NULL if out of memory
+ */
+struct nvme_queue *nvme_alloc_queue(struct nvme_dev *dev, int qid, int depth);
+
+/**
+ * nvme_free_queue() - free a queue allocated by nvme_alloc_queue()
+ *
+ * @nvmeq:	queue to free
+ */
+void nvme_free_queue(struct nvme_queue *nvmeq);
+
+/**
+ * nvme_init_prp_pool() - allocate the PRP lists for a device
+ *
+ * dev->page_size must be set up first.
+ *
+ * @dev:	NVMe device
+ * @return 0 if OK, -ENOMEM if out of memory
+ */
+int nvme_init_prp_pool(struct nvme_dev *dev);
+
+/**
+ * nvme_setup_prps() - set up the PRP entries for a transfer
+ *
+ * A transfer spanning more than two pages needs a PRP list, which is taken
+ * from the device's pool and must be given back when the command completes.
+ *
+ * @dev:	NVMe device
+ * @prp2:	returns the value for the PRP2 field of the command
+ * @prp_list:	returns the PRP list used, or -1 if none
+ * @total_len:	length of the transfer in bytes
+ * @dma_addr:	address of the buffer, which goes in the PRP1 field
+ * @return 0 if OK, -EBUSY if all PRP lists are in use, -EINVAL if the
+ *	transfer does not fit in one PRP list
+ */
+int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2, int *prp_list,
+		    int total_len, u64 dma_addr);
+
+/**
+ * nvme_submit_async_cmd() - submit a command without waiting for it
+ *
+ * The command ID is set to the slot the command occupies until it is
+ * reaped with nvme_reap_cmd().
+ *
+ * @nvmeq:	queue to use
+ * @cmd:	command to send
+ * @prp_list:	PRP list used by the command, or -1 if none
+ * @ctx:	value returned by nvme_reap_cmd() for this command
+ * @return 0 if OK, -EBUSY if the queue is full
+ */
+int nvme_submit_async_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd,
+			  int prp_list, ulong ctx);
+
+/**
+ * nvme_reap_cmd() - wait for the next command on a queue to complete
+ *
+ * Commands may complete in any order. The command's slot and PRP list are
+ * released.
+ *
+ * @nvmeq:	queue to use
+ * @ctxp:	returns the value passed to nvme_submit_async_cmd()
+ * @timeout:	timeout in the same units as nvme_submit_sync_cmd()
+ * @return 0 if the command succeeded, -EIO if it failed, -ETIMEDOUT if
+ *	nothing completed, -EPROTO if the completion was for no known command
+ */
+int nvme_reap_cmd(struct nvme_queue *nvmeq, ulong *ctxp, unsigned timeout);
+
 #endif /* __DRIVER_NVME_H__ */
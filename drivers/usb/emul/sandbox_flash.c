@@ -9,17 +9,29 @@
 #include <os.h>
 #include <scsi.h>
 #include <usb.h>
+#include <asm/test.h>
 
 /*
  * This driver emulates a flash stick using the UFI command specification and
  * the BBB (bulk/bulk/bulk) protocol. It supports only a single logical unit
  * number (LUN 0).
+ *
+ * With the sandbox,uas property the interface also has a USB Attached SCSI
+ * alternate setting. Until the host sets up bulk streams this works as UAS
+ * does without them: each data phase is announced with a ready IU on the
+ * status pipe. With streams there are no ready IUs, and the data and status
+ * of each command must use the stream given by its tag.
  */
 
 enum {
 	SANDBOX_FLASH_EP_OUT		= 1,	/* endpoints */
 	SANDBOX_FLASH_EP_IN		= 2,
+	SANDBOX_FLASH_EP_CMD		= 3,	/* UAS endpoints */
+	SANDBOX_FLASH_EP_STATUS		= 4,
+	SANDBOX_FLASH_EP_DATA_IN	= 5,
+	SANDBOX_FLASH_EP_DATA_OUT	= 6,
 	SANDBOX_FLASH_BLOCK_LEN		= 512,
+	SANDBOX_FLASH_MAX_STREAMS_LOG2	= 4,	/* 16 streams */
 };
 
 enum cmd_phase {
@@ -44,6 +56,9 @@ enum {
  * @transfer_len: Transfer length from CBW header
  * @read_len:	Number of blocks of data left in the current read command
  * @tag:	Tag value from last command
+ * @altsetting:	Selected alternate setting, 1 for UAS
+ * @ready_sent:	true if the UAS ready IU for the data phase has been sent
+ * @streams:	Number of UAS bulk streams set up by the host, 0 for none
  * @fd:		File descriptor of backing file
  * @file_size:	Size of file in bytes
  * @status_buff:	Data buffer for outgoing status
@@ -57,6 +72,9 @@ struct sandbox_flash_priv {
 	int read_len;
 	enum cmd_phase phase;
 	u32 tag;
+	int altsetting;
+	bool ready_sent;
+	int streams;
 	int fd;
 	loff_t file_size;
 	struct umass_bbb_csw status;
@@ -66,6 +84,7 @@ struct sandbox_flash_priv {
 
 struct sandbox_flash_plat {
 	const char *pathname;
+	bool uas;
 	struct usb_string flash_strings[STRINGID_COUNT];
 };
 
@@ -167,12 +186,106 @@ static void *flash_desc_list[] = {
 	NULL,
 };
 
+static struct usb_config_descriptor flash_uas_config0 = {
+	.bLength		= sizeof(flash_uas_config0),
+	.bDescriptorType	= USB_DT_CONFIG,
+
+	/* wTotalLength is set up by usb-emul-uclass */
+	.bNumInterfaces		= 1,
+	.bConfigurationValue	= 0,
+	.iConfiguration		= 0,
+	.bmAttributes		= 1 << 7,
+	.bMaxPower		= 50,
+};
+
+static struct usb_interface_descriptor flash_interface0_uas = {
+	.bLength		= sizeof(flash_interface0_uas),
+	.bDescriptorType	= USB_DT_INTERFACE,
+
+	.bInterfaceNumber	= 0,
+	.bAlternateSetting	= 1,
+	.bNumEndpoints		= 4,
+	.bInterfaceClass	= USB_CLASS_MASS_STORAGE,
+	.bInterfaceSubClass	= US_SC_SCSI,
+	.bInterfaceProtocol	= US_PR_UAS,
+	.iInterface		= 0,
+};
+
+#define FLASH_UAS_ENDPOINT(_name, _addr)				\
+static struct usb_endpoint_descriptor _name = {				\
+	.bLength		= USB_DT_ENDPOINT_SIZE,			\
+	.bDescriptorType	= USB_DT_ENDPOINT,			\
+	.bEndpointAddress	= _addr,				\
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,		\
+	.wMaxPacketSize		= __constant_cpu_to_le16(512),	\
+	.bInterval		= 0,					\
+}
+
+#define FLASH_UAS_PIPE(_name, _id)					\
+static struct usb_pipe_usage_descriptor _name = {			\
+	.bLength		= sizeof(struct usb_pipe_usage_descriptor), \
+	.bDescriptorType	= USB_DT_PIPE_USAGE,			\
+	.bPipeID		= _id,					\
+}
+
+/* All but the command pipe can have streams */
+#define FLASH_UAS_COMP(_name)						\
+static struct usb_ss_ep_comp_descriptor _name = {			\
+	.bLength		= USB_DT_SS_EP_COMP_SIZE,		\
+	.bDescriptorType	= USB_DT_SS_ENDPOINT_COMP,		\
+	.bmAttributes		= SANDBOX_FLASH_MAX_STREAMS_LOG2,	\
+}
+
+FLASH_UAS_ENDPOINT(flash_uas_cmd, SANDBOX_FLASH_EP_CMD);
+FLASH_UAS_PIPE(flash_uas_cmd_pipe, UAS_PIPE_CMD);
+FLASH_UAS_ENDPOINT(flash_uas_status,
+		   SANDBOX_FLASH_EP_STATUS | USB_ENDPOINT_DIR_MASK);
+FLASH_UAS_COMP(flash_uas_status_comp);
+FLASH_UAS_PIPE(flash_uas_status_pipe, UAS_PIPE_STATUS);
+FLASH_UAS_ENDPOINT(flash_uas_data_in,
+		   SANDBOX_FLASH_EP_DATA_IN | USB_ENDPOINT_DIR_MASK);
+FLASH_UAS_COMP(flash_uas_data_in_comp);
+FLASH_UAS_PIPE(flash_uas_data_in_pipe, UAS_PIPE_DATA_IN);
+FLASH_UAS_ENDPOINT(flash_uas_data_out, SANDBOX_FLASH_EP_DATA_OUT);
+FLASH_UAS_COMP(flash_uas_data_out_comp);
+FLASH_UAS_PIPE(flash_uas_data_out_pipe, UAS_PIPE_DATA_OUT);
+
+static void *flash_uas_desc_list[] = {
+	&flash_device_desc,
+	&flash_uas_config0,
+	&flash_interface0,
+	&flash_endpoint0_out,
+	&flash_endpoint1_in,
+	&flash_interface0_uas,
+	&flash_uas_cmd,
+	&flash_uas_cmd_pipe,
+	&flash_uas_status,
+	&flash_uas_status_comp,
+	&flash_uas_status_pipe,
+	&flash_uas_data_in,
+	&flash_uas_data_in_comp,
+	&flash_uas_data_in_pipe,
+	&flash_uas_data_out,
+	&flash_uas_data_out_comp,
+	&flash_uas_data_out_pipe,
+	NULL,
+};
+
 static int sandbox_flash_control(struct udevice *dev, struct usb_device *udev,
 				 unsigned long pipe, void *buff, int len,
 				 struct devrequest *setup)
 {
+	struct sandbox_flash_plat *plat = dev_get_platdata(dev);
 	struct sandbox_flash_priv *priv = dev_get_priv(dev);
 
+	if (pipe == usb_sndctrlpipe(udev, 0) &&
+	    setup->request == USB_REQ_SET_INTERFACE) {
+		if (setup->value > plat->uas)
+			return -EINVAL;
+		priv->altsetting = setup->value;
+		priv->phase = PHASE_START;
+		return 0;
+	}
 	if (pipe == usb_rcvctrlpipe(udev, 0)) {
 		switch (setup->request) {
 		case US_BBB_RESET:
@@ -293,6 +406,107 @@ static int handle_ufi_command(struct sandbox_flash_plat *plat,
 	return 0;
 }
 
+static int sandbox_flash_data_in(struct sandbox_flash_priv *priv, void *buff,
+				 int len)
+{
+	debug("data in, len=%x, alloc_len=%x, priv->read_len=%x\n",
+	      len, priv->alloc_len, priv->read_len);
+	if (priv->read_len) {
+		ulong bytes_read;
+
+		bytes_read = os_read(priv->fd, buff, len);
+		if (bytes_read != len)
+			return -EIO;
+		priv->read_len -= len / SANDBOX_FLASH_BLOCK_LEN;
+		if (!priv->read_len)
+			priv->phase = PHASE_STATUS;
+	} else {
+		if (priv->alloc_len && len > priv->alloc_len)
+			len = priv->alloc_len;
+		memcpy(buff, priv->buff, len);
+		priv->phase = PHASE_STATUS;
+	}
+
+	return len;
+}
+
+static int sandbox_flash_uas_bulk(struct sandbox_flash_plat *plat,
+				  struct sandbox_flash_priv *priv, int ep,
+				  unsigned int stream_id, void *buff, int len)
+{
+	/* With streams, the data and status must be on the command's stream */
+	if ((ep != SANDBOX_FLASH_EP_CMD && priv->streams) ?
+	    stream_id != priv->tag : stream_id != 0) {
+		debug("%s: ep %d on stream %u, tag %u\n", __func__, ep,
+		      stream_id, priv->tag);
+		return -EIO;
+	}
+
+	switch (ep) {
+	case SANDBOX_FLASH_EP_CMD: {
+		struct uas_command_iu *cmd = buff;
+		int ret;
+
+		if (priv->phase != PHASE_START || len != sizeof(*cmd) ||
+		    cmd->iu_id != UAS_IU_COMMAND || cmd->lun[1])
+			break;
+		priv->alloc_len = 0;
+		priv->read_len = 0;
+		priv->buff_used = 0;
+		priv->tag = be16_to_cpu(cmd->tag);
+		ret = handle_ufi_command(plat, priv, cmd->cdb,
+					 sizeof(cmd->cdb));
+		if (ret)
+			return ret;
+
+		/* The IU has no transfer length, so use the command's */
+		priv->transfer_len = priv->read_len ?
+			priv->read_len * SANDBOX_FLASH_BLOCK_LEN :
+			priv->buff_used;
+		priv->phase = priv->transfer_len ? PHASE_DATA : PHASE_STATUS;
+		priv->ready_sent = false;
+		return len;
+	}
+	case SANDBOX_FLASH_EP_STATUS:
+		if (priv->phase == PHASE_DATA && !priv->ready_sent &&
+		    !priv->streams) {
+			struct uas_ready_iu *ready = buff;
+
+			if (len < sizeof(*ready))
+				break;
+			memset(ready, '\0', sizeof(*ready));
+			ready->iu_id = UAS_IU_READ_READY;
+			ready->tag = cpu_to_be16(priv->tag);
+			priv->ready_sent = true;
+			return sizeof(*ready);
+		} else if (priv->phase == PHASE_STATUS) {
+			struct uas_sense_iu *iu = buff;
+
+			if (len < UAS_SENSE_IU_SIZE)
+				break;
+			memset(iu, '\0', UAS_SENSE_IU_SIZE);
+			iu->iu_id = UAS_IU_SENSE;
+			iu->tag = cpu_to_be16(priv->tag);
+			/* CHECK CONDITION, without sense data */
+			if (priv->status.bCSWStatus != CSWSTATUS_GOOD)
+				iu->status = 2;
+			priv->phase = PHASE_START;
+			return UAS_SENSE_IU_SIZE;
+		}
+		break;
+	case SANDBOX_FLASH_EP_DATA_IN:
+		if (priv->phase == PHASE_DATA &&
+		    (priv->ready_sent || priv->streams))
+			return sandbox_flash_data_in(priv, buff, len);
+		break;
+	default:
+		break;
+	}
+	debug("%s: Detected transfer error\n", __func__);
+
+	return -EIO;
+}
+
 static int sandbox_flash_bulk(struct udevice *dev, struct usb_device *udev,
 			      unsigned long pipe, void *buff, int len)
 {
@@ -303,6 +517,8 @@ static int sandbox_flash_bulk(struct udevice *dev, struct usb_device *udev,
 
 	debug("%s: dev=%s, pipe=%lx, ep=%x, len=%x, phase=%d\n", __func__,
 	      dev->name, pipe, ep, len, priv->phase);
+	if (priv->altsetting)
+		return sandbox_flash_uas_bulk(plat, priv, ep, 0, buff, len);
 	switch (ep) {
 	case SANDBOX_FLASH_EP_OUT:
 		switch (priv->phase) {
@@ -330,24 +546,7 @@ static int sandbox_flash_bulk(struct udevice *dev, struct usb_device *udev,
 	case SANDBOX_FLASH_EP_IN:
 		switch (priv->phase) {
 		case PHASE_DATA:
-			debug("data in, len=%x, alloc_len=%x, priv->read_len=%x\n",
-			      len, priv->alloc_len, priv->read_len);
-			if (priv->read_len) {
-				ulong bytes_read;
-
-				bytes_read = os_read(priv->fd, buff, len);
-				if (bytes_read != len)
-					return -EIO;
-				priv->read_len -= len / SANDBOX_FLASH_BLOCK_LEN;
-				if (!priv->read_len)
-					priv->phase = PHASE_STATUS;
-			} else {
-				if (priv->alloc_len && len > priv->alloc_len)
-					len = priv->alloc_len;
-				memcpy(buff, priv->buff, len);
-				priv->phase = PHASE_STATUS;
-			}
-			return len;
+			return sandbox_flash_data_in(priv, buff, len);
 		case PHASE_STATUS:
 			debug("status in, len=%x\n", len);
 			if (len > sizeof(priv->status))
@@ -365,6 +564,43 @@ err:
 	return 0;
 }
 
+static int sandbox_flash_bulk_stream(struct udevice *dev,
+				     struct usb_device *udev,
+				     unsigned long pipe, unsigned int stream_id,
+				     void *buff, int len)
+{
+	struct sandbox_flash_plat *plat = dev_get_platdata(dev);
+	struct sandbox_flash_priv *priv = dev_get_priv(dev);
+
+	debug("%s: dev=%s, pipe=%lx, stream=%u, len=%x, phase=%d\n",
+	      __func__, dev->name, pipe, stream_id, len, priv->phase);
+	if (!priv->altsetting || !stream_id || stream_id > priv->streams)
+		return -EINVAL;
+
+	return sandbox_flash_uas_bulk(plat, priv, usb_pipeendpoint(pipe),
+				      stream_id, buff, len);
+}
+
+static int sandbox_flash_alloc_streams(struct udevice *dev,
+				       struct usb_device *udev,
+				       unsigned long *pipes, int num_pipes,
+				       int num_streams)
+{
+	struct sandbox_flash_plat *plat = dev_get_platdata(dev);
+	struct sandbox_flash_priv *priv = dev_get_priv(dev);
+	int i;
+
+	if (!plat->uas)
+		return -ENOSYS;
+	for (i = 0; i < num_pipes; i++) {
+		if (usb_pipeendpoint(pipes[i]) <= SANDBOX_FLASH_EP_CMD)
+			return -EINVAL;
+	}
+	priv->streams = min(num_streams, 1 << SANDBOX_FLASH_MAX_STREAMS_LOG2);
+
+	return priv->streams;
+}
+
 static int sandbox_flash_ofdata_to_platdata(struct udevice *dev)
 {
 	struct sandbox_flash_plat *plat = dev_get_platdata(dev);
@@ -374,6 +610,20 @@ static int sandbox_flash_ofdata_to_platdata(struct udevice *dev)
 	return 0;
 }
 
+int sandbox_flash_get_altsetting(struct udevice *dev)
+{
+	struct sandbox_flash_priv *priv = dev_get_priv(dev);
+
+	return priv->altsetting;
+}
+
+int sandbox_flash_get_streams(struct udevice *dev)
+{
+	struct sandbox_flash_priv *priv = dev_get_priv(dev);
+
+	return priv->streams;
+}
+
 static int sandbox_flash_bind(struct udevice *dev)
 {
 	struct sandbox_flash_plat *plat = dev_get_platdata(dev);
@@ -387,7 +637,12 @@ static int sandbox_flash_bind(struct udevice *dev)
 	fs[2].id = STRINGID_SERIAL;
 	fs[2].s = dev->name;
 
-	return usb_emul_setup_device(dev, plat->flash_strings, flash_desc_list);
+	/* platdata is not read yet, but the descriptors are needed now */
+	plat->uas = dev_read_bool(dev, "sandbox,uas");
+
+	return usb_emul_setup_device(dev, plat->flash_strings,
+				     plat->uas ? flash_uas_desc_list :
+				     flash_desc_list);
 }
 
 static int sandbox_flash_probe(struct udevice *dev)
@@ -405,6 +660,8 @@ static int sandbox_flash_probe(struct udevice *dev)
 static const struct dm_usb_ops sandbox_usb_flash_ops = {
 	.control	= sandbox_flash_control,
 	.bulk		= sandbox_flash_bulk,
+	.bulk_stream	= sandbox_flash_bulk_stream,
+	.alloc_streams	= sandbox_flash_alloc_streams,
 };
 
 static const struct udevice_id sandbox_usb_flash_ids[] = {
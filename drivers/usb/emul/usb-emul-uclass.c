@@ -244,6 +244,36 @@ int usb_emul_bulk(struct udevice *emul, struct usb_device *udev,
 	return ops->bulk(emul, udev, pipe, buffer, length);
 }
 
+int usb_emul_bulk_stream(struct udevice *emul, struct usb_device *udev,
+			 unsigned long pipe, unsigned int stream_id,
+			 void *buffer, int length)
+{
+	struct dm_usb_ops *ops = usb_get_emul_ops(emul);
+	int ret;
+
+	if (!ops->bulk_stream)
+		return -ENOSYS;
+	debug("%s: dev=%s, stream=%u\n", __func__, emul->name, stream_id);
+	ret = device_probe(emul);
+	if (ret)
+		return ret;
+	return ops->bulk_stream(emul, udev, pipe, stream_id, buffer, length);
+}
+
+int usb_emul_alloc_streams(struct udevice *emul, struct usb_device *udev,
+			   unsigned long *pipes, int num_pipes, int num_streams)
+{
+	struct dm_usb_ops *ops = usb_get_emul_ops(emul);
+	int ret;
+
+	if (!ops->alloc_streams)
+		return -ENOSYS;
+	ret = device_probe(emul);
+	if (ret)
+		return ret;
+	return ops->alloc_streams(emul, udev, pipes, num_pipes, num_streams);
+}
+
 int usb_emul_int(struct udevice *emul, struct usb_device *udev,
 		  unsigned long pipe, void *buffer, int length, int interval)
 {
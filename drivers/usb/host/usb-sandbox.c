@@ -97,6 +97,51 @@ static int sandbox_submit_bulk(struct udevice *bus, struct usb_device *udev,
 	return ret;
 }
 
+static int sandbox_submit_bulk_stream(struct udevice *bus,
+				      struct usb_device *udev,
+				      unsigned long pipe,
+				      unsigned int stream_id, void *buffer,
+				      int length)
+{
+	struct udevice *emul;
+	int ret;
+
+	debug("%s: bus=%s, stream=%u\n", __func__, bus->name, stream_id);
+	ret = usb_emul_find(bus, pipe, udev->portnr, &emul);
+	usbmon_trace(bus, pipe, NULL, emul);
+	if (ret)
+		return ret;
+	ret = usb_emul_bulk_stream(emul, udev, pipe, stream_id, buffer,
+				   length);
+	if (ret < 0) {
+		debug("ret=%d\n", ret);
+		udev->status = ret;
+		udev->act_len = 0;
+	} else {
+		udev->status = 0;
+		udev->act_len = ret;
+	}
+
+	return ret;
+}
+
+static int sandbox_alloc_streams(struct udevice *bus, struct usb_device *udev,
+				 unsigned long *pipes, int num_pipes,
+				 int num_streams)
+{
+	struct udevice *emul;
+	int ret;
+
+	if (!num_pipes)
+		return -EINVAL;
+	ret = usb_emul_find(bus, pipes[0], udev->portnr, &emul);
+	if (ret)
+		return ret;
+
+	return usb_emul_alloc_streams(emul, udev, pipes, num_pipes,
+				      num_streams);
+}
+
 static int sandbox_submit_int(struct udevice *bus, struct usb_device *udev,
 			      unsigned long pipe, void *buffer, int length,
 			      int interval)
@@ -138,8 +183,10 @@ static int sandbox_usb_probe(struct udevice *dev)
 static const struct dm_usb_ops sandbox_usb_ops = {
 	.control	= sandbox_submit_control,
 	.bulk		= sandbox_submit_bulk,
+	.bulk_stream	= sandbox_submit_bulk_stream,
 	.interrupt	= sandbox_submit_int,
 	.alloc_device	= sandbox_alloc_device,
+	.alloc_streams	= sandbox_alloc_streams,
 };
 
 static const struct udevice_id sandbox_usb_ids[] = {
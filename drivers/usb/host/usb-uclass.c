@@ -77,6 +77,18 @@ int submit_bulk_msg(struct usb_device *udev, unsigned long pipe, void *buffer,
 	return ops->bulk(bus, udev, pipe, buffer, length);
 }
 
+int submit_bulk_stream_msg(struct usb_device *udev, unsigned long pipe,
+			   unsigned int stream_id, void *buffer, int length)
+{
+	struct udevice *bus = udev->controller_dev;
+	struct dm_usb_ops *ops = usb_get_ops(bus);
+
+	if (!ops->bulk_stream)
+		return -ENOSYS;
+
+	return ops->bulk_stream(bus, udev, pipe, stream_id, buffer, length);
+}
+
 struct int_queue *create_int_queue(struct usb_device *udev,
 		unsigned long pipe, int queuesize, int elementsize,
 		void *buffer, int interval)
@@ -158,6 +170,18 @@ int usb_get_max_xfer_size(struct usb_device *udev, size_t *size)
 	return ops->get_max_xfer_size(bus, size);
 }
 
+int usb_alloc_streams(struct usb_device *udev, unsigned long *pipes,
+		      int num_pipes, int num_streams)
+{
+	struct udevice *bus = udev->controller_dev;
+	struct dm_usb_ops *ops = usb_get_ops(bus);
+
+	if (!ops->alloc_streams)
+		return -ENOSYS;
+
+	return ops->alloc_streams(bus, udev, pipes, num_pipes, num_streams);
+}
+
 int usb_stop(void)
 {
 	struct udevice *bus;
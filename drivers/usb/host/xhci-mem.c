@@ -125,6 +125,29 @@ static void xhci_free_container_ctx(struct xhci_container_ctx *ctx)
 	free(ctx);
 }
 
+/**
+ * frees the stream context array and stream rings of an endpoint
+ *
+ * @param ep	endpoint set up by xhci_alloc_stream_info()
+ * @return none
+ */
+void xhci_free_stream_info(struct xhci_virt_ep *ep)
+{
+	unsigned int i;
+
+	if (!ep->stream_rings)
+		return;
+
+	for (i = 1; i <= ep->num_streams; i++)
+		xhci_ring_free(ep->stream_rings[i]);
+	free(ep->stream_rings);
+	free(ep->stream_ctx);
+	ep->stream_rings = NULL;
+	ep->stream_ctx = NULL;
+	ep->num_streams = 0;
+	ep->ep_state &= ~EP_HAS_STREAMS;
+}
+
 /**
  * frees the virtual devices for "xhci_ctrl" pointer passed
  *
@@ -148,9 +171,11 @@ static void xhci_free_virt_devices(struct xhci_ctrl *ctrl)
 
 		ctrl->dcbaa->dev_context_ptrs[slot_id] = 0;
 
-		for (i = 0; i < 31; ++i)
+		for (i = 0; i < 31; ++i) {
+			xhci_free_stream_info(&virt_dev->eps[i]);
 			if (virt_dev->eps[i].ring)
 				xhci_ring_free(virt_dev->eps[i].ring);
+		}
 
 		if (virt_dev->in_ctx)
 			xhci_free_container_ctx(virt_dev->in_ctx);
@@ -338,6 +363,51 @@ struct xhci_ring *xhci_ring_alloc(unsigned int num_segs, bool link_trbs)
 	return ring;
 }
 
+/**
+ * Allocates the stream context array of an endpoint and a transfer ring for
+ * each stream, see section 4.12.2. Stream 0 is reserved and the entries past
+ * @num_streams are left unused.
+ *
+ * @param ep		endpoint to set up
+ * @param num_ctxs	entries in the stream context array, a power of 2
+ * @param num_streams	number of streams to give a ring, below @num_ctxs
+ * @return 0 if OK, -ENOMEM if out of memory
+ */
+int xhci_alloc_stream_info(struct xhci_virt_ep *ep, unsigned int num_ctxs,
+			   unsigned int num_streams)
+{
+	size_t size = num_ctxs * sizeof(struct xhci_stream_ctx);
+	struct xhci_ring *ring;
+	unsigned int i;
+	u64 val_64;
+
+	/* Aligning to the size keeps the array within a 64KB boundary */
+	ep->stream_ctx = memalign(max_t(size_t, size, CACHELINE_SIZE),
+				  ALIGN(size, CACHELINE_SIZE));
+	ep->stream_rings = calloc(num_streams + 1, sizeof(struct xhci_ring *));
+	if (!ep->stream_ctx || !ep->stream_rings) {
+		free(ep->stream_ctx);
+		free(ep->stream_rings);
+		ep->stream_ctx = NULL;
+		ep->stream_rings = NULL;
+		return -ENOMEM;
+	}
+	memset(ep->stream_ctx, '\0', size);
+
+	for (i = 1; i <= num_streams; i++) {
+		ring = xhci_ring_alloc(1, true);
+		ep->stream_rings[i] = ring;
+		val_64 = (uintptr_t)ring->first_seg->trbs;
+		ep->stream_ctx[i].stream_ring = cpu_to_le64(val_64 |
+			SCT_FOR_CTX(SCT_PRI_TR) | ring->cycle_state);
+	}
+	xhci_flush_cache((uintptr_t)ep->stream_ctx, size);
+	ep->num_streams = num_streams;
+	ep->ep_state |= EP_HAS_STREAMS;
+
+	return 0;
+}
+
 /**
  * Set up the scratchpad buffer array and scratchpad buffers
  *
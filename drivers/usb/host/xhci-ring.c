@@ -258,18 +258,19 @@ static int prepare_ring(struct xhci_ctrl *ctrl, struct xhci_ring *ep_ring,
 }
 
 /**
- * Generic function for queueing a command TRB on the command ring.
- * Check to make sure there's room on the command ring for one command TRB.
+ * Queues a command TRB with a third field, as needed for the stream ID of
+ * a Set TR Dequeue Pointer command.
  *
  * @param ctrl		Host controller data structure
  * @param ptr		Pointer address to write in the first two fields (opt.)
+ * @param field2	Value of the third field
  * @param slot_id	Slot ID to encode in the flags field (opt.)
  * @param ep_index	Endpoint index to encode in the flags field (opt.)
  * @param cmd		Command type to enqueue
  * @return none
  */
-void xhci_queue_command(struct xhci_ctrl *ctrl, u8 *ptr, u32 slot_id,
-			u32 ep_index, trb_type cmd)
+static void queue_command(struct xhci_ctrl *ctrl, u8 *ptr, u32 field2,
+			  u32 slot_id, u32 ep_index, trb_type cmd)
 {
 	u32 fields[4];
 	u64 val_64 = (uintptr_t)ptr;
@@ -278,7 +279,7 @@ void xhci_queue_command(struct xhci_ctrl *ctrl, u8 *ptr, u32 slot_id,
 
 	fields[0] = lower_32_bits(val_64);
 	fields[1] = upper_32_bits(val_64);
-	fields[2] = 0;
+	fields[2] = field2;
 	fields[3] = TRB_TYPE(cmd) | SLOT_ID_FOR_TRB(slot_id) |
 		    ctrl->cmd_ring->cycle_state;
 
@@ -295,6 +296,23 @@ void xhci_queue_command(struct xhci_ctrl *ctrl, u8 *ptr, u32 slot_id,
 	xhci_writel(&ctrl->dba->doorbell[0], DB_VALUE_HOST);
 }
 
+/**
+ * Generic function for queueing a command TRB on the command ring.
+ * Check to make sure there's room on the command ring for one command TRB.
+ *
+ * @param ctrl		Host controller data structure
+ * @param ptr		Pointer address to write in the first two fields (opt.)
+ * @param slot_id	Slot ID to encode in the flags field (opt.)
+ * @param ep_index	Endpoint index to encode in the flags field (opt.)
+ * @param cmd		Command type to enqueue
+ * @return none
+ */
+void xhci_queue_command(struct xhci_ctrl *ctrl, u8 *ptr, u32 slot_id,
+			u32 ep_index, trb_type cmd)
+{
+	queue_command(ctrl, ptr, 0, slot_id, ep_index, cmd);
+}
+
 /**
  * The TD size is the number of bytes remaining in the TD (including this TRB),
  * right shifted by 10.
@@ -351,12 +369,13 @@ static u32 xhci_v1_0_td_remainder(int running_total,
  *
  * @param udev		pointer to the USB device structure
  * @param ep_index	index of the endpoint
+ * @param stream_id	stream the TRBs are on, 0 if none
  * @param start_cycle	cycle flag of the first TRB
  * @param start_trb	pionter to the first TRB
  * @return none
  */
 static void giveback_first_trb(struct usb_device *udev, int ep_index,
-				int start_cycle,
+				unsigned int stream_id, int start_cycle,
 				struct xhci_generic_trb *start_trb)
 {
 	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
@@ -374,13 +393,26 @@ static void giveback_first_trb(struct usb_device *udev, int ep_index,
 
 	/* Ringing EP doorbell here */
 	xhci_writel(&ctrl->dba->doorbell[udev->slot_id],
-				DB_VALUE(ep_index, 0));
+				DB_VALUE(ep_index, stream_id));
 
 	return;
 }
 
 /**** POLLING mechanism for XHCI ****/
 
+/**
+ * Tells the hardware how far we have got through the event ring, which it
+ * can then reuse. Several events can be handled before doing this once.
+ *
+ * @param ctrl	Host controller data structure
+ * @return none
+ */
+static void xhci_update_erdp(struct xhci_ctrl *ctrl)
+{
+	xhci_writeq(&ctrl->ir_set->erst_dequeue,
+		(uintptr_t)ctrl->event_ring->dequeue | ERST_EHB);
+}
+
 /**
  * Finalizes a handled event TRB by advancing our dequeue pointer and giving
  * the TRB back to the hardware for recycling. Must call this exactly once at
@@ -394,9 +426,7 @@ void xhci_acknowledge_event(struct xhci_ctrl *ctrl)
 	/* Advance our dequeue pointer to the next event */
 	inc_deq(ctrl, ctrl->event_ring);
 
-	/* Inform the hardware */
-	xhci_writeq(&ctrl->ir_set->erst_dequeue,
-		(uintptr_t)ctrl->event_ring->dequeue | ERST_EHB);
+	xhci_update_erdp(ctrl);
 }
 
 /**
@@ -473,6 +503,45 @@ union xhci_trb *xhci_wait_for_event(struct xhci_ctrl *ctrl, trb_type expected)
 	BUG();
 }
 
+/*
+ * Returns the transfer ring of a stream of an endpoint, or the endpoint's
+ * ring if @stream_id is 0. Returns NULL if there is no such stream.
+ */
+static struct xhci_ring *xhci_stream_ring(struct xhci_virt_ep *ep,
+					  unsigned int stream_id)
+{
+	if (!ep->num_streams)
+		return stream_id ? NULL : ep->ring;
+	if (!stream_id || stream_id > ep->num_streams)
+		return NULL;
+
+	return ep->stream_rings[stream_id];
+}
+
+/*
+ * Moves the xHC's dequeue pointer for a stopped endpoint to our enqueue
+ * pointer, throwing away any TRBs it has not processed.
+ */
+static void set_deq_to_enqueue(struct usb_device *udev, int ep_index,
+			       unsigned int stream_id)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	struct xhci_virt_ep *ep = &ctrl->devs[udev->slot_id]->eps[ep_index];
+	struct xhci_ring *ring = xhci_stream_ring(ep, stream_id);
+	uintptr_t deq = (uintptr_t)ring->enqueue | ring->cycle_state;
+	union xhci_trb *event;
+
+	if (stream_id)
+		deq |= SCT_FOR_TRB(SCT_PRI_TR);
+	queue_command(ctrl, (void *)deq, STREAM_ID_FOR_TRB(stream_id),
+		      udev->slot_id, ep_index, TRB_SET_DEQ);
+	event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
+	BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags))
+		!= udev->slot_id || GET_COMP_CODE(le32_to_cpu(
+		event->event_cmd.status)) != COMP_SUCCESS);
+	xhci_acknowledge_event(ctrl);
+}
+
 /*
  * Stops transfer processing for an endpoint and throws away all unprocessed
  * TRBs by setting the xHC's dequeue pointer to our enqueue pointer. The next
@@ -481,10 +550,10 @@ union xhci_trb *xhci_wait_for_event(struct xhci_ctrl *ctrl, trb_type expected)
  * (Careful: This will BUG() when there was no transfer in progress. Shouldn't
  * happen in practice for current uses and is too complicated to fix right now.)
  */
-static void abort_td(struct usb_device *udev, int ep_index)
+static void abort_td(struct usb_device *udev, int ep_index,
+		     unsigned int stream_id)
 {
 	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
-	struct xhci_ring *ring =  ctrl->devs[udev->slot_id]->eps[ep_index].ring;
 	union xhci_trb *event;
 	u32 field;
 
@@ -504,13 +573,62 @@ static void abort_td(struct usb_device *udev, int ep_index)
 		event->event_cmd.status)) != COMP_SUCCESS);
 	xhci_acknowledge_event(ctrl);
 
-	xhci_queue_command(ctrl, (void *)((uintptr_t)ring->enqueue |
-		ring->cycle_state), udev->slot_id, ep_index, TRB_SET_DEQ);
-	event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
-	BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags))
-		!= udev->slot_id || GET_COMP_CODE(le32_to_cpu(
-		event->event_cmd.status)) != COMP_SUCCESS);
-	xhci_acknowledge_event(ctrl);
+	set_deq_to_enqueue(udev, ep_index, stream_id);
+}
+
+/*
+ * Throws away the TDs of a bulk transfer left on the ring after one of them
+ * failed or completed short. A failed TD halts the endpoint, which must be
+ * reset rather than stopped before the xHC's dequeue pointer can be moved.
+ * An endpoint still running may complete more of the TDs before it stops;
+ * their events are dropped.
+ */
+static void abort_bulk_tds(struct usb_device *udev, int ep_index,
+			   unsigned int stream_id)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	struct xhci_virt_device *virt_dev = ctrl->devs[udev->slot_id];
+	struct xhci_ep_ctx *ep_ctx;
+	union xhci_trb *event;
+	unsigned long ts;
+	trb_type type;
+	u32 field;
+
+	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
+	xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
+			 virt_dev->out_ctx->size);
+	if ((le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK) ==
+	    EP_STATE_RUNNING) {
+		xhci_queue_command(ctrl, NULL, udev->slot_id, ep_index,
+				   TRB_STOP_RING);
+		ts = get_timer(0);
+		type = TRB_TRANSFER;
+		while (type != TRB_COMPLETION) {
+			BUG_ON(get_timer(ts) >= XHCI_TIMEOUT);
+			if (!event_ready(ctrl))
+				continue;
+			event = ctrl->event_ring->dequeue;
+			field = le32_to_cpu(event->event_cmd.flags);
+			type = TRB_FIELD_TO_TYPE(field);
+			xhci_acknowledge_event(ctrl);
+		}
+		xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
+				 virt_dev->out_ctx->size);
+	}
+
+	/* It may have halted before the stop command got to it */
+	if ((le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK) ==
+	    EP_STATE_HALTED) {
+		xhci_queue_command(ctrl, NULL, udev->slot_id, ep_index,
+				   TRB_RESET_EP);
+		event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
+		BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags))
+			!= udev->slot_id || GET_COMP_CODE(le32_to_cpu(
+			event->event_cmd.status)) != COMP_SUCCESS);
+		xhci_acknowledge_event(ctrl);
+	}
+
+	set_deq_to_enqueue(udev, ep_index, stream_id);
 }
 
 static void record_transfer_result(struct usb_device *udev,
@@ -542,124 +660,123 @@ static void record_transfer_result(struct usb_device *udev,
 }
 
 /**** Bulk and Control transfer methods ****/
+
+/*
+ * A bulk transfer is split into TDs which are refilled as the xHC completes
+ * them, so it is not limited by the size of the ring. OUT TDs are kept short
+ * so that several are on the ring at once. IN TDs are queued one at a time:
+ * after a short packet the xHC moves on to the next TD, which would put any
+ * data that follows (such as a mass storage CSW) in the wrong place.
+ */
+#define XHCI_BULK_TD_TRBS	16
+/* TRBs which may be queued at once, leaving the link TRB and one spare */
+#define XHCI_RING_TRBS		(TRBS_PER_SEGMENT - 2)
+#define XHCI_BULK_MAX_TDS	(XHCI_RING_TRBS / XHCI_BULK_TD_TRBS + 1)
+
+struct xhci_bulk_td {
+	u64 addr;		/* start of the data */
+	int len;		/* number of bytes */
+	int num_trbs;		/* TRBs used on the ring */
+};
+
 /**
- * Queues up the BULK Request
+ * Counts the TRBs needed for a buffer. The buffer referenced by a TRB must
+ * not span a 64KB boundary (xHCI spec section 6.4.1 and table 49).
  *
- * @param udev		pointer to the USB device structure
- * @param pipe		contains the DIR_IN or OUT , devnum
- * @param length	length of the buffer
- * @param buffer	buffer to be read/written based on the request
- * @return returns 0 if successful else -1 on failure
+ * @param addr		start of the buffer
+ * @param len		length of the buffer
+ * @return number of TRBs, at least 1
  */
-int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
-			int length, void *buffer)
+static int xhci_count_trbs(u64 addr, int len)
 {
+	int running_total;
 	int num_trbs = 0;
-	struct xhci_generic_trb *start_trb;
-	bool first_trb = false;
-	int start_cycle;
-	u32 field = 0;
-	u32 length_field = 0;
-	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
-	int slot_id = udev->slot_id;
-	int ep_index;
-	struct xhci_virt_device *virt_dev;
-	struct xhci_ep_ctx *ep_ctx;
-	struct xhci_ring *ring;		/* EP transfer ring */
-	union xhci_trb *event;
-
-	int running_total, trb_buff_len;
-	unsigned int total_packet_count;
-	int maxpacketsize;
-	u64 addr;
-	int ret;
-	u32 trb_fields[4];
-	u64 val_64 = (uintptr_t)buffer;
-
-	debug("dev=%p, pipe=%lx, buffer=%p, length=%d\n",
-		udev, pipe, buffer, length);
-
-	ep_index = usb_pipe_ep_index(pipe);
-	virt_dev = ctrl->devs[slot_id];
-
-	xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
-			 virt_dev->out_ctx->size);
-
-	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
 
-	ring = virt_dev->eps[ep_index].ring;
-	/*
-	 * How much data is (potentially) left before the 64KB boundary?
-	 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of XHCI Spec)
-	 * that the buffer should not span 64KB boundary. if so
-	 * we send request in more than 1 TRB by chaining them.
-	 */
 	running_total = TRB_MAX_BUFF_SIZE -
-			(lower_32_bits(val_64) & (TRB_MAX_BUFF_SIZE - 1));
-	trb_buff_len = running_total;
+			(lower_32_bits(addr) & (TRB_MAX_BUFF_SIZE - 1));
 	running_total &= TRB_MAX_BUFF_SIZE - 1;
 
 	/*
 	 * If there's some data on this 64KB chunk, or we have to send a
 	 * zero-length transfer, we need at least one TRB
 	 */
-	if (running_total != 0 || length == 0)
+	if (running_total != 0 || len == 0)
 		num_trbs++;
 
 	/* How many more 64KB chunks to transfer, how many more TRBs? */
-	while (running_total < length) {
+	while (running_total < len) {
 		num_trbs++;
 		running_total += TRB_MAX_BUFF_SIZE;
 	}
 
-	/*
-	 * XXX: Calling routine prepare_ring() called in place of
-	 * prepare_trasfer() as there in 'Linux' since we are not
-	 * maintaining multiple TDs/transfer at the same time.
-	 */
-	ret = prepare_ring(ctrl, ring,
-			   le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK);
-	if (ret < 0)
-		return ret;
-
-	/*
-	 * Don't give the first TRB to the hardware (by toggling the cycle bit)
-	 * until we've finished creating all the other TRBs.  The ring's cycle
-	 * state may change as we enqueue the other TRBs, so save it too.
-	 */
-	start_trb = &ring->enqueue->generic;
-	start_cycle = ring->cycle_state;
+	return num_trbs;
+}
 
-	running_total = 0;
-	maxpacketsize = usb_maxpacket(udev, pipe);
+/**
+ * Works out the length of the next TD of a bulk transfer
+ *
+ * @param addr		start of the TD's data
+ * @param left		bytes left in the transfer
+ * @param max_trbs	maximum number of TRBs in the TD
+ * @param maxpacketsize	max packet size of the pipe
+ * @return length of the TD
+ */
+static int xhci_bulk_td_len(u64 addr, int left, int max_trbs,
+			    int maxpacketsize)
+{
+	int len;
 
-	total_packet_count = DIV_ROUND_UP(length, maxpacketsize);
+	len = TRB_MAX_BUFF_SIZE -
+	      (lower_32_bits(addr) & (TRB_MAX_BUFF_SIZE - 1));
+	len += (max_trbs - 1) * TRB_MAX_BUFF_SIZE;
+	if (len >= left)
+		return left;
 
-	/* How much data is in the first TRB? */
-	/*
-	 * How much data is (potentially) left before the 64KB boundary?
-	 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of XHCI Spec)
-	 * that the buffer should not span 64KB boundary. if so
-	 * we send request in more than 1 TRB by chaining them.
-	 */
-	addr = val_64;
+	/* Only the last TD may end with a short packet */
+	return len - len % maxpacketsize;
+}
 
-	if (trb_buff_len > length)
-		trb_buff_len = length;
+/**
+ * Queues the TRBs of one TD, chained together with IOC set on the last
+ *
+ * @param ctrl		Host controller data structure
+ * @param ring		EP transfer ring
+ * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param td		TD to queue
+ * @param maxpacketsize	max packet size of the pipe
+ * @param hold		true to keep the first TRB from the xHC, which is
+ *			given back by giveback_first_trb()
+ * @return none
+ */
+static void xhci_queue_bulk_td(struct xhci_ctrl *ctrl, struct xhci_ring *ring,
+			       unsigned long pipe, struct xhci_bulk_td *td,
+			       int maxpacketsize, bool hold)
+{
+	unsigned int total_packet_count;
+	int running_total, trb_buff_len;
+	int num_trbs = td->num_trbs;
+	u64 addr = td->addr;
+	u32 trb_fields[4];
+	u32 length_field;
+	u32 field;
 
-	first_trb = true;
+	running_total = 0;
+	total_packet_count = DIV_ROUND_UP(td->len, maxpacketsize);
 
-	/* flush the buffer before use */
-	xhci_flush_cache((uintptr_t)buffer, length);
+	/* How much data is in the first TRB, up to the 64KB boundary? */
+	trb_buff_len = TRB_MAX_BUFF_SIZE -
+		       (lower_32_bits(addr) & (TRB_MAX_BUFF_SIZE - 1));
+	if (trb_buff_len > td->len)
+		trb_buff_len = td->len;
 
 	/* Queue the first TRB, even if it's zero-length */
 	do {
 		u32 remainder = 0;
 		field = 0;
 		/* Don't change the cycle bit of the first TRB until later */
-		if (first_trb) {
-			first_trb = false;
-			if (start_cycle == 0)
+		if (hold) {
+			hold = false;
+			if (ring->cycle_state == 0)
 				field |= TRB_CYCLE;
 		} else {
 			field |= ring->cycle_state;
@@ -680,7 +797,7 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 
 		/* Set the TRB length, TD size, and interrupter fields. */
 		if (HC_VERSION(xhci_readl(&ctrl->hccr->cr_capbase)) < 0x100)
-			remainder = xhci_td_remainder(length - running_total);
+			remainder = xhci_td_remainder(td->len - running_total);
 		else
 			remainder = xhci_v1_0_td_remainder(running_total,
 							   trb_buff_len,
@@ -706,28 +823,192 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 
 		/* Calculate length for next transfer */
 		addr += trb_buff_len;
-		trb_buff_len = min((length - running_total), TRB_MAX_BUFF_SIZE);
-	} while (running_total < length);
+		trb_buff_len = min((td->len - running_total),
+				   TRB_MAX_BUFF_SIZE);
+	} while (running_total < td->len);
+}
 
-	giveback_first_trb(udev, ep_index, start_cycle, start_trb);
+/**
+ * Works out how much of a TD was transferred from its transfer event
+ *
+ * @param td		TD the event is for
+ * @param event		transfer event
+ * @return number of bytes transferred
+ */
+static int xhci_td_actual(struct xhci_bulk_td *td, union xhci_trb *event)
+{
+	union xhci_trb *trb;
+	u64 trb_end;
+
+	trb = (union xhci_trb *)(uintptr_t)
+		le64_to_cpu(event->trans_event.buffer);
+	trb_end = le32_to_cpu(trb->generic.field[0]) |
+		  (u64)le32_to_cpu(trb->generic.field[1]) << 32;
+	trb_end += le32_to_cpu(trb->generic.field[2]) & TRB_LEN_MASK;
+	BUG_ON(trb_end <= td->addr && td->len);
+	BUG_ON(trb_end > td->addr + td->len);
+
+	return trb_end - td->addr -
+	       EVENT_TRB_LEN(le32_to_cpu(event->trans_event.transfer_len));
+}
 
-	event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
-	if (!event) {
-		debug("XHCI bulk transfer timed out, aborting...\n");
-		abort_td(udev, ep_index);
-		udev->status = USB_ST_NAK_REC;  /* closest thing to a timeout */
-		udev->act_len = 0;
-		return -ETIMEDOUT;
+/**
+ * Queues up the BULK Request
+ *
+ * @param udev		pointer to the USB device structure
+ * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param stream_id	stream to use, 0 if the endpoint has no streams
+ * @param length	length of the buffer
+ * @param buffer	buffer to be read/written based on the request
+ * @return returns 0 if successful else -1 on failure
+ */
+int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
+		 unsigned int stream_id, int length, void *buffer)
+{
+	struct xhci_bulk_td tds[XHCI_BULK_MAX_TDS];
+	struct xhci_generic_trb *start_trb;
+	int start_cycle;
+	u32 field;
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	int slot_id = udev->slot_id;
+	int ep_index;
+	struct xhci_virt_device *virt_dev;
+	struct xhci_ep_ctx *ep_ctx;
+	struct xhci_ring *ring;		/* EP transfer ring */
+	union xhci_trb *event;
+	int maxpacketsize, max_trbs, max_tds;
+	int head, count, ring_trbs;	/* TDs on the ring */
+	int num_tds;			/* TDs queued in all */
+	int queued, done;		/* bytes queued and completed */
+	bool finished;
+	ulong start_us;
+	int ret;
+
+	debug("dev=%p, pipe=%lx, buffer=%p, length=%d\n",
+		udev, pipe, buffer, length);
+
+	ep_index = usb_pipe_ep_index(pipe);
+	virt_dev = ctrl->devs[slot_id];
+
+	xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
+			 virt_dev->out_ctx->size);
+
+	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
+
+	ring = xhci_stream_ring(&virt_dev->eps[ep_index], stream_id);
+	if (!ring)
+		return -EINVAL;
+	ret = prepare_ring(ctrl, ring,
+			   le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK);
+	if (ret < 0)
+		return ret;
+
+	maxpacketsize = usb_maxpacket(udev, pipe);
+	if (usb_pipein(pipe)) {
+		max_trbs = XHCI_RING_TRBS;
+		max_tds = 1;
+	} else {
+		max_trbs = XHCI_BULK_TD_TRBS;
+		max_tds = XHCI_BULK_MAX_TDS;
 	}
-	field = le32_to_cpu(event->trans_event.flags);
 
-	BUG_ON(TRB_TO_SLOT_ID(field) != slot_id);
-	BUG_ON(TRB_TO_EP_INDEX(field) != ep_index);
-	BUG_ON(*(void **)(uintptr_t)le64_to_cpu(event->trans_event.buffer) -
-		buffer > (size_t)length);
+	/* flush the buffer before use */
+	xhci_flush_cache((uintptr_t)buffer, length);
 
-	record_transfer_result(udev, event, length);
-	xhci_acknowledge_event(ctrl);
+	ctrl->stats.bulk_xfers++;
+	udev->status = 0;
+	head = 0;
+	count = 0;
+	ring_trbs = 0;
+	num_tds = 0;
+	queued = 0;
+	done = 0;
+	do {
+		/*
+		 * Queue as many TDs as there is room for. Don't give the first
+		 * TRB to the hardware (by toggling the cycle bit) until we've
+		 * finished creating all the other TRBs. The ring's cycle state
+		 * may change as we enqueue the other TRBs, so save it too.
+		 */
+		start_trb = NULL;
+		start_cycle = 0;
+		while ((queued < length || !num_tds) && count < max_tds) {
+			struct xhci_bulk_td *td = &tds[(head + count) % max_tds];
+			bool hold = !start_trb;
+
+			td->addr = (uintptr_t)buffer + queued;
+			td->len = xhci_bulk_td_len(td->addr, length - queued,
+						   max_trbs, maxpacketsize);
+			td->num_trbs = xhci_count_trbs(td->addr, td->len);
+			if (count && ring_trbs + td->num_trbs > XHCI_RING_TRBS)
+				break;
+
+			prepare_ring(ctrl, ring, EP_STATE_RUNNING);
+			if (hold) {
+				start_trb = &ring->enqueue->generic;
+				start_cycle = ring->cycle_state;
+			}
+			xhci_queue_bulk_td(ctrl, ring, pipe, td, maxpacketsize,
+					   hold);
+			ring_trbs += td->num_trbs;
+			queued += td->len;
+			count++;
+			num_tds++;
+			ctrl->stats.tds++;
+			ctrl->stats.trbs += td->num_trbs;
+		}
+		if (start_trb)
+			giveback_first_trb(udev, ep_index, stream_id,
+					   start_cycle, start_trb);
+
+		event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
+		if (!event) {
+			debug("XHCI bulk transfer timed out, aborting...\n");
+			abort_td(udev, ep_index, stream_id);
+			udev->status = USB_ST_NAK_REC;  /* closest thing to a timeout */
+			udev->act_len = 0;
+			return -ETIMEDOUT;
+		}
+
+		/* Handle this event and any others which are ready */
+		start_us = timer_get_us();
+		ctrl->stats.event_batches++;
+		finished = false;
+		while (1) {
+			struct xhci_bulk_td *td = &tds[head];
+
+			field = le32_to_cpu(event->trans_event.flags);
+			BUG_ON(TRB_TO_SLOT_ID(field) != slot_id);
+			BUG_ON(TRB_TO_EP_INDEX(field) != ep_index);
+
+			record_transfer_result(udev, event, td->len);
+			done += xhci_td_actual(td, event);
+			if (udev->status || GET_COMP_CODE(le32_to_cpu(
+			    event->trans_event.transfer_len)) == COMP_SHORT_TX)
+				finished = true;
+			inc_deq(ctrl, ctrl->event_ring);
+			ctrl->stats.events++;
+
+			ring_trbs -= td->num_trbs;
+			head = (head + 1) % max_tds;
+			if (!--count && queued == length)
+				finished = true;
+
+			event = ctrl->event_ring->dequeue;
+			if (finished || !count || !event_ready(ctrl) ||
+			    TRB_FIELD_TO_TYPE(le32_to_cpu(
+			    event->event_cmd.flags)) != TRB_TRANSFER)
+				break;
+		}
+		xhci_update_erdp(ctrl);
+		ctrl->stats.event_us += timer_get_us() - start_us;
+	} while (!finished);
+
+	/* Don't leave the rest of the transfer for the xHC to send later */
+	if (count)
+		abort_bulk_tds(udev, ep_index, stream_id);
+
+	udev->act_len = done;
 	xhci_inval_cache((uintptr_t)buffer, length);
 
 	return (udev->status != USB_ST_NOT_PROC) ? 0 : -1;
@@ -906,7 +1187,7 @@ int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 
 	queue_trb(ctrl, ep_ring, false, trb_fields);
 
-	giveback_first_trb(udev, ep_index, start_cycle, start_trb);
+	giveback_first_trb(udev, ep_index, 0, start_cycle, start_trb);
 
 	event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
 	if (!event)
@@ -938,7 +1219,7 @@ int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 
 abort:
 	debug("XHCI control transfer timed out, aborting...\n");
-	abort_td(udev, ep_index);
+	abort_td(udev, ep_index, 0);
 	udev->status = USB_ST_NAK_REC;
 	udev->act_len = 0;
 	return -ETIMEDOUT;
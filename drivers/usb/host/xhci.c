@@ -28,6 +28,7 @@
 #include <asm/cache.h>
 #include <asm/unaligned.h>
 #include <linux/errno.h>
+#include <linux/log2.h>
 #include "xhci.h"
 
 #ifndef CONFIG_USB_MAX_CONTROLLER_COUNT
@@ -1122,7 +1123,7 @@ static int _xhci_submit_int_msg(struct usb_device *udev, unsigned long pipe,
 	 * (at most) one TD. A TD (comprised of sg list entries) can
 	 * take several service intervals to transmit.
 	 */
-	return xhci_bulk_tx(udev, pipe, length, buffer);
+	return xhci_bulk_tx(udev, pipe, 0, length, buffer);
 }
 
 /**
@@ -1135,14 +1136,15 @@ static int _xhci_submit_int_msg(struct usb_device *udev, unsigned long pipe,
  * @return returns 0 if successful else -1 on failure
  */
 static int _xhci_submit_bulk_msg(struct usb_device *udev, unsigned long pipe,
-				 void *buffer, int length)
+				 unsigned int stream_id, void *buffer,
+				 int length)
 {
 	if (usb_pipetype(pipe) != PIPE_BULK) {
 		printf("non-bulk pipe (type=%lu)", usb_pipetype(pipe));
 		return -EINVAL;
 	}
 
-	return xhci_bulk_tx(udev, pipe, length, buffer);
+	return xhci_bulk_tx(udev, pipe, stream_id, length, buffer);
 }
 
 /**
@@ -1273,7 +1275,7 @@ int submit_control_msg(struct usb_device *udev, unsigned long pipe,
 int submit_bulk_msg(struct usb_device *udev, unsigned long pipe, void *buffer,
 		    int length)
 {
-	return _xhci_submit_bulk_msg(udev, pipe, buffer, length);
+	return _xhci_submit_bulk_msg(udev, pipe, 0, buffer, length);
 }
 
 int submit_int_msg(struct usb_device *udev, unsigned long pipe, void *buffer,
@@ -1381,7 +1383,18 @@ static int xhci_submit_bulk_msg(struct udevice *dev, struct usb_device *udev,
 				unsigned long pipe, void *buffer, int length)
 {
 	debug("%s: dev='%s', udev=%p\n", __func__, dev->name, udev);
-	return _xhci_submit_bulk_msg(udev, pipe, buffer, length);
+	return _xhci_submit_bulk_msg(udev, pipe, 0, buffer, length);
+}
+
+static int xhci_submit_bulk_stream_msg(struct udevice *dev,
+				       struct usb_device *udev,
+				       unsigned long pipe,
+				       unsigned int stream_id, void *buffer,
+				       int length)
+{
+	debug("%s: dev='%s', udev=%p, stream=%u\n", __func__, dev->name, udev,
+	      stream_id);
+	return _xhci_submit_bulk_msg(udev, pipe, stream_id, buffer, length);
 }
 
 static int xhci_submit_int_msg(struct udevice *dev, struct usb_device *udev,
@@ -1464,16 +1477,131 @@ static int xhci_update_hub_device(struct udevice *dev, struct usb_device *udev)
 	return xhci_configure_endpoints(udev, false);
 }
 
+/*
+ * Returns the most streams the companion descriptor of an endpoint allows.
+ * The endpoints of all alternate settings are in the interface, so take the
+ * largest of those with the endpoint's address.
+ */
+static int xhci_get_endpoint_max_streams(struct usb_device *udev,
+					 unsigned long pipe)
+{
+	u8 addr = usb_pipeendpoint(pipe) | (usb_pipein(pipe) ? USB_DIR_IN : 0);
+	struct usb_ss_ep_comp_descriptor *comp;
+	struct usb_interface *ifdesc;
+	int max_streams = 0;
+	int i, j;
+
+	for (i = 0; i < udev->config.no_of_if; i++) {
+		ifdesc = &udev->config.if_desc[i];
+		for (j = 0; j < ifdesc->no_of_ep; j++) {
+			comp = &ifdesc->ss_ep_comp_desc[j];
+			if (ifdesc->ep_desc[j].bEndpointAddress != addr ||
+			    !usb_endpoint_xfer_bulk(&ifdesc->ep_desc[j]))
+				continue;
+			max_streams = max(max_streams,
+					  usb_ss_max_streams(comp));
+		}
+	}
+
+	return max_streams;
+}
+
+/*
+ * Set up bulk streams on the endpoints of some bulk pipes, see section 4.12.
+ * Each endpoint gets the same number of streams, limited by the xHC and by
+ * the companion descriptors, and is given a stream context array in place
+ * of its transfer ring with a Configure Endpoint command.
+ */
+static int xhci_alloc_streams(struct udevice *dev, struct usb_device *udev,
+			      unsigned long *pipes, int num_pipes,
+			      int num_streams)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	struct xhci_virt_device *virt_dev = ctrl->devs[udev->slot_id];
+	struct xhci_container_ctx *in_ctx = virt_dev->in_ctx;
+	struct xhci_container_ctx *out_ctx = virt_dev->out_ctx;
+	u32 hcc = xhci_readl(&ctrl->hccr->cr_hccparams);
+	struct xhci_input_control_ctx *ctrl_ctx;
+	struct xhci_virt_ep *ep;
+	struct xhci_ep_ctx *ep_ctx;
+	unsigned int num_ctxs;
+	u32 ep_flags = 0;
+	int ep_index, max_streams;
+	int i, ret;
+
+	debug("%s: dev='%s', udev=%p, streams=%d\n", __func__, dev->name,
+	      udev, num_streams);
+	if (HCC_MAX_PSA(hcc) < 4) {
+		debug("xHC does not support streams\n");
+		return -ENOSYS;
+	}
+	if (num_pipes < 1 || num_streams < 1)
+		return -EINVAL;
+
+	for (i = 0; i < num_pipes; i++) {
+		ep_index = usb_pipe_ep_index(pipes[i]);
+		if (!usb_pipebulk(pipes[i]) ||
+		    virt_dev->eps[ep_index].num_streams)
+			return -EINVAL;
+		max_streams = xhci_get_endpoint_max_streams(udev, pipes[i]);
+		num_streams = min(num_streams, max_streams);
+		if (!num_streams) {
+			debug("Endpoint %lu has no streams\n",
+			      usb_pipeendpoint(pipes[i]));
+			return -ENOSYS;
+		}
+	}
+
+	/* The array has an entry for stream 0, which is reserved */
+	num_ctxs = min_t(unsigned int, roundup_pow_of_two(num_streams + 1),
+			 HCC_MAX_PSA(hcc));
+	num_streams = min_t(int, num_streams, num_ctxs - 1);
+
+	xhci_inval_cache((uintptr_t)out_ctx->bytes, out_ctx->size);
+	for (i = 0; i < num_pipes; i++) {
+		ep_index = usb_pipe_ep_index(pipes[i]);
+		ep = &virt_dev->eps[ep_index];
+		ret = xhci_alloc_stream_info(ep, num_ctxs, num_streams);
+		if (ret)
+			goto err;
+
+		xhci_endpoint_copy(ctrl, in_ctx, out_ctx, ep_index);
+		ep_ctx = xhci_get_ep_ctx(ctrl, in_ctx, ep_index);
+		ep_ctx->ep_info &= cpu_to_le32(~(EP_MAXPSTREAMS_MASK |
+						 EP_STATE_MASK));
+		ep_ctx->ep_info |= cpu_to_le32(EP_HAS_LSA |
+			EP_MAXPSTREAMS(ilog2(num_ctxs) - 1));
+		ep_ctx->deq = cpu_to_le64((uintptr_t)ep->stream_ctx);
+		ep_flags |= 1 << (ep_index + 1);
+	}
+
+	/* Drop and add the endpoints again to change their contexts */
+	ctrl_ctx = xhci_get_input_control_ctx(in_ctx);
+	ctrl_ctx->add_flags = cpu_to_le32(ep_flags | SLOT_FLAG);
+	ctrl_ctx->drop_flags = cpu_to_le32(ep_flags);
+	xhci_slot_copy(ctrl, in_ctx, out_ctx);
+	ret = xhci_configure_endpoints(udev, false);
+	if (ret)
+		goto err;
+
+	return num_streams;
+err:
+	for (i = 0; i < num_pipes; i++) {
+		ep_index = usb_pipe_ep_index(pipes[i]);
+		xhci_free_stream_info(&virt_dev->eps[ep_index]);
+	}
+
+	return ret;
+}
+
 static int xhci_get_max_xfer_size(struct udevice *dev, size_t *size)
 {
 	/*
-	 * xHCD allocates one segment which includes 64 TRBs for each endpoint
-	 * and the last TRB in this segment is configured as a link TRB to form
-	 * a TRB ring. Each TRB can transfer up to 64K bytes, however data
-	 * buffers referenced by transfer TRBs shall not span 64KB boundaries.
-	 * Hence the maximum number of TRBs we can use in one transfer is 62.
+	 * xHCD allocates one segment of 64 TRBs for each endpoint, but
+	 * xhci_bulk_tx() splits a transfer into TDs and queues more as the
+	 * earlier ones complete, so the ring does not limit the transfer.
 	 */
-	*size = (TRBS_PER_SEGMENT - 2) * TRB_MAX_BUFF_SIZE;
+	*size = INT_MAX;
 
 	return 0;
 }
@@ -1519,6 +1647,10 @@ int xhci_deregister(struct udevice *dev)
 {
 	struct xhci_ctrl *ctrl = dev_get_priv(dev);
 
+	debug("%s: %lu bulk transfers, %lu TDs, %lu TRBs, %lu events in %lu batches, %lu us handling events\n",
+	      __func__, ctrl->stats.bulk_xfers, ctrl->stats.tds,
+	      ctrl->stats.trbs, ctrl->stats.events, ctrl->stats.event_batches,
+	      ctrl->stats.event_us);
 	xhci_lowlevel_stop(ctrl);
 	xhci_cleanup(ctrl);
 
@@ -1528,10 +1660,12 @@ int xhci_deregister(struct udevice *dev)
 struct dm_usb_ops xhci_usb_ops = {
 	.control = xhci_submit_control_msg,
 	.bulk = xhci_submit_bulk_msg,
+	.bulk_stream = xhci_submit_bulk_stream_msg,
 	.interrupt = xhci_submit_int_msg,
 	.alloc_device = xhci_alloc_device,
 	.update_hub_device = xhci_update_hub_device,
 	.get_max_xfer_size  = xhci_get_max_xfer_size,
+	.alloc_streams = xhci_alloc_streams,
 };
 
 #endif
@@ -670,6 +670,26 @@ struct xhci_ep_ctx {
 /* deq bitmasks */
 #define EP_CTX_CYCLE_MASK		(1 << 0)
 
+/**
+ * struct xhci_stream_ctx
+ * Stream context, one entry of an endpoint's stream context array;
+ * see section 6.2.4.1.
+ *
+ * @stream_ring:	dequeue pointer of the stream's transfer ring, with
+ *			the cycle state and the Stream Context Type
+ */
+struct xhci_stream_ctx {
+	__le64	stream_ring;
+	/* offset 0x8 - 0xf reserved for HC internal use */
+	__le32	reserved[2];
+};
+
+/* Stream Context Type, in a stream context or a Set TR Dequeue TRB */
+#define SCT_FOR_CTX(p)		(((p) & 0x7) << 1)
+#define SCT_FOR_TRB(p)		(((p) & 0x7) << 1)
+/* Primary stream array entry with a transfer ring */
+#define SCT_PRI_TR		1
+
 
 /**
  * struct xhci_input_control_context
@@ -1067,6 +1087,10 @@ struct xhci_virt_ep {
 #define EP_HAS_STREAMS		(1 << 4)
 /* Transitioning the endpoint to not using streams, don't enqueue URBs */
 #define EP_GETTING_NO_STREAMS	(1 << 5)
+	/* Set up by xhci_alloc_stream_info() for an endpoint with streams */
+	struct xhci_stream_ctx		*stream_ctx;
+	struct xhci_ring		**stream_rings;	/* by stream ID */
+	unsigned int			num_streams;	/* without stream 0 */
 };
 
 #define CTX_SIZE(_hcc) (HCC_64BYTE_CONTEXT(_hcc) ? 64 : 32)
@@ -1210,6 +1234,25 @@ void xhci_hcd_stop(int index);
 /* true: Controller Not Ready to accept doorbell or op reg writes after reset */
 #define XHCI_STS_CNR		(1 << 11)
 
+/**
+ * struct xhci_stats - bulk transfer counters of a controller
+ *
+ * @bulk_xfers:		calls to xhci_bulk_tx()
+ * @tds:		TDs queued
+ * @trbs:		transfer TRBs queued
+ * @events:		transfer events handled
+ * @event_batches:	times the event ring was drained
+ * @event_us:		microseconds spent handling transfer events
+ */
+struct xhci_stats {
+	ulong bulk_xfers;
+	ulong tds;
+	ulong trbs;
+	ulong events;
+	ulong event_batches;
+	ulong event_us;
+};
+
 struct xhci_ctrl {
 #if CONFIG_IS_ENABLED(DM_USB)
 	struct udevice *dev;
@@ -1230,6 +1273,7 @@ struct xhci_ctrl {
 	struct xhci_scratchpad *scratchpad;
 	struct xhci_virt_device *devs[MAX_HC_SLOTS];
 	int rootdev;
+	struct xhci_stats stats;
 };
 
 unsigned long trb_addr(struct xhci_segment *seg, union xhci_trb *trb);
@@ -1254,7 +1298,7 @@ void xhci_queue_command(struct xhci_ctrl *ctrl, u8 *ptr,
 void xhci_acknowledge_event(struct xhci_ctrl *ctrl);
 union xhci_trb *xhci_wait_for_event(struct xhci_ctrl *ctrl, trb_type expected);
 int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
-		 int length, void *buffer);
+		 unsigned int stream_id, int length, void *buffer);
 int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 		 struct devrequest *req, int length, void *buffer);
 int xhci_check_maxpacket(struct usb_device *udev);
@@ -1263,6 +1307,9 @@ void xhci_inval_cache(uintptr_t addr, u32 type_len);
 void xhci_cleanup(struct xhci_ctrl *ctrl);
 struct xhci_ring *xhci_ring_alloc(unsigned int num_segs, bool link_trbs);
 int xhci_alloc_virt_device(struct xhci_ctrl *ctrl, unsigned int slot_id);
+int xhci_alloc_stream_info(struct xhci_virt_ep *ep, unsigned int num_ctxs,
+			   unsigned int num_streams);
+void xhci_free_stream_info(struct xhci_virt_ep *ep);
 int xhci_mem_init(struct xhci_ctrl *ctrl, struct xhci_hccr *hccr,
 		  struct xhci_hcor *hcor);
 
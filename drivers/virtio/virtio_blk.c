@@ -12,26 +12,43 @@
 #include <virtio_ring.h>
 #include "virtio_blk.h"
 
+/* Number of requests kept in flight */
+#define VIRTIO_BLK_REQS		16
+/* Size of each request, unless the device asks for smaller ones */
+#define VIRTIO_BLK_REQ_SECTORS	256
+
+struct virtio_blk_req {
+	struct virtio_blk_outhdr out_hdr;
+	u8 status;
+	bool busy;
+	lbaint_t start;		/* offset of the request into the transfer */
+};
+
 struct virtio_blk_priv {
 	struct virtqueue *vq;
+	uint max_sectors;	/* largest request, in sectors */
+	struct virtio_blk_req reqs[VIRTIO_BLK_REQS];
 };
 
-static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
-			       lbaint_t blkcnt, void *buffer, u32 type)
+static const u32 feature[] = {
+	VIRTIO_BLK_F_SIZE_MAX,
+};
+
+static int virtio_blk_add_req(struct udevice *dev, struct virtio_blk_req *req,
+			      u64 sector, lbaint_t blkcnt, void *buffer,
+			      u32 type)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
 	unsigned int num_out = 0, num_in = 0;
 	struct virtio_sg *sgs[3];
-	u8 status;
-	int ret;
-
-	struct virtio_blk_outhdr out_hdr = {
-		.type = cpu_to_virtio32(dev, type),
-		.sector = cpu_to_virtio64(dev, sector),
-	};
-	struct virtio_sg hdr_sg = { &out_hdr, sizeof(out_hdr) };
+	struct virtio_sg hdr_sg = { &req->out_hdr, sizeof(req->out_hdr) };
 	struct virtio_sg data_sg = { buffer, blkcnt * 512 };
-	struct virtio_sg status_sg = { &status, sizeof(status) };
+	struct virtio_sg status_sg = { &req->status, sizeof(req->status) };
+
+	req->out_hdr.type = cpu_to_virtio32(dev, type);
+	req->out_hdr.ioprio = 0;
+	req->out_hdr.sector = cpu_to_virtio64(dev, sector);
+	req->status = VIRTIO_BLK_S_IOERR;
 
 	sgs[num_out++] = &hdr_sg;
 
@@ -42,16 +59,66 @@ static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
 
 	sgs[num_out + num_in++] = &status_sg;
 
-	ret = virtqueue_add(priv->vq, sgs, num_out, num_in);
-	if (ret)
-		return ret;
-
-	virtqueue_kick(priv->vq);
+	return virtqueue_add(priv->vq, sgs, num_out, num_in);
+}
 
-	while (!virtqueue_get_buf(priv->vq, NULL))
-		;
+/*
+ * Split the transfer into requests and keep as many of them in flight as
+ * the ring allows, so that the device can work on them together. Each
+ * batch of new requests is announced with a single notification.
+ */
+static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
+			       lbaint_t blkcnt, void *buffer, u32 type)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct virtio_blk_req *req;
+	lbaint_t next = 0, failed = blkcnt;
+	uint inflight = 0, added, i;
+	void *buf;
+	int ret;
 
-	return status == VIRTIO_BLK_S_OK ? blkcnt : -EIO;
+	while (next < blkcnt || inflight) {
+		for (added = 0, i = 0; i < VIRTIO_BLK_REQS &&
+		     next < blkcnt && failed == blkcnt; i++) {
+			lbaint_t count = min_t(lbaint_t, blkcnt - next,
+					       priv->max_sectors);
+
+			req = &priv->reqs[i];
+			if (req->busy)
+				continue;
+			ret = virtio_blk_add_req(dev, req, sector + next, count,
+						 buffer + next * 512, type);
+			if (ret == -ENOSPC && inflight + added)
+				break;
+			if (ret) {
+				failed = next;
+				break;
+			}
+			req->busy = true;
+			req->start = next;
+			next += count;
+			added++;
+		}
+		if (added)
+			virtqueue_kick(priv->vq);
+		inflight += added;
+		if (!inflight)
+			break;
+
+		/* Wait for one request, then collect any others done too */
+		while (!(buf = virtqueue_get_buf(priv->vq, NULL)))
+			;
+		do {
+			req = container_of(buf, struct virtio_blk_req,
+					   out_hdr);
+			req->busy = false;
+			inflight--;
+			if (req->status != VIRTIO_BLK_S_OK)
+				failed = min(failed, req->start);
+		} while ((buf = virtqueue_get_buf(priv->vq, NULL)));
+	}
+
+	return failed;
 }
 
 static ulong virtio_blk_read(struct udevice *dev, lbaint_t start,
@@ -97,7 +164,8 @@ static int virtio_blk_bind(struct udevice *dev)
 	desc->bdev = dev;
 
 	/* Indicate what driver features we support */
-	virtio_driver_features_init(uc_priv, NULL, 0, NULL, 0);
+	virtio_driver_features_init(uc_priv, feature, ARRAY_SIZE(feature),
+				    NULL, 0);
 
 	return 0;
 }
@@ -106,6 +174,7 @@ static int virtio_blk_probe(struct udevice *dev)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
 	struct blk_desc *desc = dev_get_uclass_platdata(dev);
+	u32 size_max;
 	u64 cap;
 	int ret;
 
@@ -117,6 +186,13 @@ static int virtio_blk_probe(struct udevice *dev)
 	virtio_cread(dev, struct virtio_blk_config, capacity, &cap);
 	desc->lba = cap;
 
+	priv->max_sectors = VIRTIO_BLK_REQ_SECTORS;
+	if (!virtio_cread_feature(dev, VIRTIO_BLK_F_SIZE_MAX,
+				  struct virtio_blk_config, size_max,
+				  &size_max) && size_max >= 512)
+		priv->max_sectors = min_t(uint, priv->max_sectors,
+					  size_max / 512);
+
 	return 0;
 }
 
@@ -32,6 +32,7 @@ struct virtio_net_priv {
 
 	char rx_buff[VIRTIO_NET_NUM_RX_BUFS][VIRTIO_NET_RX_BUF_SIZE];
 	bool rx_running;
+	bool rx_refilled;
 	int net_hdr_len;
 };
 
@@ -120,6 +121,31 @@ static int virtio_net_recv(struct udevice *dev, int flags, uchar **packetp)
 	return len - priv->net_hdr_len;
 }
 
+static int virtio_net_recv_batch(struct udevice *dev, int flags,
+				 uchar **packets, int *lengths, int budget)
+{
+	struct virtio_net_priv *priv = dev_get_priv(dev);
+	unsigned int len;
+	void *buf;
+	int i;
+
+	/* Tell the device once about the buffers given back since last time */
+	if (priv->rx_refilled) {
+		virtqueue_kick(priv->rx_vq);
+		priv->rx_refilled = false;
+	}
+
+	for (i = 0; i < budget; i++) {
+		buf = virtqueue_get_buf(priv->rx_vq, &len);
+		if (!buf)
+			break;
+		packets[i] = buf + priv->net_hdr_len;
+		lengths[i] = len - priv->net_hdr_len;
+	}
+
+	return i;
+}
+
 static int virtio_net_free_pkt(struct udevice *dev, uchar *packet, int length)
 {
 	struct virtio_net_priv *priv = dev_get_priv(dev);
@@ -129,6 +155,7 @@ static int virtio_net_free_pkt(struct udevice *dev, uchar *packet, int length)
 
 	/* Put the buffer back to the rx ring */
 	virtqueue_add(priv->rx_vq, sgs, 0, 1);
+	priv->rx_refilled = true;
 
 	return 0;
 }
@@ -220,6 +247,7 @@ static const struct eth_ops virtio_net_ops = {
 	.start = virtio_net_start,
 	.send = virtio_net_send,
 	.recv = virtio_net_recv,
+	.recv_batch = virtio_net_recv_batch,
 	.free_pkt = virtio_net_free_pkt,
 	.stop = virtio_net_stop,
 	.write_hwaddr = virtio_net_write_hwaddr,
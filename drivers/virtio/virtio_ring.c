@@ -19,26 +19,35 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 	struct vring_desc *desc;
 	unsigned int total_sg = out_sgs + in_sgs;
 	unsigned int i, n, avail, descs_used, uninitialized_var(prev);
+	bool indirect;
 	int head;
 
 	WARN_ON(total_sg == 0);
 
 	head = vq->free_head;
 
-	desc = vq->vring.desc;
-	i = head;
-	descs_used = total_sg;
+	indirect = vq->indirect && total_sg > 1 &&
+		   total_sg <= VIRTQUEUE_MAX_INDIRECT;
+	if (indirect) {
+		/* Each ring entry has its own table, chained in order */
+		desc = vq->indirect + head * VIRTQUEUE_MAX_INDIRECT;
+		for (n = 0; n < total_sg; n++)
+			desc[n].next = cpu_to_virtio16(vq->vdev, n + 1);
+		i = 0;
+		descs_used = 1;
+	} else {
+		desc = vq->vring.desc;
+		i = head;
+		descs_used = total_sg;
+	}
 
+	/*
+	 * The caller kicks the other side once it has added all it can, so
+	 * there is no need to notify it here.
+	 */
 	if (vq->num_free < descs_used) {
 		debug("Can't add buf len %i - avail = %i\n",
 		      descs_used, vq->num_free);
-		/*
-		 * FIXME: for historical reasons, we force a notify here if
-		 * there are outgoing parts to the buffer.  Presumably the
-		 * host should service the ring ASAP.
-		 */
-		if (out_sgs)
-			virtio_notify(vq->vdev, vq);
 		return -ENOSPC;
 	}
 
@@ -67,6 +76,18 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 	/* Last one doesn't continue */
 	desc[prev].flags &= cpu_to_virtio16(vq->vdev, ~VRING_DESC_F_NEXT);
 
+	if (indirect) {
+		desc = vq->vring.desc;
+		desc[head].flags = cpu_to_virtio16(vq->vdev,
+						   VRING_DESC_F_INDIRECT);
+		desc[head].addr = cpu_to_virtio64(vq->vdev,
+				(u64)(uintptr_t)(vq->indirect +
+						 head * VIRTQUEUE_MAX_INDIRECT));
+		desc[head].len = cpu_to_virtio32(vq->vdev, total_sg *
+						 sizeof(struct vring_desc));
+		i = virtio16_to_cpu(vq->vdev, desc[head].next);
+	}
+
 	/* We're using some buffers from the free list. */
 	vq->num_free -= descs_used;
 
@@ -159,6 +180,7 @@ static inline bool more_used(const struct virtqueue *vq)
 
 void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 {
+	struct vring_desc *desc;
 	unsigned int i;
 	u16 last_used;
 
@@ -197,8 +219,12 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 		virtio_store_mb(&vring_used_event(&vq->vring),
 				cpu_to_virtio16(vq->vdev, vq->last_used_idx));
 
-	return (void *)(uintptr_t)virtio64_to_cpu(vq->vdev,
-						  vq->vring.desc[i].addr);
+	/* Hand back the first buffer, whether or not it was indirect */
+	desc = &vq->vring.desc[i];
+	if (desc->flags & cpu_to_virtio16(vq->vdev, VRING_DESC_F_INDIRECT))
+		desc = &vq->indirect[i * VIRTQUEUE_MAX_INDIRECT];
+
+	return (void *)(uintptr_t)virtio64_to_cpu(vq->vdev, desc->addr);
 }
 
 static struct virtqueue *__vring_new_virtqueue(unsigned int index,
@@ -218,6 +244,13 @@ static struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	vq->index = index;
 	vq->num_free = vring.num;
 	vq->vring = vring;
+	vq->indirect = NULL;
+	if (virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC)) {
+		/* Without the tables, requests just use the ring directly */
+		vq->indirect = memalign(VRING_DESC_ALIGN_SIZE, vring.num *
+					VIRTQUEUE_MAX_INDIRECT *
+					sizeof(struct vring_desc));
+	}
 	vq->last_used_idx = 0;
 	vq->avail_flags_shadow = 0;
 	vq->avail_idx_shadow = 0;
@@ -287,6 +320,7 @@ struct virtqueue *vring_create_virtqueue(unsigned int index, unsigned int num,
 
 void vring_del_virtqueue(struct virtqueue *vq)
 {
+	free(vq->indirect);
 	free(vq->vring.desc);
 	list_del(&vq->list);
 	free(vq);
@@ -7,11 +7,22 @@
 
 #include <common.h>
 #include <dm.h>
+#include <malloc.h>
 #include <virtio_types.h>
 #include <virtio.h>
 #include <virtio_ring.h>
+#include <asm/test.h>
 #include <linux/compat.h>
 #include <linux/io.h>
+#include "virtio_blk.h"
+
+/*
+ * The block device behind the transport is a small RAM disk. Requests are
+ * carried out as soon as the driver notifies the queue.
+ */
+#define SB_VIRTIO_BLK_SECTORS	512
+#define SB_VIRTIO_BLK_SIZE_MAX	(32 << 10)	/* if VIRTIO_BLK_F_SIZE_MAX */
+#define SB_VIRTIO_MAX_SG	VIRTQUEUE_MAX_INDIRECT
 
 struct virtio_sandbox_priv {
 	u8 id;
@@ -21,11 +32,21 @@ struct virtio_sandbox_priv {
 	ulong queue_desc;
 	ulong queue_available;
 	ulong queue_used;
+	struct virtio_blk_config config;
+	u8 *disk;
+	u16 last_avail_idx;	/* next available entry to process */
+	struct sandbox_virtio_stats stats;
 };
 
 static int virtio_sandbox_get_config(struct udevice *udev, unsigned int offset,
 				     void *buf, unsigned int len)
 {
+	struct virtio_sandbox_priv *priv = dev_get_priv(udev);
+
+	if (offset + len > sizeof(priv->config))
+		return -EINVAL;
+	memcpy(buf, (u8 *)&priv->config + offset, len);
+
 	return 0;
 }
 
@@ -99,6 +120,7 @@ static struct virtqueue *virtio_sandbox_setup_vq(struct udevice *udev,
 		err = -ENOMEM;
 		goto error_new_virtqueue;
 	}
+	priv->last_avail_idx = 0;
 
 	addr = virtqueue_get_desc_addr(vq);
 	priv->queue_desc = addr;
@@ -147,11 +169,100 @@ static int virtio_sandbox_find_vqs(struct udevice *udev, unsigned int nvqs,
 	return 0;
 }
 
+/* Carry out a block request made up of the buffers in @sg */
+static int virtio_sandbox_blk_req(struct virtio_sandbox_priv *priv,
+				  struct vring_desc *sg, int count)
+{
+	struct virtio_blk_outhdr *hdr;
+	u64 sector;
+	u8 *status;
+	int i, len;
+
+	if (count < 2 || sg[0].len != sizeof(*hdr) || sg[count - 1].len != 1)
+		return 0;
+	hdr = (void *)(uintptr_t)sg[0].addr;
+	status = (void *)(uintptr_t)sg[count - 1].addr;
+	*status = VIRTIO_BLK_S_OK;
+	sector = hdr->sector;
+	for (i = 1, len = 0; i < count - 1; i++) {
+		void *buf = (void *)(uintptr_t)sg[i].addr;
+
+		if (sg[i].len % 512 ||
+		    sector + sg[i].len / 512 > SB_VIRTIO_BLK_SECTORS) {
+			*status = VIRTIO_BLK_S_IOERR;
+			break;
+		}
+		if (hdr->type == VIRTIO_BLK_T_IN) {
+			memcpy(buf, priv->disk + sector * 512, sg[i].len);
+			len += sg[i].len;
+		} else if (hdr->type == VIRTIO_BLK_T_OUT) {
+			memcpy(priv->disk + sector * 512, buf, sg[i].len);
+		} else {
+			*status = VIRTIO_BLK_S_UNSUPP;
+			break;
+		}
+		sector += sg[i].len / 512;
+	}
+
+	return len + 1;
+}
+
 static int virtio_sandbox_notify(struct udevice *udev, struct virtqueue *vq)
 {
+	struct virtio_sandbox_priv *priv = dev_get_priv(udev);
+	struct vring *vr = &vq->vring;
+	struct vring_desc sg[SB_VIRTIO_MAX_SG];
+	u16 avail_idx = vr->avail->idx;
+	struct vring_desc *desc;
+	int count, i;
+
+	priv->stats.notify_count++;
+	priv->stats.max_batch = max_t(uint, priv->stats.max_batch,
+				      (u16)(avail_idx - priv->last_avail_idx));
+	for (; priv->last_avail_idx != avail_idx; priv->last_avail_idx++) {
+		struct vring_used_elem *used;
+		u16 head;
+
+		head = vr->avail->ring[priv->last_avail_idx % vr->num];
+		desc = vr->desc;
+		i = head;
+		if (desc[i].flags & VRING_DESC_F_INDIRECT) {
+			priv->stats.indirect_count++;
+			desc = (void *)(uintptr_t)desc[i].addr;
+			i = 0;
+		}
+		for (count = 0; count < SB_VIRTIO_MAX_SG; i = desc[i].next) {
+			sg[count++] = desc[i];
+			if (!(desc[i].flags & VRING_DESC_F_NEXT))
+				break;
+		}
+
+		used = &vr->used->ring[vr->used->idx % vr->num];
+		used->id = head;
+		used->len = virtio_sandbox_blk_req(priv, sg, count);
+		vr->used->idx++;
+		priv->stats.req_count++;
+	}
+
 	return 0;
 }
 
+void sandbox_virtio_set_features(struct udevice *dev, u64 features)
+{
+	struct virtio_sandbox_priv *priv = dev_get_priv(dev);
+
+	priv->device_features = features;
+}
+
+void sandbox_virtio_get_stats(struct udevice *dev,
+			      struct sandbox_virtio_stats *stats)
+{
+	struct virtio_sandbox_priv *priv = dev_get_priv(dev);
+
+	*stats = priv->stats;
+	memset(&priv->stats, '\0', sizeof(priv->stats));
+}
+
 static int virtio_sandbox_probe(struct udevice *udev)
 {
 	struct virtio_sandbox_priv *priv = dev_get_priv(udev);
@@ -162,6 +273,21 @@ static int virtio_sandbox_probe(struct udevice *udev)
 	uc_priv->device = VIRTIO_ID_BLOCK;
 	uc_priv->vendor = ('u' << 24) | ('b' << 16) | ('o' << 8) | 't';
 
+	priv->config.capacity = SB_VIRTIO_BLK_SECTORS;
+	priv->config.size_max = SB_VIRTIO_BLK_SIZE_MAX;
+	priv->disk = calloc(SB_VIRTIO_BLK_SECTORS, 512);
+	if (!priv->disk)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int virtio_sandbox_remove(struct udevice *udev)
+{
+	struct virtio_sandbox_priv *priv = dev_get_priv(udev);
+
+	free(priv->disk);
+
 	return 0;
 }
 
@@ -201,6 +327,7 @@ U_BOOT_DRIVER(virtio_sandbox1) = {
 	.of_match = virtio_sandbox1_ids,
 	.ops	= &virtio_sandbox1_ops,
 	.probe	= virtio_sandbox_probe,
+	.remove	= virtio_sandbox_remove,
 	.child_post_remove = virtio_sandbox_child_post_remove,
 	.priv_auto_alloc_size = sizeof(struct virtio_sandbox_priv),
 };
@@ -229,5 +356,6 @@ U_BOOT_DRIVER(virtio_sandbox2) = {
 	.of_match = virtio_sandbox2_ids,
 	.ops	= &virtio_sandbox2_ops,
 	.probe	= virtio_sandbox_probe,
+	.remove	= virtio_sandbox_remove,
 	.priv_auto_alloc_size = sizeof(struct virtio_sandbox_priv),
 };
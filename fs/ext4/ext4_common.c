@@ -21,6 +21,7 @@
 #include <common.h>
 #include <ext_common.h>
 #include <ext4fs.h>
+#include <fs.h>
 #include <malloc.h>
 #include <memalign.h>
 #include <stddef.h>
@@ -2296,17 +2297,35 @@ int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
 
 int ext4fs_open(const char *filename, loff_t *len)
 {
+	struct ext_filesystem *fs = get_fs();
 	struct ext2fs_node *fdiro = NULL;
 	int status;
+	int ino;
 
 	if (ext4fs_root == NULL)
 		return -1;
 
 	ext4fs_file = NULL;
-	status = ext4fs_find_file(filename, &ext4fs_root->diropen, &fdiro,
-				  FILETYPE_REG);
-	if (status == 0)
-		goto fail;
+	/* An earlier lookup of the path gives the inode without the walk */
+	status = fs_cache_get_dentry(fs->dev_desc, filename, &ino, sizeof(ino));
+	if (status == -ENOENT)
+		return -1;
+	if (status == 0) {
+		fdiro = zalloc(sizeof(struct ext2fs_node));
+		if (!fdiro)
+			return -1;
+		fdiro->data = ext4fs_root;
+		fdiro->ino = ino;
+	} else {
+		status = ext4fs_find_file(filename, &ext4fs_root->diropen,
+					  &fdiro, FILETYPE_REG);
+		if (status == 0) {
+			fs_cache_put_dentry(fs->dev_desc, filename, NULL, 0);
+			goto fail;
+		}
+		fs_cache_put_dentry(fs->dev_desc, filename, &fdiro->ino,
+				    sizeof(fdiro->ino));
+	}
 
 	if (!fdiro->inode_read) {
 		status = ext4fs_read_inode(fdiro->data, fdiro->ino,
@@ -16,10 +16,13 @@
 #include <fs.h>
 #include <asm/byteorder.h>
 #include <part.h>
+#include <sink.h>
 #include <malloc.h>
 #include <memalign.h>
 #include <linux/compiler.h>
 #include <linux/ctype.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
 
 /*
  * Convert a string to lowercase.  Converts at most 'len' characters,
@@ -144,16 +147,85 @@ static void get_name(dir_entry *dirent, char *s_name)
 		*s_name = DELETED_FLAG;
 }
 
-static int flush_dirty_fat_buffer(fsdata *mydata);
+static int flush_fat_window(fsdata *mydata, int win);
 #if !defined(CONFIG_FAT_WRITE)
 /* Stub for read only operation */
-int flush_dirty_fat_buffer(fsdata *mydata)
+static int flush_fat_window(fsdata *mydata, int win)
 {
 	(void)(mydata);
+	(void)(win);
 	return 0;
 }
 #endif
 
+/*
+ * Allocate the FAT buffers of 'mydata' and mark them all empty.
+ * Return 0 on success, -1 otherwise.
+ */
+static int fat_cache_init(fsdata *mydata)
+{
+	int i;
+
+	for (i = 0; i < FATBUFWINDOWS; i++) {
+		mydata->fatbufnum[i] = -1;
+		mydata->fatbufused[i] = 0;
+	}
+	mydata->fatbuftick = 0;
+	mydata->fat_dirty = 0;
+	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE * FATBUFWINDOWS);
+	if (!mydata->fatbuf) {
+		debug("Error: allocating memory\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Get the FAT buffer holding window 'bufnum' of the FAT table, reading it
+ * in place of the least recently used buffer if it is not cached.
+ * Return the buffer index, or -1 on failure.
+ */
+static int fat_get_window(fsdata *mydata, __u32 bufnum)
+{
+	__u32 getsize = FATBUFBLOCKS;
+	__u32 startblock = bufnum * FATBUFBLOCKS;
+	__u8 *bufptr;
+	int i, win = 0;
+
+	for (i = 0; i < FATBUFWINDOWS; i++) {
+		if (mydata->fatbufnum[i] == bufnum) {
+			win = i;
+			goto found;
+		}
+		if (mydata->fatbufused[i] < mydata->fatbufused[win])
+			win = i;
+	}
+
+	/* Write back the buffer being replaced */
+	if (flush_fat_window(mydata, win) < 0)
+		return -1;
+
+	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+	if (startblock + getsize > mydata->fatlength)
+		getsize = mydata->fatlength - startblock;
+
+	startblock += mydata->fat_sect;	/* Offset from start of disk */
+
+	debug("FAT window %u -> buffer %d\n", bufnum, win);
+	bufptr = mydata->fatbuf + win * FATBUFSIZE;
+	if (disk_read(startblock, getsize, bufptr) < 0) {
+		debug("Error reading FAT blocks\n");
+		mydata->fatbufnum[win] = -1;
+		return -1;
+	}
+	mydata->fatbufnum[win] = bufnum;
+found:
+	mydata->fatbufused[win] = ++mydata->fatbuftick;
+
+	return win;
+}
+
 /*
  * Get the entry at index 'entry' in a FAT (12/16/32) table.
  * On failure 0x00 is returned.
@@ -163,6 +235,8 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	__u32 bufnum;
 	__u32 offset, off8;
 	__u32 ret = 0x00;
+	__u8 *fatbuf;
+	int win;
 
 	if (CHECK_CLUST(entry, mydata->fatsize)) {
 		printf("Error: Invalid FAT entry: 0x%08x\n", entry);
@@ -191,42 +265,23 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	debug("FAT%d: entry: 0x%08x = %d, offset: 0x%04x = %d\n",
 	       mydata->fatsize, entry, entry, offset, offset);
 
-	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		__u32 getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		startblock += mydata->fat_sect;	/* Offset from start of disk */
-
-		/* Write back the fatbuf to the disk */
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return ret;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	win = fat_get_window(mydata, bufnum);
+	if (win < 0)
+		return ret;
+	fatbuf = mydata->fatbuf + win * FATBUFSIZE;
 
 	/* Get the actual entry from the table */
 	switch (mydata->fatsize) {
 	case 32:
-		ret = FAT2CPU32(((__u32 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU32(((__u32 *)fatbuf)[offset]);
 		break;
 	case 16:
-		ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU16(((__u16 *)fatbuf)[offset]);
 		break;
 	case 12:
 		off8 = (offset * 3) / 2;
 		/* fatbut + off8 may be unaligned, read in byte granularity */
-		ret = mydata->fatbuf[off8] + (mydata->fatbuf[off8 + 1] << 8);
+		ret = fatbuf[off8] + (fatbuf[off8 + 1] << 8);
 
 		if (offset & 0x1)
 			ret >>= 4;
@@ -300,6 +355,100 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/* Bytes to read at a time, so each piece is written while the next loads */
+#define FAT_SINK_CHUNK	SZ_1M
+
+/*
+ * As get_cluster(), but read the whole sectors in pieces. While each piece
+ * is being read, the data before it from *@sent on is written to @sink, and
+ * *@sent moved up to the piece. The last piece is left for the next call.
+ */
+static int get_cluster_sink(fsdata *mydata, __u32 clustnum, __u8 *buffer,
+			    unsigned long size, struct sink *sink, __u8 **sent)
+{
+	__u32 chunk = FAT_SINK_CHUNK / mydata->sect_size;
+	__u32 startsect = clust_to_sect(mydata, clustnum);
+	struct blk_req req;
+	__u32 n;
+
+	if ((unsigned long)buffer & (ARCH_DMA_MINALIGN - 1))
+		return get_cluster(mydata, clustnum, buffer, size);
+
+	while (size >= mydata->sect_size) {
+		n = min(chunk, (__u32)(size / mydata->sect_size));
+		if (blk_dread_submit(cur_dev, cur_part_info.start + startsect,
+				     n, buffer, &req))
+			return -1;
+		if (buffer > *sent && sink_write(sink, *sent, buffer - *sent)) {
+			blk_dread_wait(&req);
+			return -1;
+		}
+		*sent = buffer;
+		if (blk_dread_wait(&req) != n) {
+			debug("Error reading data\n");
+			return -1;
+		}
+		startsect += n;
+		buffer += n * mydata->sect_size;
+		size -= n * mydata->sect_size;
+	}
+	if (size) {
+		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
+
+		if (disk_read(startsect, 1, tmpbuf) != 1) {
+			debug("Error reading data\n");
+			return -1;
+		}
+		memcpy(buffer, tmpbuf, size);
+	}
+
+	return 0;
+}
+
+/* A run of consecutive clusters of a file */
+struct fat_run {
+	__u32 clust;
+	__u32 count;
+};
+
+#define FAT_RUNS	32	/* Runs mapped at a time by get_contents */
+
+/*
+ * Follow the cluster chain from '*clust' for at most '*nclust' clusters,
+ * merging consecutive clusters into at most 'maxruns' entries of 'runs'.
+ * On return '*clust' is the next cluster to map and '*nclust' has been
+ * reduced by the number of clusters mapped.
+ * Return the number of runs, 0 if the chain ends early.
+ */
+static int fat_map_chain(fsdata *mydata, __u32 *clust, __u32 *nclust,
+			 struct fat_run *runs, int maxruns)
+{
+	struct fat_run *run = NULL;
+	int nruns = 0;
+
+	while (*nclust) {
+		if (CHECK_CLUST(*clust, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", *clust);
+			debug("Invalid FAT entry\n");
+			break;
+		}
+		if (run && run->clust + run->count == *clust) {
+			run->count++;
+		} else if (nruns < maxruns) {
+			run = &runs[nruns++];
+			run->clust = *clust;
+			run->count = 1;
+		} else {
+			break;
+		}
+		/* No need to look up the entry after the last cluster */
+		if (--*nclust)
+			*clust = get_fatent(mydata, *clust);
+	}
+
+	return nruns;
+}
+
 /*
  * Read at most 'maxsize' bytes from 'pos' in the file associated with 'dentptr'
  * into 'buffer'.
@@ -313,9 +462,13 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
+	struct fat_run runs[FAT_RUNS];
 	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
+	__u32 skip, offset, nclust, clust, count;
+	struct sink *sink;
+	__u8 *sent = buffer;
 	loff_t actsize;
+	int nruns, i, ret;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -330,92 +483,76 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
-	actsize = bytesperclust;
-
-	/* go to cluster at pos */
-	while (actsize <= pos) {
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			debug("Invalid FAT entry\n");
-			return 0;
-		}
-		actsize += bytesperclust;
-	}
+	/* Clusters before the one at pos, and clusters up to the last byte */
+	skip = div_u64_rem(pos, bytesperclust, &offset);
+	nclust = div_u64(filesize + bytesperclust - 1, bytesperclust);
+	filesize -= pos;
 
-	/* actsize > pos */
-	actsize -= bytesperclust;
-	filesize -= actsize;
-	pos -= actsize;
-
-	/* align to beginning of next cluster if any */
-	if (pos) {
-		actsize = min(filesize, (loff_t)bytesperclust);
-		if (get_cluster(mydata, curclust, get_contents_vfatname_block,
-				(int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		filesize -= actsize;
-		actsize -= pos;
-		memcpy(buffer, get_contents_vfatname_block + pos, actsize);
-		*gotsize += actsize;
-		if (!filesize)
+	/*
+	 * Map the chain a batch of runs at a time, and read each run, past
+	 * the clusters before pos, with a single request. For a sink, a run
+	 * is read in pieces which are passed on while the next one loads; the
+	 * caller writes whatever is left.
+	 */
+	sink = CONFIG_IS_ENABLED(SINK) ? fs_get_read_sink() : NULL;
+	while (filesize) {
+		nruns = fat_map_chain(mydata, &curclust, &nclust, runs,
+				      FAT_RUNS);
+		if (!nruns)
 			return 0;
-		buffer += actsize;
 
-		curclust = get_fatent(mydata, curclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			debug("Invalid FAT entry\n");
-			return 0;
-		}
-	}
+		for (i = 0; i < nruns && filesize; i++) {
+			clust = runs[i].clust;
+			count = runs[i].count;
+			if (skip >= count) {
+				skip -= count;
+				continue;
+			}
+			clust += skip;
+			count -= skip;
+			skip = 0;
+
+			/* align to beginning of next cluster if any */
+			if (offset) {
+				actsize = min(filesize + offset,
+					      (loff_t)bytesperclust);
+				if (get_cluster(mydata, clust,
+						get_contents_vfatname_block,
+						(int)actsize) != 0) {
+					printf("Error reading cluster\n");
+					return -1;
+				}
+				actsize -= offset;
+				memcpy(buffer, get_contents_vfatname_block +
+				       offset, actsize);
+				*gotsize += actsize;
+				filesize -= actsize;
+				buffer += actsize;
+				offset = 0;
+				clust++;
+				count--;
+			}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				debug("Invalid FAT entry\n");
-				return 0;
+			actsize = min(filesize, (loff_t)count * bytesperclust);
+			if (!actsize)
+				continue;
+			if (sink)
+				ret = get_cluster_sink(mydata, clust, buffer,
+						       actsize, sink, &sent);
+			else
+				ret = get_cluster(mydata, clust, buffer,
+						  actsize);
+			if (ret) {
+				printf("Error reading cluster\n");
+				return -1;
 			}
-			endclust = newclust;
-			actsize += bytesperclust;
+			*gotsize += actsize;
+			filesize -= actsize;
+			buffer += actsize;
 		}
+	}
 
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
-		filesize -= actsize;
-		buffer += actsize;
-
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return 0;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
@@ -561,6 +698,10 @@ static int get_fs_info(fsdata *mydata)
 
 	mydata->fats = bs.fats;
 	mydata->fat_sect = bs.reserved;
+	mydata->fsinfo_sect = mydata->fatsize == 32 ? bs.info_sector : 0;
+	mydata->max_clust = 0;
+	mydata->freemap = NULL;
+	mydata->freemap_done = NULL;
 
 	mydata->rootdir_sect = mydata->fat_sect + mydata->fatlength * bs.fats;
 
@@ -599,13 +740,8 @@ static int get_fs_info(fsdata *mydata)
 			sect_to_clust(mydata, mydata->rootdir_sect);
 	}
 
-	mydata->fatbufnum = -1;
-	mydata->fat_dirty = 0;
-	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE);
-	if (mydata->fatbuf == NULL) {
-		debug("Error: allocating memory\n");
+	if (fat_cache_init(mydata))
 		return -1;
-	}
 
 	debug("FAT%d, fat_sect: %d, fatlength: %d\n",
 	       mydata->fatsize, mydata->fat_sect, mydata->fatlength);
@@ -1069,10 +1205,39 @@ int file_fat_detectfs(void)
 	return 0;
 }
 
+/*
+ * Find a file to read, reusing the directory entry found by an earlier
+ * lookup of the same path. On success itr->dent points at the entry, which
+ * may be the copy in @dent. Returns -EISDIR if the path is a directory.
+ */
+static int fat_itr_resolve_file(fat_itr *itr, const char *path,
+				dir_entry *dent)
+{
+	int ret;
+
+	ret = fs_cache_get_dentry(cur_dev, path, dent, sizeof(*dent));
+	if (ret != -EAGAIN) {
+		itr->dent = ret ? NULL : dent;
+		return ret;
+	}
+
+	ret = fat_itr_resolve(itr, path, TYPE_ANY);
+	if (ret == -ENOENT)
+		fs_cache_put_dentry(cur_dev, path, NULL, 0);
+	if (ret)
+		return ret;
+	if (!itr->dent)
+		return -EISDIR;
+	fs_cache_put_dentry(cur_dev, path, itr->dent, sizeof(*itr->dent));
+
+	return 0;
+}
+
 int fat_exists(const char *filename)
 {
 	fsdata fsdata;
 	fat_itr *itr;
+	dir_entry dent;
 	int ret;
 
 	itr = malloc_cache_aligned(sizeof(fat_itr));
@@ -1082,17 +1247,18 @@ int fat_exists(const char *filename)
 	if (ret)
 		goto out;
 
-	ret = fat_itr_resolve(itr, filename, TYPE_ANY);
+	ret = fat_itr_resolve_file(itr, filename, &dent);
 	free(fsdata.fatbuf);
 out:
 	free(itr);
-	return ret == 0;
+	return ret == 0 || ret == -EISDIR;
 }
 
 int fat_size(const char *filename, loff_t *size)
 {
 	fsdata fsdata;
 	fat_itr *itr;
+	dir_entry dent;
 	int ret;
 
 	itr = malloc_cache_aligned(sizeof(fat_itr));
@@ -1102,20 +1268,18 @@ int fat_size(const char *filename, loff_t *size)
 	if (ret)
 		goto out_free_itr;
 
-	ret = fat_itr_resolve(itr, filename, TYPE_FILE);
-	if (ret) {
+	ret = fat_itr_resolve_file(itr, filename, &dent);
+	if (ret == -EISDIR) {
 		/*
 		 * Directories don't have size, but fs_size() is not
 		 * expected to fail if passed a directory path:
 		 */
-		free(fsdata.fatbuf);
-		fat_itr_root(itr, &fsdata);
-		if (!fat_itr_resolve(itr, filename, TYPE_DIR)) {
-			*size = 0;
-			ret = 0;
-		}
+		*size = 0;
+		ret = 0;
 		goto out_free_both;
 	}
+	if (ret)
+		goto out_free_both;
 
 	*size = FAT2CPU32(itr->dent->size);
 out_free_both:
@@ -1130,6 +1294,7 @@ int file_fat_read_at(const char *filename, loff_t pos, void *buffer,
 {
 	fsdata fsdata;
 	fat_itr *itr;
+	dir_entry dent;
 	int ret;
 
 	itr = malloc_cache_aligned(sizeof(fat_itr));
@@ -1139,7 +1304,9 @@ int file_fat_read_at(const char *filename, loff_t pos, void *buffer,
 	if (ret)
 		goto out_free_itr;
 
-	ret = fat_itr_resolve(itr, filename, TYPE_FILE);
+	ret = fat_itr_resolve_file(itr, filename, &dent);
+	if (ret == -EISDIR)
+		ret = -ENOENT;
 	if (ret)
 		goto out_free_both;
 
@@ -100,19 +100,19 @@ static void set_name(dir_entry *dirent, const char *filename)
 }
 
 /*
- * Write fat buffer into block device
+ * Write fat buffer 'win' into block device if it has been modified
  */
-static int flush_dirty_fat_buffer(fsdata *mydata)
+static int flush_fat_window(fsdata *mydata, int win)
 {
 	int getsize = FATBUFBLOCKS;
 	__u32 fatlength = mydata->fatlength;
-	__u8 *bufptr = mydata->fatbuf;
-	__u32 startblock = mydata->fatbufnum * FATBUFBLOCKS;
+	__u8 *bufptr = mydata->fatbuf + win * FATBUFSIZE;
+	__u32 startblock = mydata->fatbufnum[win] * FATBUFBLOCKS;
 
-	debug("debug: evicting %d, dirty: %d\n", mydata->fatbufnum,
-	      (int)mydata->fat_dirty);
+	debug("debug: evicting %d, dirty: %d\n", mydata->fatbufnum[win],
+	      !!(mydata->fat_dirty & (1 << win)));
 
-	if ((!mydata->fat_dirty) || (mydata->fatbufnum == -1))
+	if (!(mydata->fat_dirty & (1 << win)) || mydata->fatbufnum[win] == -1)
 		return 0;
 
 	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
@@ -135,7 +135,22 @@ static int flush_dirty_fat_buffer(fsdata *mydata)
 			return -1;
 		}
 	}
-	mydata->fat_dirty = 0;
+	mydata->fat_dirty &= ~(1 << win);
+
+	return 0;
+}
+
+/*
+ * Write all modified fat buffers into block device
+ */
+static int flush_dirty_fat_buffer(fsdata *mydata)
+{
+	int win;
+
+	for (win = 0; win < FATBUFWINDOWS; win++) {
+		if (flush_fat_window(mydata, win) < 0)
+			return -1;
+	}
 
 	return 0;
 }
@@ -258,6 +273,118 @@ fill_dir_slot(fat_itr *itr, const char *l_name)
 	return 0;
 }
 
+#define FAT_FREEMAP_CHUNK	8192	/* Clusters of the map read at once */
+
+/*
+ * Set up the free cluster map and read the FAT32 FSInfo sector. The map
+ * is filled in a chunk at a time as the allocator reaches it, so a hint
+ * pointing at free space keeps the FAT from being read as a whole.
+ * Without memory for the map, clusters are looked up in the FAT instead.
+ */
+static void fat_freemap_init(fsdata *mydata)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(__u8, block, mydata->sect_size);
+	fsinfo_sector *fsinfo = (fsinfo_sector *)block;
+	__u32 entries = div_u64((u64)mydata->fatlength * mydata->sect_size * 8,
+				mydata->fatsize);
+	__u32 free_count, next_free;
+
+	mydata->max_clust = min((__u32)((mydata->total_sect -
+					 mydata->data_begin) /
+					mydata->clust_size), entries) - 1;
+	mydata->free_count = FSI_UNKNOWN;
+	mydata->next_free = 2;
+	mydata->fsinfo_dirty = 0;
+
+	if (mydata->fsinfo_sect && mydata->fsinfo_sect < mydata->fat_sect &&
+	    disk_read(mydata->fsinfo_sect, 1, block) == 1 &&
+	    FAT2CPU32(fsinfo->lead_sig) == FSI_LEADSIG &&
+	    FAT2CPU32(fsinfo->struc_sig) == FSI_STRUCSIG &&
+	    FAT2CPU32(fsinfo->trail_sig) == FSI_TRAILSIG) {
+		free_count = FAT2CPU32(fsinfo->free_count);
+		next_free = FAT2CPU32(fsinfo->next_free);
+		if (free_count < mydata->max_clust)
+			mydata->free_count = free_count;
+		if (next_free >= 2 && next_free <= mydata->max_clust)
+			mydata->next_free = next_free;
+	} else {
+		mydata->fsinfo_sect = 0;
+	}
+	debug("FSInfo: %u free, next free %u\n", mydata->free_count,
+	      mydata->next_free);
+
+	mydata->freemap = calloc(mydata->max_clust / 32 + 1, sizeof(__u32));
+	mydata->freemap_done = calloc(mydata->max_clust / FAT_FREEMAP_CHUNK /
+				      32 + 1, sizeof(__u32));
+	if (!mydata->freemap || !mydata->freemap_done) {
+		debug("No memory for the free cluster map\n");
+		free(mydata->freemap);
+		free(mydata->freemap_done);
+		mydata->freemap = NULL;
+		mydata->freemap_done = NULL;
+	}
+}
+
+static void fat_freemap_free(fsdata *mydata)
+{
+	free(mydata->freemap);
+	free(mydata->freemap_done);
+	mydata->freemap = NULL;
+	mydata->freemap_done = NULL;
+}
+
+/*
+ * Record in the free map and FSInfo that 'entry' changes from 'old_value'
+ * to 'entry_value'
+ */
+static void fat_freemap_update(fsdata *mydata, __u32 entry, __u32 old_value,
+			       __u32 entry_value)
+{
+	if (!mydata->max_clust)
+		fat_freemap_init(mydata);
+
+	if (!old_value == !entry_value)
+		return;
+
+	if (mydata->freemap) {
+		if (entry_value)
+			mydata->freemap[entry / 32] |= 1U << (entry % 32);
+		else
+			mydata->freemap[entry / 32] &= ~(1U << (entry % 32));
+	}
+	if (mydata->free_count != FSI_UNKNOWN)
+		mydata->free_count += entry_value ? -1 : 1;
+	if (entry_value)
+		mydata->next_free = entry < mydata->max_clust ? entry + 1 : 2;
+	mydata->fsinfo_dirty = 1;
+}
+
+/*
+ * Write the free cluster count and next free cluster to the FSInfo sector
+ */
+static int flush_fsinfo(fsdata *mydata)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(__u8, block, mydata->sect_size);
+	fsinfo_sector *fsinfo = (fsinfo_sector *)block;
+
+	if (!mydata->fsinfo_dirty || !mydata->fsinfo_sect)
+		return 0;
+
+	if (disk_read(mydata->fsinfo_sect, 1, block) != 1) {
+		debug("error: reading FSInfo sector\n");
+		return -1;
+	}
+	fsinfo->free_count = cpu_to_le32(mydata->free_count);
+	fsinfo->next_free = cpu_to_le32(mydata->next_free);
+	if (disk_write(mydata->fsinfo_sect, 1, block) < 0) {
+		debug("error: writing FSInfo sector\n");
+		return -1;
+	}
+	mydata->fsinfo_dirty = 0;
+
+	return 0;
+}
+
 /*
  * Set the entry at index 'entry' in a FAT (12/16/32) table.
  */
@@ -265,6 +392,8 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 {
 	__u32 bufnum, offset, off16;
 	__u16 val1, val2;
+	__u8 *fatbuf;
+	int win;
 
 	switch (mydata->fatsize) {
 	case 32:
@@ -284,39 +413,25 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 		return -1;
 	}
 
-	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		int getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		startblock += mydata->fat_sect;
+	win = fat_get_window(mydata, bufnum);
+	if (win < 0)
+		return -1;
+	fatbuf = mydata->fatbuf + win * FATBUFSIZE;
 
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return -1;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	/* get_fatent() finds the same buffer */
+	fat_freemap_update(mydata, entry, get_fatent(mydata, entry),
+			   entry_value);
 
 	/* Mark as dirty */
-	mydata->fat_dirty = 1;
+	mydata->fat_dirty |= 1 << win;
 
 	/* Set the actual entry */
 	switch (mydata->fatsize) {
 	case 32:
-		((__u32 *) mydata->fatbuf)[offset] = cpu_to_le32(entry_value);
+		((__u32 *)fatbuf)[offset] = cpu_to_le32(entry_value);
 		break;
 	case 16:
-		((__u16 *) mydata->fatbuf)[offset] = cpu_to_le16(entry_value);
+		((__u16 *)fatbuf)[offset] = cpu_to_le16(entry_value);
 		break;
 	case 12:
 		off16 = (offset * 3) / 4;
@@ -324,33 +439,33 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 		switch (offset & 0x3) {
 		case 0:
 			val1 = cpu_to_le16(entry_value) & 0xfff;
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xfff;
-			((__u16 *)mydata->fatbuf)[off16] |= val1;
+			((__u16 *)fatbuf)[off16] &= ~0xfff;
+			((__u16 *)fatbuf)[off16] |= val1;
 			break;
 		case 1:
 			val1 = cpu_to_le16(entry_value) & 0xf;
 			val2 = (cpu_to_le16(entry_value) >> 4) & 0xff;
 
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xf000;
-			((__u16 *)mydata->fatbuf)[off16] |= (val1 << 12);
+			((__u16 *)fatbuf)[off16] &= ~0xf000;
+			((__u16 *)fatbuf)[off16] |= (val1 << 12);
 
-			((__u16 *)mydata->fatbuf)[off16 + 1] &= ~0xff;
-			((__u16 *)mydata->fatbuf)[off16 + 1] |= val2;
+			((__u16 *)fatbuf)[off16 + 1] &= ~0xff;
+			((__u16 *)fatbuf)[off16 + 1] |= val2;
 			break;
 		case 2:
 			val1 = cpu_to_le16(entry_value) & 0xff;
 			val2 = (cpu_to_le16(entry_value) >> 8) & 0xf;
 
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xff00;
-			((__u16 *)mydata->fatbuf)[off16] |= (val1 << 8);
+			((__u16 *)fatbuf)[off16] &= ~0xff00;
+			((__u16 *)fatbuf)[off16] |= (val1 << 8);
 
-			((__u16 *)mydata->fatbuf)[off16 + 1] &= ~0xf;
-			((__u16 *)mydata->fatbuf)[off16 + 1] |= val2;
+			((__u16 *)fatbuf)[off16 + 1] &= ~0xf;
+			((__u16 *)fatbuf)[off16 + 1] |= val2;
 			break;
 		case 3:
 			val1 = cpu_to_le16(entry_value) & 0xfff;
-			((__u16 *)mydata->fatbuf)[off16] &= ~0xfff0;
-			((__u16 *)mydata->fatbuf)[off16] |= (val1 << 4);
+			((__u16 *)fatbuf)[off16] &= ~0xfff0;
+			((__u16 *)fatbuf)[off16] |= (val1 << 4);
 			break;
 		default:
 			break;
@@ -364,23 +479,148 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 	return 0;
 }
 
+/*
+ * Read chunk 'chunk' of the FAT into the free cluster map
+ * Return 0 on success, -1 otherwise.
+ */
+static int fat_freemap_fill(fsdata *mydata, __u32 chunk)
+{
+	__u32 bytes = FAT_FREEMAP_CHUNK * mydata->fatsize / 8;
+	__u32 getsize = bytes / mydata->sect_size;
+	__u32 startblock = chunk * getsize;
+	__u32 i, clust, value, off8;
+	__u8 *buf;
+
+	/* Have the FAT on disk up to date before reading it */
+	if (flush_dirty_fat_buffer(mydata) < 0)
+		return -1;
+
+	if (startblock + getsize > mydata->fatlength)
+		getsize = mydata->fatlength - startblock;
+	bytes = getsize * mydata->sect_size;
+
+	buf = malloc_cache_aligned(bytes);
+	if (!buf)
+		return -1;
+	if (disk_read(mydata->fat_sect + startblock, getsize, buf) != getsize) {
+		debug("Error reading FAT blocks\n");
+		free(buf);
+		return -1;
+	}
+
+	/* max_clust is within the FAT, so its entry is always read */
+	clust = chunk * FAT_FREEMAP_CHUNK;
+	for (i = 0; i < FAT_FREEMAP_CHUNK && clust <= mydata->max_clust;
+	     i++, clust++) {
+		if (mydata->fatsize == 32) {
+			value = FAT2CPU32(((__u32 *)buf)[i]);
+		} else if (mydata->fatsize == 16) {
+			value = FAT2CPU16(((__u16 *)buf)[i]);
+		} else {
+			off8 = (i * 3) / 2;
+			value = buf[off8] + (buf[off8 + 1] << 8);
+			if (i & 0x1)
+				value >>= 4;
+			value &= 0xfff;
+		}
+		if (value)
+			mydata->freemap[clust / 32] |= 1U << (clust % 32);
+		else
+			mydata->freemap[clust / 32] &= ~(1U << (clust % 32));
+	}
+	mydata->freemap_done[chunk / 32] |= 1U << (chunk % 32);
+	free(buf);
+
+	return 0;
+}
+
+static bool fat_freemap_has(fsdata *mydata, __u32 clust)
+{
+	__u32 chunk = clust / FAT_FREEMAP_CHUNK;
+
+	return mydata->freemap_done[chunk / 32] & (1U << (chunk % 32));
+}
+
+/*
+ * Check whether cluster 'clust' is free.
+ * Return 1 if it is, 0 if it is in use and -1 on error.
+ */
+static int fat_clust_free(fsdata *mydata, __u32 clust)
+{
+	if (!mydata->freemap)
+		return !get_fatent(mydata, clust);
+
+	if (!fat_freemap_has(mydata, clust) &&
+	    fat_freemap_fill(mydata, clust / FAT_FREEMAP_CHUNK) < 0)
+		return -1;
+
+	return !(mydata->freemap[clust / 32] & (1U << (clust % 32)));
+}
+
+/*
+ * Find a free cluster from 'start' on, wrapping around at the end of the
+ * FAT. The first cluster of 'want' free ones in a row is preferred, else
+ * the first free one is taken.
+ * Return the cluster, or 0 if there is none.
+ */
+static __u32 fat_find_free(fsdata *mydata, __u32 start, __u32 want)
+{
+	__u32 clust, left, run = 0, first = 0, found = 0;
+	int ret;
+
+	if (!mydata->max_clust)
+		fat_freemap_init(mydata);
+
+	clust = start;
+	for (left = mydata->max_clust - 1; left; left--, clust++) {
+		if (clust < 2 || clust > mydata->max_clust) {
+			clust = 2;
+			run = 0;
+		}
+
+		/* Skip 32 clusters in use at a time */
+		while (mydata->freemap && !(clust % 32) && left > 32 &&
+		       clust + 31 <= mydata->max_clust &&
+		       fat_freemap_has(mydata, clust) &&
+		       mydata->freemap[clust / 32] == ~0U) {
+			clust += 32;
+			left -= 32;
+			run = 0;
+		}
+		if (clust > mydata->max_clust)
+			continue;
+
+		ret = fat_clust_free(mydata, clust);
+		if (ret < 0)
+			return 0;
+		if (!ret) {
+			run = 0;
+			continue;
+		}
+		if (!run++)
+			first = clust;
+		if (!found)
+			found = clust;
+		if (run >= want)
+			return first;
+	}
+
+	return found;
+}
+
 /*
  * Determine the next free cluster after 'entry' in a FAT (12/16/32) table
  * and link it to 'entry'. EOC marker is not set on returned entry.
+ * Return 0 if there is no free cluster left.
  */
 static __u32 determine_fatent(fsdata *mydata, __u32 entry)
 {
-	__u32 next_fat, next_entry = entry + 1;
+	__u32 next_entry;
 
-	while (1) {
-		next_fat = get_fatent(mydata, next_entry);
-		if (next_fat == 0) {
-			/* found free entry, link to entry */
-			set_fatent_value(mydata, entry, next_entry);
-			break;
-		}
-		next_entry++;
-	}
+	next_entry = fat_find_free(mydata, entry + 1, 1);
+	if (next_entry)
+		/* found free entry, link to entry */
+		set_fatent_value(mydata, entry, next_entry);
 	debug("FAT%d: entry: %08x, entry_value: %04x\n",
 	       mydata->fatsize, entry, next_entry);
 
@@ -573,20 +813,15 @@ get_set_cluster(fsdata *mydata, __u32 clustnum, loff_t pos, __u8 *buffer,
 }
 
 /*
- * Find the first empty cluster
+ * Find an empty cluster, from where the last one was allocated
+ * Return 0 if there is none.
  */
-static int find_empty_cluster(fsdata *mydata)
+static __u32 find_empty_cluster(fsdata *mydata)
 {
-	__u32 fat_val, entry = 3;
+	if (!mydata->max_clust)
+		fat_freemap_init(mydata);
 
-	while (1) {
-		fat_val = get_fatent(mydata, entry);
-		if (fat_val == 0)
-			break;
-		entry++;
-	}
-
-	return entry;
+	return fat_find_free(mydata, mydata->next_free, 1);
 }
 
 /*
@@ -603,6 +838,10 @@ static int flush_dir_table(fat_itr *itr)
 		return -1;
 	}
 	dir_newclust = find_empty_cluster(mydata);
+	if (!dir_newclust) {
+		printf("error: no space left for directory\n");
+		return -1;
+	}
 	set_fatent_value(mydata, itr->clust, dir_newclust);
 	if (mydata->fatsize == 32)
 		set_fatent_value(mydata, dir_newclust, 0xffffff8);
@@ -836,7 +1075,12 @@ set_clusters:
 
 	/* Assure that curclust is valid */
 	if (!curclust) {
-		curclust = find_empty_cluster(mydata);
+		/* Start the file where it fits in one piece if possible */
+		if (!mydata->max_clust)
+			fat_freemap_init(mydata);
+		curclust = fat_find_free(mydata, mydata->next_free,
+					 div_u64(filesize + bytesperclust - 1,
+						 bytesperclust));
 		set_start_cluster(mydata, dentptr, curclust);
 	} else {
 		newclust = get_fatent(mydata, curclust);
@@ -850,6 +1094,10 @@ set_clusters:
 			return -1;
 		}
 	}
+	if (!curclust) {
+		printf("Error: no space left: %llu\n", filesize);
+		return -1;
+	}
 
 	/* TODO: already partially written */
 	if (check_overflow(mydata, curclust, filesize)) {
@@ -863,6 +1111,11 @@ set_clusters:
 		/* search for consecutive clusters */
 		while (actsize < filesize) {
 			newclust = determine_fatent(mydata, endclust);
+			if (!newclust) {
+				printf("Error: no space left: %llu\n",
+				       filesize - actsize);
+				return -1;
+			}
 
 			if ((newclust - 1) != endclust)
 				/* write to <curclust..endclust> */
@@ -1162,8 +1415,10 @@ int file_fat_write_at(const char *filename, loff_t pos, void *buffer,
 	}
 	debug("attempt to write 0x%llx bytes\n", *actwrite);
 
-	/* Flush fat buffer */
+	/* Flush fat buffer and FSInfo */
 	ret = flush_dirty_fat_buffer(mydata);
+	if (!ret)
+		ret = flush_fsinfo(mydata);
 	if (ret) {
 		printf("Error: flush fat buffer\n");
 		ret = -EIO;
@@ -1181,6 +1436,7 @@ int file_fat_write_at(const char *filename, loff_t pos, void *buffer,
 exit:
 	free(filename_copy);
 	free(mydata->fatbuf);
+	fat_freemap_free(mydata);
 	free(itr);
 	return ret;
 }
@@ -1195,7 +1451,6 @@ static int fat_dir_entries(fat_itr *itr)
 {
 	fat_itr *dirs;
 	fsdata fsdata = { .fatbuf = NULL, }, *mydata = &fsdata;
-						/* for FATBUFSIZE */
 	int count;
 
 	dirs = malloc_cache_aligned(sizeof(fat_itr));
@@ -1209,14 +1464,11 @@ static int fat_dir_entries(fat_itr *itr)
 	fat_itr_child(dirs, itr);
 	fsdata = *dirs->fsdata;
 
-	/* allocate local fat buffer */
-	fsdata.fatbuf = malloc_cache_aligned(FATBUFSIZE);
-	if (!fsdata.fatbuf) {
-		debug("Error: allocating memory\n");
+	/* allocate local fat buffers */
+	if (fat_cache_init(mydata)) {
 		count = -ENOMEM;
 		goto exit;
 	}
-	fsdata.fatbufnum = -1;
 	dirs->fsdata = &fsdata;
 
 	for (count = 0; fat_itr_next(dirs); count++)
@@ -1235,7 +1487,7 @@ static int delete_dentry(fat_itr *itr)
 
 	/* free cluster blocks */
 	clear_fatent(mydata, START(dentptr));
-	if (flush_dirty_fat_buffer(mydata) < 0) {
+	if (flush_dirty_fat_buffer(mydata) < 0 || flush_fsinfo(mydata) < 0) {
 		printf("Error: flush fat buffer\n");
 		return -EIO;
 	}
@@ -1323,6 +1575,7 @@ int fat_unlink(const char *filename)
 
 exit:
 	free(fsdata.fatbuf);
+	fat_freemap_free(&fsdata);
 	free(itr);
 	free(filename_copy);
 
@@ -1444,8 +1697,10 @@ int fat_mkdir(const char *new_dirname)
 		goto exit;
 	}
 
-	/* Flush fat buffer */
+	/* Flush fat buffer and FSInfo */
 	ret = flush_dirty_fat_buffer(mydata);
+	if (!ret)
+		ret = flush_fsinfo(mydata);
 	if (ret) {
 		printf("Error: flush fat buffer\n");
 		goto exit;
@@ -1460,6 +1715,7 @@ int fat_mkdir(const char *new_dirname)
 exit:
 	free(dirname_copy);
 	free(mydata->fatbuf);
+	fat_freemap_free(mydata);
 	free(itr);
 	free(dotdent);
 	return ret;
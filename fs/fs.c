@@ -6,16 +6,19 @@
 #include <config.h>
 #include <errno.h>
 #include <common.h>
+#include <malloc.h>
 #include <mapmem.h>
 #include <part.h>
 #include <ext4fs.h>
 #include <fat.h>
 #include <fs.h>
 #include <sandboxfs.h>
+#include <sink.h>
 #include <ubifs_uboot.h>
 #include <btrfs.h>
 #include <asm/io.h>
 #include <div64.h>
+#include <linux/list.h>
 #include <linux/math64.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -24,6 +27,8 @@ static struct blk_desc *fs_dev_desc;
 static int fs_dev_part;
 static disk_partition_t fs_partition;
 static int fs_type = FS_TYPE_ANY;
+/* Sink for the read in progress, see fs_read_sink() */
+static struct sink *fs_sink;
 
 static inline int fs_probe_unsupported(struct blk_desc *fs_dev_desc,
 				      disk_partition_t *fs_partition)
@@ -304,6 +309,227 @@ const char *fs_get_type_name(void)
 	return fs_get_info(fs_type)->name;
 }
 
+/**
+ * struct fs_cache_entry - result of looking up a path
+ *
+ * @list:	Node in fs_cache_list, most recently used first
+ * @if_type:	Interface type of the device
+ * @devnum:	Device number of the device
+ * @hwpart:	Hardware partition of the device
+ * @lba:	Number of blocks of the device
+ * @blksz:	Block size of the device
+ * @part:	Partition the filesystem is on
+ * @fstype:	Type of the filesystem
+ * @exists:	true if the path was found, false for a negative entry
+ * @size:	Size of the file, or -1 if not known yet
+ * @dent:	What the filesystem saved to find the file again without
+ *		walking the directories, see fs_cache_put_dentry()
+ * @dent_len:	Number of bytes in @dent, 0 if none
+ * @path:	Path as given by the caller
+ */
+struct fs_cache_entry {
+	struct list_head list;
+	int if_type;
+	int devnum;
+	int hwpart;
+	lbaint_t lba;
+	ulong blksz;
+	int part;
+	int fstype;
+	bool exists;
+	loff_t size;
+	u8 dent[FS_CACHE_DENT_SIZE];
+	int dent_len;
+	char path[];
+};
+
+#if CONFIG_IS_ENABLED(FS_CACHE)
+static LIST_HEAD(fs_cache_list);
+static struct fs_cache_stats _stats;
+/* Set when the lookup in progress was answered from the cache */
+static bool fs_cache_hit;
+/* Name of the bootstage record of lookups, which shows the counts */
+static char fs_cache_stage[48] = "fs_cache";
+
+static void fs_cache_start(void)
+{
+	bootstage_start(BOOTSTAGE_ID_ACCUM_FS_CACHE, fs_cache_stage);
+	fs_cache_hit = false;
+}
+
+static void fs_cache_mark_hit(void)
+{
+	fs_cache_hit = true;
+}
+
+/* Count the lookup just done, and show the counts in bootstage */
+static void fs_cache_count(void)
+{
+	if (fs_cache_hit)
+		_stats.hits++;
+	else
+		_stats.misses++;
+	snprintf(fs_cache_stage, sizeof(fs_cache_stage),
+		 "fs_cache (%u hits, %u misses)", _stats.hits, _stats.misses);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_FS_CACHE);
+}
+
+static void fs_cache_free(struct fs_cache_entry *ce)
+{
+	list_del(&ce->list);
+	free(ce);
+	_stats.entries--;
+}
+
+/*
+ * Find the entry for a path on the current filesystem, dropping the entries
+ * of the device if the medium changed
+ */
+static struct fs_cache_entry *fs_cache_find(const char *filename)
+{
+	struct fs_cache_entry *ce, *next;
+
+	/* Only block devices tell us when they are written */
+	if (!fs_dev_desc)
+		return NULL;
+
+	list_for_each_entry_safe(ce, next, &fs_cache_list, list) {
+		if (ce->if_type != fs_dev_desc->if_type ||
+		    ce->devnum != fs_dev_desc->devnum ||
+		    ce->hwpart != fs_dev_desc->hwpart)
+			continue;
+		if (ce->lba != fs_dev_desc->lba ||
+		    ce->blksz != fs_dev_desc->blksz) {
+			fs_cache_free(ce);
+			continue;
+		}
+		if (ce->part != fs_dev_part || ce->fstype != fs_type ||
+		    strcmp(ce->path, filename))
+			continue;
+		list_move(&ce->list, &fs_cache_list);
+		return ce;
+	}
+
+	return NULL;
+}
+
+/*
+ * Record the result of a lookup, dropping the oldest entry if full. Returns
+ * the entry, or NULL if none could be made.
+ */
+static struct fs_cache_entry *fs_cache_add(const char *filename, bool exists,
+					   loff_t size)
+{
+	struct fs_cache_entry *ce;
+
+	if (!fs_dev_desc)
+		return NULL;
+	ce = fs_cache_find(filename);
+	if (ce) {
+		ce->exists = exists;
+		if (size >= 0 || !exists)
+			ce->size = size;
+		if (!exists)
+			ce->dent_len = 0;
+		return ce;
+	}
+
+	if (_stats.entries >= CONFIG_FS_CACHE_ENTRIES)
+		fs_cache_free(list_last_entry(&fs_cache_list,
+					      struct fs_cache_entry, list));
+	ce = malloc(sizeof(*ce) + strlen(filename) + 1);
+	if (!ce)
+		return NULL;
+	ce->if_type = fs_dev_desc->if_type;
+	ce->devnum = fs_dev_desc->devnum;
+	ce->hwpart = fs_dev_desc->hwpart;
+	ce->lba = fs_dev_desc->lba;
+	ce->blksz = fs_dev_desc->blksz;
+	ce->part = fs_dev_part;
+	ce->fstype = fs_type;
+	ce->exists = exists;
+	ce->size = size;
+	ce->dent_len = 0;
+	strcpy(ce->path, filename);
+	list_add(&ce->list, &fs_cache_list);
+	_stats.entries++;
+
+	return ce;
+}
+
+int fs_cache_get_dentry(struct blk_desc *dev_desc, const char *filename,
+			void *dent, int len)
+{
+	struct fs_cache_entry *ce;
+
+	/* Only while the fs layer has this device set up for a command */
+	if (dev_desc != fs_dev_desc || fs_type == FS_TYPE_ANY)
+		return -EAGAIN;
+	ce = fs_cache_find(filename);
+	if (!ce || (ce->exists && ce->dent_len != len))
+		return -EAGAIN;
+	fs_cache_mark_hit();
+	if (!ce->exists)
+		return -ENOENT;
+	memcpy(dent, ce->dent, len);
+
+	return 0;
+}
+
+void fs_cache_put_dentry(struct blk_desc *dev_desc, const char *filename,
+			 const void *dent, int len)
+{
+	struct fs_cache_entry *ce;
+
+	if (dev_desc != fs_dev_desc || fs_type == FS_TYPE_ANY ||
+	    len > FS_CACHE_DENT_SIZE)
+		return;
+	ce = fs_cache_add(filename, !!dent, -1);
+	if (ce && dent) {
+		memcpy(ce->dent, dent, len);
+		ce->dent_len = len;
+	}
+}
+
+void fs_cache_invalidate(int iftype, int dev)
+{
+	struct fs_cache_entry *ce, *next;
+
+	list_for_each_entry_safe(ce, next, &fs_cache_list, list) {
+		if (ce->if_type == iftype && ce->devnum == dev)
+			fs_cache_free(ce);
+	}
+}
+
+void fs_cache_stats(struct fs_cache_stats *stats)
+{
+	*stats = _stats;
+}
+#else
+static inline void fs_cache_start(void)
+{
+}
+
+static inline void fs_cache_mark_hit(void)
+{
+}
+
+static inline void fs_cache_count(void)
+{
+}
+
+static inline struct fs_cache_entry *fs_cache_find(const char *filename)
+{
+	return NULL;
+}
+
+static inline struct fs_cache_entry *fs_cache_add(const char *filename,
+						  bool exists, loff_t size)
+{
+	return NULL;
+}
+#endif
+
 int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 {
 	struct fstype_info *info;
@@ -325,10 +551,13 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	}
 #endif
 
+	bootstage_start(BOOTSTAGE_ID_ACCUM_FS, "fs");
 	part = blk_get_device_part_str(ifname, dev_part_str, &fs_dev_desc,
 					&fs_partition, 1);
-	if (part < 0)
+	if (part < 0) {
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_FS);
 		return -1;
+	}
 
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
@@ -344,6 +573,7 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 			return 0;
 		}
 	}
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_FS);
 
 	return -1;
 }
@@ -354,12 +584,15 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 	struct fstype_info *info;
 	int ret, i;
 
+	bootstage_start(BOOTSTAGE_ID_ACCUM_FS, "fs");
 	if (part >= 1)
 		ret = part_get_info(desc, part, &fs_partition);
 	else
 		ret = part_get_info_whole_disk(desc, &fs_partition);
-	if (ret)
+	if (ret) {
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_FS);
 		return ret;
+	}
 	fs_dev_desc = desc;
 
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
@@ -369,6 +602,7 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 			return 0;
 		}
 	}
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_FS);
 
 	return -1;
 }
@@ -380,6 +614,7 @@ static void fs_close(void)
 	info->close();
 
 	fs_type = FS_TYPE_ANY;
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_FS);
 }
 
 int fs_uuid(char *uuid_str)
@@ -405,11 +640,21 @@ int fs_ls(const char *dirname)
 
 int fs_exists(const char *filename)
 {
+	struct fs_cache_entry *ce;
 	int ret;
 
 	struct fstype_info *info = fs_get_info(fs_type);
 
-	ret = info->exists(filename);
+	fs_cache_start();
+	ce = fs_cache_find(filename);
+	if (ce) {
+		ret = ce->exists;
+		fs_cache_mark_hit();
+	} else {
+		ret = info->exists(filename);
+		fs_cache_add(filename, ret, -1);
+	}
+	fs_cache_count();
 
 	fs_close();
 
@@ -418,11 +663,24 @@ int fs_exists(const char *filename)
 
 int fs_size(const char *filename, loff_t *size)
 {
+	struct fs_cache_entry *ce;
 	int ret;
 
 	struct fstype_info *info = fs_get_info(fs_type);
 
-	ret = info->size(filename, size);
+	/* A found path whose size was not asked for yet must be looked up */
+	fs_cache_start();
+	ce = fs_cache_find(filename);
+	if (ce && (!ce->exists || ce->size >= 0)) {
+		*size = ce->size;
+		ret = ce->exists ? 0 : -ENOENT;
+		fs_cache_mark_hit();
+	} else {
+		ret = info->size(filename, size);
+		if (!ret)
+			fs_cache_add(filename, true, *size);
+	}
+	fs_cache_count();
 
 	fs_close();
 
@@ -440,18 +698,52 @@ int fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	 * We don't actually know how many bytes are being read, since len==0
 	 * means read the whole file.
 	 */
+	fs_cache_start();
 	buf = map_sysmem(addr, len);
 	ret = info->read(filename, buf, offset, len, actread);
 	unmap_sysmem(buf);
+	fs_cache_count();
 
 	/* If we requested a specific number of bytes, check we got it */
 	if (ret == 0 && len && *actread != len)
 		debug("** %s shorter than offset + len **\n", filename);
+	/* A whole file tells us its size for a later 'size' or 'test -e' */
+	if (ret == 0 && !offset && !len)
+		fs_cache_add(filename, true, *actread);
 	fs_close();
 
 	return ret;
 }
 
+int fs_read_sink(const char *filename, ulong addr, loff_t offset, loff_t len,
+		 loff_t *actread, struct sink *sink)
+{
+	void *buf;
+	int ret;
+
+	if (!CONFIG_IS_ENABLED(SINK) || !sink)
+		return fs_read(filename, addr, offset, len, actread);
+
+	fs_sink = sink;
+	ret = fs_read(filename, addr, offset, len, actread);
+	fs_sink = NULL;
+	if (ret || sink->size >= *actread)
+		return ret;
+
+	/* Write what the filesystem did not, which may be the whole file */
+	buf = map_sysmem(addr + sink->size, *actread - sink->size);
+	if (sink_write(sink, buf, *actread - sink->size))
+		ret = -1;
+	unmap_sysmem(buf);
+
+	return ret;
+}
+
+struct sink *fs_get_read_sink(void)
+{
+	return fs_sink;
+}
+
 int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 	     loff_t *actwrite)
 {
@@ -580,6 +872,7 @@ int do_load(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[],
 	loff_t bytes;
 	loff_t pos;
 	loff_t len_read;
+	struct sink *hash;
 	int ret;
 	unsigned long time;
 	char *ep;
@@ -621,11 +914,15 @@ int do_load(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[],
 	else
 		pos = 0;
 
+	if (sink_hash_env_new("loadhash", &hash))
+		return 1;
 	time = get_timer(0);
-	ret = fs_read(filename, addr, pos, bytes, &len_read);
+	ret = fs_read_sink(filename, addr, pos, bytes, &len_read, hash);
 	time = get_timer(time);
-	if (ret < 0)
+	if (ret < 0) {
+		sink_hash_env_end("loadhash", hash, ret);
 		return 1;
+	}
 
 	printf("%llu bytes read in %lu ms", len_read, time);
 	if (time > 0) {
@@ -638,6 +935,9 @@ int do_load(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[],
 	env_set_hex("fileaddr", addr);
 	env_set_hex("filesize", len_read);
 
+	if (sink_hash_env_end("loadhash", hash, 0))
+		return 1;
+
 	return 0;
 }
 
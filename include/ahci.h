@@ -16,9 +16,17 @@
 #define AHCI_RX_FIS_SZ		256
 #define AHCI_CMD_TBL_HDR	0x80
 #define AHCI_CMD_TBL_CDB	0x40
-#define AHCI_CMD_TBL_SZ		AHCI_CMD_TBL_HDR + (AHCI_MAX_SG * 16)
+#define AHCI_CMD_TBL_SZ		(AHCI_CMD_TBL_HDR + (AHCI_MAX_SG * 16))
+/* NCQ slots in use; their headers fit in the 256 bytes before the RX FIS */
+#define AHCI_NCQ_SLOTS		8
+#ifdef CONFIG_AHCI_NCQ
+#define AHCI_CMD_TBLS		AHCI_NCQ_SLOTS
+#else
+#define AHCI_CMD_TBLS		1
+#endif
 #define AHCI_PORT_PRIV_DMA_SZ	(AHCI_CMD_SLOT_SZ * AHCI_MAX_CMD_SLOT + \
-				AHCI_CMD_TBL_SZ	+ AHCI_RX_FIS_SZ)
+				AHCI_CMD_TBL_SZ * AHCI_CMD_TBLS + \
+				AHCI_RX_FIS_SZ)
 #define AHCI_CMD_ATAPI		(1 << 5)
 #define AHCI_CMD_WRITE		(1 << 6)
 #define AHCI_CMD_PREFETCH	(1 << 7)
@@ -35,6 +43,10 @@
 #define HOST_VERSION		0x10 /* AHCI spec. version compliancy */
 #define HOST_CAP2		0x24 /* host capabilities, extended */
 
+/* HOST_CAP bits */
+#define HOST_CAP_NCQ		(1 << 30) /* native command queuing */
+#define HOST_CAP_NCS(cap)	((((cap) >> 8) & 0x1f) + 1) /* command slots */
+
 /* HOST_CTL bits */
 #define HOST_RESET		(1 << 0)  /* reset controller; self-clear */
 #define HOST_IRQ_EN		(1 << 1)  /* global IRQ enable */
@@ -141,6 +153,7 @@ struct ahci_ioports {
 	struct ahci_sg		*cmd_tbl_sg;
 	ulong	cmd_tbl;
 	u32	rx_fis;
+	int	ncq_depth;	/* NCQ commands kept in flight, 0 if unused */
 };
 
 /**
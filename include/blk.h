@@ -129,6 +129,24 @@ int blkcache_read(int iftype, int dev,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer);
 
+/**
+ * blkcache_read_lines() - read a set of blocks missing from the cache
+ *
+ * The whole cache lines holding the blocks are read from the device at once
+ * and kept in the cache, together with the lines after them when the device
+ * is being read sequentially.
+ *
+ * @param block_dev - device to read from
+ * @param start - starting block number
+ * @param blkcnt - number of blocks to read
+ * @param buf - buffer to contain the data
+ *
+ * @return - '1' if the blocks were read, '0' if the read is too large to
+ * cache or failed, and should go to the device directly.
+ */
+int blkcache_read_lines(struct blk_desc *block_dev, lbaint_t start,
+			lbaint_t blkcnt, void *buffer);
+
 /**
  * blkcache_fill() - make data read from a block device available
  * to the block cache
@@ -157,8 +175,8 @@ void blkcache_invalidate(int iftype, int dev);
 /**
  * blkcache_configure() - configure block cache
  *
- * @param blocks - maximum blocks per entry
- * @param entries - maximum entries in cache
+ * @param blocks - blocks per cache line, rounded down to a power of two
+ * @param entries - maximum number of lines in the cache
  */
 void blkcache_configure(unsigned blocks, unsigned entries);
 
@@ -168,9 +186,13 @@ void blkcache_configure(unsigned blocks, unsigned entries);
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
-	unsigned entries; /* current entry count */
-	unsigned max_blocks_per_entry;
-	unsigned max_entries;
+	unsigned prefetches; /* lines read ahead */
+	unsigned prefetch_hits; /* lines read ahead and then used */
+	unsigned prefetch_unused; /* lines read ahead and evicted unused */
+	unsigned evictions;
+	unsigned entries; /* current line count */
+	unsigned max_blocks_per_entry; /* blocks per line */
+	unsigned max_entries; /* most lines */
 };
 
 /**
@@ -189,6 +211,13 @@ static inline int blkcache_read(int iftype, int dev,
 	return 0;
 }
 
+static inline int blkcache_read_lines(struct blk_desc *block_dev,
+				      lbaint_t start, lbaint_t blkcnt,
+				      void *buffer)
+{
+	return 0;
+}
+
 static inline void blkcache_fill(int iftype, int dev,
 				 lbaint_t start, lbaint_t blkcnt,
 				 unsigned long blksz, void const *buffer) {}
@@ -197,6 +226,53 @@ static inline void blkcache_invalidate(int iftype, int dev) {}
 
 #endif
 
+#if CONFIG_IS_ENABLED(EFI_PARTITION_CACHE)
+/**
+ * gpt_cache_invalidate() - discard the cached GPT of a device
+ *
+ * @param iftype - IF_TYPE_x for type
+ * @param dev - device index of particular type
+ */
+void gpt_cache_invalidate(int iftype, int dev);
+#else
+static inline void gpt_cache_invalidate(int iftype, int dev) {}
+#endif
+
+#if CONFIG_IS_ENABLED(FS_CACHE)
+/**
+ * fs_cache_invalidate() - discard the cached file lookups of a device
+ *
+ * @param iftype - IF_TYPE_x for type
+ * @param dev - device index of particular type
+ */
+void fs_cache_invalidate(int iftype, int dev);
+#else
+static inline void fs_cache_invalidate(int iftype, int dev) {}
+#endif
+
+/**
+ * struct blk_req - an asynchronous read from a block device
+ *
+ * A read is started with blk_dread_submit() and is complete once
+ * blk_dread_poll() returns 0 or blk_dread_wait() returns. The buffer must
+ * not be touched until then.
+ *
+ * @desc:	Block device to read from
+ * @start:	Start block number to read (0=first)
+ * @blkcnt:	Number of blocks to read
+ * @buffer:	Destination buffer for data read
+ * @ret:	Number of blocks read, or -ve error number, once done
+ * @done:	true once the read is complete
+ */
+struct blk_req {
+	struct blk_desc *desc;
+	lbaint_t start;
+	lbaint_t blkcnt;
+	void *buffer;
+	long ret;
+	bool done;
+};
+
 #if CONFIG_IS_ENABLED(BLK)
 struct udevice;
 
@@ -258,6 +334,31 @@ struct blk_ops {
 	 * @return 0 if OK, -ve on error
 	 */
 	int (*select_hwpart)(struct udevice *dev, int hwpart);
+
+	/**
+	 * read_submit() - start reading from a block device
+	 *
+	 * This returns as soon as the read is under way, so that the caller
+	 * can get on with something else while the device transfers the
+	 * data. A device need only handle one read at a time.
+	 *
+	 * @dev:	Device to read from
+	 * @req:	Read to start (@start, @blkcnt and @buffer are set up)
+	 * @return 0 if started, -ENOSYS if this read must be done with read()
+	 * instead, -EBUSY if another read is in progress, other -ve on error
+	 */
+	int (*read_submit)(struct udevice *dev, struct blk_req *req);
+
+	/**
+	 * read_poll() - check on a read started with read_submit()
+	 *
+	 * @dev:	Device being read
+	 * @req:	Read to check
+	 * @return 0 if the read is complete, with @req->ret set to the
+	 * number of blocks read or a -ve error number, -EBUSY if it is still
+	 * in progress
+	 */
+	int (*read_poll)(struct udevice *dev, struct blk_req *req);
 };
 
 #define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
@@ -275,6 +376,39 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt);
 
+/**
+ * blk_dread_submit() - start reading from a block device
+ *
+ * If the device cannot read in the background, or the data is in the block
+ * cache, the read is done straight away and @req is complete on return.
+ *
+ * @block_dev:	Block device to read from
+ * @start:	Start block number to read (0=first)
+ * @blkcnt:	Number of blocks to read
+ * @buffer:	Destination buffer for data read
+ * @req:	Returns the read request, which must stay valid until complete
+ * @return 0 if OK, -ve on error (in which case the read was not started)
+ */
+int blk_dread_submit(struct blk_desc *block_dev, lbaint_t start,
+		     lbaint_t blkcnt, void *buffer, struct blk_req *req);
+
+/**
+ * blk_dread_poll() - check whether a read has completed
+ *
+ * @req:	Read started with blk_dread_submit()
+ * @return 0 if complete (see @req->ret), -EBUSY if still in progress
+ */
+int blk_dread_poll(struct blk_req *req);
+
+/**
+ * blk_dread_wait() - wait for a read to complete
+ *
+ * @req:	Read started with blk_dread_submit()
+ * @return number of blocks read, or -ve error number (see the
+ * IS_ERR_VALUE() macro)
+ */
+unsigned long blk_dread_wait(struct blk_req *req);
+
 /**
  * blk_find_device() - Find a block device
  *
@@ -450,6 +584,8 @@ static inline ulong blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 			       lbaint_t blkcnt, const void *buffer)
 {
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	gpt_cache_invalidate(block_dev->if_type, block_dev->devnum);
+	fs_cache_invalidate(block_dev->if_type, block_dev->devnum);
 	return block_dev->block_write(block_dev, start, blkcnt, buffer);
 }
 
@@ -457,9 +593,36 @@ static inline ulong blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			       lbaint_t blkcnt)
 {
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
+	gpt_cache_invalidate(block_dev->if_type, block_dev->devnum);
+	fs_cache_invalidate(block_dev->if_type, block_dev->devnum);
 	return block_dev->block_erase(block_dev, start, blkcnt);
 }
 
+/* Without driver model, reads are always done straight away */
+static inline int blk_dread_submit(struct blk_desc *block_dev, lbaint_t start,
+				   lbaint_t blkcnt, void *buffer,
+				   struct blk_req *req)
+{
+	req->desc = block_dev;
+	req->start = start;
+	req->blkcnt = blkcnt;
+	req->buffer = buffer;
+	req->ret = blk_dread(block_dev, start, blkcnt, buffer);
+	req->done = true;
+
+	return 0;
+}
+
+static inline int blk_dread_poll(struct blk_req *req)
+{
+	return 0;
+}
+
+static inline ulong blk_dread_wait(struct blk_req *req)
+{
+	return req->ret;
+}
+
 /**
  * struct blk_driver - Driver for block interface types
  *
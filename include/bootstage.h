@@ -199,6 +199,10 @@ enum bootstage_id {
 	BOOTSTATE_ID_ACCUM_DM_SPL,
 	BOOTSTATE_ID_ACCUM_DM_F,
 	BOOTSTATE_ID_ACCUM_DM_R,
+	BOOTSTAGE_ID_ACCUM_NET,
+	BOOTSTAGE_ID_ACCUM_MMC,
+	BOOTSTAGE_ID_ACCUM_FS,
+	BOOTSTAGE_ID_ACCUM_FS_CACHE,
 
 	/* a few spare for the user, from here */
 	BOOTSTAGE_ID_USER,
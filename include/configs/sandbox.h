@@ -72,6 +72,8 @@
 #define CONFIG_BOOTP_SEND_HOSTNAME
 #define CONFIG_BOOTP_SERVERIP
 #define CONFIG_IP_DEFRAG
+/* Room for a whole TFTP window plus the stale tail of a broken one */
+#define CONFIG_SYS_RX_ETH_BUFFER	16
 
 #ifndef SANDBOX_NO_SDL
 #define CONFIG_SANDBOX_SDL
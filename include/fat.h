@@ -29,6 +29,12 @@
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
 #define FAT32BUFSIZE	(FATBUFSIZE/4)
 
+#if defined(CONFIG_FS_FAT_CACHE_WINDOWS) && !defined(CONFIG_SPL_BUILD)
+#define FATBUFWINDOWS	CONFIG_FS_FAT_CACHE_WINDOWS
+#else
+#define FATBUFWINDOWS	1
+#endif
+
 /* Maximum number of entry for long file name according to spec */
 #define MAX_LFN_SLOT	20
 
@@ -126,6 +132,22 @@ typedef struct volume_info
 	/* Boot sign comes last, 2 bytes */
 } volume_info;
 
+/* FAT32 filesystem info sector */
+#define FSI_LEADSIG	0x41615252
+#define FSI_STRUCSIG	0x61417272
+#define FSI_TRAILSIG	0xaa550000
+#define FSI_UNKNOWN	0xffffffff	/* free_count or next_free not known */
+
+typedef struct fsinfo_sector {
+	__u32	lead_sig;	/* FSI_LEADSIG */
+	__u8	reserved1[480];
+	__u32	struc_sig;	/* FSI_STRUCSIG */
+	__u32	free_count;	/* Number of free clusters */
+	__u32	next_free;	/* Cluster to look for free clusters from */
+	__u8	reserved2[12];
+	__u32	trail_sig;	/* FSI_TRAILSIG */
+} fsinfo_sector;
+
 /* see dir_entry::lcase: */
 #define CASE_LOWER_BASE	8	/* base (name) is lower case */
 #define CASE_LOWER_EXT	16	/* extension is lower case */
@@ -161,20 +183,29 @@ typedef struct dir_slot {
  * (see FAT32 accesses)
  */
 typedef struct {
-	__u8	*fatbuf;	/* Current FAT buffer */
+	__u8	*fatbuf;	/* FATBUFWINDOWS FAT buffers of FATBUFSIZE */
 	int	fatsize;	/* Size of FAT in bits */
 	__u32	fatlength;	/* Length of FAT in sectors */
 	__u16	fat_sect;	/* Starting sector of the FAT */
-	__u8	fat_dirty;      /* Set if fatbuf has been modified */
+	__u32	fat_dirty;	/* Bit set for each modified FAT buffer */
 	__u32	rootdir_sect;	/* Start sector of root directory */
 	__u16	sect_size;	/* Size of sectors in bytes */
 	__u16	clust_size;	/* Size of clusters in sectors */
 	int	data_begin;	/* The sector of the first cluster, can be negative */
-	int	fatbufnum;	/* Used by get_fatent, init to -1 */
+	int	fatbufnum[FATBUFWINDOWS];	/* FAT window held, or -1 */
+	__u32	fatbufused[FATBUFWINDOWS];	/* Last use, for LRU */
+	__u32	fatbuftick;	/* Counts FAT buffer uses */
 	int	rootdir_size;	/* Size of root dir for non-FAT32 */
 	__u32	root_cluster;	/* First cluster of root dir for FAT32 */
 	u32	total_sect;	/* Number of sectors */
 	int	fats;		/* Number of FATs */
+	__u16	fsinfo_sect;	/* FAT32 FSInfo sector, or 0 if none */
+	__u8	fsinfo_dirty;	/* Set if free_count or next_free changed */
+	__u32	free_count;	/* Free clusters, or FSI_UNKNOWN */
+	__u32	next_free;	/* Cluster to look for free clusters from */
+	__u32	max_clust;	/* Highest cluster, 0 until freemap is set up */
+	__u32	*freemap;	/* Bit set for each cluster in use */
+	__u32	*freemap_done;	/* Bit set for each chunk of freemap read in */
 } fsdata;
 
 static inline u32 clust_to_sect(fsdata *fsdata, u32 clust)
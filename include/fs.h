@@ -6,6 +6,10 @@
 #define _FS_H
 
 #include <common.h>
+#include <linux/errno.h>
+
+struct blk_desc;
+struct sink;
 
 #define FS_TYPE_ANY	0
 #define FS_TYPE_FAT	1
@@ -85,6 +89,30 @@ int fs_size(const char *filename, loff_t *size);
 int fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 	    loff_t *actread);
 
+/*
+ * fs_read_sink - Read a file as fs_read() does, also writing it to a sink
+ * Filesystems which can pass each piece of the file on to @sink while the
+ * next piece is read do so; anything left is written once the read is done.
+ *
+ * @filename: Name of file to read from
+ * @addr: The address to read into
+ * @offset: The offset in file to read from
+ * @len: The number of bytes to read. Maybe 0 to read entire file
+ * @actread: Returns the actual number of bytes read
+ * @sink: Sink to write the bytes read to, which must not have been written
+ *	yet, or NULL for none
+ * @return 0 if ok with valid *actread, -1 on error conditions
+ */
+int fs_read_sink(const char *filename, ulong addr, loff_t offset, loff_t len,
+		 loff_t *actread, struct sink *sink);
+
+/*
+ * fs_get_read_sink - Get the sink for the read in progress, for filesystems
+ *
+ * @return sink passed to fs_read_sink(), or NULL if none
+ */
+struct sink *fs_get_read_sink(void);
+
 /*
  * fs_write - Write file to the partition previously set by fs_set_blk_dev()
  * Note that not all filesystem types support offset!=0.
@@ -173,6 +201,68 @@ int fs_unlink(const char *filename);
  */
 int fs_mkdir(const char *filename);
 
+/*
+ * statistics of the file lookup cache
+ */
+struct fs_cache_stats {
+	unsigned hits;
+	unsigned misses;
+	unsigned entries; /* paths held */
+};
+
+/*
+ * fs_cache_stats - return statistics of the file lookup cache
+ *
+ * @stats: statistics are copied here
+ */
+void fs_cache_stats(struct fs_cache_stats *stats);
+
+/* Most a filesystem may save for a path, see fs_cache_put_dentry() */
+#define FS_CACHE_DENT_SIZE	32
+
+#if CONFIG_IS_ENABLED(FS_CACHE)
+/*
+ * fs_cache_get_dentry - look up a path in the file lookup cache
+ *
+ * This lets a filesystem skip walking the directories to a file it has
+ * found before on the device the fs layer has open.
+ *
+ * @dev_desc: Device the filesystem is reading
+ * @filename: Path being looked up
+ * @dent: the data saved by fs_cache_put_dentry() is copied here
+ * @len: Size of @dent, which must match the size saved
+ * @return 0 if found, -ENOENT if the path is known to be missing, -EAGAIN
+ * if the path must be looked up on the device
+ */
+int fs_cache_get_dentry(struct blk_desc *dev_desc, const char *filename,
+			void *dent, int len);
+
+/*
+ * fs_cache_put_dentry - save the result of looking up a path
+ *
+ * @dev_desc: Device the filesystem is reading
+ * @filename: Path that was looked up
+ * @dent: Data to find the file again, e.g. its directory entry, or NULL if
+ * the path does not exist
+ * @len: Size of @dent, at most FS_CACHE_DENT_SIZE
+ */
+void fs_cache_put_dentry(struct blk_desc *dev_desc, const char *filename,
+			 const void *dent, int len);
+#else
+static inline int fs_cache_get_dentry(struct blk_desc *dev_desc,
+				      const char *filename, void *dent,
+				      int len)
+{
+	return -EAGAIN;
+}
+
+static inline void fs_cache_put_dentry(struct blk_desc *dev_desc,
+				       const char *filename, const void *dent,
+				       int len)
+{
+}
+#endif
+
 /*
  * Common implementation for various filesystem commands, optionally limited
  * to a specific filesystem type via the fstype parameter.
@@ -70,9 +70,11 @@
 #define MMC_MODE_4BIT		BIT(29)
 #define MMC_MODE_1BIT		BIT(28)
 #define MMC_MODE_SPI		BIT(27)
+#define MMC_MODE_CMD23		BIT(26)	/* SET_BLOCK_COUNT before transfers */
 
 
 #define SD_DATA_4BIT	0x00040000
+#define SD_CMD23_SUPPORT	0x00000002
 
 #define IS_SD(x)	((x)->version & SD_VERSION_SD)
 #define IS_MMC(x)	((x)->version & MMC_VERSION_MMC)
@@ -119,6 +121,7 @@
 
 #define SD_CMD_APP_SET_BUS_WIDTH	6
 #define SD_CMD_APP_SD_STATUS		13
+#define SD_CMD_APP_SET_WR_BLK_ERASE_COUNT	23
 #define SD_CMD_ERASE_WR_BLK_START	32
 #define SD_CMD_ERASE_WR_BLK_END		33
 #define SD_CMD_APP_SEND_OP_COND		41
@@ -168,6 +171,7 @@ static inline bool mmc_is_tuning_cmd(uint cmdidx)
 #define MMC_STATUS_CURR_STATE	(0xf << 9)
 #define MMC_STATUS_ERROR	(1 << 19)
 
+#define MMC_STATE_TRANS		(4 << 9)
 #define MMC_STATE_PRG		(7 << 9)
 
 #define MMC_VDD_165_195		0x00000080	/* VDD voltage 1.65 - 1.95 */
@@ -461,6 +465,31 @@ struct dm_mmc_ops {
 	 */
 	int (*wait_dat0)(struct udevice *dev, int state, int timeout);
 #endif
+
+	/**
+	 * send_cmd_async() - Send a command and start its data transfer
+	 *
+	 * This returns once the command has been accepted, leaving the
+	 * controller to move the data by itself. The transfer must be
+	 * finished with poll_data() before another command is sent.
+	 *
+	 * @dev:	Device to receive the command
+	 * @cmd:	Command to send
+	 * @data:	Data to receive
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*send_cmd_async)(struct udevice *dev, struct mmc_cmd *cmd,
+			      struct mmc_data *data);
+
+	/**
+	 * poll_data() - Check on the data transfer of send_cmd_async()
+	 *
+	 * @dev:	Device to check
+	 * @data:	Data passed to send_cmd_async()
+	 * @return 0 if the transfer is complete, -EBUSY if it is still in
+	 * progress, other -ve on error
+	 */
+	int (*poll_data)(struct udevice *dev, struct mmc_data *data);
 };
 
 #define mmc_get_ops(dev)        ((struct dm_mmc_ops *)(dev)->driver->ops)
@@ -473,6 +502,9 @@ int dm_mmc_get_cd(struct udevice *dev);
 int dm_mmc_get_wp(struct udevice *dev);
 int dm_mmc_execute_tuning(struct udevice *dev, uint opcode);
 int dm_mmc_wait_dat0(struct udevice *dev, int state, int timeout);
+int dm_mmc_send_cmd_async(struct udevice *dev, struct mmc_cmd *cmd,
+			  struct mmc_data *data);
+int dm_mmc_poll_data(struct udevice *dev, struct mmc_data *data);
 
 /* Transition functions for compatibility */
 int mmc_set_ios(struct mmc *mmc);
@@ -619,6 +651,9 @@ struct mmc {
 	struct blk_desc block_dev;
 #endif
 	char op_cond_pending;	/* 1 if we are waiting on an op_cond command */
+	char sd_op_cond_pending;	/* 1 if an SD card is still powering up */
+	bool op_cond_uhs;	/* UHS was asked for in the pending ACMD41 */
+	ulong op_cond_start;	/* time we started waiting for the op_cond */
 	char init_in_progress;	/* 1 if we have done mmc_start_init() */
 	char preinit;		/* start init as early as possible */
 	int ddr_mode;
@@ -628,6 +663,10 @@ struct mmc {
 	struct udevice *vmmc_supply;	/* Main voltage regulator (Vcc)*/
 	struct udevice *vqmmc_supply;	/* IO voltage regulator (Vccq)*/
 #endif
+#if CONFIG_IS_ENABLED(BLK)
+	struct blk_req *read_req;	/* read in progress, or NULL */
+	struct mmc_data read_data;	/* data transfer of that read */
+#endif
 #endif
 	u8 *ext_csd;
 	u32 cardtype;		/* cardtype read from the MMC */
@@ -817,6 +856,86 @@ int mmc_start_init(struct mmc *mmc);
  */
 void mmc_set_preinit(struct mmc *mmc, int preinit);
 
+/**
+ * struct mmc_handoff - state of an MMC card passed on to the next phase
+ *
+ * SPL fills this in once it has finished with its boot device, so that
+ * U-Boot proper can carry on using the card without enumerating it again.
+ *
+ * @valid: 1 until the record has been used
+ * @devnum: Block device number of the MMC device
+ * @version: Card version (SD_VERSION_... or MMC_VERSION_...)
+ * @ocr, @scr, @csd, @cid: Card registers
+ * @card_caps: Card capabilities (MMC_MODE_...)
+ * @clock: Bus clock in Hz
+ * @ssr_au, @ssr_erase_timeout, @ssr_erase_offset: SD status, see sd_ssr
+ * @rca: Relative card address
+ * @high_capacity: 1 if the card is addressed in blocks
+ * @bus_width: Bus width in bits
+ * @selected_mode: Bus mode (enum bus_mode)
+ * @signal_voltage: Signal voltage (enum mmc_voltage)
+ * @hwpart: Hardware partition the card is switched to
+ * @part_config: PARTITION_CONFIG of an MMC card
+ * @has_ext_csd: 1 if @ext_csd holds the EXT_CSD of an MMC v4 card
+ * @ext_csd: EXT_CSD register
+ */
+struct mmc_handoff {
+	u32 valid;
+	u32 devnum;
+	u32 version;
+	u32 ocr;
+	u32 scr[2];
+	u32 csd[4];
+	u32 cid[4];
+	u32 card_caps;
+	u32 clock;
+	u32 ssr_au;
+	u32 ssr_erase_timeout;
+	u32 ssr_erase_offset;
+	u16 rca;
+	u8 high_capacity;
+	u8 bus_width;
+	u8 selected_mode;
+	u8 signal_voltage;
+	u8 hwpart;
+	u8 part_config;
+	u8 has_ext_csd;
+	u8 spare[3];
+	u8 ext_csd[MMC_MAX_BLOCK_LEN];
+};
+
+#if defined(CONFIG_MMC_HANDOFF) && CONFIG_IS_ENABLED(BLOBLIST)
+/**
+ * mmc_handoff_save() - Record the state of a card for the next phase
+ *
+ * This adds it to the bloblist, where mmc_init() in the next phase looks
+ * for it.
+ *
+ * @mmc:	Initialised MMC device
+ * @return 0 if OK, -ENOSPC if there is no space in the bloblist
+ */
+int mmc_handoff_save(struct mmc *mmc);
+#else
+static inline int mmc_handoff_save(struct mmc *mmc)
+{
+	return -ENOSYS;
+}
+#endif
+
+/**
+ * mmc_init_devices() - Initialise several MMC devices at once
+ *
+ * The power-up of every card is started first, then they are polled in turn
+ * and each is enumerated as soon as it is ready. The total time taken is
+ * then close to that of the slowest card rather than the sum of them all.
+ * The time at which each device is ready is recorded with bootstage.
+ *
+ * @mmcs:	Devices to initialise
+ * @count:	Number of devices
+ * @return 0 if all were initialised, else the last error seen
+ */
+int mmc_init_devices(struct mmc **mmcs, int count);
+
 #ifdef CONFIG_MMC_SPI
 #define mmc_host_is_spi(mmc)	((mmc)->cfg->host_caps & MMC_MODE_SPI)
 #else
@@ -118,6 +118,13 @@ enum eth_recv_flags {
  *	 indicate that the hardware receive FIFO is empty. If 0 is returned, the
  *	 network stack will not process the empty packet, but free_pkt() will be
  *	 called if supplied
+ * recv_batch: Return up to "budget" packets the hardware received, setting
+ *	       the pointers to their buffers in "packets" and their lengths in
+ *	       "lengths". Returns the number of packets, 0 if there are none,
+ *	       or an error. All of them are processed before free_pkt() is
+ *	       called for each, in order, so none of the buffers may be reused
+ *	       before then. Used instead of recv when supplied, so that a ring
+ *	       is drained with one call - optional
  * free_pkt: Give the driver an opportunity to manage its packet buffer memory
  *	     when the network stack is finished processing it. This will only be
  *	     called when no error was returned from recv - optional
@@ -138,6 +145,8 @@ struct eth_ops {
 	int (*start)(struct udevice *dev);
 	int (*send)(struct udevice *dev, void *packet, int length);
 	int (*recv)(struct udevice *dev, int flags, uchar **packetp);
+	int (*recv_batch)(struct udevice *dev, int flags, uchar **packets,
+			  int *lengths, int budget);
 	int (*free_pkt)(struct udevice *dev, uchar *packet, int length);
 	void (*stop)(struct udevice *dev);
 #ifdef CONFIG_MCAST_TFTP
@@ -161,8 +170,69 @@ unsigned char *eth_get_ethaddr(void); /* get the current device MAC */
 int eth_is_active(struct udevice *dev); /* Test device for active state */
 int eth_init_state_only(void); /* Set active state */
 void eth_halt_state_only(void); /* Set passive state */
+
+#ifdef CONFIG_NET_STATS
+/**
+ * struct eth_stats - traffic counters of an Ethernet device
+ *
+ * @rx_packets:	Packets received
+ * @rx_bytes:	Bytes received
+ * @rx_errors:	Errors reported by the driver's recv()
+ * @rx_dropped:	Packets dropped by the network stack as malformed or not for us
+ * @rx_csum_errors: Packets dropped for a bad IP, UDP or TCP checksum
+ * @rx_polls:	Polls of the device which returned at least one packet
+ * @rx_batch_max: Largest number of packets returned by one poll
+ * @tx_packets:	Packets sent
+ * @tx_bytes:	Bytes sent
+ * @tx_errors:	Errors reported by the driver's send()
+ * @timeouts:	Timeouts of the TFTP, NFS or TCP state machines
+ * @retransmits: Requests, ACKs or segments sent again
+ * @dup_blocks:	Data blocks received twice or out of order, and dropped
+ * @xfer_bytes:	Size of the last file loaded
+ * @xfer_ms:	Time taken to load the last file, in ms
+ */
+struct eth_stats {
+	ulong rx_packets;
+	ulong rx_bytes;
+	ulong rx_errors;
+	ulong rx_dropped;
+	ulong rx_csum_errors;
+	ulong rx_polls;
+	ulong rx_batch_max;
+	ulong tx_packets;
+	ulong tx_bytes;
+	ulong tx_errors;
+	ulong timeouts;
+	ulong retransmits;
+	ulong dup_blocks;
+	ulong xfer_bytes;
+	ulong xfer_ms;
+};
+
+/**
+ * eth_get_stats() - get the counters of a device
+ *
+ * @dev:	Ethernet device, or NULL
+ * @return pointer to the counters of @dev, or NULL if there is no device or
+ * it is not probed
+ */
+struct eth_stats *eth_get_stats(struct udevice *dev);
+
+/* Count an event against the current device */
+#define net_stats_add(field, n) \
+	do { \
+		struct eth_stats *__stats = eth_get_stats(eth_get_dev()); \
+		if (__stats) \
+			__stats->field += (n); \
+	} while (0)
+#endif
 #endif
 
+#ifndef CONFIG_NET_STATS
+#define net_stats_add(field, n)	do { } while (0)
+#endif
+#define net_stats_inc(field)	net_stats_add(field, 1)
+
 #ifndef CONFIG_DM_ETH
 struct eth_device {
 #define ETH_NAME_LEN 20
@@ -537,7 +607,7 @@ extern int		net_restart_wrap;	/* Tried all network devices */
 
 enum proto_t {
 	BOOTP, RARP, ARP, TFTPGET, DHCP, PING, DNS, NFS, CDP, NETCONS, SNTP,
-	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL
+	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL, WGET
 };
 
 extern char	net_boot_file_name[1024];/* Boot File name */
@@ -548,6 +618,12 @@ extern u32	net_boot_file_size;
 /* Boot file size in blocks as reported by the DHCP server */
 extern u32	net_boot_file_expected_size_in_blocks;
 
+#ifdef CONFIG_NET_SINK
+/* Chain the received file is written to, NULL to store it as is */
+extern struct sink *net_sink;
+int net_sink_store(ulong offset, const void *src, ulong len);
+#endif
+
 #if defined(CONFIG_CMD_DNS)
 extern char *net_dns_resolve;		/* The host to resolve  */
 extern char *net_dns_env_var;		/* the env var to put the ip into */
@@ -638,6 +714,21 @@ void net_set_udp_handler(rxhand_f *);	/* Set UDP RX packet handler */
 rxhand_f *net_get_arp_handler(void);	/* Get ARP RX packet handler */
 void net_set_arp_handler(rxhand_f *);	/* Set ARP RX packet handler */
 bool arp_is_waiting(void);		/* Waiting for ARP reply? */
+#ifdef CONFIG_NET_ARP_CACHE
+/**
+ * arp_cache_lookup() - Look up where to send packets for an IP address
+ *
+ * This finds the Ethernet address of @dest, or of the gateway if @dest is
+ * not on our subnet, among the neighbours learnt on the current interface.
+ *
+ * @dest:	Destination IP address
+ * @ethaddr:	Returns the Ethernet address to send to
+ * @return 0 if found, -ENOENT if an ARP request is needed
+ */
+int arp_cache_lookup(struct in_addr dest, uchar *ethaddr);
+void arp_cache_flush(void);		/* Forget all neighbours */
+void arp_cache_print(void);		/* Show neighbours and counters */
+#endif
 void net_set_icmp_handler(rxhand_icmp_f *f); /* Set ICMP RX handler */
 void net_set_timeout_handler(ulong, thand_f *);/* Set timeout handler */
 
@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Minimal TCP client, enough to download a file over a single connection
+ */
+
+#ifndef __TCP_H__
+#define __TCP_H__
+
+#define IPPROTO_TCP	6	/* Transmission Control Protocol	*/
+
+/*
+ *	TCP header.
+ */
+struct tcp_hdr {
+	u16		tcp_src;	/* TCP source port		*/
+	u16		tcp_dst;	/* TCP destination port		*/
+	u32		tcp_seq;	/* Sequence number		*/
+	u32		tcp_ack;	/* Acknowledgement number	*/
+	u8		tcp_hlen;	/* Header length in words << 4	*/
+	u8		tcp_flags;	/* TCP_SYN etc.			*/
+	u16		tcp_win;	/* Window, to be scaled		*/
+	u16		tcp_xsum;	/* Checksum			*/
+	u16		tcp_urg;	/* Urgent pointer		*/
+} __attribute__((packed));
+
+#define TCP_HDR_SIZE		(sizeof(struct tcp_hdr))
+
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PUSH	0x08
+#define TCP_ACK		0x10
+
+/* Options sent with our SYN: MSS, then NOP and window scale */
+#define TCP_OPT_END	0
+#define TCP_OPT_NOP	1
+#define TCP_OPT_MSS	2
+#define TCP_OPT_WS	3
+#define TCP_SYN_OPT_SIZE	8
+
+/* Largest segment we can receive in one Ethernet frame */
+#define TCP_MSS		(1500 - IP_HDR_SIZE - TCP_HDR_SIZE)
+
+enum tcp_state {
+	TCP_CLOSED,
+	TCP_SYN_SENT,
+	TCP_ESTABLISHED,
+	TCP_CLOSE_WAIT,		/* the peer has no more data for us */
+	TCP_FIN_WAIT,		/* we have no more data for the peer */
+};
+
+enum tcp_event {
+	TCP_EV_CONNECTED,	/* the connection is up, data may be sent */
+	TCP_EV_CLOSED,		/* the peer sent all its data */
+	TCP_EV_RESET,		/* the peer refused or reset the connection */
+	TCP_EV_TIMEOUT,		/* the peer stopped answering */
+};
+
+/**
+ * typedef tcp_rx_f - handle data received in order
+ *
+ * @data:	Data received
+ * @offset:	Offset of @data in the stream sent by the peer
+ * @len:	Number of bytes received
+ */
+typedef void tcp_rx_f(const uchar *data, u32 offset, u32 len);
+
+/**
+ * typedef tcp_event_f - handle a change in the state of the connection
+ *
+ * @event:	What happened
+ */
+typedef void tcp_event_f(enum tcp_event event);
+
+/**
+ * tcp_connect() - open the connection to a server
+ *
+ * This sends the SYN; @event is called with TCP_EV_CONNECTED once the
+ * server answers. Any previous connection is forgotten.
+ *
+ * @dest:	Address of the server
+ * @dport:	Port of the server
+ * @rx:		Called with the data received from the server
+ * @event:	Called when the state of the connection changes
+ * @return 0 if ok, -ve on error
+ */
+int tcp_connect(struct in_addr dest, int dport, tcp_rx_f *rx,
+		tcp_event_f *event);
+
+/**
+ * tcp_send() - queue data to send to the server
+ *
+ * @data:	Data to send
+ * @len:	Number of bytes to send
+ * @return 0 if ok, -ENOSPC if the send buffer is full, -ENOTCONN if the
+ * connection is not established
+ */
+int tcp_send(const void *data, u32 len);
+
+/**
+ * tcp_close() - send a FIN after any queued data
+ *
+ * We do not wait for the FIN to be acknowledged.
+ */
+void tcp_close(void);
+
+/**
+ * tcp_abort() - reset the connection
+ */
+void tcp_abort(void);
+
+/**
+ * tcp_get_state() - get the state of the connection
+ *
+ * @return state of the connection
+ */
+enum tcp_state tcp_get_state(void);
+
+/**
+ * tcp_checksum() - compute the checksum of a TCP segment
+ *
+ * @src:	Source IP address
+ * @dest:	Destination IP address
+ * @seg:	TCP header and payload
+ * @len:	Length of the segment
+ * @return checksum to store in the header, or 0 (or 0xffff) when checking a
+ * segment whose checksum is correct
+ */
+u16 tcp_checksum(struct in_addr src, struct in_addr dest, const void *seg,
+		 int len);
+
+/**
+ * tcp_set_tcp_header() - fill in the IP and TCP headers of a segment
+ *
+ * The payload, if any, must already be in place after a TCP header without
+ * options. A SYN carries our options and no payload.
+ *
+ * @pkt:	Start of the IP header
+ * @dest:	Destination IP address
+ * @dport:	Destination port
+ * @sport:	Source port
+ * @payload_len: Number of bytes of payload
+ * @action:	TCP flags
+ * @tcp_seq_num: Sequence number
+ * @tcp_ack_num: Acknowledgement number
+ * @return size of the IP and TCP headers
+ */
+int tcp_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 tcp_seq_num,
+		       u32 tcp_ack_num);
+
+/**
+ * tcp_receive() - process a TCP segment
+ *
+ * @ip:		IP header of the segment, whose IP checksum is correct
+ * @len:	Length of the IP packet
+ */
+void tcp_receive(struct ip_udp_hdr *ip, int len);
+
+/**
+ * tcp_poll() - send the ACK delayed by the last received segments
+ *
+ * Called after each poll of the Ethernet device, so that the segments it
+ * had queued are acknowledged together.
+ */
+void tcp_poll(void);
+
+#endif /* __TCP_H__ */
@@ -22,6 +22,43 @@ void tftp_start(enum proto_t protocol);	/* Begin TFTP get/put */
 void tftp_start_server(void);	/* Wait for incoming TFTP put */
 #endif
 
+#ifdef CONFIG_TFTP_MULTI
+/* Largest number of files loaded by one tftpboot -m */
+#define TFTP_MULTI_MAX	8
+
+/**
+ * tftp_multi_add() - add a file to load with the next TFTPGET
+ *
+ * Once files have been added, the next TFTPGET loads all of them from the
+ * server at once, instead of net_boot_file_name to load_addr. It finishes
+ * with load_addr and net_boot_file_size set for the last file added.
+ *
+ * @addr:	Address to load the file to
+ * @filename:	Name of the file on the server
+ * @return 0 if ok, -ENOSPC if TFTP_MULTI_MAX files are already listed,
+ * -ENAMETOOLONG if the name is too long
+ */
+int tftp_multi_add(ulong addr, const char *filename);
+
+/**
+ * tftp_multi_probe() - find out which of the files added the server has
+ *
+ * The read requests for all the files added with tftp_multi_add() are sent
+ * at once, and each transfer is stopped at the server's first answer, so
+ * that nothing is loaded. The probe ends as soon as the first file the
+ * server has, in the order added, is known.
+ *
+ * @return index of that file, -ENOENT if the server has none of them, or
+ * -EIO if it could not be reached
+ */
+int tftp_multi_probe(void);
+
+/**
+ * tftp_multi_clear() - forget the files added by tftp_multi_add()
+ */
+void tftp_multi_clear(void);
+#endif
+
 extern ulong tftp_timeout_ms;
 extern int tftp_timeout_count_max;
 
@@ -273,6 +273,20 @@ struct part_driver {
 	int (*get_info)(struct blk_desc *dev_desc, int part,
 			disk_partition_t *info);
 
+	/**
+	 * get_info_by_name() - Find a partition by name (optional)
+	 *
+	 * If this is NULL, get_info() is called for each partition in turn.
+	 *
+	 * @dev_desc:	Block device descriptor
+	 * @name:	Name of the partition to find
+	 * @info:	Returns partition information
+	 * @return partition number (1 = first) of the first partition with
+	 *	   that name, or -1 if there is none
+	 */
+	int (*get_info_by_name)(struct blk_desc *dev_desc, const char *name,
+				disk_partition_t *info);
+
 	/**
 	 * print() - Print partition information
 	 *
@@ -422,6 +436,22 @@ int get_disk_guid(struct blk_desc *dev_desc, char *guid);
 
 #endif
 
+/*
+ * statistics of the GPT cache
+ */
+struct gpt_cache_stats {
+	unsigned hits;
+	unsigned misses;
+	unsigned entries; /* tables held */
+};
+
+/**
+ * gpt_cache_stats() - return statistics of the GPT cache
+ *
+ * @param stats - statistics are copied here
+ */
+void gpt_cache_stats(struct gpt_cache_stats *stats);
+
 #if CONFIG_IS_ENABLED(DOS_PARTITION)
 /**
  * is_valid_dos_buf() - Ensure that a DOS MBR image is valid
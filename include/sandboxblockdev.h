@@ -12,6 +12,9 @@ struct host_block_dev {
 #endif
 	char *filename;
 	int fd;
+#ifdef CONFIG_BLK
+	struct blk_req *req;	/* read in progress, or NULL */
+#endif
 };
 
 int host_dev_bind(int dev, char *filename);
@@ -186,6 +186,7 @@
 /* 55-57 reserved */
 
 #define SDHCI_ADMA_ADDRESS	0x58
+#define SDHCI_ADMA_ADDRESS_HI	0x5C
 
 /* 60-FB reserved */
 
@@ -235,6 +236,33 @@ struct sdhci_host;
  */
 #define SDHCI_DEFAULT_BOUNDARY_SIZE	(512 * 1024)
 #define SDHCI_DEFAULT_BOUNDARY_ARG	(7)
+
+/*
+ * ADMA2 descriptor. The 32-bit form stops after addr_lo, the 64-bit form
+ * (SD Host Controller Specification Version 3.00) carries addr_hi too.
+ */
+struct sdhci_adma_desc {
+	u8 attr;
+	u8 reserved;
+	__le16 len;
+	__le32 addr_lo;
+	__le32 addr_hi;
+} __packed;
+
+#define SDHCI_ADMA_DESC_32_SZ	8
+#define SDHCI_ADMA_DESC_64_SZ	12
+
+#define ADMA_DESC_ATTR_VALID	BIT(0)
+#define ADMA_DESC_ATTR_END	BIT(1)
+#define ADMA_DESC_ATTR_INT	BIT(2)
+#define ADMA_DESC_TRANSFER_DATA	BIT(5)
+
+/* Largest length a descriptor can hold while keeping 4-byte alignment */
+#define SDHCI_ADMA_MAX_LEN	65532
+#define SDHCI_ADMA_DESC_COUNT	DIV_ROUND_UP(CONFIG_SYS_MMC_MAX_BLK_COUNT * \
+					     512, SDHCI_ADMA_MAX_LEN)
+#define SDHCI_ADMA_TABLE_SZ	(SDHCI_ADMA_DESC_COUNT * SDHCI_ADMA_DESC_64_SZ)
+
 struct sdhci_ops {
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
 	u32	(*read_l)(struct sdhci_host *host, int reg);
@@ -272,6 +300,20 @@ struct sdhci_host {
 	uint	voltages;
 
 	struct mmc_config cfg;
+
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	void *adma_table;		/* ADMA2 descriptor table */
+	bool use_adma;			/* controller can do ADMA2 */
+	bool adma_64;			/* ...with 64-bit descriptors */
+#endif
+
+	/* State of the data transfer of the current command */
+	dma_addr_t start_addr;		/* DMA address */
+	int trans_bytes;
+	int is_aligned;			/* 0 if it goes via aligned_buffer */
+	unsigned int xfer_block;	/* blocks moved by PIO */
+	bool xfer_done;			/* all blocks moved by PIO */
+	ulong xfer_start;		/* time the transfer started */
 };
 
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
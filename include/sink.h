@@ -0,0 +1,181 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Chains of stages consuming a stream of data as it is produced
+ */
+
+#ifndef _SINK_H
+#define _SINK_H
+
+struct sink;
+
+/**
+ * struct sink_ops - operations of a sink
+ *
+ * @write:	Consume the next @len bytes of the stream. Returns 0 if ok,
+ *		-ve on error, after which the stream is abandoned
+ * @close:	Optional; the stream is complete, so flush any buffered data
+ *		to the next sink and check that nothing is missing
+ * @get_buf:	Optional; return where the next bytes may be written in
+ *		place and how many may be, so that a stage producing data
+ *		need not copy it. The caller must then call @put_buf
+ * @put_buf:	Commit @len bytes written to the buffer from @get_buf
+ * @free:	Optional; release the resources held by the sink, but not
+ *		the sink itself
+ */
+struct sink_ops {
+	int (*write)(struct sink *sink, const void *buf, ulong len);
+	int (*close)(struct sink *sink);
+	void *(*get_buf)(struct sink *sink, ulong *sizep);
+	int (*put_buf)(struct sink *sink, ulong len);
+	void (*free)(struct sink *sink);
+};
+
+/**
+ * struct sink - a consumer of data written to it in order
+ *
+ * Stages which transform the data, such as decompressors or hashes, pass
+ * their output on to @next. The last sink of a chain stores the data.
+ *
+ * @ops:	Operations of this sink
+ * @next:	Next sink in the chain, NULL for the last one
+ * @size:	Number of bytes written to this sink so far
+ */
+struct sink {
+	const struct sink_ops *ops;
+	struct sink *next;
+	ulong size;
+};
+
+/**
+ * sink_write() - write the next part of the stream to a sink
+ *
+ * @sink:	Sink to write to
+ * @buf:	Data to write
+ * @len:	Number of bytes to write
+ * @return 0 if ok, -ve on error
+ */
+int sink_write(struct sink *sink, const void *buf, ulong len);
+
+/**
+ * sink_get_buf() - find out where the next bytes may be written in place
+ *
+ * @sink:	Sink to write to
+ * @sizep:	Returns the number of bytes which may be written
+ * @return pointer to write to, then commit with sink_put_buf(), or NULL if
+ * the sink cannot be written in place (use sink_write() instead)
+ */
+void *sink_get_buf(struct sink *sink, ulong *sizep);
+
+/**
+ * sink_put_buf() - commit the bytes written from sink_get_buf()
+ *
+ * @sink:	Sink written to
+ * @len:	Number of bytes written, which may be 0
+ * @return 0 if ok, -ve on error
+ */
+int sink_put_buf(struct sink *sink, ulong len);
+
+/**
+ * sink_close() - end the stream written to a chain of sinks
+ *
+ * Each sink in the chain is closed in turn, so that it can flush its data
+ * to the next one.
+ *
+ * @sink:	First sink of the chain
+ * @return 0 if ok, -ve if a sink failed or found the stream incomplete
+ */
+int sink_close(struct sink *sink);
+
+/**
+ * sink_free() - free a chain of sinks
+ *
+ * @sink:	First sink of the chain, or NULL
+ */
+void sink_free(struct sink *sink);
+
+/**
+ * sink_mem_new() - create a sink storing data in memory
+ *
+ * @addr:	Address to store the data at
+ * @size:	Space available at @addr, or 0 for no limit
+ * @return new sink, or NULL if out of memory
+ */
+struct sink *sink_mem_new(ulong addr, ulong size);
+
+/**
+ * sink_gunzip_new() - create a stage decompressing gzip data
+ *
+ * The CRC and size in the gzip trailer are checked when the stage is closed.
+ *
+ * @next:	Sink receiving the decompressed data
+ * @return new sink, or NULL if out of memory
+ */
+struct sink *sink_gunzip_new(struct sink *next);
+
+/**
+ * sink_lz4_new() - create a stage decompressing an LZ4 frame
+ *
+ * @next:	Sink receiving the decompressed data
+ * @return new sink, or NULL if out of memory
+ */
+struct sink *sink_lz4_new(struct sink *next);
+
+/**
+ * sink_hash_new() - create a stage hashing the data passing through it
+ *
+ * @algo_name:	Name of the hash algorithm, e.g. "sha256"
+ * @next:	Sink receiving the data unchanged, or NULL to only hash it
+ * @return new sink, or NULL if the algorithm is unknown or out of memory
+ */
+struct sink *sink_hash_new(const char *algo_name, struct sink *next);
+
+/**
+ * sink_hash_digest() - get the digest computed by a hash stage
+ *
+ * @sink:	Hash stage, which must have been closed
+ * @sizep:	Returns the size of the digest in bytes
+ * @return pointer to the digest, or NULL if it is not available
+ */
+const uint8_t *sink_hash_digest(struct sink *sink, int *sizep);
+
+#if CONFIG_IS_ENABLED(SINK)
+/**
+ * sink_hash_env_new() - create a hash stage for a load, if asked for
+ *
+ * @var:	Environment variable naming the hash algorithm, e.g.
+ *		"diskhash"
+ * @sinkp:	Returns the new stage, which only hashes, or NULL if @var is
+ *		not set
+ * @return 0 if ok, -EINVAL if the algorithm is not supported
+ */
+int sink_hash_env_new(const char *var, struct sink **sinkp);
+
+/**
+ * sink_hash_env_end() - finish with a stage from sink_hash_env_new()
+ *
+ * If the load went well, the stage is closed and its digest printed and
+ * stored in hex in @var with "sum" appended, e.g. "diskhashsum". The stage
+ * is then freed.
+ *
+ * @var:	Environment variable naming the hash algorithm
+ * @sink:	Stage to finish with, or NULL if none
+ * @err:	Result of the load, 0 if it went well
+ * @return @err if not 0, else 0 if ok or -ve on error
+ */
+int sink_hash_env_end(const char *var, struct sink *sink, int err);
+#else
+static inline int sink_hash_env_new(const char *var, struct sink **sinkp)
+{
+	*sinkp = NULL;
+
+	return 0;
+}
+
+static inline int sink_hash_env_end(const char *var, struct sink *sink,
+				    int err)
+{
+	return err;
+}
+#endif
+
+#endif
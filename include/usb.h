@@ -261,6 +261,9 @@ int usb_control_msg(struct usb_device *dev, unsigned int pipe,
 			void *data, unsigned short size, int timeout);
 int usb_bulk_msg(struct usb_device *dev, unsigned int pipe,
 			void *data, int len, int *actual_length, int timeout);
+int usb_bulk_msg_stream(struct usb_device *dev, unsigned int pipe,
+			unsigned int stream_id, void *data, int len,
+			int *actual_length, int timeout);
 int usb_submit_int_msg(struct usb_device *dev, unsigned long pipe,
 			void *buffer, int transfer_len, int interval);
 int usb_disable_asynch(int disable);
@@ -699,6 +702,17 @@ struct dm_usb_ops {
 	 */
 	int (*bulk)(struct udevice *bus, struct usb_device *udev,
 		    unsigned long pipe, void *buffer, int length);
+	/**
+	 * bulk_stream() - Send a bulk message on a stream
+	 *
+	 * Most parameters are as above.
+	 *
+	 * @stream_id: Stream to use, from 1 to the number of streams set up
+	 *	by alloc_streams()
+	 */
+	int (*bulk_stream)(struct udevice *bus, struct usb_device *udev,
+			   unsigned long pipe, unsigned int stream_id,
+			   void *buffer, int length);
 	/**
 	 * interrupt() - Send an interrupt message
 	 *
@@ -785,6 +799,22 @@ struct dm_usb_ops {
 	 * in a USB transfer. USB class driver needs to be aware of this.
 	 */
 	int (*get_max_xfer_size)(struct udevice *bus, size_t *size);
+
+	/**
+	 * alloc_streams() - Set up bulk streams on some endpoints
+	 *
+	 * Each endpoint gets the same number of streams, which may be fewer
+	 * than asked for. After this, transfers on the endpoints must use
+	 * bulk_stream().
+	 *
+	 * @pipes: Bulk pipes of the endpoints
+	 * @num_pipes: Number of pipes
+	 * @num_streams: Number of streams wanted, not counting stream 0
+	 * @return number of streams set up, -ve on error
+	 */
+	int (*alloc_streams)(struct udevice *bus, struct usb_device *udev,
+			     unsigned long *pipes, int num_pipes,
+			     int num_streams);
 };
 
 #define usb_get_ops(dev)	((struct dm_usb_ops *)(dev)->driver->ops)
@@ -980,6 +1010,37 @@ int usb_update_hub_device(struct usb_device *dev);
  */
 int usb_get_max_xfer_size(struct usb_device *dev, size_t *size);
 
+/**
+ * usb_alloc_streams() - Set up bulk streams on some endpoints of a device
+ *
+ * Streams let a device keep several transfers on an endpoint apart, as USB
+ * Attached SCSI does with one stream per command tag. Only SuperSpeed bulk
+ * endpoints can have them.
+ *
+ * @dev:		USB device
+ * @pipes:		Bulk pipes of the endpoints
+ * @num_pipes:		Number of pipes
+ * @num_streams:	Number of streams wanted, not counting stream 0
+ * @return number of streams set up on each endpoint, -ENOSYS if the host
+ * controller or the device has no streams, other -ve on error
+ */
+int usb_alloc_streams(struct usb_device *dev, unsigned long *pipes,
+		      int num_pipes, int num_streams);
+
+/**
+ * submit_bulk_stream_msg() - Submit a bulk message on a stream
+ *
+ * @dev:		USB device
+ * @pipe:		Bulk pipe
+ * @stream_id:		Stream set up by usb_alloc_streams()
+ * @buffer:		Data to send or receive
+ * @transfer_len:	Number of bytes
+ * @return 0 if OK, -ve on error
+ */
+int submit_bulk_stream_msg(struct usb_device *dev, unsigned long pipe,
+			   unsigned int stream_id, void *buffer,
+			   int transfer_len);
+
 /**
  * usb_emul_setup_device() - Set up a new USB device emulation
  *
@@ -1020,6 +1081,30 @@ int usb_emul_control(struct udevice *emul, struct usb_device *udev,
 int usb_emul_bulk(struct udevice *emul, struct usb_device *udev,
 		  unsigned long pipe, void *buffer, int length);
 
+/**
+ * usb_emul_bulk_stream() - Send a bulk packet on a stream to an emulator
+ *
+ * @emul:	Emulator device
+ * @udev:	USB device (which the emulator is causing to appear)
+ * See struct dm_usb_ops for details on other parameters
+ * @return number of bytes transferred, or -ve on error
+ */
+int usb_emul_bulk_stream(struct udevice *emul, struct usb_device *udev,
+			 unsigned long pipe, unsigned int stream_id,
+			 void *buffer, int length);
+
+/**
+ * usb_emul_alloc_streams() - Ask an emulator for bulk streams
+ *
+ * @emul:	Emulator device
+ * @udev:	USB device (which the emulator is causing to appear)
+ * See struct dm_usb_ops for details on other parameters
+ * @return number of streams allocated, or -ve on error
+ */
+int usb_emul_alloc_streams(struct udevice *emul, struct usb_device *udev,
+			   unsigned long *pipes, int num_pipes,
+			   int num_streams);
+
 /**
  * usb_emul_int() - Send an interrupt packet to an emulator
  *
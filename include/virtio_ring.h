@@ -81,6 +81,9 @@ struct vring {
 	struct vring_used *used;
 };
 
+/* Maximum number of buffers a request can describe with one descriptor */
+#define VIRTQUEUE_MAX_INDIRECT		8
+
 /**
  * virtqueue - a queue to register buffers for sending or receiving.
  *
@@ -89,6 +92,7 @@ struct vring {
  * @index: the zero-based ordinal number for this queue
  * @num_free: number of elements we expect to be able to fit
  * @vring: actual memory layout for this queue
+ * @indirect: indirect descriptor tables, one per ring entry, or NULL if unused
  * @event: host publishes avail event idx
  * @free_head: head of free buffer list
  * @num_added: number we've added since last sync
@@ -102,6 +106,7 @@ struct virtqueue {
 	unsigned int index;
 	unsigned int num_free;
 	struct vring vring;
+	struct vring_desc *indirect;
 	bool event;
 	unsigned int free_head;
 	unsigned int num_added;
@@ -173,6 +178,10 @@ struct virtio_sg;
  * Caller must ensure we don't call this with other virtqueue operations
  * at the same time (except where noted).
  *
+ * If VIRTIO_RING_F_INDIRECT_DESC was negotiated, the buffers are described
+ * in an indirect table so that they take up a single ring entry. Several
+ * requests may be added before calling virtqueue_kick() once for them all.
+ *
  * Returns zero or a negative error (ie. ENOSPC, ENOMEM, EIO).
  */
 int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
@@ -11,8 +11,10 @@
 #include <image.h>
 #include <malloc.h>
 #include <memalign.h>
+#include <sink.h>
 #include <u-boot/zlib.h>
 #include <div64.h>
+#include <asm/unaligned.h>
 
 #define HEADER0			'\x1f'
 #define HEADER1			'\x8b'
@@ -305,3 +307,233 @@ int zunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp,
 
 	return err;
 }
+
+#if CONFIG_IS_ENABLED(SINK)
+/* Room for the gzip header, including the original file name */
+#define SINK_GZ_HDR		1024
+/* Output buffer used when the next sink cannot be written in place */
+#define SINK_GZ_BUF		(64 << 10)
+
+enum {
+	SINK_GZ_HEADER,
+	SINK_GZ_DATA,
+	SINK_GZ_TRAILER,
+	SINK_GZ_DONE,
+};
+
+struct sink_gunzip {
+	struct sink sink;
+	z_stream s;
+	int state;
+	uchar hdr[SINK_GZ_HDR];
+	int hdr_len;
+	uchar trailer[8];
+	int trailer_len;
+	u32 crc;
+	uchar *buf;
+};
+
+/* Length of the gzip header at @src, 0 if more than @len bytes are needed */
+static int sink_gunzip_header_len(const uchar *src, int len)
+{
+	int i, flags;
+
+	if (len < 10)
+		return 0;
+	flags = src[3];
+	if (src[0] != (uchar)HEADER0 || src[1] != (uchar)HEADER1 ||
+	    src[2] != DEFLATED ||
+	    (flags & RESERVED) != 0)
+		return -EINVAL;
+
+	i = 10;
+	if ((flags & EXTRA_FIELD) != 0) {
+		if (len < 12)
+			return 0;
+		i = 12 + src[10] + (src[11] << 8);
+	}
+	if ((flags & ORIG_NAME) != 0) {
+		do {
+			if (i >= len)
+				return 0;
+		} while (src[i++] != 0);
+	}
+	if ((flags & COMMENT) != 0) {
+		do {
+			if (i >= len)
+				return 0;
+		} while (src[i++] != 0);
+	}
+	if ((flags & HEAD_CRC) != 0)
+		i += 2;
+
+	return i <= len ? i : 0;
+}
+
+/* Inflate everything in @src, passing the output on to the next sink */
+static int sink_gunzip_inflate(struct sink_gunzip *gz, const uchar *src,
+			       ulong len, ulong *usedp)
+{
+	struct sink *next = gz->sink.next;
+	ulong avail;
+	uchar *out;
+	int ret, r;
+	uint n;
+
+	gz->s.next_in = (uchar *)src;
+	gz->s.avail_in = len;
+	do {
+		/* Inflate straight into the next sink if it allows it */
+		out = sink_get_buf(next, &avail);
+		if (out && !avail) {
+			sink_put_buf(next, 0);
+			out = NULL;
+		}
+		if (!out) {
+			out = gz->buf;
+			avail = SINK_GZ_BUF;
+		}
+		gz->s.next_out = out;
+		gz->s.avail_out = min(avail, (ulong)UINT_MAX);
+		r = inflate(&gz->s, Z_SYNC_FLUSH);
+		n = min(avail, (ulong)UINT_MAX) - gz->s.avail_out;
+		gz->crc = crc32(gz->crc, out, n);
+		if (out == gz->buf)
+			ret = sink_write(next, out, n);
+		else
+			ret = sink_put_buf(next, n);
+		if (ret)
+			return ret;
+		if (r == Z_STREAM_END) {
+			gz->state = SINK_GZ_TRAILER;
+			break;
+		}
+		if (r != Z_OK && r != Z_BUF_ERROR) {
+			printf("Error: inflate() returned %d\n", r);
+			return -EIO;
+		}
+	} while (gz->s.avail_in || !gz->s.avail_out);
+	*usedp = len - gz->s.avail_in;
+
+	return 0;
+}
+
+static int sink_gunzip_feed(struct sink_gunzip *gz, const uchar *src,
+			    ulong len)
+{
+	ulong used;
+	int ret;
+
+	while (len) {
+		switch (gz->state) {
+		case SINK_GZ_DATA:
+			ret = sink_gunzip_inflate(gz, src, len, &used);
+			if (ret)
+				return ret;
+			break;
+		case SINK_GZ_TRAILER:
+			used = min(len, sizeof(gz->trailer) - gz->trailer_len);
+			memcpy(gz->trailer + gz->trailer_len, src, used);
+			gz->trailer_len += used;
+			if (gz->trailer_len < sizeof(gz->trailer))
+				break;
+			if (get_unaligned_le32(gz->trailer) != gz->crc ||
+			    get_unaligned_le32(gz->trailer + 4) !=
+			    (u32)gz->s.total_out) {
+				puts("Error: gunzip CRC or size mismatch\n");
+				return -EBADMSG;
+			}
+			gz->state = SINK_GZ_DONE;
+			break;
+		default:
+			/* ignore any padding after the trailer */
+			return 0;
+		}
+		src += used;
+		len -= used;
+	}
+
+	return 0;
+}
+
+static int sink_gunzip_write(struct sink *sink, const void *buf, ulong len)
+{
+	struct sink_gunzip *gz = container_of(sink, struct sink_gunzip, sink);
+	ulong used;
+	int hlen;
+	int ret;
+
+	if (gz->state != SINK_GZ_HEADER)
+		return sink_gunzip_feed(gz, buf, len);
+
+	/* Collect the header, which has no fixed length */
+	used = min(len, (ulong)SINK_GZ_HDR - gz->hdr_len);
+	memcpy(gz->hdr + gz->hdr_len, buf, used);
+	gz->hdr_len += used;
+	hlen = sink_gunzip_header_len(gz->hdr, gz->hdr_len);
+	if (hlen < 0) {
+		puts("Error: Bad gzipped data\n");
+		return hlen;
+	}
+	if (!hlen) {
+		if (gz->hdr_len < SINK_GZ_HDR)
+			return 0;
+		puts("Error: gzip header too long\n");
+		return -E2BIG;
+	}
+
+	gz->state = SINK_GZ_DATA;
+	ret = sink_gunzip_feed(gz, gz->hdr + hlen, gz->hdr_len - hlen);
+	if (ret)
+		return ret;
+
+	return sink_gunzip_feed(gz, buf + used, len - used);
+}
+
+static int sink_gunzip_close(struct sink *sink)
+{
+	struct sink_gunzip *gz = container_of(sink, struct sink_gunzip, sink);
+
+	if (gz->state != SINK_GZ_DONE) {
+		puts("Error: gzipped data is truncated\n");
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+static void sink_gunzip_free(struct sink *sink)
+{
+	struct sink_gunzip *gz = container_of(sink, struct sink_gunzip, sink);
+
+	inflateEnd(&gz->s);
+	free(gz->buf);
+}
+
+static const struct sink_ops sink_gunzip_ops = {
+	.write	= sink_gunzip_write,
+	.close	= sink_gunzip_close,
+	.free	= sink_gunzip_free,
+};
+
+struct sink *sink_gunzip_new(struct sink *next)
+{
+	struct sink_gunzip *gz;
+
+	gz = calloc(1, sizeof(*gz));
+	if (!gz)
+		return NULL;
+	gz->buf = malloc(SINK_GZ_BUF);
+	gz->s.zalloc = gzalloc;
+	gz->s.zfree = gzfree;
+	if (!gz->buf || inflateInit2(&gz->s, -MAX_WBITS) != Z_OK) {
+		free(gz->buf);
+		free(gz);
+		return NULL;
+	}
+	gz->sink.ops = &sink_gunzip_ops;
+	gz->sink.next = next;
+
+	return &gz->sink;
+}
+#endif
@@ -5,6 +5,8 @@
 
 #include <common.h>
 #include <compiler.h>
+#include <malloc.h>
+#include <sink.h>
 #include <linux/kernel.h>
 #include <linux/types.h>
 
@@ -136,3 +138,203 @@ int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 	*dstn = out - dst;
 	return ret;
 }
+
+#if CONFIG_IS_ENABLED(SINK)
+enum {
+	SINK_LZ4_HEADER,
+	SINK_LZ4_BLOCK_HEADER,
+	SINK_LZ4_BLOCK,
+	SINK_LZ4_TRAILER,
+	SINK_LZ4_DONE,
+};
+
+struct sink_lz4 {
+	struct sink sink;
+	int state;
+	ulong have;		/* bytes gathered for the current state */
+	u8 hdr[sizeof(struct lz4_frame_header) + sizeof(u64) + sizeof(u8)];
+	struct lz4_frame_header *h;
+	struct lz4_block_header b;
+	ulong max_block;
+	u8 *in;			/* the block being gathered */
+	u8 *out;		/* output when the next sink has too little room */
+};
+
+/* Gather @need bytes at @dst from the input; true once they are all there */
+static bool sink_lz4_gather(struct sink_lz4 *lz, void *dst, ulong need,
+			    const u8 **srcp, ulong *lenp)
+{
+	ulong n = min(need - lz->have, *lenp);
+
+	memcpy(dst + lz->have, *srcp, n);
+	lz->have += n;
+	*srcp += n;
+	*lenp -= n;
+
+	return lz->have == need;
+}
+
+static int sink_lz4_header(struct sink_lz4 *lz)
+{
+	const struct lz4_frame_header *h = lz->h;
+
+	/* Same restrictions as ulz4fn() */
+	if (le32_to_cpu(h->magic) != LZ4F_MAGIC || h->version != 1)
+		return -EPROTONOSUPPORT;
+	if (h->reserved0 || h->reserved1 || h->reserved2)
+		return -EINVAL;
+	if (!h->independent_blocks)
+		return -EPROTONOSUPPORT;
+	if (h->max_block_size < 4)
+		return -EINVAL;
+
+	lz->max_block = 1 << (8 + 2 * h->max_block_size);
+	lz->in = malloc(lz->max_block + sizeof(u32));
+	if (!lz->in)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/* Decompress the block gathered in lz->in */
+static int sink_lz4_block(struct sink_lz4 *lz)
+{
+	struct sink *next = lz->sink.next;
+	ulong avail;
+	u8 *out;
+	int ret;
+
+	if (lz->b.not_compressed)
+		return sink_write(next, lz->in, lz->b.size);
+
+	/* Decompress in place if the next sink has room for a whole block */
+	out = sink_get_buf(next, &avail);
+	if (out && avail < lz->max_block) {
+		sink_put_buf(next, 0);
+		out = NULL;
+	}
+	if (!out) {
+		if (!lz->out)
+			lz->out = malloc(lz->max_block);
+		if (!lz->out)
+			return -ENOMEM;
+		out = lz->out;
+	}
+
+	/* constant folding essential, do not touch params! */
+	ret = LZ4_decompress_generic((const char *)lz->in, (char *)out,
+				     lz->b.size, lz->max_block, endOnInputSize,
+				     full, 0, noDict, out, NULL, 0);
+	if (ret < 0) {
+		if (out != lz->out)
+			sink_put_buf(next, 0);
+		return -EPROTO;
+	}
+	if (out == lz->out)
+		return sink_write(next, out, ret);
+
+	return sink_put_buf(next, ret);
+}
+
+static int sink_lz4_write(struct sink *sink, const void *buf, ulong len)
+{
+	struct sink_lz4 *lz = container_of(sink, struct sink_lz4, sink);
+	const u8 *src = buf;
+	ulong need;
+	int ret;
+
+	while (len) {
+		switch (lz->state) {
+		case SINK_LZ4_HEADER:
+			/* the flags tell how long the rest of the header is */
+			need = sizeof(*lz->h);
+			if (lz->have >= need)
+				need += sizeof(u8) + (lz->h->has_content_size ?
+						      sizeof(u64) : 0);
+			if (!sink_lz4_gather(lz, lz->hdr, need, &src, &len) ||
+			    need == sizeof(*lz->h))
+				break;
+			ret = sink_lz4_header(lz);
+			if (ret)
+				return ret;
+			lz->state = SINK_LZ4_BLOCK_HEADER;
+			lz->have = 0;
+			break;
+		case SINK_LZ4_BLOCK_HEADER:
+			if (!sink_lz4_gather(lz, &lz->b, sizeof(lz->b), &src,
+					     &len))
+				break;
+			lz->b.raw = le32_to_cpu(lz->b.raw);
+			lz->have = 0;
+			if (!lz->b.size) {
+				lz->state = lz->h->has_content_checksum ?
+					SINK_LZ4_TRAILER : SINK_LZ4_DONE;
+				break;
+			}
+			if (lz->b.size > lz->max_block)
+				return -EINVAL;
+			lz->state = SINK_LZ4_BLOCK;
+			break;
+		case SINK_LZ4_BLOCK:
+			need = lz->b.size;
+			if (lz->h->has_block_checksum)
+				need += sizeof(u32);
+			if (!sink_lz4_gather(lz, lz->in, need, &src, &len))
+				break;
+			ret = sink_lz4_block(lz);
+			if (ret)
+				return ret;
+			lz->state = SINK_LZ4_BLOCK_HEADER;
+			lz->have = 0;
+			break;
+		case SINK_LZ4_TRAILER:
+			/* the content checksum is not checked, as in ulz4fn() */
+			if (!sink_lz4_gather(lz, &lz->b, sizeof(u32), &src,
+					     &len))
+				break;
+			lz->state = SINK_LZ4_DONE;
+			break;
+		default:
+			/* We assume there's always only a single frame. */
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+static int sink_lz4_close(struct sink *sink)
+{
+	struct sink_lz4 *lz = container_of(sink, struct sink_lz4, sink);
+
+	return lz->state == SINK_LZ4_DONE ? 0 : -EINVAL;
+}
+
+static void sink_lz4_free(struct sink *sink)
+{
+	struct sink_lz4 *lz = container_of(sink, struct sink_lz4, sink);
+
+	free(lz->in);
+	free(lz->out);
+}
+
+static const struct sink_ops sink_lz4_ops = {
+	.write	= sink_lz4_write,
+	.close	= sink_lz4_close,
+	.free	= sink_lz4_free,
+};
+
+struct sink *sink_lz4_new(struct sink *next)
+{
+	struct sink_lz4 *lz;
+
+	lz = calloc(1, sizeof(*lz));
+	if (!lz)
+		return NULL;
+	lz->sink.ops = &sink_lz4_ops;
+	lz->sink.next = next;
+	lz->h = (struct lz4_frame_header *)lz->hdr;
+
+	return &lz->sink;
+}
+#endif
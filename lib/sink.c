@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Chains of stages consuming a stream of data as it is produced
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <sink.h>
+
+/* Largest part of a memory sink offered to be written in place at once */
+#define SINK_MEM_CHUNK	(1UL << 30)
+
+int sink_write(struct sink *sink, const void *buf, ulong len)
+{
+	int ret;
+
+	if (!len)
+		return 0;
+	ret = sink->ops->write(sink, buf, len);
+	if (ret)
+		return ret;
+	sink->size += len;
+
+	return 0;
+}
+
+void *sink_get_buf(struct sink *sink, ulong *sizep)
+{
+	if (!sink->ops->get_buf)
+		return NULL;
+
+	return sink->ops->get_buf(sink, sizep);
+}
+
+int sink_put_buf(struct sink *sink, ulong len)
+{
+	int ret;
+
+	ret = sink->ops->put_buf(sink, len);
+	if (ret)
+		return ret;
+	sink->size += len;
+
+	return 0;
+}
+
+int sink_close(struct sink *sink)
+{
+	int ret;
+
+	for (; sink; sink = sink->next) {
+		if (!sink->ops->close)
+			continue;
+		ret = sink->ops->close(sink);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+void sink_free(struct sink *sink)
+{
+	struct sink *next;
+
+	for (; sink; sink = next) {
+		next = sink->next;
+		if (sink->ops->free)
+			sink->ops->free(sink);
+		free(sink);
+	}
+}
+
+struct sink_mem {
+	struct sink sink;
+	ulong addr;
+	ulong limit;
+	void *buf;	/* mapped by sink_mem_get_buf() */
+};
+
+static int sink_mem_write(struct sink *sink, const void *buf, ulong len)
+{
+	struct sink_mem *mem = container_of(sink, struct sink_mem, sink);
+	void *ptr;
+
+	if (len > mem->limit - sink->size)
+		return -ENOSPC;
+	ptr = map_sysmem(mem->addr + sink->size, len);
+	memcpy(ptr, buf, len);
+	unmap_sysmem(ptr);
+
+	return 0;
+}
+
+static void *sink_mem_get_buf(struct sink *sink, ulong *sizep)
+{
+	struct sink_mem *mem = container_of(sink, struct sink_mem, sink);
+
+	*sizep = min(mem->limit - sink->size, SINK_MEM_CHUNK);
+	mem->buf = map_sysmem(mem->addr + sink->size, *sizep);
+
+	return mem->buf;
+}
+
+static int sink_mem_put_buf(struct sink *sink, ulong len)
+{
+	struct sink_mem *mem = container_of(sink, struct sink_mem, sink);
+
+	unmap_sysmem(mem->buf);
+
+	return 0;
+}
+
+static const struct sink_ops sink_mem_ops = {
+	.write		= sink_mem_write,
+	.get_buf	= sink_mem_get_buf,
+	.put_buf	= sink_mem_put_buf,
+};
+
+struct sink *sink_mem_new(ulong addr, ulong size)
+{
+	struct sink_mem *mem;
+
+	mem = calloc(1, sizeof(*mem));
+	if (!mem)
+		return NULL;
+	mem->sink.ops = &sink_mem_ops;
+	mem->addr = addr;
+	/* without a limit, stop at the end of the address space */
+	mem->limit = size ? size : -addr;
+
+	return &mem->sink;
+}
@@ -37,6 +37,86 @@ int		arp_wait_try;
 uchar	       *arp_tx_packet; /* THE ARP transmit packet */
 static uchar	arp_tx_packet_buf[PKTSIZE_ALIGN + PKTALIGN];
 
+#ifdef CONFIG_NET_ARP_CACHE
+/*
+ * Neighbour table, so that each command does not have to ARP again for the
+ * server or gateway. Entries are tied to the interface they were learnt on
+ * and expire CONFIG_NET_ARP_CACHE_TIMEOUT seconds after they were last
+ * confirmed.
+ */
+struct arp_cache_entry {
+	struct in_addr ip;
+	uchar ethaddr[ARP_HLEN];
+	int dev_index;
+	ulong updated;
+};
+
+static struct arp_cache_entry arp_cache[CONFIG_NET_ARP_CACHE_SIZE];
+static ulong arp_cache_hits;
+static ulong arp_cache_misses;
+
+static struct arp_cache_entry *arp_cache_find(struct in_addr ip)
+{
+	int dev_index = eth_get_dev_index();
+	int i;
+
+	for (i = 0; i < CONFIG_NET_ARP_CACHE_SIZE; i++) {
+		struct arp_cache_entry *entry = &arp_cache[i];
+
+		if (entry->ip.s_addr != ip.s_addr ||
+		    entry->dev_index != dev_index)
+			continue;
+		if (get_timer(entry->updated) >
+		    CONFIG_NET_ARP_CACHE_TIMEOUT * 1000UL) {
+			entry->ip.s_addr = 0;
+			return NULL;
+		}
+		return entry;
+	}
+
+	return NULL;
+}
+
+/**
+ * arp_cache_update() - Record the Ethernet address of a neighbour
+ *
+ * @ip:		IP address of the neighbour
+ * @ethaddr:	its Ethernet address
+ * @create:	true to add the neighbour if it is not known yet, false to
+ *		only refresh an existing entry
+ */
+static void arp_cache_update(struct in_addr ip, const uchar *ethaddr,
+			     bool create)
+{
+	struct arp_cache_entry *entry;
+	int i;
+
+	if (!ip.s_addr || !is_valid_ethaddr(ethaddr))
+		return;
+
+	entry = arp_cache_find(ip);
+	if (!entry) {
+		if (!create)
+			return;
+		/* Use a free slot, or else evict the oldest entry */
+		entry = &arp_cache[0];
+		for (i = 0; i < CONFIG_NET_ARP_CACHE_SIZE; i++) {
+			if (!arp_cache[i].ip.s_addr) {
+				entry = &arp_cache[i];
+				break;
+			}
+			if (get_timer(arp_cache[i].updated) >
+			    get_timer(entry->updated))
+				entry = &arp_cache[i];
+		}
+		entry->ip = ip;
+		entry->dev_index = eth_get_dev_index();
+	}
+	memcpy(entry->ethaddr, ethaddr, ARP_HLEN);
+	entry->updated = get_timer(0);
+}
+#endif
+
 void arp_init(void)
 {
 	/* XXX problem with bss workaround */
@@ -78,23 +158,68 @@ void arp_raw_request(struct in_addr source_ip, const uchar *target_ethaddr,
 	net_send_packet(arp_tx_packet, eth_hdr_size + ARP_HDR_SIZE);
 }
 
+/* Work out which host answers for @dest: itself, or the gateway */
+static struct in_addr arp_next_hop(struct in_addr dest)
+{
+	if ((dest.s_addr & net_netmask.s_addr) !=
+	    (net_ip.s_addr & net_netmask.s_addr) && net_gateway.s_addr)
+		return net_gateway;
+
+	return dest;
+}
+
 void arp_request(void)
 {
 	if ((net_arp_wait_packet_ip.s_addr & net_netmask.s_addr) !=
-	    (net_ip.s_addr & net_netmask.s_addr)) {
-		if (net_gateway.s_addr == 0) {
-			puts("## Warning: gatewayip needed but not set\n");
-			net_arp_wait_reply_ip = net_arp_wait_packet_ip;
-		} else {
-			net_arp_wait_reply_ip = net_gateway;
-		}
-	} else {
-		net_arp_wait_reply_ip = net_arp_wait_packet_ip;
-	}
+	    (net_ip.s_addr & net_netmask.s_addr) && net_gateway.s_addr == 0)
+		puts("## Warning: gatewayip needed but not set\n");
+	net_arp_wait_reply_ip = arp_next_hop(net_arp_wait_packet_ip);
 
 	arp_raw_request(net_ip, net_null_ethaddr, net_arp_wait_reply_ip);
 }
 
+#ifdef CONFIG_NET_ARP_CACHE
+int arp_cache_lookup(struct in_addr dest, uchar *ethaddr)
+{
+	struct arp_cache_entry *entry = arp_cache_find(arp_next_hop(dest));
+
+	if (!entry) {
+		arp_cache_misses++;
+		return -ENOENT;
+	}
+
+	arp_cache_hits++;
+	memcpy(ethaddr, entry->ethaddr, ARP_HLEN);
+
+	return 0;
+}
+
+void arp_cache_flush(void)
+{
+	memset(arp_cache, '\0', sizeof(arp_cache));
+	arp_cache_hits = 0;
+	arp_cache_misses = 0;
+}
+
+void arp_cache_print(void)
+{
+	char ip[16];
+	int i;
+
+	puts("IP address       HW address         Dev  Age\n");
+	for (i = 0; i < CONFIG_NET_ARP_CACHE_SIZE; i++) {
+		struct arp_cache_entry *entry = &arp_cache[i];
+
+		if (!entry->ip.s_addr)
+			continue;
+		ip_to_string(entry->ip, ip);
+		printf("%-16s %pM  %3d  %lus\n", ip, entry->ethaddr,
+		       entry->dev_index, get_timer(entry->updated) / 1000);
+	}
+	printf("hits: %lu, misses: %lu\n", arp_cache_hits, arp_cache_misses);
+}
+#endif
+
 int arp_timeout_check(void)
 {
 	ulong t;
@@ -155,6 +280,17 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 	if (net_ip.s_addr == 0)
 		return;
 
+#ifdef CONFIG_NET_ARP_CACHE
+	/*
+	 * Learn the sender of anything addressed to us and of gratuitous
+	 * ARPs; only refresh what we already know from the rest.
+	 */
+	arp_cache_update(net_read_ip(&arp->ar_spa), &arp->ar_sha,
+			 net_read_ip(&arp->ar_tpa).s_addr == net_ip.s_addr ||
+			 net_read_ip(&arp->ar_tpa).s_addr ==
+			 net_read_ip(&arp->ar_spa).s_addr);
+#endif
+
 	if (net_read_ip(&arp->ar_tpa).s_addr != net_ip.s_addr)
 		return;
 
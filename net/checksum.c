@@ -10,27 +10,71 @@
 #include <common.h>
 #include <net.h>
 
+/*
+ * The checksum is the ones' complement sum of the data taken as 16-bit
+ * words. The sum is endian-independent as long as the words are loaded in
+ * host order, and carries out of one half of a wider word end up in the other
+ * when it is folded, so the data is summed 32 bits at a time into a 64-bit
+ * accumulator, which only needs folding at the end.
+ *
+ * Data starting at an odd address is summed from the byte before, taken as
+ * zero: each byte then lands in the other half of its 16-bit word, which
+ * only swaps the two bytes of the result.
+ */
 unsigned compute_ip_checksum(const void *vptr, unsigned nbytes)
 {
-	int sum, oddbyte;
-	const unsigned short *ptr = vptr;
+	const u8 *ptr = vptr;
+	const u32 *wptr;
+	union {
+		u8 b[2];
+		u16 w;
+	} part;
+	bool swap = false;
+	u64 sum = 0;
 
-	sum = 0;
-	while (nbytes > 1) {
-		sum += *ptr++;
+	if (((ulong)ptr & 1) && nbytes) {
+		part.b[0] = 0;
+		part.b[1] = *ptr++;
+		sum += part.w;
+		nbytes--;
+		swap = true;
+	}
+	if (((ulong)ptr & 2) && nbytes >= 2) {
+		sum += *(const u16 *)ptr;
+		ptr += 2;
 		nbytes -= 2;
 	}
-	if (nbytes == 1) {
-		oddbyte = 0;
-		((u8 *)&oddbyte)[0] = *(u8 *)ptr;
-		((u8 *)&oddbyte)[1] = 0;
-		sum += oddbyte;
+
+	wptr = (const u32 *)ptr;
+	for (; nbytes >= 16; nbytes -= 16, wptr += 4) {
+		sum += wptr[0];
+		sum += wptr[1];
+		sum += wptr[2];
+		sum += wptr[3];
 	}
+	for (; nbytes >= 4; nbytes -= 4)
+		sum += *wptr++;
+
+	ptr = (const u8 *)wptr;
+	if (nbytes >= 2) {
+		sum += *(const u16 *)ptr;
+		ptr += 2;
+		nbytes -= 2;
+	}
+	if (nbytes) {
+		part.b[0] = *ptr;
+		part.b[1] = 0;
+		sum += part.w;
+	}
+
+	sum = (sum >> 32) + (sum & 0xffffffff);
 	sum = (sum >> 16) + (sum & 0xffff);
-	sum += (sum >> 16);
-	sum = ~sum & 0xffff;
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	if (swap)
+		sum = ((sum >> 8) & 0xff) | ((sum << 8) & 0xff00);
 
-	return sum;
+	return ~sum & 0xffff;
 }
 
 unsigned add_ip_checksums(unsigned offset, unsigned sum, unsigned new)
@@ -19,9 +19,13 @@ DECLARE_GLOBAL_DATA_PTR;
  * struct eth_device_priv - private structure for each Ethernet device
  *
  * @state: The state of the Ethernet MAC driver (defined by enum eth_state_t)
+ * @stats: Traffic counters, kept for as long as the device is probed
  */
 struct eth_device_priv {
 	enum eth_state_t state;
+#ifdef CONFIG_NET_STATS
+	struct eth_stats stats;
+#endif
 };
 
 /**
@@ -343,14 +347,64 @@ int eth_send(void *packet, int length)
 	if (ret < 0) {
 		/* We cannot completely return the error at present */
 		debug("%s: send() returned error %d\n", __func__, ret);
+		net_stats_inc(tx_errors);
+	} else {
+		net_stats_inc(tx_packets);
+		net_stats_add(tx_bytes, length);
 	}
 	return ret;
 }
 
+/* Most packets processed by one call to eth_rx() */
+#define ETH_RX_BUDGET	32
+
+/* Count a poll which returned @count packets */
+static void eth_rx_account(struct udevice *dev, int count)
+{
+#ifdef CONFIG_NET_STATS
+	struct eth_stats *stats = eth_get_stats(dev);
+
+	if (!stats || !count)
+		return;
+	stats->rx_polls++;
+	if (count > stats->rx_batch_max)
+		stats->rx_batch_max = count;
+#endif
+}
+
+/* Take all the packets the driver has ready in one call */
+static int eth_rx_batch(struct udevice *current)
+{
+	struct eth_ops *ops = eth_get_ops(current);
+	uchar *packets[ETH_RX_BUDGET];
+	int lengths[ETH_RX_BUDGET];
+	int count;
+	int i;
+
+	count = ops->recv_batch(current, ETH_RECV_CHECK_DEVICE, packets,
+				lengths, ETH_RX_BUDGET);
+	if (count <= 0)
+		return count;
+
+	eth_rx_account(current, count);
+	for (i = 0; i < count; i++) {
+		net_stats_inc(rx_packets);
+		net_stats_add(rx_bytes, lengths[i]);
+		net_process_received_packet(packets[i], lengths[i]);
+	}
+	if (ops->free_pkt) {
+		for (i = 0; i < count; i++)
+			ops->free_pkt(current, packets[i], lengths[i]);
+	}
+
+	return lengths[count - 1];
+}
+
 int eth_rx(void)
 {
 	struct udevice *current;
 	uchar *packet;
+	int count = 0;
 	int flags;
 	int ret;
 	int i;
@@ -362,27 +416,52 @@ int eth_rx(void)
 	if (!eth_is_active(current))
 		return -EINVAL;
 
-	/* Process up to 32 packets at one time */
-	flags = ETH_RECV_CHECK_DEVICE;
-	for (i = 0; i < 32; i++) {
-		ret = eth_get_ops(current)->recv(current, flags, &packet);
-		flags = 0;
-		if (ret > 0)
-			net_process_received_packet(packet, ret);
-		if (ret >= 0 && eth_get_ops(current)->free_pkt)
-			eth_get_ops(current)->free_pkt(current, packet, ret);
-		if (ret <= 0)
-			break;
+	if (eth_get_ops(current)->recv_batch) {
+		ret = eth_rx_batch(current);
+	} else {
+		/* Process up to ETH_RX_BUDGET packets at one time */
+		flags = ETH_RECV_CHECK_DEVICE;
+		for (i = 0; i < ETH_RX_BUDGET; i++) {
+			ret = eth_get_ops(current)->recv(current, flags,
+							 &packet);
+			flags = 0;
+			if (ret > 0) {
+				count++;
+				net_stats_inc(rx_packets);
+				net_stats_add(rx_bytes, ret);
+				net_process_received_packet(packet, ret);
+			}
+			if (ret >= 0 && eth_get_ops(current)->free_pkt)
+				eth_get_ops(current)->free_pkt(current, packet,
+							       ret);
+			if (ret <= 0)
+				break;
+		}
+		eth_rx_account(current, count);
 	}
 	if (ret == -EAGAIN)
 		ret = 0;
 	if (ret < 0) {
 		/* We cannot completely return the error at present */
 		debug("%s: recv() returned error %d\n", __func__, ret);
+		net_stats_inc(rx_errors);
 	}
 	return ret;
 }
 
+#ifdef CONFIG_NET_STATS
+struct eth_stats *eth_get_stats(struct udevice *dev)
+{
+	struct eth_device_priv *priv;
+
+	if (!dev || !device_active(dev))
+		return NULL;
+	priv = dev_get_uclass_priv(dev);
+
+	return &priv->stats;
+}
+#endif
+
 int eth_initialize(void)
 {
 	int num_devices = 0;
@@ -472,6 +551,8 @@ static int eth_post_probe(struct udevice *dev)
 			ops->send += gd->reloc_off;
 		if (ops->recv)
 			ops->recv += gd->reloc_off;
+		if (ops->recv_batch)
+			ops->recv_batch += gd->reloc_off;
 		if (ops->free_pkt)
 			ops->free_pkt += gd->reloc_off;
 		if (ops->stop)
@@ -538,6 +619,11 @@ static int eth_pre_remove(struct udevice *dev)
 	/* clear the MAC address */
 	memset(pdata->enetaddr, 0, ARP_HLEN);
 
+#ifdef CONFIG_NET_ARP_CACHE
+	/* neighbours are tied to a device index that may be reused */
+	arp_cache_flush();
+#endif
+
 	return 0;
 }
 
@@ -92,9 +92,12 @@
 #include <console.h>
 #include <environment.h>
 #include <errno.h>
+#include <hash.h>
 #include <net.h>
 #include <net/fastboot.h>
+#include <net/tcp.h>
 #include <net/tftp.h>
+#include <sink.h>
 #if defined(CONFIG_LED_STATUS)
 #include <miiphy.h>
 #include <status_led.h>
@@ -114,6 +117,7 @@
 #if defined(CONFIG_CMD_SNTP)
 #include "sntp.h"
 #endif
+#include "wget.h"
 #if defined(CONFIG_CMD_WOL)
 #include "wol.h"
 #endif
@@ -180,6 +184,14 @@ bool net_boot_file_name_explicit;
 u32 net_boot_file_size;
 /* Boot file size in blocks as reported by the DHCP server */
 u32 net_boot_file_expected_size_in_blocks;
+#ifdef CONFIG_NET_SINK
+/* Chain the received file is written to, NULL to store it as is */
+struct sink *net_sink;
+/* Hash stage of net_sink, if any */
+static struct sink *net_sink_hash;
+/* Last sink of net_sink, storing the data at load_addr */
+static struct sink *net_sink_mem;
+#endif
 
 #if defined(CONFIG_CMD_SNTP)
 /* NTP server IP address */
@@ -205,6 +217,10 @@ static thand_f *time_handler;
 static ulong	time_start;
 /* Current timeout value */
 static ulong	time_delta;
+#ifdef CONFIG_NET_STATS
+/* Time the current transfer started */
+static ulong	net_xfer_start;
+#endif
 /* THE transmit packet */
 uchar *net_tx_packet;
 
@@ -396,6 +412,144 @@ void net_init(void)
 	net_init_loop();
 }
 
+#ifdef CONFIG_NET_SINK
+static void net_sink_free(void)
+{
+	sink_free(net_sink);
+	net_sink = NULL;
+	net_sink_hash = NULL;
+	net_sink_mem = NULL;
+}
+
+/*
+ * Set up the chain the file is written to, as selected by the environment.
+ * The data is hashed as received, then decompressed and stored.
+ */
+static int net_sink_start(void)
+{
+	const char *decomp = env_get("netdecomp");
+	const char *hash = env_get("nethash");
+	struct sink *stage;
+
+	net_sink_free();
+	if (!decomp && !hash)
+		return 0;
+
+	net_sink_mem = sink_mem_new(load_addr, 0);
+	if (!net_sink_mem)
+		goto nomem;
+	net_sink = net_sink_mem;
+	if (decomp) {
+		if (IS_ENABLED(CONFIG_GZIP) && !strcmp(decomp, "gzip")) {
+			stage = sink_gunzip_new(net_sink);
+		} else if (IS_ENABLED(CONFIG_LZ4) && !strcmp(decomp, "lz4")) {
+			stage = sink_lz4_new(net_sink);
+		} else {
+			printf("Unsupported netdecomp '%s'\n", decomp);
+			goto err;
+		}
+		if (!stage)
+			goto nomem;
+		net_sink = stage;
+	}
+	if (hash) {
+		stage = sink_hash_new(hash, net_sink);
+		if (!stage) {
+			printf("Unsupported nethash '%s'\n", hash);
+			goto err;
+		}
+		net_sink = stage;
+		net_sink_hash = stage;
+	}
+
+	return 0;
+
+nomem:
+	puts("Out of memory for the download chain\n");
+err:
+	net_sink_free();
+
+	return -EINVAL;
+}
+
+/**
+ * net_sink_store() - pass a received part of the file to net_sink
+ *
+ * Parts must arrive in order. A part already stored, e.g. retransmitted, is
+ * ignored.
+ *
+ * @offset:	Offset of the part in the file
+ * @src:	Data received
+ * @len:	Length of the part
+ * @return 0 if ok, -ve on error
+ */
+int net_sink_store(ulong offset, const void *src, ulong len)
+{
+	ulong done = net_sink->size;
+	int ret;
+
+	if (offset + len <= done)
+		return 0;
+	if (offset > done) {
+		printf("\nMissing data at offset %lx\n", done);
+		return -EIO;
+	}
+	ret = sink_write(net_sink, src + done - offset,
+			 len - (done - offset));
+	if (ret) {
+		printf("\nCannot store data at offset %lx (err=%d)\n", done,
+		       ret);
+		return ret;
+	}
+	net_boot_file_size = net_sink->size;
+
+	return 0;
+}
+
+/* Complete the download chain and report what it found */
+static int net_sink_finish(void)
+{
+	const uint8_t *digest;
+	int ret, size, i;
+	char *p;
+
+	ret = sink_close(net_sink);
+	if (ret) {
+		printf("\nIncomplete or corrupt file (err=%d)\n", ret);
+		return ret;
+	}
+	if (net_sink_mem->size != net_sink->size)
+		printf("\nBytes received = %d (%x hex)",
+		       net_boot_file_size, net_boot_file_size);
+	net_boot_file_size = net_sink_mem->size;
+	if (net_sink_hash) {
+		char sum[HASH_MAX_DIGEST_SIZE * 2 + 1];
+
+		digest = sink_hash_digest(net_sink_hash, &size);
+		for (i = 0, p = sum; i < size; i++, p += 2)
+			sprintf(p, "%02x", digest[i]);
+		printf("\n%s = %s", env_get("nethash"), sum);
+		env_set("nethashsum", sum);
+	}
+	putc('\n');
+
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_NET_STATS
+/* Remember how fast the file just loaded came in */
+static void net_stats_xfer_done(void)
+{
+	struct eth_stats *stats = eth_get_stats(eth_get_dev());
+
+	if (stats) {
+		stats->xfer_bytes = net_boot_file_size;
+		stats->xfer_ms = get_timer(net_xfer_start);
+	}
+}
+#endif
+
 /**********************************************************************/
 /*
  *	Main network processing loop.
@@ -452,6 +606,18 @@ restart:
 	case 0:
 		net_dev_exists = 1;
 		net_boot_file_size = 0;
+		bootstage_start(BOOTSTAGE_ID_ACCUM_NET, "net");
+#ifdef CONFIG_NET_STATS
+		net_xfer_start = get_timer(0);
+#endif
+#ifdef CONFIG_NET_SINK
+		if ((protocol == TFTPGET || protocol == NFS ||
+		     protocol == WGET) && net_sink_start()) {
+			eth_halt();
+			net_set_state(prev_net_state);
+			return -EINVAL;
+		}
+#endif
 		switch (protocol) {
 		case TFTPGET:
 #ifdef CONFIG_CMD_TFTPPUT
@@ -501,6 +667,11 @@ restart:
 			nfs_start();
 			break;
 #endif
+#if defined(CONFIG_CMD_WGET)
+		case WGET:
+			wget_start();
+			break;
+#endif
 #if defined(CONFIG_CMD_CDP)
 		case CDP:
 			cdp_start();
@@ -574,6 +745,10 @@ restart:
 		 *	errors that may have happened.
 		 */
 		eth_rx();
+#ifdef CONFIG_PROT_TCP
+		/* acknowledge together what this poll received */
+		tcp_poll();
+#endif
 
 		/*
 		 *	Abort if ctrl-c was pressed.
@@ -635,11 +810,22 @@ restart:
 
 		case NETLOOP_SUCCESS:
 			net_cleanup_loop();
+#ifdef CONFIG_NET_SINK
+			if (net_sink && net_sink_finish()) {
+				eth_halt();
+				eth_set_last_protocol(BOOTP);
+				ret = -EIO;
+				goto done;
+			}
+#endif
 			if (net_boot_file_size > 0) {
 				printf("Bytes transferred = %d (%x hex)\n",
 				       net_boot_file_size, net_boot_file_size);
 				env_set_hex("filesize", net_boot_file_size);
 				env_set_hex("fileaddr", load_addr);
+#ifdef CONFIG_NET_STATS
+				net_stats_xfer_done();
+#endif
 			}
 			if (protocol != NETCONS)
 				eth_halt();
@@ -667,6 +853,11 @@ restart:
 done:
 #ifdef CONFIG_USB_KEYBOARD
 	net_busy_flag = 0;
+#endif
+	if (net_dev_exists)
+		bootstage_accum(BOOTSTAGE_ID_ACCUM_NET);
+#ifdef CONFIG_NET_SINK
+	net_sink_free();
 #endif
 #ifdef CONFIG_CMD_TFTPPUT
 	/* Clear out the handlers */
@@ -845,10 +1036,25 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 				   payload_len);
 		pkt_hdr_size = eth_hdr_size + IP_UDP_HDR_SIZE;
 		break;
+#ifdef CONFIG_PROT_TCP
+	case IPPROTO_TCP:
+		pkt_hdr_size = eth_hdr_size +
+			tcp_set_tcp_header(pkt + eth_hdr_size, dest, dport,
+					   sport, payload_len, action,
+					   tcp_seq_num, tcp_ack_num);
+		break;
+#endif
 	default:
 		return -EINVAL;
 	}
 
+#ifdef CONFIG_NET_ARP_CACHE
+	/* we may have learnt the MAC address already */
+	if (memcmp(ether, net_null_ethaddr, 6) == 0 &&
+	    !arp_cache_lookup(dest, ether))
+		memcpy(((struct ethernet_hdr *)pkt)->et_dest, ether, ARP_HLEN);
+#endif
+
 	/* if MAC address was not discovered yet, do an ARP request */
 	if (memcmp(ether, net_null_ethaddr, 6) == 0) {
 		debug_cond(DEBUG_DEV_PKT, "sending ARP for %pI4\n", &dest);
@@ -1091,8 +1297,10 @@ void net_process_received_packet(uchar *in_packet, int len)
 	et = (struct ethernet_hdr *)in_packet;
 
 	/* too small packet? */
-	if (len < ETHER_HDR_SIZE)
+	if (len < ETHER_HDR_SIZE) {
+		net_stats_inc(rx_dropped);
 		return;
+	}
 
 #if defined(CONFIG_API) || defined(CONFIG_EFI_LOADER)
 	if (push_packet) {
@@ -1189,11 +1397,13 @@ void net_process_received_packet(uchar *in_packet, int len)
 		if (len < IP_UDP_HDR_SIZE) {
 			debug("len bad %d < %lu\n", len,
 			      (ulong)IP_UDP_HDR_SIZE);
+			net_stats_inc(rx_dropped);
 			return;
 		}
 		/* Check the packet length */
 		if (len < ntohs(ip->ip_len)) {
 			debug("len bad %d < %d\n", len, ntohs(ip->ip_len));
+			net_stats_inc(rx_dropped);
 			return;
 		}
 		len = ntohs(ip->ip_len);
@@ -1201,14 +1411,19 @@ void net_process_received_packet(uchar *in_packet, int len)
 			   len, ip->ip_hl_v & 0xff);
 
 		/* Can't deal with anything except IPv4 */
-		if ((ip->ip_hl_v & 0xf0) != 0x40)
+		if ((ip->ip_hl_v & 0xf0) != 0x40) {
+			net_stats_inc(rx_dropped);
 			return;
+		}
 		/* Can't deal with IP options (headers != 20 bytes) */
-		if ((ip->ip_hl_v & 0x0f) > 0x05)
+		if ((ip->ip_hl_v & 0x0f) > 0x05) {
+			net_stats_inc(rx_dropped);
 			return;
+		}
 		/* Check the Checksum of the header */
 		if (!ip_checksum_ok((uchar *)ip, IP_HDR_SIZE)) {
 			debug("checksum bad\n");
+			net_stats_inc(rx_csum_errors);
 			return;
 		}
 		/* If it is not for us, ignore it */
@@ -1218,7 +1433,10 @@ void net_process_received_packet(uchar *in_packet, int len)
 #ifdef CONFIG_MCAST_TFTP
 			if (net_mcast_addr != dst_ip)
 #endif
+			{
+				net_stats_inc(rx_dropped);
 				return;
+			}
 		}
 		/* Read source IP address for later use */
 		src_ip = net_read_ip(&ip->ip_src);
@@ -1254,6 +1472,11 @@ void net_process_received_packet(uchar *in_packet, int len)
 		if (ip->ip_p == IPPROTO_ICMP) {
 			receive_icmp(ip, len, src_ip, et);
 			return;
+#ifdef CONFIG_PROT_TCP
+		} else if (ip->ip_p == IPPROTO_TCP) {
+			tcp_receive(ip, len);
+			return;
+#endif
 		} else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
 			return;
 		}
@@ -1299,6 +1522,7 @@ void net_process_received_packet(uchar *in_packet, int len)
 			if ((xsum != 0x00000000) && (xsum != 0x0000ffff)) {
 				printf(" UDP wrong checksum %08lx %08x\n",
 				       xsum, ntohs(ip->udp_xsum));
+				net_stats_inc(rx_csum_errors);
 				return;
 			}
 		}
@@ -1360,6 +1584,9 @@ static int net_check_prereq(enum proto_t protocol)
 #endif
 #if defined(CONFIG_CMD_NFS)
 	case NFS:
+#endif
+#if defined(CONFIG_CMD_WGET)
+	case WGET:
 #endif
 		/* Fall through */
 	case TFTPGET:
@@ -78,6 +78,69 @@ static char nfs_path_buff[2048];
 #define NFSV3_FLAG 1 << 1
 static char supported_nfs_versions = NFSV2_FLAG | NFSV3_FLAG;
 
+/*
+ * READ requests in flight. Replies are matched to their request by XID and
+ * stored at its offset, so they may come back in any order, and a request
+ * whose reply is overdue is retransmitted on its own with the same XID.
+ */
+struct nfs_read_slot {
+	unsigned long id;	/* XID of the request, 0 if the slot is free */
+	int offset;
+	int len;
+	ulong sent;		/* get_timer() when the request was last sent */
+};
+
+static struct nfs_read_slot nfs_read_slots[CONFIG_NFS_READ_WINDOW];
+static int nfs_read_window;	/* number of slots used for this transfer */
+static int nfs_read_next;	/* offset of the next block to request */
+static int nfs_read_eof;	/* file size once known, -1 before */
+
+#ifdef CONFIG_NET_SINK
+/*
+ * A download chain takes the file in order, so replies are gathered here,
+ * one block per slot of the window, until those before them have arrived.
+ */
+static uchar *nfs_sink_buf;
+static int nfs_sink_fill[CONFIG_NFS_READ_WINDOW];	/* bytes in each block */
+static int nfs_sink_pos;	/* offset of the first block not passed on */
+
+static int nfs_sink_put(uchar *src, int offset, int len)
+{
+	int blk = offset / nfs_len % nfs_read_window;
+
+	if (!nfs_sink_buf) {
+		nfs_sink_buf = malloc(CONFIG_NFS_READ_WINDOW * NFS_READ_SIZE);
+		if (!nfs_sink_buf)
+			return -ENOMEM;
+	}
+	memcpy(nfs_sink_buf + blk * nfs_len + offset % nfs_len, src, len);
+	nfs_sink_fill[blk] += len;
+
+	return 0;
+}
+
+/* Pass the complete blocks at the head of the window on to the chain */
+static int nfs_sink_flush(void)
+{
+	int blk, len, ret;
+
+	for (;;) {
+		blk = nfs_sink_pos / nfs_len % nfs_read_window;
+		len = nfs_len;
+		if (nfs_read_eof >= 0)
+			len = min(len, nfs_read_eof - nfs_sink_pos);
+		if (len <= 0 || nfs_sink_fill[blk] < len)
+			return 0;
+		ret = net_sink_store(nfs_sink_pos, nfs_sink_buf + blk * nfs_len,
+				     len);
+		if (ret)
+			return ret;
+		nfs_sink_fill[blk] = 0;
+		nfs_sink_pos += len;
+	}
+}
+#endif
+
 static inline int store_block(uchar *src, unsigned offset, unsigned len)
 {
 	ulong newsize = offset + len;
@@ -170,15 +233,14 @@ static uint32_t *rpc_add_credentials(uint32_t *p)
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
-static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+static void rpc_req_xid(unsigned long id, int rpc_prog, int rpc_proc,
+			uint32_t *data, int datalen)
 {
 	struct rpc_t rpc_pkt;
-	unsigned long id;
 	uint32_t *p;
 	int pktlen;
 	int sport;
 
-	id = ++rpc_id;
 	rpc_pkt.u.call.id = htonl(id);
 	rpc_pkt.u.call.type = htonl(MSG_CALL);
 	rpc_pkt.u.call.rpcvers = htonl(2);	/* use RPC version 2 */
@@ -217,6 +279,11 @@ static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 			    nfs_our_port, pktlen);
 }
 
+static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+{
+	rpc_req_xid(++rpc_id, rpc_prog, rpc_proc, data, datalen);
+}
+
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
@@ -356,10 +423,12 @@ static void nfs_lookup_req(char *fname)
 /**************************************************************************
 NFS_READ - Read File on NFS Server
 **************************************************************************/
-static void nfs_read_req(int offset, int readlen)
+static void nfs_read_req(struct nfs_read_slot *slot)
 {
 	uint32_t data[1024];
 	uint32_t *p;
+	int offset = slot->offset;
+	int readlen = slot->len;
 	int len;
 
 	p = &(data[0]);
@@ -383,7 +452,77 @@ static void nfs_read_req(int offset, int readlen)
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_READ, data, len);
+	/* a retransmission keeps its XID, so that either reply will do */
+	if (!slot->id)
+		slot->id = ++rpc_id;
+	else
+		net_stats_inc(retransmits);
+	slot->sent = get_timer(0);
+	rpc_req_xid(slot->id, PROG_NFS, NFS_READ, data, len);
+}
+
+/* Request the next blocks of the file into the free slots */
+static void nfs_read_fill(void)
+{
+	int i;
+
+	for (i = 0; i < nfs_read_window; i++) {
+		struct nfs_read_slot *slot = &nfs_read_slots[i];
+
+		if (slot->id)
+			continue;
+		if (nfs_read_eof >= 0 && nfs_read_next >= nfs_read_eof)
+			break;
+#ifdef CONFIG_NET_SINK
+		/* keep within the blocks the reorder buffer can hold */
+		if (net_sink && nfs_read_next >=
+		    nfs_sink_pos + nfs_read_window * nfs_len)
+			break;
+#endif
+		slot->offset = nfs_read_next;
+		slot->len = nfs_len;
+		nfs_read_next += nfs_len;
+		nfs_read_req(slot);
+	}
+}
+
+/* Retransmit the requests whose reply is overdue, or all of them */
+static void nfs_read_resend(bool all)
+{
+	int i;
+
+	for (i = 0; i < nfs_read_window; i++) {
+		struct nfs_read_slot *slot = &nfs_read_slots[i];
+
+		if (slot->id && (all || get_timer(slot->sent) > nfs_timeout))
+			nfs_read_req(slot);
+	}
+}
+
+static bool nfs_read_busy(void)
+{
+	int i;
+
+	for (i = 0; i < nfs_read_window; i++) {
+		if (nfs_read_slots[i].id)
+			return true;
+	}
+
+	return false;
+}
+
+/* The file ends at @offset: forget the requests beyond it */
+static void nfs_read_set_eof(int offset)
+{
+	int i;
+
+	if (nfs_read_eof >= 0 && nfs_read_eof <= offset)
+		return;
+	nfs_read_eof = offset;
+	for (i = 0; i < nfs_read_window; i++) {
+		if (nfs_read_slots[i].offset >= offset)
+			nfs_read_slots[i].id = 0;
+	}
 }
 
 /**************************************************************************
@@ -416,7 +555,7 @@ static void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_fill();
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -654,9 +793,12 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 
 static int nfs_read_reply(uchar *pkt, unsigned len)
 {
+	struct nfs_read_slot *slot = NULL;
 	struct rpc_t rpc_pkt;
 	int rlen;
+	int eof = 0;
 	uchar *data_ptr;
+	int i;
 
 	debug("%s\n", __func__);
 
@@ -664,8 +806,19 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 
 	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
 		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+
+	/* Stale replies and duplicates of retransmissions find no request */
+	for (i = 0; i < nfs_read_window; i++) {
+		if (nfs_read_slots[i].id &&
+		    nfs_read_slots[i].id == ntohl(rpc_pkt.u.reply.id))
+			slot = &nfs_read_slots[i];
+	}
+	if (!slot) {
+		net_stats_inc(dup_blocks);
 		return -NFS_RPC_DROP;
+	}
+	slot->id = 0;
+	nfs_offset = slot->offset;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -693,16 +846,41 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
+		eof = ntohl(rpc_pkt.u.reply.data[2 + nfsv3_data_offset]);
 		/* Skip unused values :
-			EOF:		32 bits value,
 			data_size:	32 bits value,
 		*/
 		data_ptr = (uchar *)
 			&(rpc_pkt.u.reply.data[4 + nfsv3_data_offset]);
 	}
 
-	if (store_block(data_ptr, nfs_offset, rlen))
+	if (rlen > slot->len)
+		return -9999;
+
+#ifdef CONFIG_NET_SINK
+	if (net_sink) {
+		if (rlen && nfs_sink_put(data_ptr, nfs_offset, rlen))
 			return -9999;
+	} else
+#endif
+	/* reads past the end must not grow the file */
+	if (rlen && store_block(data_ptr, nfs_offset, rlen))
+			return -9999;
+
+	if (rlen < slot->len) {
+		if (!rlen || eof) {
+			nfs_read_set_eof(slot->offset + rlen);
+		} else {
+			/* The server has a smaller rsize: ask for the rest */
+			slot->offset += rlen;
+			slot->len -= rlen;
+			nfs_read_req(slot);
+		}
+	}
+#ifdef CONFIG_NET_SINK
+	if (net_sink && nfs_sink_flush())
+		return -9999;
+#endif
 
 	return rlen;
 }
@@ -712,6 +890,7 @@ Interfaces of U-BOOT
 **************************************************************************/
 static void nfs_timeout_handler(void)
 {
+	net_stats_inc(timeouts);
 	if (++nfs_timeout_count > NFS_RETRY_COUNT) {
 		puts("\nRetry count exceeded; starting again\n");
 		net_start_again();
@@ -720,7 +899,12 @@ static void nfs_timeout_handler(void)
 		net_set_timeout_handler(nfs_timeout +
 					NFS_TIMEOUT * nfs_timeout_count,
 					nfs_timeout_handler);
-		nfs_send();
+		if (nfs_state == STATE_READ_REQ) {
+			nfs_read_resend(true);
+		} else {
+			net_stats_inc(retransmits);
+			nfs_send();
+		}
 	}
 }
 
@@ -798,6 +982,13 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_state = STATE_READ_REQ;
 			nfs_offset = 0;
 			nfs_len = NFS_READ_SIZE;
+			memset(nfs_read_slots, '\0', sizeof(nfs_read_slots));
+			nfs_read_next = 0;
+			nfs_read_eof = -1;
+#ifdef CONFIG_NET_SINK
+			memset(nfs_sink_fill, '\0', sizeof(nfs_sink_fill));
+			nfs_sink_pos = 0;
+#endif
 			nfs_send();
 		}
 		break;
@@ -825,15 +1016,15 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (rlen == -NFS_RPC_DROP)
 			break;
 		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
-			nfs_send();
+		if (rlen >= 0 && (nfs_read_eof < 0 || nfs_read_busy())) {
+			nfs_read_fill();
+			nfs_read_resend(false);
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
+			if (rlen >= 0)
 				nfs_download_state = NETLOOP_SUCCESS;
 			if (rlen < 0)
 				debug("NFS READ error (%d)\n", rlen);
@@ -905,6 +1096,13 @@ void nfs_start(void)
 	nfs_timeout_count = 0;
 	nfs_state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
 
+	nfs_read_window = env_get_ulong("nfsreadwindow", 10,
+					CONFIG_NFS_READ_WINDOW);
+	if (nfs_read_window < 1)
+		nfs_read_window = 1;
+	if (nfs_read_window > CONFIG_NFS_READ_WINDOW)
+		nfs_read_window = CONFIG_NFS_READ_WINDOW;
+
 	/*nfs_our_port = 4096 + (get_ticks() % 3072);*/
 	/*FIX ME !!!*/
 	nfs_our_port = 1000;
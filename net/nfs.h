@@ -38,10 +38,15 @@
 /*
  * Block size used for NFS read accesses.  A RPC reply packet (including  all
  * headers) must fit within a single Ethernet frame to avoid fragmentation.
- * However, if CONFIG_IP_DEFRAG is set, a bigger value could be used.  In any
- * case, most NFS servers are optimized for a power of 2.
+ * However, if CONFIG_IP_DEFRAG is set, a bigger value can be selected with
+ * CONFIG_NFS_READ_SIZE.  In any case, most NFS servers are optimized for a
+ * power of 2.
  */
+#if defined(CONFIG_IP_DEFRAG) && defined(CONFIG_NFS_READ_SIZE)
+#define NFS_READ_SIZE	CONFIG_NFS_READ_SIZE
+#else
 #define NFS_READ_SIZE	1024	/* biggest power of two that fits Ether frame */
+#endif
 #define NFS_MAX_ATTRS	26
 
 /* Values for Accept State flag on RPC answers (See: rfc1831) */
@@ -38,18 +38,31 @@ static int ping_send(void)
 {
 	uchar *pkt;
 	int eth_hdr_size;
-
-	/* XXX always send arp request */
-
-	debug_cond(DEBUG_DEV_PKT, "sending ARP for %pI4\n", &net_ping_ip);
-
-	net_arp_wait_packet_ip = net_ping_ip;
+#ifdef CONFIG_NET_ARP_CACHE
+	uchar ethaddr[ARP_HLEN];
+#endif
 
 	eth_hdr_size = net_set_ether(net_tx_packet, net_null_ethaddr, PROT_IP);
 	pkt = (uchar *)net_tx_packet + eth_hdr_size;
 
 	set_icmp_header(pkt, net_ping_ip);
 
+#ifdef CONFIG_NET_ARP_CACHE
+	if (!arp_cache_lookup(net_ping_ip, ethaddr)) {
+		memcpy(((struct ethernet_hdr *)net_tx_packet)->et_dest,
+		       ethaddr, ARP_HLEN);
+		net_send_packet(net_tx_packet,
+				eth_hdr_size + IP_ICMP_HDR_SIZE);
+		return 0;	/* transmitted */
+	}
+#endif
+
+	/* XXX always send arp request if the address is not cached */
+
+	debug_cond(DEBUG_DEV_PKT, "sending ARP for %pI4\n", &net_ping_ip);
+
+	net_arp_wait_packet_ip = net_ping_ip;
+
 	/* size of the waiting packet */
 	arp_wait_tx_packet_size = eth_hdr_size + IP_ICMP_HDR_SIZE;
 
@@ -0,0 +1,477 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Minimal TCP client
+ *
+ * There is a single connection, opened by us, which mostly receives: data
+ * is handed to the application as soon as it arrives in order, so that the
+ * receive window never closes and can be as large as the Ethernet driver
+ * can absorb (RFC 7323 window scaling). A segment arriving out of order is
+ * dropped, but answered at once with a duplicate ACK so that the server
+ * resends the missing one without waiting for its timer (RFC 5681 fast
+ * retransmit). Segments in order are acknowledged every second one or once
+ * the Ethernet device has no more queued (delayed ACK).
+ *
+ * The few bytes we send, e.g. an HTTP request, are kept until acknowledged
+ * and sent again on timeout or after three duplicate ACKs.
+ */
+
+#include <common.h>
+#include <net.h>
+#include <net/tcp.h>
+#include <asm/unaligned.h>
+
+/* Retransmission timeout in ms, doubled on each retry (RFC 6298) */
+#define TCP_RTO_INIT		1000
+#define TCP_RTO_MAX		16000
+/* Timeouts without progress before the connection is given up */
+#define TCP_RETRIES		8
+/* Duplicate ACKs which trigger a fast retransmit */
+#define TCP_DUPACK_THRESH	3
+/* Segment size assumed when the server does not say */
+#define TCP_DEFAULT_MSS		536
+/* Room for the data sent to the server */
+#define TCP_SND_BUF		2048
+
+static struct tcp_conn {
+	enum tcp_state state;
+	struct in_addr rip;		/* server address */
+	uchar rether[6];		/* server or gateway MAC address */
+	int rport;
+	int lport;
+	tcp_rx_f *rx;
+	tcp_event_f *event;
+
+	u32 iss;			/* initial send sequence number */
+	u32 snd_una;			/* oldest unacknowledged */
+	u32 snd_nxt;			/* next to send */
+	u32 snd_wnd;			/* window granted by the server */
+	u32 snd_mss;
+	u8 snd_wscale;
+	uchar snd_buf[TCP_SND_BUF];	/* data from snd_una on */
+	u32 snd_len;
+	bool fin_queued;
+	bool fin_sent;
+	int dupacks;
+
+	u32 irs;			/* initial receive sequence number */
+	u32 rcv_nxt;			/* next expected */
+	u8 rcv_wscale;
+	int rcv_unacked;		/* segments received since our ACK */
+
+	ulong rto;
+	int retries;
+} tcp;
+
+static inline bool seq_lt(u32 a, u32 b)
+{
+	return (s32)(a - b) < 0;
+}
+
+static inline bool seq_le(u32 a, u32 b)
+{
+	return (s32)(a - b) <= 0;
+}
+
+enum tcp_state tcp_get_state(void)
+{
+	return tcp.state;
+}
+
+u16 tcp_checksum(struct in_addr src, struct in_addr dest, const void *seg,
+		 int len)
+{
+	struct {
+		struct in_addr src;
+		struct in_addr dest;
+		u8 zero;
+		u8 proto;
+		u16 len;
+	} __attribute__((packed)) pseudo;
+	unsigned sum;
+
+	net_copy_ip(&pseudo.src, &src);
+	net_copy_ip(&pseudo.dest, &dest);
+	pseudo.zero = 0;
+	pseudo.proto = IPPROTO_TCP;
+	pseudo.len = htons(len);
+	sum = compute_ip_checksum(&pseudo, sizeof(pseudo));
+
+	return add_ip_checksums(sizeof(pseudo), sum,
+				compute_ip_checksum(seg, len));
+}
+
+/* The window to advertise, which is never scaled in a SYN */
+static u16 tcp_window(u8 flags)
+{
+	u32 wnd = CONFIG_TCP_WINDOW;
+
+	if (!(flags & TCP_SYN))
+		wnd >>= tcp.rcv_wscale;
+
+	return min(wnd, 0xffffU);
+}
+
+int tcp_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 tcp_seq_num,
+		       u32 tcp_ack_num)
+{
+	struct tcp_hdr *th = (struct tcp_hdr *)(pkt + IP_HDR_SIZE);
+	int hlen = TCP_HDR_SIZE;
+
+	if (action & TCP_SYN) {
+		uchar *opt = (uchar *)(th + 1);
+
+		opt[0] = TCP_OPT_MSS;
+		opt[1] = 4;
+		put_unaligned_be16(TCP_MSS, opt + 2);
+		opt[4] = TCP_OPT_NOP;
+		opt[5] = TCP_OPT_WS;
+		opt[6] = 3;
+		opt[7] = tcp.rcv_wscale;
+		hlen += TCP_SYN_OPT_SIZE;
+	}
+
+	th->tcp_src = htons(sport);
+	th->tcp_dst = htons(dport);
+	th->tcp_seq = htonl(tcp_seq_num);
+	th->tcp_ack = htonl(action & TCP_ACK ? tcp_ack_num : 0);
+	th->tcp_hlen = hlen / 4 << 4;
+	th->tcp_flags = action;
+	th->tcp_win = htons(tcp_window(action));
+	th->tcp_xsum = 0;
+	th->tcp_urg = 0;
+
+	net_set_ip_header(pkt, dest, net_ip, IP_HDR_SIZE + hlen + payload_len,
+			  IPPROTO_TCP);
+	th->tcp_xsum = tcp_checksum(net_ip, dest, th, hlen + payload_len);
+
+	return IP_HDR_SIZE + hlen;
+}
+
+static void tcp_send_segment(u8 flags, u32 seq, const uchar *data, int len)
+{
+	uchar *pkt = net_tx_packet + net_eth_hdr_size() + IP_HDR_SIZE +
+		     TCP_HDR_SIZE;
+
+	if (len)
+		memcpy(pkt, data, len);
+	net_send_ip_packet(tcp.rether, tcp.rip, tcp.rport, tcp.lport, len,
+			   IPPROTO_TCP, flags, seq, tcp.rcv_nxt);
+	if (flags & TCP_ACK)
+		tcp.rcv_unacked = 0;
+}
+
+static void tcp_send_ack(void)
+{
+	tcp_send_segment(TCP_ACK, tcp.snd_nxt, NULL, 0);
+}
+
+static void tcp_timeout_handler(void);
+
+/* (Re)start the timer, which runs as long as the connection is open */
+static void tcp_timer_start(void)
+{
+	net_set_timeout_handler(tcp.rto, tcp_timeout_handler);
+}
+
+/* The server acknowledged something new or sent more data */
+static void tcp_progress(void)
+{
+	tcp.retries = 0;
+	tcp.rto = TCP_RTO_INIT;
+	tcp_timer_start();
+}
+
+/* Send whatever the window allows of the queued data, then any FIN */
+static void tcp_output(void)
+{
+	u32 off, len, wnd_end;
+
+	if (tcp.state == TCP_CLOSED || tcp.state == TCP_SYN_SENT)
+		return;
+
+	wnd_end = tcp.snd_una + tcp.snd_wnd;
+	while ((off = tcp.snd_nxt - tcp.snd_una) < tcp.snd_len) {
+		len = min(tcp.snd_len - off, tcp.snd_mss);
+		if (seq_lt(wnd_end, tcp.snd_nxt + len))
+			len = wnd_end - tcp.snd_nxt;
+		/* a closed window is probed by the retransmission timer */
+		if (!len || seq_lt(wnd_end, tcp.snd_nxt))
+			return;
+		tcp_send_segment(TCP_ACK | TCP_PUSH, tcp.snd_nxt,
+				 tcp.snd_buf + off, len);
+		tcp.snd_nxt += len;
+	}
+
+	if (tcp.fin_queued && !tcp.fin_sent) {
+		tcp_send_segment(TCP_ACK | TCP_FIN, tcp.snd_nxt, NULL, 0);
+		tcp.snd_nxt++;
+		tcp.fin_sent = true;
+		tcp.state = TCP_FIN_WAIT;
+	}
+}
+
+/* Resend the oldest unacknowledged segment */
+static void tcp_retransmit(void)
+{
+	u32 len = min(tcp.snd_len, tcp.snd_mss);
+
+	net_stats_inc(retransmits);
+	if (len)
+		tcp_send_segment(TCP_ACK | TCP_PUSH, tcp.snd_una, tcp.snd_buf,
+				 len);
+	else if (tcp.fin_sent)
+		tcp_send_segment(TCP_ACK | TCP_FIN, tcp.snd_una, NULL, 0);
+}
+
+static void tcp_timeout_handler(void)
+{
+	net_stats_inc(timeouts);
+	if (++tcp.retries > TCP_RETRIES) {
+		tcp.state = TCP_CLOSED;
+		tcp.event(TCP_EV_TIMEOUT);
+		return;
+	}
+	tcp.rto = min(tcp.rto * 2, (ulong)TCP_RTO_MAX);
+
+	if (tcp.state == TCP_SYN_SENT) {
+		net_stats_inc(retransmits);
+		tcp_send_segment(TCP_SYN, tcp.iss, NULL, 0);
+	} else if (tcp.snd_una != tcp.snd_nxt) {
+		tcp_retransmit();
+	} else {
+		tcp_send_ack();
+	}
+	tcp_timer_start();
+}
+
+int tcp_connect(struct in_addr dest, int dport, tcp_rx_f *rx,
+		tcp_event_f *event)
+{
+	static int port;
+
+	memset(&tcp, '\0', sizeof(tcp));
+	tcp.rip = dest;
+	tcp.rport = dport;
+	/* a new port each time, so that old segments are not mistaken */
+	tcp.lport = 49152 + (get_timer(0) + ++port) % 16384;
+	tcp.rx = rx;
+	tcp.event = event;
+	tcp.iss = get_ticks() * 2654435761U;
+	tcp.snd_una = tcp.iss;
+	tcp.snd_nxt = tcp.iss + 1;
+	tcp.snd_mss = TCP_DEFAULT_MSS;
+	while (CONFIG_TCP_WINDOW >> tcp.rcv_wscale > 0xffff)
+		tcp.rcv_wscale++;
+	tcp.rto = TCP_RTO_INIT;
+	tcp.state = TCP_SYN_SENT;
+
+	tcp_send_segment(TCP_SYN, tcp.iss, NULL, 0);
+	tcp_timer_start();
+
+	return 0;
+}
+
+int tcp_send(const void *data, u32 len)
+{
+	if (tcp.state != TCP_ESTABLISHED && tcp.state != TCP_CLOSE_WAIT)
+		return -ENOTCONN;
+	if (len > TCP_SND_BUF - tcp.snd_len)
+		return -ENOSPC;
+	memcpy(tcp.snd_buf + tcp.snd_len, data, len);
+	tcp.snd_len += len;
+	tcp_output();
+
+	return 0;
+}
+
+void tcp_close(void)
+{
+	if (tcp.state != TCP_ESTABLISHED && tcp.state != TCP_CLOSE_WAIT)
+		return;
+	tcp.fin_queued = true;
+	tcp_output();
+}
+
+void tcp_abort(void)
+{
+	if (tcp.state == TCP_CLOSED)
+		return;
+	tcp_send_segment(TCP_RST | TCP_ACK, tcp.snd_nxt, NULL, 0);
+	tcp.state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+}
+
+void tcp_poll(void)
+{
+	if (tcp.state != TCP_CLOSED && tcp.rcv_unacked)
+		tcp_send_ack();
+}
+
+/* Pick the MSS and window scale out of the options of a SYN */
+static void tcp_parse_syn_options(const uchar *opt, int len)
+{
+	bool wscale = false;
+
+	while (len > 0 && opt[0] != TCP_OPT_END) {
+		if (opt[0] == TCP_OPT_NOP) {
+			opt++;
+			len--;
+			continue;
+		}
+		if (len < 2 || opt[1] < 2 || opt[1] > len)
+			break;
+		if (opt[0] == TCP_OPT_MSS && opt[1] == 4)
+			tcp.snd_mss = min(get_unaligned_be16(opt + 2),
+					  (u16)TCP_MSS);
+		if (opt[0] == TCP_OPT_WS && opt[1] == 3) {
+			tcp.snd_wscale = min(opt[2], (u8)14);
+			wscale = true;
+		}
+		len -= opt[1];
+		opt += opt[1];
+	}
+
+	/* Scaling is only used if both sides ask for it */
+	if (!wscale) {
+		tcp.snd_wscale = 0;
+		tcp.rcv_wscale = 0;
+	}
+}
+
+/* Process the acknowledgement of a segment; returns false to drop it */
+static bool tcp_ack(u32 ack, u32 wnd, bool dup_candidate)
+{
+	u32 acked;
+
+	if (seq_lt(tcp.snd_nxt, ack))
+		return false;		/* acknowledges what we never sent */
+
+	if (seq_lt(tcp.snd_una, ack)) {
+		acked = ack - tcp.snd_una;
+		if (acked > tcp.snd_len)
+			acked = tcp.snd_len;	/* the rest is our FIN */
+		memmove(tcp.snd_buf, tcp.snd_buf + acked, tcp.snd_len - acked);
+		tcp.snd_len -= acked;
+		tcp.snd_una = ack;
+		tcp.dupacks = 0;
+		tcp_progress();
+	} else if (ack == tcp.snd_una && dup_candidate &&
+		   tcp.snd_una != tcp.snd_nxt && wnd == tcp.snd_wnd) {
+		if (++tcp.dupacks == TCP_DUPACK_THRESH)
+			tcp_retransmit();
+	}
+	tcp.snd_wnd = wnd;
+
+	return true;
+}
+
+void tcp_receive(struct ip_udp_hdr *ip, int len)
+{
+	struct tcp_hdr *th = (struct tcp_hdr *)((uchar *)ip + IP_HDR_SIZE);
+	struct in_addr src = net_read_ip(&ip->ip_src);
+	struct in_addr dst = net_read_ip(&ip->ip_dst);
+	u32 seq, ack, wnd;
+	int hlen, dlen;
+	uchar *data;
+	u16 sum;
+	u8 flags;
+
+	if (len < IP_HDR_SIZE + TCP_HDR_SIZE)
+		return;
+	hlen = (th->tcp_hlen >> 4) * 4;
+	if (hlen < TCP_HDR_SIZE || IP_HDR_SIZE + hlen > len)
+		return;
+	sum = tcp_checksum(src, dst, th, len - IP_HDR_SIZE);
+	if (sum && sum != 0xffff) {
+		debug("TCP wrong checksum %04x\n", sum);
+		net_stats_inc(rx_csum_errors);
+		return;
+	}
+	if (tcp.state == TCP_CLOSED || src.s_addr != tcp.rip.s_addr ||
+	    ntohs(th->tcp_src) != tcp.rport ||
+	    ntohs(th->tcp_dst) != tcp.lport)
+		return;
+
+	flags = th->tcp_flags;
+	seq = ntohl(th->tcp_seq);
+	ack = ntohl(th->tcp_ack);
+	data = (uchar *)th + hlen;
+	dlen = len - IP_HDR_SIZE - hlen;
+
+	if (tcp.state == TCP_SYN_SENT) {
+		if (!(flags & TCP_ACK) || ack != tcp.snd_nxt)
+			return;
+		if (flags & TCP_RST) {
+			tcp.state = TCP_CLOSED;
+			tcp.event(TCP_EV_RESET);
+			return;
+		}
+		if (!(flags & TCP_SYN))
+			return;
+		tcp_parse_syn_options((uchar *)(th + 1), hlen - TCP_HDR_SIZE);
+		tcp.irs = seq;
+		tcp.rcv_nxt = seq + 1;
+		tcp.snd_una = ack;
+		tcp.snd_wnd = ntohs(th->tcp_win);
+		tcp.state = TCP_ESTABLISHED;
+		tcp_progress();
+
+		/* data sent from the handler carries the ACK of the SYN */
+		tcp.rcv_unacked = 1;
+		tcp.event(TCP_EV_CONNECTED);
+		if (tcp.state != TCP_CLOSED && tcp.rcv_unacked)
+			tcp_send_ack();
+		return;
+	}
+
+	if (flags & TCP_RST) {
+		if (seq_le(tcp.rcv_nxt, seq) &&
+		    seq_lt(seq, tcp.rcv_nxt + CONFIG_TCP_WINDOW)) {
+			tcp.state = TCP_CLOSED;
+			net_set_timeout_handler(0, NULL);
+			tcp.event(TCP_EV_RESET);
+		}
+		return;
+	}
+	if (!(flags & TCP_ACK))
+		return;
+
+	wnd = ntohs(th->tcp_win) << tcp.snd_wscale;
+	if (!tcp_ack(ack, wnd, !dlen && !(flags & (TCP_SYN | TCP_FIN))))
+		return;
+	tcp_output();
+
+	if (!dlen && !(flags & TCP_FIN))
+		return;
+
+	/* Keep the part of a retransmission we have not seen yet */
+	if (seq_lt(seq, tcp.rcv_nxt) && seq_lt(tcp.rcv_nxt, seq + dlen)) {
+		data += tcp.rcv_nxt - seq;
+		dlen -= tcp.rcv_nxt - seq;
+		seq = tcp.rcv_nxt;
+	}
+	if (seq != tcp.rcv_nxt || tcp.state == TCP_CLOSE_WAIT) {
+		/* out of order or already seen: tell the server at once */
+		net_stats_inc(dup_blocks);
+		tcp_send_ack();
+		return;
+	}
+
+	if (dlen) {
+		tcp.rcv_nxt += dlen;
+		tcp_progress();
+		tcp.rx(data, seq - tcp.irs - 1, dlen);
+		if (tcp.state == TCP_CLOSED)
+			return;
+		if (++tcp.rcv_unacked >= 2)
+			tcp_send_ack();
+	}
+
+	if (flags & TCP_FIN) {
+		tcp.rcv_nxt++;
+		tcp_send_ack();
+		tcp.state = tcp.fin_sent ? TCP_CLOSED : TCP_CLOSE_WAIT;
+		tcp.event(TCP_EV_CLOSED);
+	}
+}
@@ -134,6 +134,77 @@ static char tftp_filename[MAX_LEN];
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = TFTP_MTU_BLOCKSIZE;
 
+/*
+ * RFC 7440 lets the server send a window of several blocks before it waits
+ * for an ACK, so a transfer is no longer bounded by one round trip per block.
+ * A window size of 1 is the classic lock-step protocol.
+ */
+static unsigned short tftp_windowsize = 1;
+static unsigned short tftp_window_size_option = CONFIG_TFTP_WINDOWSIZE;
+/* block number after which the next ACK is due */
+static unsigned short tftp_next_ack;
+/* last block number re-ACKed to recover a lost block, -1 if none */
+static int tftp_last_nack;
+
+#ifdef CONFIG_TFTP_MULTI
+/**
+ * struct tftp_session - one of several files loaded at once
+ *
+ * The transfer code works on the globals above. When several files are
+ * loaded, each has its own copy of them here, and the globals are switched
+ * over to the session a packet or timeout belongs to.
+ *
+ * @load_addr:	Address the file is loaded to
+ * @filename:	Name of the file on the server
+ * @size:	Number of bytes loaded so far
+ * @our_port:	Our UDP port, which tells the sessions apart
+ * @last_rx:	Time of the last packet received, or request sent
+ * @started:	The read request has been sent
+ * @done:	The whole file has been received, or the probe answered
+ * @found:	When probing, the server has the file
+ * The other members mirror the globals of the same name.
+ */
+struct tftp_session {
+	ulong load_addr;
+	char filename[MAX_LEN];
+	u32 size;
+	int our_port;
+	ulong last_rx;
+	bool started;
+	bool done;
+	bool found;
+	int remote_port;
+	int timeout_count;
+	ulong cur_block;
+	ulong prev_block;
+	ulong block_wrap;
+	ulong block_wrap_offset;
+	int state;
+#ifdef CONFIG_TFTP_TSIZE
+	int tsize;
+	short tsize_num_hash;
+#endif
+	unsigned short block_size;
+	unsigned short windowsize;
+	unsigned short next_ack;
+	int last_nack;
+};
+
+static struct tftp_session tftp_sessions[TFTP_MULTI_MAX];
+/* number of files to load at once, 0 for a single file */
+static int tftp_num_sessions;
+/* session whose state is in the globals, or NULL */
+static struct tftp_session *tftp_cur;
+/* number of sessions done */
+static int tftp_multi_done;
+/* blocks received by all sessions, for the progress hashes */
+static ulong tftp_multi_blocks;
+/* only find out which of the files the server has */
+static bool tftp_probing;
+
+static void tftp_multi_complete(void);
+#endif
+
 #ifdef CONFIG_MCAST_TFTP
 #include <malloc.h>
 #define MTFTP_BITMAPSIZE	0x1000
@@ -170,6 +241,16 @@ static inline void store_block(int block, uchar *src, unsigned len)
 	ulong newsize = offset + len;
 #ifdef CONFIG_SYS_DIRECT_FLASH_TFTP
 	int i, rc = 0;
+#endif
+
+#ifdef CONFIG_NET_SINK
+	if (net_sink) {
+		if (net_sink_store(offset, src, len))
+			net_set_state(NETLOOP_FAIL);
+		return;
+	}
+#endif
+#ifdef CONFIG_SYS_DIRECT_FLASH_TFTP
 
 	for (i = 0; i < CONFIG_SYS_MAX_FLASH_BANKS; i++) {
 		/* start address in flash? */
@@ -230,9 +311,12 @@ static int load_block(unsigned block, uchar *dst, unsigned len)
 	/* We may want to get the final block from the previous set */
 	ulong offset = ((int)block - 1) * len + tftp_block_wrap_offset;
 	ulong tosend = len;
+	void *ptr;
 
 	tosend = min(net_boot_file_size - offset, tosend);
-	(void)memcpy(dst, (void *)(save_addr + offset), tosend);
+	ptr = map_sysmem(save_addr + offset, tosend);
+	(void)memcpy(dst, ptr, tosend);
+	unmap_sysmem(ptr);
 	debug("%s: block=%d, offset=%ld, len=%d, tosend=%ld\n", __func__,
 	      block, offset, len, tosend);
 	return tosend;
@@ -246,6 +330,16 @@ static void tftp_timeout_handler(void);
 
 static void show_block_marker(void)
 {
+#ifdef CONFIG_TFTP_MULTI
+	/* Several files: one hash per ten blocks of any of them */
+	if (tftp_num_sessions) {
+		if (!(++tftp_multi_blocks % 10))
+			putc('#');
+		if (!(tftp_multi_blocks % (10 * HASHES_PER_LINE)))
+			puts("\n\t ");
+		return;
+	}
+#endif
 #ifdef CONFIG_TFTP_TSIZE
 	if (tftp_tsize) {
 		ulong pos = tftp_cur_block * tftp_block_size +
@@ -306,6 +400,12 @@ static void update_block_number(void)
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
+#ifdef CONFIG_TFTP_MULTI
+	if (tftp_num_sessions) {
+		tftp_multi_complete();
+		return;
+	}
+#endif
 #ifdef CONFIG_TFTP_TSIZE
 	/* Print hash marks for the last packet received */
 	while (tftp_tsize && tftp_tsize_num_hash < 49) {
@@ -372,6 +472,14 @@ static void tftp_send(void)
 		/* try for more effic. blk size */
 		pkt += sprintf((char *)pkt, "blksize%c%d%c",
 				0, tftp_block_size_option, 0);
+		/*
+		 * ...and several blocks per ACK, if the server will do it.
+		 * A put still sends one block per ACK, so only ask on a get.
+		 */
+		if (tftp_state == STATE_SEND_RRQ &&
+		    tftp_window_size_option > 1)
+			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
+					0, tftp_window_size_option, 0);
 #ifdef CONFIG_MCAST_TFTP
 		/* Check all preconditions before even trying the option */
 		if (!tftp_mcast_disabled) {
@@ -404,6 +512,8 @@ static void tftp_send(void)
 		s[0] = htons(TFTP_ACK);
 		s[1] = htons(tftp_cur_block);
 		pkt = (uchar *)(s + 2);
+		/* The server now sends the window following this block */
+		tftp_next_ack = tftp_cur_block + tftp_windowsize;
 #ifdef CONFIG_CMD_TFTPPUT
 		if (tftp_put_active) {
 			int toload = tftp_block_size;
@@ -457,6 +567,44 @@ static void icmp_handler(unsigned type, unsigned code, unsigned dest,
 }
 #endif
 
+/**
+ * Check that a data block is the next one expected in the current window
+ *
+ * With a window size above one, a lost or reordered block shows up as a gap
+ * in the sequence. RFC 7440 recovers from that by ACKing the last block
+ * received in order, which makes the server restart the window just after
+ * it. Only one such ACK is sent per gap: the rest of the window is still in
+ * flight and would otherwise trigger a retransmission for each block.
+ *
+ * @param block	Sequence number of the received block
+ * @return true if the block is in order, false if it must be dropped
+ */
+static bool tftp_window_check(ushort block)
+{
+	ushort expected;
+
+	if (tftp_state == STATE_DATA)
+		expected = tftp_prev_block + 1;
+	else if (tftp_state == STATE_OACK)
+		expected = 1;
+	else
+		return true;
+
+	if (block == expected)
+		return true;
+
+	debug("Received block %u, expected %u\n", block, expected);
+	net_stats_inc(dup_blocks);
+	/* tftp_cur_block still holds the last block received in order */
+	if (tftp_last_nack != (ushort)tftp_cur_block) {
+		tftp_last_nack = (ushort)tftp_cur_block;
+		net_stats_inc(retransmits);
+		tftp_send();
+	}
+
+	return false;
+}
+
 static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 unsigned src, unsigned len)
 {
@@ -540,6 +688,17 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				debug("Blocksize ack: %s, %d\n",
 				      (char *)pkt + i + 8, tftp_block_size);
 			}
+			if (strcmp((char *)pkt + i, "windowsize") == 0) {
+				tftp_windowsize = (unsigned short)
+					simple_strtoul((char *)pkt + i + 11,
+						       NULL, 10);
+				if (!tftp_windowsize ||
+				    tftp_windowsize > tftp_window_size_option)
+					tftp_windowsize =
+						tftp_window_size_option;
+				debug("Windowsize ack: %s, %d\n",
+				      (char *)pkt + i + 11, tftp_windowsize);
+			}
 #ifdef CONFIG_TFTP_TSIZE
 			if (strcmp((char *)pkt+i, "tsize") == 0) {
 				tftp_tsize = simple_strtoul((char *)pkt + i + 6,
@@ -568,6 +727,11 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (len < 2)
 			return;
 		len -= 2;
+
+		if (tftp_windowsize > 1 &&
+		    !tftp_window_check(ntohs(*(__be16 *)pkt)))
+			break;
+
 		tftp_cur_block = ntohs(*(__be16 *)pkt);
 
 		update_block_number();
@@ -599,6 +763,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		if (tftp_cur_block == tftp_prev_block) {
 			/* Same block again; ignore it. */
+			net_stats_inc(dup_blocks);
 			break;
 		}
 
@@ -607,6 +772,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
 		store_block(tftp_cur_block - 1, pkt + 2, len);
+		if (net_state == NETLOOP_FAIL)
+			break;
 
 		/*
 		 *	Acknowledge the block just received, which will prompt
@@ -638,7 +805,13 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			}
 		}
 #endif
-		tftp_send();
+		/*
+		 * Within a window only the last block, or the final short
+		 * one, is acknowledged.
+		 */
+		if (tftp_windowsize == 1 || len < tftp_block_size ||
+		    (ushort)tftp_cur_block == tftp_next_ack)
+			tftp_send();
 
 #ifdef CONFIG_MCAST_TFTP
 		if (tftp_mcast_active) {
@@ -685,16 +858,358 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 static void tftp_timeout_handler(void)
 {
+	net_stats_inc(timeouts);
 	if (++timeout_count > timeout_count_max) {
 		restart("Retry count exceeded");
 	} else {
 		puts("T ");
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
-		if (tftp_state != STATE_RECV_WRQ)
+		if (tftp_state != STATE_RECV_WRQ) {
+			net_stats_inc(retransmits);
 			tftp_send();
+		}
+	}
+}
+
+
+#ifdef CONFIG_TFTP_MULTI
+int tftp_multi_add(ulong addr, const char *filename)
+{
+	struct tftp_session *s;
+
+	if (tftp_num_sessions == TFTP_MULTI_MAX)
+		return -ENOSPC;
+	if (strlen(filename) >= MAX_LEN)
+		return -ENAMETOOLONG;
+
+	s = &tftp_sessions[tftp_num_sessions++];
+	s->load_addr = addr;
+	strcpy(s->filename, filename);
+
+	return 0;
+}
+
+void tftp_multi_clear(void)
+{
+	tftp_num_sessions = 0;
+	tftp_cur = NULL;
+}
+
+/* Copy the globals back to the session they belong to */
+static void tftp_session_save(struct tftp_session *s)
+{
+	s->load_addr = load_addr;
+	s->size = net_boot_file_size;
+	s->remote_port = tftp_remote_port;
+	s->timeout_count = timeout_count;
+	s->cur_block = tftp_cur_block;
+	s->prev_block = tftp_prev_block;
+	s->block_wrap = tftp_block_wrap;
+	s->block_wrap_offset = tftp_block_wrap_offset;
+	s->state = tftp_state;
+#ifdef CONFIG_TFTP_TSIZE
+	s->tsize = tftp_tsize;
+	s->tsize_num_hash = tftp_tsize_num_hash;
+#endif
+	s->block_size = tftp_block_size;
+	s->windowsize = tftp_windowsize;
+	s->next_ack = tftp_next_ack;
+	s->last_nack = tftp_last_nack;
+}
+
+/* Save the globals of the current session and load those of @s */
+static void tftp_switch(struct tftp_session *s)
+{
+	if (tftp_cur == s)
+		return;
+	if (tftp_cur)
+		tftp_session_save(tftp_cur);
+
+	load_addr = s->load_addr;
+	net_boot_file_size = s->size;
+	tftp_our_port = s->our_port;
+	tftp_remote_port = s->remote_port;
+	timeout_count = s->timeout_count;
+	tftp_cur_block = s->cur_block;
+	tftp_prev_block = s->prev_block;
+	tftp_block_wrap = s->block_wrap;
+	tftp_block_wrap_offset = s->block_wrap_offset;
+	tftp_state = s->state;
+#ifdef CONFIG_TFTP_TSIZE
+	tftp_tsize = s->tsize;
+	tftp_tsize_num_hash = s->tsize_num_hash;
+#endif
+	tftp_block_size = s->block_size;
+	tftp_windowsize = s->windowsize;
+	tftp_next_ack = s->next_ack;
+	tftp_last_nack = s->last_nack;
+	/* The name is only needed for the read request */
+	if (tftp_state == STATE_SEND_RRQ)
+		strcpy(tftp_filename, s->filename);
+	tftp_cur = s;
+}
+
+static void tftp_multi_send_rrq(struct tftp_session *s)
+{
+	tftp_switch(s);
+	s->started = true;
+	s->last_rx = get_timer(0);
+	tftp_send();
+}
+
+static void tftp_multi_timeout(void);
+
+/* Wake up when the first of the running sessions times out */
+static void tftp_multi_set_timeout(void)
+{
+	ulong next = timeout_ms;
+	ulong elapsed;
+	int i;
+
+	for (i = 0; i < tftp_num_sessions; i++) {
+		struct tftp_session *s = &tftp_sessions[i];
+
+		if (!s->started || s->done)
+			continue;
+		elapsed = get_timer(s->last_rx);
+		next = min(next, elapsed < timeout_ms ? timeout_ms - elapsed :
+			   1UL);
 	}
+	net_set_timeout_handler(next, tftp_multi_timeout);
 }
 
+static void tftp_multi_timeout(void)
+{
+	int i;
+
+	for (i = 0; i < tftp_num_sessions; i++) {
+		struct tftp_session *s = &tftp_sessions[i];
+
+		if (!s->started || s->done ||
+		    get_timer(s->last_rx) < timeout_ms)
+			continue;
+		tftp_switch(s);
+		s->last_rx = get_timer(0);
+		tftp_timeout_handler();
+		if (net_state != NETLOOP_CONTINUE)
+			return;
+	}
+	tftp_multi_set_timeout();
+}
+
+/*
+ * When probing, the first answer to a read request tells whether the server
+ * has the file. A transfer the server has started is cut short with an
+ * error, as a client refusing the options would do (RFC 2347).
+ */
+static void tftp_probe_reply(struct tftp_session *s, uchar *pkt,
+			     unsigned src, unsigned len)
+{
+	__be16 *p = (__be16 *)pkt;
+	int i;
+
+	if (len < 2)
+		return;
+	switch (ntohs(p[0])) {
+	case TFTP_OACK:
+	case TFTP_DATA:
+		s->found = true;
+		pkt = net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+		p = (__be16 *)pkt;
+		p[0] = htons(TFTP_ERROR);
+		p[1] = htons(TFTP_ERR_UNDEFINED);
+		strcpy((char *)(p + 2), "Probe only");
+		net_send_udp_packet(net_server_ethaddr, tftp_remote_ip, src,
+				    s->our_port, 4 + 10 /*strlen("Probe only")*/
+				    + 1);
+		break;
+	case TFTP_ERROR:
+		break;
+	default:
+		return;
+	}
+	s->done = true;
+
+	/* Done once the answers for all files up to the first found are in */
+	for (i = 0; i < tftp_num_sessions; i++) {
+		if (!tftp_sessions[i].done)
+			return;
+		if (tftp_sessions[i].found)
+			break;
+	}
+	puts("\n");
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+static void tftp_multi_handler(uchar *pkt, unsigned dest, struct in_addr sip,
+			       unsigned src, unsigned len)
+{
+	struct tftp_session *s;
+	int i;
+
+	for (i = 0; i < tftp_num_sessions; i++) {
+		if (tftp_sessions[i].our_port == dest)
+			break;
+	}
+	if (i == tftp_num_sessions)
+		return;
+	s = &tftp_sessions[i];
+	if (!s->started || s->done)
+		return;
+
+	tftp_switch(s);
+	s->last_rx = get_timer(0);
+	if (tftp_probing)
+		tftp_probe_reply(s, pkt, src, len);
+	else
+		tftp_handler(pkt, dest, sip, src, len);
+	if (net_state != NETLOOP_CONTINUE)
+		return;
+
+	/*
+	 * The first reply has resolved the server's MAC address, so the
+	 * other requests can go out together without waiting for ARP
+	 */
+	if (!i) {
+		for (i = 1; i < tftp_num_sessions; i++) {
+			if (!tftp_sessions[i].started)
+				tftp_multi_send_rrq(&tftp_sessions[i]);
+		}
+	}
+	tftp_multi_set_timeout();
+}
+
+static void tftp_multi_complete(void)
+{
+	ulong size = 0;
+	ulong elapsed;
+	int i;
+
+	tftp_cur->done = true;
+	if (++tftp_multi_done < tftp_num_sessions)
+		return;
+
+	tftp_session_save(tftp_cur);
+	for (i = 0; i < tftp_num_sessions; i++) {
+		printf("\n\t %s: ", tftp_sessions[i].filename);
+		print_size(tftp_sessions[i].size, "");
+		size += tftp_sessions[i].size;
+	}
+	/* Finish with the last file in load_addr and net_boot_file_size */
+	tftp_switch(&tftp_sessions[tftp_num_sessions - 1]);
+
+	elapsed = get_timer(time_start);
+	if (elapsed > 0) {
+		puts("\n\t ");	/* Line up with "Loading: " */
+		print_size(size / elapsed * 1000, "/s");
+	}
+	puts("\ndone\n");
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+/* Send the first read request; the others follow once the server answers */
+static void tftp_multi_start(void)
+{
+	int remote_port = WELL_KNOWN_PORT;
+	int our_port;
+	int i;
+#ifdef CONFIG_TFTP_PORT
+	char *ep;
+#endif
+
+#ifdef CONFIG_NET_SINK
+	if (net_sink) {
+		puts("Cannot decompress or hash several files at once\n");
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+#endif
+
+	printf("Using %s device\n", eth_get_name());
+	printf("TFTP from server %pI4; our IP address is %pI4\n",
+	       &net_server_ip, &net_ip);
+	for (i = 0; i < tftp_num_sessions; i++) {
+		if (tftp_probing)
+			printf("Probing '%s'\n", tftp_sessions[i].filename);
+		else
+			printf("Filename '%s'. Load address: 0x%lx\n",
+			       tftp_sessions[i].filename,
+			       tftp_sessions[i].load_addr);
+	}
+	puts(tftp_probing ? "Waiting: " : "Loading: *\b");
+
+	/* Each file is a transfer of its own, on consecutive ports */
+	our_port = 1024 + (get_timer(0) % 3072);
+#ifdef CONFIG_TFTP_PORT
+	ep = env_get("tftpdstp");
+	if (ep != NULL)
+		remote_port = simple_strtol(ep, NULL, 10);
+	ep = env_get("tftpsrcp");
+	if (ep != NULL)
+		our_port = simple_strtol(ep, NULL, 10);
+#endif
+
+	for (i = 0; i < tftp_num_sessions; i++) {
+		struct tftp_session *s = &tftp_sessions[i];
+
+		s->size = 0;
+		s->our_port = our_port + i;
+		s->started = false;
+		s->done = false;
+		s->found = false;
+		s->remote_port = remote_port;
+		s->timeout_count = 0;
+		s->cur_block = 0;
+		s->prev_block = 0;
+		s->block_wrap = 0;
+		s->block_wrap_offset = 0;
+		s->state = STATE_SEND_RRQ;
+#ifdef CONFIG_TFTP_TSIZE
+		s->tsize = 0;
+		s->tsize_num_hash = 0;
+#endif
+		s->block_size = TFTP_BLOCK_SIZE;
+		s->windowsize = 1;
+		s->last_nack = -1;
+	}
+	tftp_cur = NULL;
+	tftp_multi_done = 0;
+	tftp_multi_blocks = 0;
+
+	tftp_remote_ip = net_server_ip;
+	time_start = get_timer(0);
+	timeout_count_max = tftp_timeout_count_max;
+	/* zero out server ether in case the server ip has changed */
+	memset(net_server_ethaddr, 0, 6);
+	net_set_udp_handler(tftp_multi_handler);
+
+	tftp_multi_send_rrq(&tftp_sessions[0]);
+	tftp_multi_set_timeout();
+}
+
+int tftp_multi_probe(void)
+{
+	ulong addr = load_addr;
+	int ret;
+	int i;
+
+	tftp_probing = true;
+	ret = net_loop(TFTPGET);
+	tftp_probing = false;
+	/* Switching between the sessions changed it */
+	load_addr = addr;
+	if (ret < 0)
+		return -EIO;
+
+	for (i = 0; i < tftp_num_sessions; i++) {
+		if (tftp_sessions[i].found)
+			return i;
+	}
+
+	return -ENOENT;
+}
+#endif /* CONFIG_TFTP_MULTI */
+
 
 void tftp_start(enum proto_t protocol)
 {
@@ -710,6 +1225,11 @@ void tftp_start(enum proto_t protocol)
 	if (ep != NULL)
 		tftp_block_size_option = simple_strtol(ep, NULL, 10);
 
+	tftp_window_size_option = CONFIG_TFTP_WINDOWSIZE;
+	ep = env_get("tftpwindowsize");
+	if (ep != NULL)
+		tftp_window_size_option = simple_strtol(ep, NULL, 10);
+
 	ep = env_get("tftptimeout");
 	if (ep != NULL)
 		timeout_ms = simple_strtol(ep, NULL, 10);
@@ -731,8 +1251,21 @@ void tftp_start(enum proto_t protocol)
 	}
 #endif
 
-	debug("TFTP blocksize = %i, timeout = %ld ms\n",
-	      tftp_block_size_option, timeout_ms);
+	if (tftp_window_size_option < 1) {
+		printf("TFTP window size (%d) too low, set to 1\n",
+		       tftp_window_size_option);
+		tftp_window_size_option = 1;
+	}
+
+	debug("TFTP blocksize = %i, windowsize = %i, timeout = %ld ms\n",
+	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
+
+#ifdef CONFIG_TFTP_MULTI
+	if (tftp_num_sessions && protocol == TFTPGET) {
+		tftp_multi_start();
+		return;
+	}
+#endif
 
 	tftp_remote_ip = net_server_ip;
 	if (!net_parse_bootfile(&tftp_remote_ip, tftp_filename, MAX_LEN)) {
@@ -824,8 +1357,10 @@ void tftp_start(enum proto_t protocol)
 
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_windowsize to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_windowsize = 1;
+	tftp_last_nack = -1;
 #ifdef CONFIG_MCAST_TFTP
 	mcast_cleanup();
 #endif
@@ -853,8 +1388,9 @@ void tftp_start_server(void)
 	timeout_ms = TIMEOUT;
 	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_windowsize to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_windowsize = 1;
 	tftp_cur_block = 0;
 	tftp_our_port = WELL_KNOWN_PORT;
 
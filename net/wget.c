@@ -0,0 +1,331 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * HTTP client loading a file into memory
+ *
+ * A single GET request is sent over TCP and the body of the response is
+ * written to the load address as it arrives. Both a Content-Length and
+ * the chunked transfer coding of HTTP/1.1 are understood.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <environment.h>
+#include <mapmem.h>
+#include <net.h>
+#include <net/tcp.h>
+#include "wget.h"
+
+#define HASHES_PER_LINE	65	/* Number of "loading" hashes per line	*/
+#define WGET_HASH_BYTES	(64 << 10)	/* Bytes loaded per hash	*/
+#define WGET_HDR_SIZE	2048	/* Room for the response header	*/
+
+enum wget_state {
+	WGET_HEADER,		/* receiving the response header */
+	WGET_BODY,		/* receiving a body of known or unknown size */
+	WGET_CHUNK_SIZE,	/* receiving the size line of a chunk */
+	WGET_CHUNK_DATA,	/* receiving the data of a chunk */
+	WGET_CHUNK_END,		/* receiving the CRLF after a chunk */
+	WGET_TRAILER,		/* receiving the trailer after the last chunk */
+	WGET_DONE,
+};
+
+static enum wget_state wget_state;
+static struct in_addr wget_server_ip;
+static int wget_server_port;
+static char wget_path[1024];
+static char wget_hdr[WGET_HDR_SIZE];	/* header, or a chunk size line */
+static int wget_hdr_len;
+static long wget_content_length;	/* -1 if not given */
+static ulong wget_chunk_left;
+static ulong wget_size;			/* bytes of body stored */
+static int wget_hashes;
+static ulong wget_time_start;
+
+static void wget_fail(const char *msg)
+{
+	printf("\n%s\n", msg);
+	tcp_abort();
+	net_set_state(NETLOOP_FAIL);
+}
+
+static void wget_complete(void)
+{
+	ulong elapsed;
+
+	wget_state = WGET_DONE;
+	tcp_close();
+	elapsed = get_timer(wget_time_start);
+	if (elapsed > 0) {
+		puts("\n\t ");	/* Line up with "Loading: " */
+		print_size(wget_size / elapsed * 1000, "/s");
+	}
+	puts("\ndone\n");
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+static int wget_store(const uchar *src, ulong len)
+{
+	void *ptr;
+
+#ifdef CONFIG_NET_SINK
+	if (net_sink) {
+		if (net_sink_store(wget_size, src, len))
+			return -EIO;
+	} else
+#endif
+	{
+		ptr = map_sysmem(load_addr + wget_size, len);
+		memcpy(ptr, src, len);
+		unmap_sysmem(ptr);
+		net_boot_file_size = wget_size + len;
+	}
+	wget_size += len;
+
+	while (wget_hashes < wget_size / WGET_HASH_BYTES) {
+		putc('#');
+		if (!(++wget_hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+	}
+
+	return 0;
+}
+
+/* Find the value of header field @name, or NULL */
+static const char *wget_header_field(const char *name)
+{
+	int len = strlen(name);
+	const char *p;
+
+	for (p = strstr(wget_hdr, "\r\n"); p; p = strstr(p, "\r\n")) {
+		p += 2;
+		if (!strncasecmp(p, name, len) && p[len] == ':') {
+			for (p += len + 1; *p == ' ' || *p == '\t'; p++)
+				;
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+/* Check the status and find how the body is delimited */
+static int wget_parse_header(void)
+{
+	const char *val;
+	int status;
+
+	if (strncmp(wget_hdr, "HTTP/1.", 7) || !wget_hdr[7] ||
+	    wget_hdr[8] != ' ') {
+		wget_fail("Bad HTTP response");
+		return -EPROTO;
+	}
+	status = simple_strtoul(wget_hdr + 9, NULL, 10);
+	if (status != 200) {
+		char msg[80];
+
+		snprintf(msg, sizeof(msg), "HTTP error: %.*s", 60,
+			 wget_hdr + 9);
+		msg[strcspn(msg, "\r")] = '\0';
+		wget_fail(msg);
+		return -ENOENT;
+	}
+
+	wget_content_length = -1;
+	val = wget_header_field("Content-Length");
+	if (val)
+		wget_content_length = simple_strtoul(val, NULL, 10);
+	val = wget_header_field("Transfer-Encoding");
+	if (val && !strncasecmp(val, "chunked", 7)) {
+		wget_state = WGET_CHUNK_SIZE;
+		wget_hdr_len = 0;
+	} else {
+		wget_state = WGET_BODY;
+	}
+
+	return 0;
+}
+
+/* Gather a line, returning true once it is complete */
+static bool wget_get_line(const uchar **datap, u32 *lenp)
+{
+	while (*lenp) {
+		char c = *(*datap)++;
+
+		(*lenp)--;
+		if (wget_hdr_len == sizeof(wget_hdr) - 1) {
+			wget_fail("HTTP header too long");
+			return false;
+		}
+		wget_hdr[wget_hdr_len++] = c;
+		wget_hdr[wget_hdr_len] = '\0';
+		if (c == '\n')
+			return true;
+	}
+
+	return false;
+}
+
+static void wget_rx(const uchar *data, u32 offset, u32 len)
+{
+	u32 n;
+
+	while (len && net_state == NETLOOP_CONTINUE) {
+		switch (wget_state) {
+		case WGET_HEADER:
+			if (!wget_get_line(&data, &len))
+				break;
+			/* an empty line ends the header */
+			if (wget_hdr_len < 4 ||
+			    strcmp(wget_hdr + wget_hdr_len - 4, "\r\n\r\n"))
+				break;
+			if (wget_parse_header())
+				return;
+			if (wget_content_length == 0) {
+				wget_complete();
+				return;
+			}
+			break;
+		case WGET_BODY:
+			n = len;
+			if (wget_content_length >= 0)
+				n = min(len, (u32)(wget_content_length -
+						   wget_size));
+			if (wget_store(data, n)) {
+				wget_fail("Cannot store the file");
+				return;
+			}
+			data += n;
+			len -= n;
+			if ((long)wget_size == wget_content_length) {
+				wget_complete();
+				return;
+			}
+			break;
+		case WGET_CHUNK_SIZE:
+			if (!wget_get_line(&data, &len))
+				break;
+			wget_chunk_left = simple_strtoul(wget_hdr, NULL, 16);
+			wget_hdr_len = 0;
+			wget_state = wget_chunk_left ? WGET_CHUNK_DATA :
+						       WGET_TRAILER;
+			break;
+		case WGET_CHUNK_DATA:
+			n = min(len, (u32)wget_chunk_left);
+			if (wget_store(data, n)) {
+				wget_fail("Cannot store the file");
+				return;
+			}
+			data += n;
+			len -= n;
+			wget_chunk_left -= n;
+			if (!wget_chunk_left)
+				wget_state = WGET_CHUNK_END;
+			break;
+		case WGET_CHUNK_END:
+			if (!wget_get_line(&data, &len))
+				break;
+			wget_hdr_len = 0;
+			wget_state = WGET_CHUNK_SIZE;
+			break;
+		case WGET_TRAILER:
+			if (!wget_get_line(&data, &len))
+				break;
+			if (strcmp(wget_hdr, "\r\n")) {
+				wget_hdr_len = 0;
+				break;
+			}
+			wget_complete();
+			return;
+		case WGET_DONE:
+			return;
+		}
+	}
+}
+
+static void wget_send_request(void)
+{
+	char req[sizeof(wget_path) + 128];
+	int len;
+
+	len = snprintf(req, sizeof(req),
+		       "GET %s HTTP/1.1\r\n"
+		       "Host: %pI4\r\n"
+		       "User-Agent: U-Boot\r\n"
+		       "Connection: close\r\n"
+		       "\r\n", wget_path, &wget_server_ip);
+	if (tcp_send(req, len))
+		wget_fail("Cannot send the HTTP request");
+}
+
+static void wget_event(enum tcp_event event)
+{
+	switch (event) {
+	case TCP_EV_CONNECTED:
+		wget_send_request();
+		break;
+	case TCP_EV_CLOSED:
+		/* without a length, the body ends with the connection */
+		if (wget_state == WGET_BODY && wget_content_length < 0)
+			wget_complete();
+		else if (wget_state != WGET_DONE)
+			wget_fail("Connection closed early");
+		break;
+	case TCP_EV_RESET:
+		wget_fail("Connection refused or reset");
+		break;
+	case TCP_EV_TIMEOUT:
+		wget_fail("Retry count exceeded");
+		break;
+	}
+}
+
+/* Split "http://host[:port]/path", or "[host:]path", into its parts */
+static void wget_parse_url(void)
+{
+	char *p, *host;
+
+	wget_server_ip = net_server_ip;
+	wget_server_port = WGET_SERVER_PORT;
+	p = env_get("httpdstp");
+	if (p)
+		wget_server_port = simple_strtoul(p, NULL, 10);
+
+	if (strncmp(net_boot_file_name, "http://", 7)) {
+		net_parse_bootfile(&wget_server_ip, wget_path,
+				   sizeof(wget_path));
+		return;
+	}
+
+	host = net_boot_file_name + 7;
+	wget_server_ip = string_to_ip(host);
+	p = strchr(host, ':');
+	if (p && p < strchrnul(host, '/'))
+		wget_server_port = simple_strtoul(p + 1, NULL, 10);
+	p = strchr(host, '/');
+	strlcpy(wget_path, p ? p : "/", sizeof(wget_path));
+}
+
+void wget_start(void)
+{
+	wget_parse_url();
+	if (wget_path[0] != '/') {
+		memmove(wget_path + 1, wget_path, sizeof(wget_path) - 1);
+		wget_path[0] = '/';
+		wget_path[sizeof(wget_path) - 1] = '\0';
+	}
+
+	printf("Using %s device\n", eth_get_name());
+	printf("HTTP from server %pI4; our IP address is %pI4\n",
+	       &wget_server_ip, &net_ip);
+	printf("Filename '%s'.\n", wget_path);
+	printf("Load address: 0x%lx\n", load_addr);
+	puts("Loading: *\b");
+
+	wget_state = WGET_HEADER;
+	wget_hdr_len = 0;
+	wget_size = 0;
+	wget_hashes = 0;
+	wget_time_start = get_timer(0);
+	net_set_udp_handler(NULL);
+	tcp_connect(wget_server_ip, wget_server_port, wget_rx, wget_event);
+}
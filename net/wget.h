@@ -0,0 +1,13 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * HTTP client loading a file into memory
+ */
+
+#ifndef __WGET_H__
+#define __WGET_H__
+
+#define WGET_SERVER_PORT	80
+
+void wget_start(void);	/* Begin the HTTP download */
+
+#endif /* __WGET_H__ */
@@ -8,6 +8,7 @@
 #include <command.h>
 #include <malloc.h>
 #include <mapmem.h>
+#include <sink.h>
 #include <asm/io.h>
 
 #include <u-boot/zlib.h>
@@ -308,6 +309,58 @@ struct buf_state {
 	void *compare_buf;
 };
 
+#ifdef CONFIG_SINK
+/* Feed the input to a sink stage a few bytes at a time, as a download would */
+static int uncompress_using_sink(struct sink *(*new_stage)(struct sink *next),
+				 void *in, unsigned long in_size,
+				 void *out, unsigned long out_max,
+				 unsigned long *out_size)
+{
+	struct sink *mem, *sink;
+	unsigned long pos, len;
+	int ret = -ENOMEM;
+
+	mem = sink_mem_new(map_to_sysmem(out), out_max);
+	if (!mem)
+		return ret;
+	sink = new_stage(mem);
+	if (!sink) {
+		sink_free(mem);
+		return ret;
+	}
+
+	for (pos = 0, ret = 0; !ret && pos < in_size; pos += len) {
+		len = min(in_size - pos, 7UL);
+		ret = sink_write(sink, in + pos, len);
+	}
+	if (!ret)
+		ret = sink_close(sink);
+	if (out_size)
+		*out_size = mem->size;
+	sink_free(sink);
+
+	return ret != 0;
+}
+
+static int uncompress_using_gzip_sink(struct unit_test_state *uts,
+				      void *in, unsigned long in_size,
+				      void *out, unsigned long out_max,
+				      unsigned long *out_size)
+{
+	return uncompress_using_sink(sink_gunzip_new, in, in_size, out,
+				     out_max, out_size);
+}
+
+static int uncompress_using_lz4_sink(struct unit_test_state *uts,
+				     void *in, unsigned long in_size,
+				     void *out, unsigned long out_max,
+				     unsigned long *out_size)
+{
+	return uncompress_using_sink(sink_lz4_new, in, in_size, out,
+				     out_max, out_size);
+}
+#endif
+
 static int run_test_internal(struct unit_test_state *uts, char *name,
 			     mutate_func compress, mutate_func uncompress,
 			     struct buf_state *buf)
@@ -436,6 +489,22 @@ static int compression_test_lz4(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_lz4, 0);
 
+#ifdef CONFIG_SINK
+static int compression_test_gzip_sink(struct unit_test_state *uts)
+{
+	return run_test(uts, "gzip sink", compress_using_gzip,
+			uncompress_using_gzip_sink);
+}
+COMPRESSION_TEST(compression_test_gzip_sink, 0);
+
+static int compression_test_lz4_sink(struct unit_test_state *uts)
+{
+	return run_test(uts, "lz4 sink", compress_using_lz4,
+			uncompress_using_lz4_sink);
+}
+COMPRESSION_TEST(compression_test_lz4_sink, 0);
+#endif
+
 static int compress_using_none(struct unit_test_state *uts,
 			       void *in, unsigned long in_size,
 			       void *out, unsigned long out_max,
@@ -4,7 +4,11 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <dm.h>
+#include <malloc.h>
+#include <os.h>
+#include <sandboxblockdev.h>
 #include <usb.h>
 #include <asm/state.h>
 #include <dm/test.h>
@@ -77,12 +81,12 @@ static int dm_test_blk_usb(struct unit_test_state *uts)
 	ut_asserteq_ptr(usb_dev, dev_get_parent(dev));
 
 	/* Check we have one block device for each mass storage device */
-	ut_asserteq(6, count_blk_devices());
+	ut_asserteq(7, count_blk_devices());
 
 	/* Now go around again, making sure the old devices were unbound */
 	ut_assertok(usb_stop());
 	ut_assertok(usb_init());
-	ut_asserteq(6, count_blk_devices());
+	ut_asserteq(7, count_blk_devices());
 	ut_assertok(usb_stop());
 
 	return 0;
@@ -162,3 +166,146 @@ static int dm_test_blk_get_from_parent(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_get_from_parent, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+#define BLKCACHE_TEST_FILE	"blkcache.img"
+/* Not a whole number of cache lines, to test the end of the device */
+#define BLKCACHE_TEST_BLOCKS	2051
+
+static int blkcache_test_check(struct unit_test_state *uts,
+			       struct blk_desc *desc, const u8 *data,
+			       lbaint_t start, lbaint_t blkcnt, u8 *buf)
+{
+	ut_asserteq(blkcnt, blk_dread(desc, start, blkcnt, buf));
+	ut_assertok(memcmp(buf, data + start * 512, blkcnt * 512));
+
+	return 0;
+}
+
+static int _dm_test_blk_cache(struct unit_test_state *uts, u8 *data)
+{
+	struct block_cache_stats stats;
+	struct blk_desc *desc;
+	u32 seed = 1;
+	lbaint_t start;
+	u8 buf[64 * 512];
+	int i;
+
+	ut_assertok(host_dev_bind(0, BLKCACHE_TEST_FILE));
+	ut_asserteq(0, blk_get_device_by_str("host", "0", &desc));
+	blkcache_configure(8, 32);
+
+	/* Small sequential reads: about one miss per window read ahead */
+	for (start = 0; start < 1024; start += 2)
+		ut_assertok(blkcache_test_check(uts, desc, data, start, 2,
+						buf));
+	blkcache_stats(&stats);
+	ut_asserteq(512, stats.hits + stats.misses);
+	ut_assert(stats.misses <= 32);
+	ut_assert(stats.prefetch_hits > 100);
+	ut_assert(stats.evictions > 0);
+	ut_asserteq(32, stats.entries);
+
+	/* Random reads, across lines and up to the end of the device */
+	for (i = 0; i < 1000; i++) {
+		seed = seed * 1103515245 + 12345;
+		start = (seed >> 8) % BLKCACHE_TEST_BLOCKS;
+		ut_assertok(blkcache_test_check(uts, desc, data, start,
+				min(BLKCACHE_TEST_BLOCKS - start,
+				    (lbaint_t)1 + (seed >> 28)), buf));
+	}
+	ut_assertok(blkcache_test_check(uts, desc, data,
+					BLKCACHE_TEST_BLOCKS - 1, 1, buf));
+	ut_assertok(blkcache_test_check(uts, desc, data,
+					BLKCACHE_TEST_BLOCKS - 1, 1, buf));
+
+	/* Large reads go to the device and are not counted */
+	blkcache_stats(&stats);
+	ut_assertok(blkcache_test_check(uts, desc, data, 100, 64, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits + stats.misses);
+
+	/* A write invalidates what the cache holds */
+	ut_assertok(blkcache_test_check(uts, desc, data, 4, 1, buf));
+	memset(data + 4 * 512, 0xa5, 512);
+	ut_asserteq(1, blk_dwrite(desc, 4, 1, data + 4 * 512));
+	ut_assertok(blkcache_test_check(uts, desc, data, 0, 8, buf));
+
+	/* With no lines, everything goes to the device */
+	blkcache_configure(8, 0);
+	ut_assertok(blkcache_test_check(uts, desc, data, 0, 8, buf));
+	ut_assertok(blkcache_test_check(uts, desc, data, 0, 8, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits + stats.entries);
+
+	return 0;
+}
+
+/* Test that the block cache returns the right data, and reads ahead */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	u8 *data;
+	int ret;
+	int i;
+
+	data = malloc(BLKCACHE_TEST_BLOCKS * 512);
+	ut_assertnonnull(data);
+	for (i = 0; i < BLKCACHE_TEST_BLOCKS * 512; i++)
+		data[i] = i / 512 + i * 3;
+	ut_assertok(os_write_file(BLKCACHE_TEST_FILE, data,
+				  BLKCACHE_TEST_BLOCKS * 512));
+
+	blkcache_stats(&stats);
+	ret = _dm_test_blk_cache(uts, data);
+
+	blkcache_configure(stats.max_blocks_per_entry, stats.max_entries);
+	host_dev_bind(0, NULL);
+	os_unlink(BLKCACHE_TEST_FILE);
+	free(data);
+
+	return ret;
+}
+DM_TEST(dm_test_blk_cache, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+#endif
+
+#define BLKASYNC_TEST_FILE	"blkasync.img"
+
+/* Test that a read can be started and then finished later */
+static int dm_test_blk_async(struct unit_test_state *uts)
+{
+	u8 data[4 * 512], buf[4 * 512];
+	struct blk_req req, req2;
+	struct blk_desc *desc;
+	int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i / 512 + i * 7;
+	ut_assertok(os_write_file(BLKASYNC_TEST_FILE, data, sizeof(data)));
+	ut_assertok(host_dev_bind(0, BLKASYNC_TEST_FILE));
+	ut_asserteq(0, blk_get_device_by_str("host", "0", &desc));
+	blkcache_invalidate(IF_TYPE_HOST, 0);
+
+	/* The data only arrives once the read is polled */
+	memset(buf, '\0', sizeof(buf));
+	ut_assertok(blk_dread_submit(desc, 1, 3, buf, &req));
+	ut_asserteq(0, buf[0]);
+	ut_asserteq(-EBUSY, blk_dread_submit(desc, 0, 1, buf, &req2));
+	ut_asserteq(3, blk_dread_wait(&req));
+	ut_assertok(memcmp(data + 512, buf, 3 * 512));
+	ut_assertok(blk_dread_poll(&req));
+
+	/* Another read can be started once that is done */
+	ut_assertok(blk_dread_submit(desc, 0, 4, buf, &req2));
+	ut_assert(!req2.done);
+	ut_assertok(blk_dread_poll(&req2));
+	ut_assert(req2.done);
+	ut_asserteq(4, blk_dread_wait(&req2));
+	ut_assertok(memcmp(data, buf, sizeof(data)));
+
+	host_dev_bind(0, NULL);
+	os_unlink(BLKASYNC_TEST_FILE);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
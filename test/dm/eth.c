@@ -9,7 +9,9 @@
 #include <common.h>
 #include <dm.h>
 #include <fdtdec.h>
+#include <hash.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
@@ -329,6 +331,10 @@ static int dm_test_eth_async_arp_reply(struct unit_test_state *uts)
 {
 	net_ping_ip = string_to_ip("1.1.2.2");
 
+#ifdef CONFIG_NET_ARP_CACHE
+	/* Make sure the request goes out so that the reply is tested */
+	arp_cache_flush();
+#endif
 	sandbox_eth_set_tx_handler(0, sb_with_async_arp_handler);
 	/* Used by all of the ut_assert macros in the tx_handler */
 	sandbox_eth_set_priv(0, uts);
@@ -414,6 +420,10 @@ static int dm_test_eth_async_ping_reply(struct unit_test_state *uts)
 {
 	net_ping_ip = string_to_ip("1.1.2.2");
 
+#ifdef CONFIG_NET_ARP_CACHE
+	/* Make sure the request goes out so that the reply is tested */
+	arp_cache_flush();
+#endif
 	sandbox_eth_set_tx_handler(0, sb_with_async_ping_handler);
 	/* Used by all of the ut_assert macros in the tx_handler */
 	sandbox_eth_set_priv(0, uts);
@@ -428,3 +438,826 @@ static int dm_test_eth_async_ping_reply(struct unit_test_state *uts)
 }
 
 DM_TEST(dm_test_eth_async_ping_reply, DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_NET_ARP_CACHE
+struct sb_arp_cache_state {
+	int arp_requests;
+	struct in_addr inject_ip;
+};
+
+static int sb_arp_cache_handler(struct udevice *dev, void *packet,
+				unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_arp_cache_state *state = priv->priv;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len)) {
+		state->arp_requests++;
+		return 0;
+	}
+
+	/* Have another host ask for us while we wait for the echo reply */
+	if (state->inject_ip.s_addr) {
+		priv->fake_host_ipaddr = state->inject_ip;
+		sandbox_eth_recv_arp_req(dev);
+		state->inject_ip.s_addr = 0;
+	}
+	/* Answer as whichever host is pinged, ARP or not */
+	priv->fake_host_ipaddr = net_ping_ip;
+	sandbox_eth_ping_req_to_reply(dev, packet, len);
+
+	return 0;
+}
+
+static int dm_test_eth_arp_cache(struct unit_test_state *uts)
+{
+	struct sb_arp_cache_state state = { 0 };
+	uchar ethaddr[ARP_HLEN];
+
+	arp_cache_flush();
+	net_ping_ip = string_to_ip("1.1.2.2");
+	ut_asserteq(-ENOENT, arp_cache_lookup(net_ping_ip, ethaddr));
+
+	sandbox_eth_set_tx_handler(0, sb_arp_cache_handler);
+	sandbox_eth_set_priv(0, &state);
+	env_set("ethact", "eth@10002000");
+
+	/* Only the first ping should need to resolve the host */
+	ut_assertok(net_loop(PING));
+	ut_asserteq(1, state.arp_requests);
+	ut_assertok(net_loop(PING));
+	ut_asserteq(1, state.arp_requests);
+	ut_assertok(arp_cache_lookup(net_ping_ip, ethaddr));
+
+	/* A host asking for us is learnt without a request of our own */
+	state.inject_ip = string_to_ip("1.1.2.4");
+	ut_assertok(net_loop(PING));
+	net_ping_ip = string_to_ip("1.1.2.4");
+	ut_assertok(arp_cache_lookup(net_ping_ip, ethaddr));
+	ut_assertok(net_loop(PING));
+	ut_asserteq(1, state.arp_requests);
+
+	/* Flushing forgets the hosts again */
+	arp_cache_flush();
+	ut_assertok(net_loop(PING));
+	ut_asserteq(2, state.arp_requests);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	arp_cache_flush();
+
+	return 0;
+}
+DM_TEST(dm_test_eth_arp_cache, DM_TESTF_SCAN_FDT);
+#endif
+
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	sandbox_eth_tftp_req_to_reply(dev, packet, len);
+
+	return 0;
+}
+
+/* Fetch the mock server's file and check that it arrived intact */
+static int sb_tftp_get(struct unit_test_state *uts,
+		       struct sandbox_eth_tftp *tftp, const char *windowsize)
+{
+	const ulong addr = 0x1000000;
+	void *buf;
+
+	tftp->acks = 0;
+	tftp->blocks = 0;
+	tftp->dropped = 0;
+	env_set("tftpwindowsize", windowsize);
+	load_addr = addr;
+	copy_filename(net_boot_file_name, "sandbox.img",
+		      sizeof(net_boot_file_name));
+	ut_asserteq(tftp->size, net_loop(TFTPGET));
+
+	buf = map_sysmem(addr, tftp->size);
+	ut_assertok(memcmp(buf, tftp->data, tftp->size));
+	unmap_sysmem(buf);
+
+	/* The first ACK only answers the OACK */
+	printf("TFTP windowsize %s: %d blocks in %d round trips\n",
+	       windowsize, tftp->blocks, tftp->acks - 1);
+
+	return 0;
+}
+
+#ifdef CONFIG_CMD_TFTPPUT
+static int sb_tftp_put(struct unit_test_state *uts,
+		       struct sandbox_eth_tftp *tftp, const char *windowsize)
+{
+	const ulong addr = 0x1000000;
+	void *buf;
+
+	tftp->acks = 0;
+	tftp->blocks = 0;
+	memset(tftp->put_data, '\0', tftp->size);
+	buf = map_sysmem(addr, tftp->size);
+	memcpy(buf, tftp->data, tftp->size);
+	unmap_sysmem(buf);
+
+	env_set("tftpwindowsize", windowsize);
+	save_addr = addr;
+	save_size = tftp->size;
+	copy_filename(net_boot_file_name, "sandbox.img",
+		      sizeof(net_boot_file_name));
+	ut_assert(net_loop(TFTPPUT) >= 0);
+	ut_asserteq(tftp->size, tftp->put_size);
+	ut_assertok(memcmp(tftp->put_data, tftp->data, tftp->size));
+
+	return 0;
+}
+#endif
+
+static int _dm_test_eth_tftp_window(struct unit_test_state *uts,
+				    struct sandbox_eth_tftp *tftp)
+{
+	int nblocks;
+
+	/* Lock-step: one block per round trip */
+	ut_assertok(sb_tftp_get(uts, tftp, "1"));
+	ut_asserteq(1, tftp->window);
+	nblocks = tftp->blocks;
+	ut_asserteq(nblocks, tftp->acks - 1);
+
+	/* A full window per round trip */
+	ut_assertok(sb_tftp_get(uts, tftp, "8"));
+	ut_asserteq(8, tftp->window);
+	ut_asserteq(nblocks, tftp->blocks);
+	ut_asserteq(DIV_ROUND_UP(nblocks, 8), tftp->acks - 1);
+
+	/*
+	 * Drop a block in the middle of a window: the client must re-ACK the
+	 * block before it, once, and the server resend the window from there
+	 */
+	tftp->drop_block = 20;
+	ut_assertok(sb_tftp_get(uts, tftp, "8"));
+	ut_asserteq(1, tftp->dropped);
+	ut_assert(tftp->blocks > nblocks);
+	ut_assert(tftp->acks - 1 <= DIV_ROUND_UP(nblocks, 8) + 1);
+
+#ifdef CONFIG_CMD_TFTPPUT
+	/* A put does not ask for a window, so gets an ACK for every block */
+	ut_assertok(sb_tftp_put(uts, tftp, "8"));
+	ut_asserteq(1, tftp->window);
+	ut_asserteq(nblocks, tftp->blocks);
+	ut_asserteq(nblocks, tftp->acks);
+#endif
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_window(struct unit_test_state *uts)
+{
+	struct sandbox_eth_tftp tftp;
+	uchar *data;
+	int retval;
+	int i;
+
+	memset(&tftp, '\0', sizeof(tftp));
+	tftp.size = 200000;
+	tftp.windowsize = 8;
+	data = malloc(tftp.size);
+	ut_assertnonnull(data);
+	for (i = 0; i < tftp.size; i++)
+		data[i] = i * 7 + (i >> 8);
+	tftp.data = data;
+	tftp.put_data = malloc(tftp.size);
+	ut_assertnonnull(tftp.put_data);
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	sandbox_eth_set_priv(0, &tftp);
+	env_set("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+
+	retval = _dm_test_eth_tftp_window(uts, &tftp);
+
+	/* Restore the env */
+	net_server_ip.s_addr = 0;
+	env_set("tftpwindowsize", NULL);
+	env_set("ethact", NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	free(tftp.put_data);
+	free(data);
+
+	return retval;
+}
+
+DM_TEST(dm_test_eth_tftp_window, DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_TFTP_MULTI
+#define TFTP_MULTI_FILES	3
+
+static int _dm_test_eth_tftp_multi(struct unit_test_state *uts,
+				   struct sandbox_eth_tftp *tftp)
+{
+	const ulong addr[TFTP_MULTI_FILES] = {
+		0x1000000, 0x1100000, 0x1200000
+	};
+	void *buf;
+	int i;
+
+	/* The files arrive over separate ports, interleaved */
+	ut_assertok(run_command("tftpboot -m 1000000 Image 1100000 initrd "
+				"1200000 board.dtb", 0));
+	for (i = 0; i < TFTP_MULTI_FILES; i++) {
+		buf = map_sysmem(addr[i], tftp[i].size);
+		ut_assertok(memcmp(buf, tftp[i].data, tftp[i].size));
+		unmap_sysmem(buf);
+		ut_assert(tftp[i].client_port);
+		ut_asserteq(4, tftp[i].window);
+		printf("TFTP file %d: %d blocks in %d round trips\n", i,
+		       tftp[i].blocks, tftp[i].acks - 1);
+	}
+	ut_assert(tftp[0].client_port != tftp[1].client_port);
+	ut_assert(tftp[1].client_port != tftp[2].client_port);
+	/* The block lost from the second file is fetched again */
+	ut_asserteq(1, tftp[1].dropped);
+
+	/* The environment describes the last file, as after three loads */
+	ut_asserteq(tftp[2].size, env_get_hex("filesize", 0));
+	ut_asserteq(addr[2], env_get_hex("fileaddr", 0));
+
+	/* Address and name go in pairs */
+	ut_asserteq(1, run_command("tftpboot -m 1000000", 0));
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_multi(struct unit_test_state *uts)
+{
+	const ulong size[TFTP_MULTI_FILES] = { 50000, 30001, 70000 };
+	struct sandbox_eth_tftp tftp[TFTP_MULTI_FILES];
+	uchar *data[TFTP_MULTI_FILES];
+	int retval;
+	int i, j;
+
+	memset(tftp, '\0', sizeof(tftp));
+	for (i = 0; i < TFTP_MULTI_FILES; i++) {
+		tftp[i].size = size[i];
+		tftp[i].windowsize = 8;
+		data[i] = malloc(size[i]);
+		ut_assertnonnull(data[i]);
+		for (j = 0; j < size[i]; j++)
+			data[i][j] = j * (i + 3) + (j >> 8);
+		tftp[i].data = data[i];
+		if (i)
+			tftp[i - 1].next = &tftp[i];
+	}
+	tftp[1].drop_block = 10;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	sandbox_eth_set_priv(0, tftp);
+	env_set("ethact", "eth@10002000");
+	env_set("tftpwindowsize", "4");
+	net_server_ip = string_to_ip("1.1.2.2");
+
+	retval = _dm_test_eth_tftp_multi(uts, tftp);
+
+	/* Restore the env */
+	net_server_ip.s_addr = 0;
+	env_set("tftpwindowsize", NULL);
+	env_set("ethact", NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	for (i = 0; i < TFTP_MULTI_FILES; i++)
+		free(data[i]);
+
+	return retval;
+}
+
+DM_TEST(dm_test_eth_tftp_multi, DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_CMD_PXE
+static int _dm_test_eth_pxe_get(struct unit_test_state *uts,
+				struct sandbox_eth_tftp *tftp)
+{
+	const ulong addr = 0x1000000;
+	ulong start;
+	void *buf;
+
+	/*
+	 * The server has the file for the first half of our IP address,
+	 * 1.2.3.4, and the default one: it must send the former, after
+	 * misses for the MAC address and the longer IP prefixes
+	 */
+	env_set_hex("pxefile_addr_r", addr);
+	env_set("pxecfg", NULL);
+	start = get_timer(0);
+	ut_assertok(run_command("pxe get", 0));
+	printf("pxe get: %d requests in %d round trips, %lu ms\n",
+	       tftp->requests, tftp->round_trips, get_timer(start));
+	buf = map_sysmem(addr, tftp[0].size);
+	ut_assertok(memcmp(buf, tftp[0].data, tftp[0].size));
+	unmap_sysmem(buf);
+	ut_asserteq_str("0102", env_get("pxecfg"));
+	/* ARP with the first request, the others together, then the file */
+	ut_assert(tftp->round_trips <= 3);
+
+	/* Next time the file found is asked for first */
+	tftp->requests = 0;
+	tftp->round_trips = 0;
+	ut_assertok(run_command("pxe get", 0));
+	ut_asserteq(1, tftp->requests);
+
+	/* Once it is gone the search starts again */
+	tftp[0].name = "pxelinux.cfg/gone";
+	tftp->requests = 0;
+	ut_assertok(run_command("pxe get", 0));
+	ut_asserteq_str("default", env_get("pxecfg"));
+	ut_assert(tftp->requests > 1);
+
+	return 0;
+}
+
+static int dm_test_eth_pxe_get(struct unit_test_state *uts)
+{
+	static const char cfg[] = "default linux\n";
+	static const char dflt[] = "default local\n";
+	struct sandbox_eth_tftp tftp[2];
+	int retval;
+
+	memset(tftp, '\0', sizeof(tftp));
+	tftp[0].name = "pxelinux.cfg/0102";
+	tftp[0].data = (const uchar *)cfg;
+	tftp[0].size = sizeof(cfg) - 1;
+	tftp[0].latency = 100;
+	tftp[0].next = &tftp[1];
+	tftp[1].name = "pxelinux.cfg/default";
+	tftp[1].data = (const uchar *)dflt;
+	tftp[1].size = sizeof(dflt) - 1;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	sandbox_eth_set_priv(0, tftp);
+	env_set("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+
+	retval = _dm_test_eth_pxe_get(uts, tftp);
+
+	/* Restore the env */
+	net_server_ip.s_addr = 0;
+	env_set("pxecfg", NULL);
+	env_set("pxefile_addr_r", NULL);
+	env_set("ethact", NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+
+	return retval;
+}
+
+DM_TEST(dm_test_eth_pxe_get, DM_TESTF_SCAN_FDT);
+#endif
+#endif
+
+#ifdef CONFIG_NET_STATS
+static int dm_test_eth_stats(struct unit_test_state *uts)
+{
+	struct sandbox_eth_tftp tftp;
+	struct eth_stats *stats;
+	struct udevice *dev;
+	uchar *data;
+	int retval;
+	int i;
+
+	memset(&tftp, '\0', sizeof(tftp));
+	tftp.size = 100000;
+	tftp.windowsize = 8;
+	tftp.drop_block = 20;
+	data = malloc(tftp.size);
+	ut_assertnonnull(data);
+	for (i = 0; i < tftp.size; i++)
+		data[i] = i * 7 + (i >> 8);
+	tftp.data = data;
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	sandbox_eth_set_priv(0, &tftp);
+	env_set("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000",
+					      &dev));
+	stats = eth_get_stats(dev);
+	ut_assertnonnull(stats);
+	ut_assertok(run_command("net stats clear eth@10002000", 0));
+	ut_asserteq(0, stats->rx_packets);
+
+	retval = sb_tftp_get(uts, &tftp, "8");
+	if (!retval) {
+		/* At least the OACK and every block, the RRQ and every ACK */
+		ut_assert(stats->rx_packets >= tftp.blocks + 1);
+		ut_assert(stats->rx_bytes > tftp.size);
+		ut_assert(stats->tx_packets >= tftp.acks + 1);
+		ut_asserteq(0, stats->rx_errors + stats->tx_errors);
+		ut_asserteq(0, stats->rx_csum_errors);
+		ut_asserteq(0, stats->timeouts);
+		/* The blocks after the dropped one are out of order */
+		ut_asserteq(1, tftp.dropped);
+		ut_assert(stats->dup_blocks >= 1);
+		ut_asserteq(1, stats->retransmits);
+		/* A window of blocks is taken in one poll of the driver */
+		ut_assert(stats->rx_polls < stats->rx_packets);
+		ut_assert(stats->rx_batch_max >= 8);
+		ut_asserteq(tftp.size, stats->xfer_bytes);
+		ut_assertok(run_command("net stats", 0));
+		ut_assertok(run_command("net stats clear", 0));
+		ut_asserteq(0, stats->rx_packets);
+		ut_asserteq(0, stats->xfer_bytes);
+	}
+
+	/* Restore the env */
+	net_server_ip.s_addr = 0;
+	env_set("tftpwindowsize", NULL);
+	env_set("ethact", NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	free(data);
+
+	return retval;
+}
+
+DM_TEST(dm_test_eth_stats, DM_TESTF_SCAN_FDT);
+#endif
+
+static int sb_nfs_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	sandbox_eth_nfs_req_to_reply(dev, packet, len);
+
+	return 0;
+}
+
+static int sb_nfs_get(struct unit_test_state *uts,
+		      struct sandbox_eth_nfs *nfs, const char *window)
+{
+	const ulong addr = 0x1000000;
+	ulong start, elapsed;
+	void *buf;
+
+	nfs->reads = 0;
+	nfs->round_trips = 0;
+	nfs->dropped = 0;
+	env_set("nfsreadwindow", window);
+	load_addr = addr;
+	copy_filename(net_boot_file_name, "/export/sandbox.img",
+		      sizeof(net_boot_file_name));
+	start = get_timer(0);
+	ut_asserteq(nfs->size, net_loop(NFS));
+	elapsed = max(get_timer(start), 1UL);
+
+	buf = map_sysmem(addr, nfs->size);
+	ut_assertok(memcmp(buf, nfs->data, nfs->size));
+	unmap_sysmem(buf);
+
+	/* bytes per millisecond are kB/s */
+	printf("NFS %s READs in flight: %d reads in %d round trips, %lu.%03lu MB/s\n",
+	       window, nfs->reads, nfs->round_trips,
+	       nfs->size / elapsed / 1000, nfs->size / elapsed % 1000);
+
+	return 0;
+}
+
+static int _dm_test_eth_nfs_read_window(struct unit_test_state *uts,
+					struct sandbox_eth_nfs *nfs)
+{
+	int nreads;
+
+	/* Lock-step: one READ per round trip */
+	ut_assertok(sb_nfs_get(uts, nfs, "1"));
+	nreads = nfs->reads;
+	ut_asserteq(nreads, nfs->round_trips);
+
+	/* Eight READs in flight hide the latency of all but a few */
+	ut_assertok(sb_nfs_get(uts, nfs, "8"));
+	ut_assert(nfs->reads >= nreads);
+	ut_assert(nfs->round_trips <= 2);
+
+	/* A lost READ is sent again on its own */
+	nfs->drop_read = 20;
+	ut_assertok(sb_nfs_get(uts, nfs, "8"));
+	ut_asserteq(1, nfs->dropped);
+	nfs->drop_read = 0;
+
+	return 0;
+}
+
+static int dm_test_eth_nfs_read_window(struct unit_test_state *uts)
+{
+	struct sandbox_eth_nfs nfs;
+	uchar *data;
+	int retval;
+	int i;
+
+	memset(&nfs, '\0', sizeof(nfs));
+	nfs.size = 200000;
+	nfs.latency = 2;
+	data = malloc(nfs.size);
+	ut_assertnonnull(data);
+	for (i = 0; i < nfs.size; i++)
+		data[i] = i * 7 + (i >> 8);
+	nfs.data = data;
+
+	sandbox_eth_set_tx_handler(0, sb_nfs_handler);
+	sandbox_eth_set_priv(0, &nfs);
+	env_set("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+
+	retval = _dm_test_eth_nfs_read_window(uts, &nfs);
+
+	/* Restore the env */
+	net_server_ip.s_addr = 0;
+	env_set("nfsreadwindow", NULL);
+	env_set("ethact", NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	free(data);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_nfs_read_window, DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_NET_SINK
+/* Check a download decompressed and hashed on the fly */
+static int sb_sink_check(struct unit_test_state *uts, int ret,
+			 const uchar *plain, ulong plain_size, const char *sum)
+{
+	void *buf;
+
+	ut_asserteq(plain_size, ret);
+	buf = map_sysmem(load_addr, plain_size);
+	ut_assertok(memcmp(buf, plain, plain_size));
+	unmap_sysmem(buf);
+	ut_asserteq_str(sum, env_get("nethashsum"));
+	env_set("nethashsum", NULL);
+
+	return 0;
+}
+
+static int _dm_test_eth_net_sink(struct unit_test_state *uts,
+				 const uchar *plain, ulong plain_size,
+				 uchar *comp, ulong comp_size)
+{
+	struct sandbox_eth_tftp tftp;
+	struct sandbox_eth_nfs nfs;
+	uint8_t digest[HASH_MAX_DIGEST_SIZE];
+	char sum[HASH_MAX_DIGEST_SIZE * 2 + 1];
+	int size, i;
+
+	/* The hash covers the data as downloaded, i.e. compressed */
+	size = sizeof(digest);
+	ut_assertok(hash_block("sha256", comp, comp_size, digest, &size));
+	for (i = 0; i < size; i++)
+		sprintf(sum + i * 2, "%02x", digest[i]);
+
+	env_set("netdecomp", "gzip");
+	env_set("nethash", "sha256");
+	load_addr = 0x1000000;
+
+	memset(&tftp, '\0', sizeof(tftp));
+	tftp.data = comp;
+	tftp.size = comp_size;
+	tftp.windowsize = 8;
+	env_set("tftpwindowsize", "8");
+	copy_filename(net_boot_file_name, "sandbox.img.gz",
+		      sizeof(net_boot_file_name));
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	sandbox_eth_set_priv(0, &tftp);
+	ut_assertok(sb_sink_check(uts, net_loop(TFTPGET), plain, plain_size,
+				  sum));
+	ut_asserteq(plain_size, env_get_hex("filesize", 0));
+
+	/* A block lost in a window is sent again before it is passed on */
+	tftp.drop_block = 20;
+	ut_assertok(sb_sink_check(uts, net_loop(TFTPGET), plain, plain_size,
+				  sum));
+	ut_asserteq(1, tftp.dropped);
+
+	/* NFS replies arriving out of order are put back in order */
+	memset(&nfs, '\0', sizeof(nfs));
+	nfs.data = comp;
+	nfs.size = comp_size;
+	nfs.drop_read = 20;
+	env_set("nfsreadwindow", "8");
+	copy_filename(net_boot_file_name, "/export/sandbox.img.gz",
+		      sizeof(net_boot_file_name));
+	sandbox_eth_set_tx_handler(0, sb_nfs_handler);
+	sandbox_eth_set_priv(0, &nfs);
+	ut_assertok(sb_sink_check(uts, net_loop(NFS), plain, plain_size, sum));
+	ut_asserteq(1, nfs.dropped);
+
+	/* A corrupt gzip trailer fails the download */
+	comp[comp_size - 8] ^= 0xff;
+	tftp.drop_block = 0;
+	copy_filename(net_boot_file_name, "sandbox.img.gz",
+		      sizeof(net_boot_file_name));
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	sandbox_eth_set_priv(0, &tftp);
+	ut_assert(net_loop(TFTPGET) < 0);
+	ut_assertnull(env_get("nethashsum"));
+
+	return 0;
+}
+
+static int dm_test_eth_net_sink(struct unit_test_state *uts)
+{
+	const ulong plain_size = 200000;
+	ulong comp_size = plain_size * 2;
+	uchar *plain, *comp;
+	uint seed = 1;
+	int retval;
+	int i;
+
+	plain = malloc(plain_size);
+	ut_assertnonnull(plain);
+	comp = malloc(comp_size);
+	ut_assertnonnull(comp);
+	/* six random bits a byte, so that the data compresses but not much */
+	for (i = 0; i < plain_size; i++) {
+		seed = seed * 1103515245 + 12345;
+		plain[i] = (seed >> 16) & 0x3f;
+	}
+	ut_assertok(gzip(comp, &comp_size, plain, plain_size));
+
+	env_set("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+
+	retval = _dm_test_eth_net_sink(uts, plain, plain_size, comp,
+				       comp_size);
+
+	/* Restore the env */
+	net_server_ip.s_addr = 0;
+	env_set("netdecomp", NULL);
+	env_set("nethash", NULL);
+	env_set("tftpwindowsize", NULL);
+	env_set("nfsreadwindow", NULL);
+	env_set("ethact", NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	free(comp);
+	free(plain);
+
+	return retval;
+}
+DM_TEST(dm_test_eth_net_sink, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_CMD_WGET
+#define WGET_TEST_PORT	8000
+
+static int sb_tcp_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	sandbox_eth_tcp_req_to_reply(dev, packet, len);
+
+	return 0;
+}
+
+/* Send @hdr then @body from the mock server and check what is stored */
+static int sb_wget(struct unit_test_state *uts, struct sandbox_eth_tcp *tcp,
+		   const char *hdr, const uchar *body, ulong body_size,
+		   const uchar *expect, ulong expect_size)
+{
+	const ulong addr = 0x1000000;
+	int hdr_len = strlen(hdr);
+	uchar *resp;
+	void *buf;
+	int ret;
+
+	resp = malloc(hdr_len + body_size);
+	ut_assertnonnull(resp);
+	memcpy(resp, hdr, hdr_len);
+	memcpy(resp + hdr_len, body, body_size);
+	tcp->data = resp;
+	tcp->size = hdr_len + body_size;
+	tcp->segs = 0;
+	tcp->acks = 0;
+	tcp->retransmits = 0;
+	tcp->dropped = 0;
+
+	load_addr = addr;
+	ret = net_loop(WGET);
+	free(resp);
+	if (!expect) {
+		ut_assert(ret < 0);
+		return 0;
+	}
+	ut_asserteq(expect_size, ret);
+	ut_assertok(strncmp(tcp->request, "GET /sandbox.img HTTP/1.1\r\n",
+			    27));
+
+	buf = map_sysmem(addr, expect_size);
+	ut_assertok(memcmp(buf, expect, expect_size));
+	unmap_sysmem(buf);
+
+	printf("wget: %d segments, %d ACKs, %d retransmits\n", tcp->segs,
+	       tcp->acks, tcp->retransmits);
+
+	return 0;
+}
+
+static int _dm_test_eth_wget(struct unit_test_state *uts,
+			     struct sandbox_eth_tcp *tcp, const uchar *data,
+			     ulong size)
+{
+	const ulong chunk = 3000;
+	char hdr[128];
+	uchar *body, *p;
+	ulong i;
+	int ret;
+
+	/* Body delimited by Content-Length, with window scaling on */
+	snprintf(hdr, sizeof(hdr),
+		 "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\n\r\n", size);
+	copy_filename(net_boot_file_name, "sandbox.img",
+		      sizeof(net_boot_file_name));
+	ut_assertok(sb_wget(uts, tcp, hdr, data, size, data, size));
+	ut_asserteq(0, tcp->retransmits);
+	ut_assert(tcp->client_wscale > 0);
+	ut_assert(tcp->client_wnd > 0xffff);
+	/* ACKs are delayed over two segments or a whole receive batch */
+	ut_assert(tcp->acks <= DIV_ROUND_UP(tcp->segs, 2) + 1);
+
+	/* A lost segment is resent after three duplicate ACKs */
+	tcp->drop_seg = 10;
+	ut_assertok(sb_wget(uts, tcp, hdr, data, size, data, size));
+	ut_asserteq(1, tcp->dropped);
+	ut_asserteq(1, tcp->retransmits);
+	tcp->drop_seg = 0;
+
+	/* Chunked body, from a URL naming the server */
+	body = malloc(size + size / chunk * 16 + 32);
+	ut_assertnonnull(body);
+	for (i = 0, p = body; i < size; i += chunk) {
+		ulong n = min(size - i, chunk);
+
+		p += sprintf((char *)p, "%lx\r\n", n);
+		memcpy(p, data + i, n);
+		p += n;
+		p += sprintf((char *)p, "\r\n");
+	}
+	p += sprintf((char *)p, "0\r\n\r\n");
+	copy_filename(net_boot_file_name, "http://1.1.2.2:8080/sandbox.img",
+		      sizeof(net_boot_file_name));
+	tcp->port = 8080;
+	ret = sb_wget(uts, tcp,
+		      "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n",
+		      body, p - body, data, size);
+	free(body);
+	ut_assertok(ret);
+	tcp->port = WGET_TEST_PORT;
+
+	/* An error status fails the download */
+	copy_filename(net_boot_file_name, "sandbox.img",
+		      sizeof(net_boot_file_name));
+	ut_assertok(sb_wget(uts, tcp,
+			    "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n",
+			    NULL, 0, NULL, 0));
+
+	return 0;
+}
+
+static int dm_test_eth_wget(struct unit_test_state *uts)
+{
+	struct sandbox_eth_tcp tcp;
+	const ulong size = 200000;
+	uchar *data;
+	int retval;
+	int i;
+
+	memset(&tcp, '\0', sizeof(tcp));
+	tcp.port = WGET_TEST_PORT;
+	data = malloc(size);
+	ut_assertnonnull(data);
+	for (i = 0; i < size; i++)
+		data[i] = i * 7 + (i >> 8);
+
+	sandbox_eth_set_tx_handler(0, sb_tcp_handler);
+	sandbox_eth_set_priv(0, &tcp);
+	env_set("ethact", "eth@10002000");
+	env_set("httpdstp", simple_itoa(WGET_TEST_PORT));
+	net_server_ip = string_to_ip("1.1.2.2");
+
+	retval = _dm_test_eth_wget(uts, &tcp, data, size);
+
+	/* Restore the env */
+	net_server_ip.s_addr = 0;
+	env_set("httpdstp", NULL);
+	env_set("ethact", NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+	sandbox_eth_set_priv(0, NULL);
+	free(data);
+
+	return retval;
+}
+
+DM_TEST(dm_test_eth_wget, DM_TESTF_SCAN_FDT);
+#endif
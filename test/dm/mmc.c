@@ -4,8 +4,11 @@
  */
 
 #include <common.h>
+#include <bloblist.h>
 #include <dm.h>
+#include <malloc.h>
 #include <mmc.h>
+#include <asm/test.h>
 #include <dm/test.h>
 #include <test/ut.h>
 
@@ -41,3 +44,251 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_mmc_blk, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test reading in the background */
+static int dm_test_mmc_blk_async(struct unit_test_state *uts)
+{
+	struct blk_desc *dev_desc;
+	struct udevice *dev;
+	struct blk_req req;
+	char cmp[1024];
+	char buf[512];
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+
+	/* Reading the partition table has put these blocks in the cache */
+	blkcache_invalidate(IF_TYPE_MMC, 0);
+	memset(cmp, '\0', sizeof(cmp));
+	ut_assertok(blk_dread_submit(dev_desc, 0, 2, cmp, &req));
+
+	/* Nothing else may be sent to the card until the read is done */
+	ut_asserteq(0, blk_dread(dev_desc, 2, 1, buf));
+	ut_asserteq(-EBUSY, blk_dread_poll(&req));
+	ut_assertok(blk_dread_poll(&req));
+	ut_asserteq(2, req.ret);
+	ut_assertok(strcmp(cmp, "this is a test"));
+
+	/* The controller is free again for an ordinary read */
+	memset(cmp, '\0', sizeof(cmp));
+	ut_asserteq(2, blk_dread(dev_desc, 0, 2, cmp));
+	ut_assertok(strcmp(cmp, "this is a test"));
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_blk_async, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+#define MMC_TEST_CHUNKS		16
+#define MMC_TEST_CHUNK_BLOCKS	128
+
+/* Write in chunks as DFU and fastboot do, returning the card's statistics */
+static int mmc_test_write(struct unit_test_state *uts,
+			  struct blk_desc *dev_desc, struct udevice *dev,
+			  const void *buf, struct sandbox_mmc_stats *stats)
+{
+	int i;
+
+	sandbox_mmc_get_stats(dev, stats);
+	for (i = 0; i < MMC_TEST_CHUNKS; i++)
+		ut_asserteq(MMC_TEST_CHUNK_BLOCKS,
+			    blk_dwrite(dev_desc, i * MMC_TEST_CHUNK_BLOCKS,
+				       MMC_TEST_CHUNK_BLOCKS, buf));
+	sandbox_mmc_get_stats(dev, stats);
+
+	return 0;
+}
+
+/* Test multi-block transfers announced with SET_BLOCK_COUNT */
+static int dm_test_mmc_cmd23(struct unit_test_state *uts)
+{
+	struct sandbox_mmc_stats open, set, stats;
+	struct blk_desc *dev_desc;
+	struct udevice *dev;
+	ulong size = MMC_TEST_CHUNKS * MMC_TEST_CHUNK_BLOCKS * 512;
+	struct mmc *mmc;
+	char cmp[1024];
+	void *buf;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+	dev = dev_get_parent(dev_desc->bdev);
+	mmc = mmc_get_mmc_dev(dev);
+	ut_assert(mmc->card_caps & mmc->host_caps & MMC_MODE_CMD23);
+	buf = calloc(1, MMC_TEST_CHUNK_BLOCKS * 512);
+	ut_assertnonnull(buf);
+
+	/* Open-ended writes, each ended by STOP_TRANSMISSION */
+	mmc->host_caps &= ~MMC_MODE_CMD23;
+	ut_assertok(mmc_test_write(uts, dev_desc, dev, buf, &open));
+	mmc->host_caps |= MMC_MODE_CMD23;
+	ut_asserteq(0, open.set_count);
+	ut_asserteq(MMC_TEST_CHUNKS, open.stops);
+	ut_asserteq(MMC_TEST_CHUNKS, open.pre_erase);
+
+	/* Writes whose length the card knows in advance */
+	ut_assertok(mmc_test_write(uts, dev_desc, dev, buf, &set));
+	ut_asserteq(MMC_TEST_CHUNKS, set.set_count);
+	ut_asserteq(0, set.stops);
+	ut_asserteq(MMC_TEST_CHUNKS, set.pre_erase);
+	ut_assert(set.time_us < open.time_us);
+	printf("Writing %lu KiB: open-ended %lu KiB/s, with CMD23 %lu KiB/s\n",
+	       size >> 10, (ulong)((u64)size * 1000000 / 1024 / open.time_us),
+	       (ulong)((u64)size * 1000000 / 1024 / set.time_us));
+
+	/* Small writes are not worth pre-erasing */
+	ut_asserteq(8, blk_dwrite(dev_desc, 0, 8, buf));
+	sandbox_mmc_get_stats(dev, &stats);
+	ut_asserteq(1, stats.set_count);
+	ut_asserteq(0, stats.pre_erase);
+	free(buf);
+
+	/* Multi-block reads are announced too */
+	blkcache_invalidate(IF_TYPE_MMC, 0);
+	memset(cmp, '\0', sizeof(cmp));
+	ut_asserteq(2, blk_dread(dev_desc, 0, 2, cmp));
+	ut_assertok(strcmp(cmp, "this is a test"));
+	sandbox_mmc_get_stats(dev, &stats);
+	ut_asserteq(1, stats.set_count);
+	ut_asserteq(0, stats.stops);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cmd23, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+#define MMC_TEST_DEVS		3
+#define MMC_TEST_POWER_UP_POLLS	10	/* as in the sandbox card model */
+
+/* Test starting up all the cards together */
+static int dm_test_mmc_init_parallel(struct unit_test_state *uts)
+{
+	struct udevice *devs[MMC_TEST_DEVS];
+	struct mmc *mmcs[MMC_TEST_DEVS];
+	struct sandbox_mmc_stats stats;
+	int i;
+
+	for (i = 0; i < MMC_TEST_DEVS; i++) {
+		ut_assertok(uclass_get_device(UCLASS_MMC, i, &devs[i]));
+		mmcs[i] = mmc_get_mmc_dev(devs[i]);
+		mmcs[i]->has_init = 0;
+		sandbox_mmc_get_stats(devs[i], &stats);
+	}
+
+	/* One after the other, each card powers up on its own */
+	for (i = 0; i < MMC_TEST_DEVS; i++) {
+		ut_assertok(mmc_init(mmcs[i]));
+		sandbox_mmc_get_stats(devs[i], &stats);
+		ut_asserteq(MMC_TEST_POWER_UP_POLLS, stats.op_cond_polls);
+		ut_asserteq(1, stats.power_up_overlap);
+	}
+
+	/* Together, all of them power up at once with no extra polling */
+	for (i = 0; i < MMC_TEST_DEVS; i++)
+		mmcs[i]->has_init = 0;
+	ut_assertok(mmc_init_devices(mmcs, MMC_TEST_DEVS));
+	for (i = 0; i < MMC_TEST_DEVS; i++) {
+		ut_assert(mmcs[i]->has_init);
+		ut_assert(!mmcs[i]->init_in_progress);
+		ut_asserteq(512, mmcs[i]->read_bl_len);
+		sandbox_mmc_get_stats(devs[i], &stats);
+		ut_asserteq(MMC_TEST_POWER_UP_POLLS, stats.op_cond_polls);
+		ut_asserteq(MMC_TEST_DEVS, stats.power_up_overlap);
+	}
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_init_parallel, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test carrying on with a card set up by an earlier phase */
+static int dm_test_mmc_handoff(struct unit_test_state *uts)
+{
+	struct sandbox_mmc_stats full, resumed;
+	struct mmc_handoff *ho;
+	struct udevice *dev;
+	struct mmc_cmd cmd;
+	struct mmc *mmc;
+	u64 capacity;
+	u32 cid[4];
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	mmc = mmc_get_mmc_dev(dev);
+	ut_assertok(bloblist_new(CONFIG_BLOBLIST_ADDR, CONFIG_BLOBLIST_SIZE,
+				 0));
+
+	/* Without a record the card is enumerated as usual */
+	mmc->has_init = 0;
+	sandbox_mmc_get_stats(dev, &full);
+	ut_assertok(mmc_init(mmc));
+	sandbox_mmc_get_stats(dev, &full);
+
+	ut_assertok(mmc_handoff_save(mmc));
+	ho = bloblist_find(BLOBLISTT_MMC_HANDOFF, sizeof(*ho));
+	ut_assertnonnull(ho);
+	ut_asserteq(1, ho->valid);
+	memcpy(cid, mmc->cid, sizeof(cid));
+	capacity = mmc->capacity;
+	memset(mmc->cid, 0x5a, sizeof(mmc->cid));
+	mmc->capacity = 0;
+	mmc->read_bl_len = 0;
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	sandbox_mmc_get_stats(dev, &resumed);
+	ut_assert(mmc->has_init);
+	ut_asserteq(0, ho->valid);
+	ut_assertok(memcmp(cid, mmc->cid, sizeof(cid)));
+	ut_asserteq(512, mmc->read_bl_len);
+	ut_asserteq(512, mmc_get_blk_desc(mmc)->blksz);
+	ut_assert(mmc->capacity == capacity);
+	printf("Starting up the card: enumerated %lu us, resumed %lu us\n",
+	       full.time_us, resumed.time_us);
+	ut_assert(resumed.time_us * 4 < full.time_us);
+
+	/* A card which has been reset is enumerated again */
+	ut_assertok(mmc_handoff_save(mmc));
+	cmd.cmdidx = MMC_CMD_GO_IDLE_STATE;
+	cmd.cmdarg = 0;
+	cmd.resp_type = MMC_RSP_NONE;
+	ut_assertok(dm_mmc_send_cmd(dev, &cmd, NULL));
+	mmc->has_init = 0;
+	mmc->capacity = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(0, ho->valid);
+	ut_assert(mmc->capacity == capacity);
+	sandbox_mmc_get_stats(dev, &resumed);
+	ut_assert(resumed.time_us > full.time_us / 2);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_handoff, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+/* Test that setting up a card again drops what was cached from it */
+static int dm_test_mmc_reinit_cache(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	struct blk_desc *desc;
+	struct udevice *dev;
+	struct mmc *mmc;
+	u8 buf[2 * 512];
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	mmc = mmc_get_mmc_dev(dev);
+	ut_assertok(mmc_init(mmc));
+	desc = mmc_get_blk_desc(mmc);
+
+	blkcache_stats(&stats);
+	ut_asserteq(2, blk_dread(desc, 0, 2, buf));
+	ut_asserteq(2, blk_dread(desc, 0, 2, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.hits);
+
+	/* A card of the same size may have been put in, as with 'mmc rescan' */
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(2, blk_dread(desc, 0, 2, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits);
+	ut_asserteq(1, stats.misses);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_reinit_cache, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+#endif
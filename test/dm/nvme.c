@@ -0,0 +1,169 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the NVMe I/O queue and PRP list handling
+ *
+ * There is no NVMe emulation for sandbox, so the test plays the part of
+ * the controller, picking up commands from the submission queue and
+ * posting completions in its own order.
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <malloc.h>
+#include <dm/test.h>
+#include <test/ut.h>
+#include "../../drivers/nvme/nvme.h"
+
+#define NVME_TEST_DEPTH		8
+#define NVME_TEST_PAGE		4096
+
+/* Post a completion for command @id, as the controller would */
+static void nvme_test_complete(struct nvme_queue *nvmeq, int *tail,
+			       int *phase, u16 id, u16 status)
+{
+	struct nvme_completion *cqe = &nvmeq->cqes[*tail];
+
+	cqe->command_id = cpu_to_le16(id);
+	cqe->status = cpu_to_le16(status << 1 | *phase);
+	if (++*tail == nvmeq->q_depth) {
+		*tail = 0;
+		*phase = !*phase;
+	}
+}
+
+static int dm_test_nvme_prp(struct unit_test_state *uts)
+{
+	struct nvme_dev dev;
+	int lists[NVME_PRP_LISTS];
+	u64 prp2, *list;
+	ulong buf;
+	int i, idx;
+
+	memset(&dev, '\0', sizeof(dev));
+	dev.page_size = NVME_TEST_PAGE;
+	ut_assertok(nvme_init_prp_pool(&dev));
+	buf = 0x100000;
+
+	/* Up to two pages need no list */
+	ut_assertok(nvme_setup_prps(&dev, &prp2, &idx, 512, buf + 0x200));
+	ut_asserteq(0, prp2);
+	ut_asserteq(-1, idx);
+	ut_assertok(nvme_setup_prps(&dev, &prp2, &idx, NVME_TEST_PAGE,
+				    buf + 0x200));
+	ut_asserteq(buf + NVME_TEST_PAGE, prp2);
+	ut_asserteq(-1, idx);
+
+	/* An unaligned buffer spanning five pages needs a list of four */
+	ut_assertok(nvme_setup_prps(&dev, &prp2, &idx, 4 * NVME_TEST_PAGE,
+				    buf + 0x200));
+	ut_asserteq(0, idx);
+	list = (u64 *)(ulong)prp2;
+	ut_asserteq_ptr(dev.prp_pool, list);
+	for (i = 0; i < 4; i++)
+		ut_asserteq(buf + (i + 1) * NVME_TEST_PAGE, list[i]);
+
+	/* The lists run out, then one is given back */
+	lists[0] = idx;
+	for (i = 1; i < NVME_PRP_LISTS; i++) {
+		ut_assertok(nvme_setup_prps(&dev, &prp2, &lists[i],
+					    3 * NVME_TEST_PAGE, buf));
+		ut_asserteq(i, lists[i]);
+	}
+	ut_asserteq(-EBUSY, nvme_setup_prps(&dev, &prp2, &idx,
+					    3 * NVME_TEST_PAGE, buf));
+	dev.prp_free |= 1 << 3;
+	ut_assertok(nvme_setup_prps(&dev, &prp2, &idx, 3 * NVME_TEST_PAGE,
+				    buf));
+	ut_asserteq(3, idx);
+
+	/* A transfer too large for one list is refused */
+	dev.prp_free = 1;
+	ut_asserteq(-EINVAL, nvme_setup_prps(&dev, &prp2, &idx,
+					     (NVME_TEST_PAGE / 8 + 2) *
+					     NVME_TEST_PAGE, buf));
+	free(dev.prp_pool);
+
+	return 0;
+}
+DM_TEST(dm_test_nvme_prp, 0);
+
+static int dm_test_nvme_queue(struct unit_test_state *uts)
+{
+	struct nvme_queue *queues[2] = { NULL };
+	u32 dbs[4] = { 0 };
+	struct nvme_queue *nvmeq;
+	struct nvme_command c;
+	int tail, phase, round;
+	struct nvme_dev dev;
+	int i, idx, sq_tail;
+	ulong ctx, seen;
+	u64 prp2;
+
+	memset(&dev, '\0', sizeof(dev));
+	dev.page_size = NVME_TEST_PAGE;
+	dev.db_stride = 1;
+	dev.dbs = dbs;
+	dev.queues = queues;
+	ut_assertok(nvme_init_prp_pool(&dev));
+	nvmeq = nvme_alloc_queue(&dev, 1, NVME_TEST_DEPTH);
+	ut_assertnonnull(nvmeq);
+	nvmeq->cq_phase = 1;
+
+	tail = 0;
+	phase = 1;
+	sq_tail = 0;
+	memset(&c, '\0', sizeof(c));
+	c.rw.opcode = nvme_cmd_read;
+
+	/* Go round the queues a few times, so that the phase flips */
+	for (round = 0; round < 4; round++) {
+		/* Fill the queue, every other command with a PRP list */
+		for (i = 0; i < NVME_TEST_DEPTH - 1; i++) {
+			ut_assertok(nvme_setup_prps(&dev, &prp2, &idx,
+						    i % 2 ? 3 * NVME_TEST_PAGE :
+						    512, 0x100000));
+			c.rw.slba = cpu_to_le64(round * 100 + i);
+			ut_assertok(nvme_submit_async_cmd(nvmeq, &c, idx, i));
+		}
+		ut_asserteq(NVME_TEST_DEPTH - 1, nvmeq->inflight);
+		ut_asserteq(-EBUSY, nvme_submit_async_cmd(nvmeq, &c, -1, 0));
+
+		/* Check the commands the controller would see */
+		for (i = 0; i < NVME_TEST_DEPTH - 1; i++) {
+			struct nvme_command *cmd = &nvmeq->sq_cmds[sq_tail];
+
+			ut_asserteq(round * 100 + i, le64_to_cpu(cmd->rw.slba));
+			ut_asserteq(i, le16_to_cpu(cmd->common.command_id));
+			sq_tail = (sq_tail + 1) % NVME_TEST_DEPTH;
+		}
+		ut_asserteq(sq_tail, nvmeq->sq_tail);
+
+		/* Complete them backwards, with one failing */
+		for (i = NVME_TEST_DEPTH - 2; i >= 0; i--)
+			nvme_test_complete(nvmeq, &tail, &phase, i,
+					   i == 2 ? 0x81 : 0);
+		seen = 0;
+		for (i = NVME_TEST_DEPTH - 2; i >= 0; i--) {
+			ut_asserteq(i == 2 ? -EIO : 0,
+				    nvme_reap_cmd(nvmeq, &ctx, 1));
+			ut_asserteq(i, ctx);
+			seen |= 1 << ctx;
+		}
+		ut_asserteq((1 << (NVME_TEST_DEPTH - 1)) - 1, seen);
+		ut_asserteq(0, nvmeq->inflight);
+		ut_asserteq((1 << NVME_PRP_LISTS) - 1, dev.prp_free);
+
+		/* Nothing more has completed */
+		ut_asserteq(-ETIMEDOUT, nvme_reap_cmd(nvmeq, &ctx, 1));
+	}
+
+	/* A completion for a command not in flight is reported */
+	nvme_test_complete(nvmeq, &tail, &phase, 3, 0);
+	ut_asserteq(-EPROTO, nvme_reap_cmd(nvmeq, &ctx, 1));
+
+	nvme_free_queue(nvmeq);
+	free(dev.prp_pool);
+
+	return 0;
+}
+DM_TEST(dm_test_nvme_queue, 0);
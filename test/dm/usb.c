@@ -55,6 +55,43 @@ static int dm_test_usb_flash(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_usb_flash, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
 
+/* Test that a flash stick offering UAS is used through it, with streams */
+static int dm_test_usb_flash_uas(struct unit_test_state *uts)
+{
+	struct udevice *blk, *emul = NULL;
+	struct blk_desc *dev_desc;
+	char *buf;
+
+	state_set_skip_delays(true);
+	ut_assertok(usb_init());
+
+	/* The stick numbering depends on the hub, so look for it by name */
+	for (blk_first_device(IF_TYPE_USB, &blk); blk; blk_next_device(&blk)) {
+		ut_assertok(usb_emul_find_for_dev(dev_get_parent(blk), &emul));
+		if (!strcmp("flash-stick@4", emul->name))
+			break;
+	}
+	ut_assertnonnull(blk);
+	ut_asserteq(IS_ENABLED(CONFIG_USB_STORAGE_UAS),
+		    sandbox_flash_get_altsetting(emul));
+	/* Each command tag gets a stream */
+	ut_asserteq(IS_ENABLED(CONFIG_USB_STORAGE_UAS) ? 16 : 0,
+		    sandbox_flash_get_streams(emul));
+
+	/* Read enough blocks to need several commands */
+	dev_desc = dev_get_uclass_platdata(blk);
+	ut_asserteq(512, dev_desc->blksz);
+	buf = calloc(64, 512);
+	ut_assertnonnull(buf);
+	ut_asserteq(64, blk_dread(dev_desc, 0, 64, buf));
+	ut_assertok(strcmp(buf, "this is a test"));
+	free(buf);
+	ut_assertok(usb_stop());
+
+	return 0;
+}
+DM_TEST(dm_test_usb_flash_uas, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
 /* test that we can handle multiple storage devices */
 static int dm_test_usb_multi(struct unit_test_state *uts)
 {
@@ -107,7 +144,7 @@ static int dm_test_usb_stop(struct unit_test_state *uts)
 	ut_assertok(uclass_get_device(UCLASS_MASS_STORAGE, 0, &dev));
 	ut_assertok(uclass_get_device(UCLASS_MASS_STORAGE, 1, &dev));
 	ut_assertok(uclass_get_device(UCLASS_MASS_STORAGE, 2, &dev));
-	ut_asserteq(6, count_usb_devices());
+	ut_asserteq(7, count_usb_devices());
 	ut_assertok(usb_stop());
 	ut_asserteq(0, count_usb_devices());
 
@@ -4,15 +4,19 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <dm.h>
+#include <malloc.h>
 #include <virtio_types.h>
 #include <virtio.h>
 #include <virtio_ring.h>
+#include <asm/test.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
 #include <dm/root.h>
 #include <dm/test.h>
 #include <test/ut.h>
+#include "../../drivers/virtio/virtio_blk.h"
 
 /* Basic test of the virtio uclass */
 static int dm_test_virtio_base(struct unit_test_state *uts)
@@ -120,3 +124,75 @@ static int dm_test_virtio_remove(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_virtio_remove, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+#define VIRTIO_TEST_SECTORS	512
+#define VIRTIO_TEST_REQS	8	/* with 32KiB requests */
+
+/* Offer @features, probe virtio-blk again and read and write the disk */
+static int virtio_test_blk_rw(struct unit_test_state *uts, struct udevice *bus,
+			      u64 features, struct sandbox_virtio_stats *stats)
+{
+	struct blk_desc *desc;
+	struct udevice *dev;
+	u8 *buf, *cmp;
+	int i;
+
+	ut_assertok(device_find_first_child(bus, &dev));
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	sandbox_virtio_set_features(bus, features);
+	ut_assertok(device_probe(dev));
+	desc = dev_get_uclass_platdata(dev);
+	ut_asserteq(VIRTIO_TEST_SECTORS, desc->lba);
+	blkcache_invalidate(desc->if_type, desc->devnum);
+
+	buf = malloc(VIRTIO_TEST_SECTORS * 512);
+	cmp = malloc(VIRTIO_TEST_SECTORS * 512);
+	ut_assertnonnull(buf);
+	ut_assertnonnull(cmp);
+	for (i = 0; i < VIRTIO_TEST_SECTORS * 512; i++)
+		buf[i] = i ^ features;
+	ut_asserteq(VIRTIO_TEST_SECTORS,
+		    blk_dwrite(desc, 0, VIRTIO_TEST_SECTORS, buf));
+	sandbox_virtio_get_stats(bus, stats);
+	ut_asserteq(VIRTIO_TEST_SECTORS,
+		    blk_dread(desc, 0, VIRTIO_TEST_SECTORS, cmp));
+	sandbox_virtio_get_stats(bus, stats);
+	ut_assertok(memcmp(buf, cmp, VIRTIO_TEST_SECTORS * 512));
+
+	/* A transfer past the end fails from the first bad request */
+	ut_asserteq(VIRTIO_TEST_SECTORS - 64,
+		    blk_dread(desc, 64, VIRTIO_TEST_SECTORS, cmp));
+	free(buf);
+	free(cmp);
+
+	return 0;
+}
+
+/* Test batched requests with and without indirect descriptors */
+static int dm_test_virtio_blk_batch(struct unit_test_state *uts)
+{
+	struct sandbox_virtio_stats stats;
+	struct udevice *bus;
+	u64 features;
+
+	ut_assertok(uclass_first_device(UCLASS_VIRTIO, &bus));
+	features = 1ULL << VIRTIO_F_VERSION_1 | 1ULL << VIRTIO_BLK_F_SIZE_MAX;
+
+	/* Each request takes three of the four ring entries */
+	ut_assertok(virtio_test_blk_rw(uts, bus, features, &stats));
+	ut_asserteq(VIRTIO_TEST_REQS, stats.req_count);
+	ut_asserteq(VIRTIO_TEST_REQS, stats.notify_count);
+	ut_asserteq(0, stats.indirect_count);
+	ut_asserteq(1, stats.max_batch);
+
+	/* With indirect tables, four requests go with each notification */
+	features |= 1ULL << VIRTIO_RING_F_INDIRECT_DESC;
+	ut_assertok(virtio_test_blk_rw(uts, bus, features, &stats));
+	ut_asserteq(VIRTIO_TEST_REQS, stats.req_count);
+	ut_asserteq(VIRTIO_TEST_REQS / 4, stats.notify_count);
+	ut_asserteq(VIRTIO_TEST_REQS, stats.indirect_count);
+	ut_asserteq(4, stats.max_batch);
+
+	return 0;
+}
+DM_TEST(dm_test_virtio_blk_batch, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
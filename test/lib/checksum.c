@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the Internet checksum in net/checksum.c
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <net.h>
+#include <dm/test.h>
+#include <test/ut.h>
+#include <asm/unaligned.h>
+
+#define CSUM_BUF_SIZE	2048
+#define CSUM_BENCH_SIZE	(64 << 10)
+#define CSUM_BENCH_LOOPS	512
+
+/* The plain 16-bit word at a time routine the fast one must agree with */
+static unsigned ref_ip_checksum(const void *vptr, unsigned nbytes)
+{
+	const u8 *ptr = vptr;
+	u32 sum = 0;
+	u16 word;
+
+	while (nbytes > 1) {
+		memcpy(&word, ptr, 2);
+		sum += word;
+		ptr += 2;
+		nbytes -= 2;
+	}
+	if (nbytes == 1) {
+		word = 0;
+		((u8 *)&word)[0] = *ptr;
+		sum += word;
+	}
+	while (sum >> 16)
+		sum = (sum >> 16) + (sum & 0xffff);
+
+	return ~sum & 0xffff;
+}
+
+static u32 csum_rand(u32 *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+
+	return *seed >> 16;
+}
+
+static int lib_test_ip_checksum(struct unit_test_state *uts)
+{
+	unsigned off, len;
+	u32 seed = 1;
+	u8 *buf;
+	int i;
+
+	buf = malloc(CSUM_BUF_SIZE + 8);
+	ut_assertnonnull(buf);
+
+	/* Every alignment and short length, then random spans */
+	for (i = 0; i < 2000; i++) {
+		int j;
+
+		for (j = 0; j < CSUM_BUF_SIZE + 8; j++)
+			buf[j] = csum_rand(&seed);
+		if (i < 8 * 64) {
+			off = i % 8;
+			len = i / 8;
+		} else {
+			off = csum_rand(&seed) % 8;
+			len = csum_rand(&seed) % (CSUM_BUF_SIZE + 1);
+		}
+		ut_asserteq(ref_ip_checksum(buf + off, len),
+			    compute_ip_checksum(buf + off, len));
+	}
+
+	/* All ones sums to 0xffff, so the checksum is 0 and not 0xffff */
+	memset(buf, 0xff, CSUM_BUF_SIZE);
+	for (off = 0; off < 4; off++)
+		ut_asserteq(0, compute_ip_checksum(buf + off, 64));
+	memset(buf, '\0', CSUM_BUF_SIZE);
+	for (off = 0; off < 4; off++)
+		ut_asserteq(0xffff, compute_ip_checksum(buf + off, 63));
+
+	/* A checksum stored in the data makes it check out */
+	for (i = 0; i < 64; i++)
+		buf[i] = csum_rand(&seed);
+	buf[10] = 0;
+	buf[11] = 0;
+	put_unaligned(compute_ip_checksum(buf, 20), (u16 *)(buf + 10));
+	ut_assert(ip_checksum_ok(buf, 20));
+	buf[3] ^= 1;
+	ut_assert(!ip_checksum_ok(buf, 20));
+
+	free(buf);
+
+	return 0;
+}
+
+DM_TEST(lib_test_ip_checksum, 0);
+
+static int lib_test_ip_checksum_speed(struct unit_test_state *uts)
+{
+	ulong start, ref_ms, fast_ms;
+	unsigned ref, fast;
+	u32 seed = 1;
+	u8 *buf;
+	int i;
+
+	buf = malloc(CSUM_BENCH_SIZE);
+	ut_assertnonnull(buf);
+	for (i = 0; i < CSUM_BENCH_SIZE; i++)
+		buf[i] = csum_rand(&seed);
+
+	start = get_timer(0);
+	for (i = 0, ref = 0; i < CSUM_BENCH_LOOPS; i++)
+		ref += ref_ip_checksum(buf, CSUM_BENCH_SIZE);
+	ref_ms = max(get_timer(start), 1UL);
+
+	start = get_timer(0);
+	for (i = 0, fast = 0; i < CSUM_BENCH_LOOPS; i++)
+		fast += compute_ip_checksum(buf, CSUM_BENCH_SIZE);
+	fast_ms = max(get_timer(start), 1UL);
+	ut_asserteq(ref, fast);
+
+	printf("IP checksum of %d KiB: 16-bit words %lu MB/s, 32-bit words %lu MB/s\n",
+	       CSUM_BENCH_SIZE >> 10,
+	       (ulong)CSUM_BENCH_SIZE * CSUM_BENCH_LOOPS / 1000 / ref_ms,
+	       (ulong)CSUM_BENCH_SIZE * CSUM_BENCH_LOOPS / 1000 / fast_ms);
+	free(buf);
+
+	return 0;
+}
+
+DM_TEST(lib_test_ip_checksum_speed, 0);
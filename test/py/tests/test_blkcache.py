@@ -0,0 +1,102 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# Benchmark the block cache with directory walks on a sandbox host device
+
+import os
+import pytest
+import re
+import u_boot_utils
+
+"""
+These tests walk every directory of a FAT and an ext4 image, first with the
+block cache disabled and then with it enabled, and log the time taken and
+the cache statistics. The images are created by the test.
+"""
+
+BLKCACHE_DIRS = 32
+BLKCACHE_FILES = 64
+
+def mk_tree(path):
+    """Create a tree of directories full of small files."""
+    os.makedirs(path)
+    for d in range(BLKCACHE_DIRS):
+        dname = '%s/dir%02d' % (path, d)
+        os.mkdir(dname)
+        for f in range(BLKCACHE_FILES):
+            with open('%s/file%03d.txt' % (dname, f), 'w') as fd:
+                fd.write('%d %d\n' % (d, f))
+
+def mk_image(u_boot_console, fs_type):
+    """Create a 64MiB image of type fs_type holding the tree."""
+    dir = u_boot_console.config.persistent_data_dir
+    img = '%s/blkcache.%s.img' % (dir, fs_type)
+    tree = '%s/blkcache.tree' % dir
+    if os.path.exists(img):
+        return img
+    if not os.path.exists(tree):
+        mk_tree(tree)
+    with open(img, 'wb') as fd:
+        fd.truncate(64 << 20)
+    if fs_type == 'ext4':
+        u_boot_utils.run_and_log(u_boot_console,
+            ['mkfs.ext4', '-q', '-b', '1024', '-d', tree, img])
+    else:
+        u_boot_utils.run_and_log(u_boot_console,
+            ['mkfs.vfat', '-F', '32', img])
+        u_boot_utils.run_and_log(u_boot_console,
+            ['mcopy', '-s', '-i', img] +
+            ['%s/dir%02d' % (tree, d) for d in range(BLKCACHE_DIRS)] +
+            ['::/'])
+    return img
+
+def walk(u_boot_console, fs_type):
+    """List every directory, returning the time taken in ms."""
+    cmds = ['%sls host 0 /dir%02d' % (fs_type, d)
+            for d in range(BLKCACHE_DIRS)]
+    u_boot_console.run_command('timer start')
+    for cmd in cmds:
+        output = u_boot_console.run_command(cmd)
+        assert 'file%03d.txt' % (BLKCACHE_FILES - 1) in output.lower()
+    output = u_boot_console.run_command('timer get')
+    return int(float(output) * 1000)
+
+def run_walk(u_boot_console, fs_type):
+    """Walk the image without and then with the cache, and log the result."""
+    img = mk_image(u_boot_console, fs_type)
+    output = u_boot_console.run_command('blkcache show')
+    entries = re.search('max cache entries: (\d+)', output).group(1)
+    blocks = re.search('max blocks/entry: (\d+)', output).group(1)
+
+    u_boot_console.run_command('host bind 0 %s' % img)
+    u_boot_console.run_command('blkcache configure %s 0' % blocks)
+    uncached = walk(u_boot_console, fs_type)
+    u_boot_console.run_command('blkcache configure %s %s' % (blocks, entries))
+    cached = walk(u_boot_console, fs_type)
+    output = u_boot_console.run_command('blkcache show')
+    u_boot_console.run_command('host bind 0')
+
+    hits = int(re.search('hits: (\d+)', output).group(1))
+    misses = int(re.search('misses: (\d+)', output).group(1))
+    u_boot_console.log.info('%s walk: %d ms uncached, %d ms cached, '
+                            '%d hits, %d misses' %
+                            (fs_type, uncached, cached, hits, misses))
+    assert hits > misses
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_block_cache')
+@pytest.mark.buildconfigspec('cmd_ext4')
+@pytest.mark.buildconfigspec('cmd_timer')
+@pytest.mark.requiredtool('mkfs.ext4')
+def test_blkcache_ext4(u_boot_console):
+    """Benchmark the block cache on an ext4 directory walk."""
+    run_walk(u_boot_console, 'ext4')
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_block_cache')
+@pytest.mark.buildconfigspec('cmd_fat')
+@pytest.mark.buildconfigspec('cmd_timer')
+@pytest.mark.requiredtool('mkfs.vfat')
+@pytest.mark.requiredtool('mcopy')
+def test_blkcache_fat(u_boot_console):
+    """Benchmark the block cache on a FAT directory walk."""
+    run_walk(u_boot_console, 'fat')
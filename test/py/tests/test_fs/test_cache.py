@@ -0,0 +1,89 @@
+# SPDX-License-Identifier:      GPL-2.0+
+#
+# U-Boot File System: File Lookup Cache Test
+
+"""
+This test verifies that repeated 'test -e', 'size' and 'load' commands are
+answered from the file lookup cache, including for missing files, and that
+writing a file drops the cached lookups of the device.
+"""
+
+import pytest
+import re
+from fstest_defs import *
+
+def cache_stats(u_boot_console):
+    output = u_boot_console.run_command('fscache')
+    m = re.search('(\d+) hits, (\d+) misses, (\d+) paths', output)
+    return int(m.group(1)), int(m.group(2)), int(m.group(3))
+
+def check(u_boot_console, cmd):
+    output = u_boot_console.run_command(cmd + ' && echo yes || echo no')
+    return output.strip() == 'yes'
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('fs_cache')
+@pytest.mark.slow
+class TestFsCache(object):
+    def test_cache1(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 1 - lookups are answered from the cache
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        with u_boot_console.log.section('Test Case 1 - cached lookups'):
+            u_boot_console.run_command('host bind 0 %s' % fs_img)
+            hits, misses, paths = cache_stats(u_boot_console)
+            assert(paths == 0)
+
+            for i in range(4):
+                assert(check(u_boot_console,
+                    'test -e host 0:0 /%s' % SMALL_FILE))
+                assert(not check(u_boot_console,
+                    'test -e host 0:0 /missing.file'))
+                assert(check(u_boot_console,
+                    'size host 0:0 /%s' % SMALL_FILE))
+                output = u_boot_console.run_command('printenv filesize')
+                assert('filesize=100000' in output)
+            # Only the first 'test -e' of each path misses. The first 'size'
+            # reuses the directory entry found by 'test -e'.
+            assert(cache_stats(u_boot_console) ==
+                (hits + 10, misses + 2, 2))
+
+    def test_cache2(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 2 - a write drops the cached lookups of the device
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        with u_boot_console.log.section('Test Case 2 - write'):
+            u_boot_console.run_command('host bind 0 %s' % fs_img)
+            assert(not check(u_boot_console,
+                'test -e host 0:0 /missing.file'))
+            assert(cache_stats(u_boot_console)[2] == 1)
+
+            u_boot_console.run_command_list([
+                'mw.b %x 0 10' % ADDR,
+                'save host 0:0 %x /missing.file 10' % ADDR])
+            assert(cache_stats(u_boot_console)[2] == 0)
+            assert(check(u_boot_console, 'test -e host 0:0 /missing.file'))
+            assert(check(u_boot_console, 'size host 0:0 /missing.file'))
+            output = u_boot_console.run_command('printenv filesize')
+            assert('filesize=10' in output)
+
+    def test_cache3(self, u_boot_console, fs_obj_basic):
+        """
+        Test Case 3 - a load reuses the lookup of an earlier load
+        """
+        fs_type,fs_img,md5val = fs_obj_basic
+        with u_boot_console.log.section('Test Case 3 - load'):
+            u_boot_console.run_command('host bind 0 %s' % fs_img)
+            hits, misses, paths = cache_stats(u_boot_console)
+            for i in range(2):
+                output = u_boot_console.run_command_list([
+                    'load host 0:0 %x /%s' % (ADDR, SMALL_FILE),
+                    'md5sum %x $filesize' % ADDR])
+                assert(md5val[0] in ''.join(output))
+            assert(cache_stats(u_boot_console) == (hits + 1, misses + 1, 1))
+
+            output = u_boot_console.run_command('bootstage report')
+            assert('fs_cache (%d hits, %d misses)' % (hits + 1, misses + 1)
+                   in output)
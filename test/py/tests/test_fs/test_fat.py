@@ -0,0 +1,147 @@
+# SPDX-License-Identifier:      GPL-2.0+
+#
+# U-Boot File System: FAT Test
+
+"""
+This test verifies reads of a fragmented file on FAT, hashing it while it
+loads, the free count kept in FSInfo and a write to a full volume.
+"""
+
+import hashlib
+import pytest
+import struct
+from subprocess import check_output
+from fstest_defs import *
+
+# Each piece of the fragmented file is bigger than any cluster, so that the
+# file ends up in one run of clusters per piece
+FRAG_PIECES = 8
+FRAG_PIECE_SIZE = 0x10000
+
+def frag_pattern(piece):
+    """Return the 32-bit word which fills one piece of the fragmented file."""
+    return 0x01010101 * (piece + 1) ^ 0xa5a5a5a5
+
+def frag_data():
+    """Return the expected contents of the fragmented file."""
+    data = b''
+    for i in range(FRAG_PIECES):
+        data += struct.pack('<I', frag_pattern(i)) * (FRAG_PIECE_SIZE // 4)
+    return data
+
+def check_md5(u_boot_console, addr, data):
+    """Check that memory at addr holds data."""
+    output = u_boot_console.run_command('md5sum %x %x' % (addr, len(data)))
+    assert(hashlib.md5(data).hexdigest() in output)
+
+def fsck(fs_img):
+    """Check a volume with fsck.vfat, without changing it."""
+    output = check_output('fsck.vfat -n %s 2>&1; echo rc=$?' % fs_img,
+        shell=True).decode()
+    assert('Free cluster summary' not in output)
+    assert('rc=0' in output)
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.slow
+class TestFat(object):
+    def test_fat1(self, u_boot_console, fs_obj_fat):
+        """
+        Test Case 1 - read a fragmented file at offsets within and across
+        runs of clusters
+        """
+        fs_type,fs_img = fs_obj_fat
+        with u_boot_console.log.section('Test Case 1a - fragment a file'):
+            # Growing a second file in turn puts a gap after every piece.
+            # Only a few files are made, since a directory cannot grow
+            # past its first cluster.
+            u_boot_console.run_command('host bind 0 %s' % fs_img)
+            for i in range(FRAG_PIECES):
+                output = u_boot_console.run_command_list([
+                    'mw.l %x %08x %x' % (ADDR, frag_pattern(i),
+                                        FRAG_PIECE_SIZE // 4),
+                    '%swrite host 0:0 %x /frag.bin %x %x'
+                        % (fs_type, ADDR, FRAG_PIECE_SIZE,
+                           i * FRAG_PIECE_SIZE),
+                    '%swrite host 0:0 %x /gap.bin %x %x'
+                        % (fs_type, ADDR, FRAG_PIECE_SIZE,
+                           i * FRAG_PIECE_SIZE)])
+                assert('Error' not in ''.join(output))
+
+        data = frag_data()
+        with u_boot_console.log.section('Test Case 1b - whole file'):
+            output = u_boot_console.run_command_list([
+                '%sload host 0:0 %x /frag.bin' % (fs_type, ADDR),
+                'printenv filesize'])
+            assert('filesize=%x' % len(data) in ''.join(output))
+            check_md5(u_boot_console, ADDR, data)
+
+        with u_boot_console.log.section('Test Case 1c - offsets'):
+            for offset, length in [
+                    (0x100, 0x200),
+                    (2 * FRAG_PIECE_SIZE + 0x1234, 0x400),
+                    (FRAG_PIECE_SIZE - 0x100, 0x200),
+                    (3 * FRAG_PIECE_SIZE + 0x123, 2 * FRAG_PIECE_SIZE + 5),
+                    (1, len(data) - 1),
+                    (len(data) - 0x10, 0x10)]:
+                output = u_boot_console.run_command(
+                    '%sload host 0:0 %x /frag.bin %x %x'
+                        % (fs_type, ADDR, length, offset))
+                assert('%d bytes read' % length in output)
+                check_md5(u_boot_console, ADDR,
+                          data[offset:offset + length])
+
+        with u_boot_console.log.section('Test Case 1d - hash while loading'):
+            output = u_boot_console.run_command_list([
+                'setenv loadhash sha256',
+                '%sload host 0:0 %x /frag.bin' % (fs_type, ADDR),
+                'setenv loadhash',
+                'printenv loadhashsum'])
+            assert('loadhashsum=%s' % hashlib.sha256(data).hexdigest()
+                   in ''.join(output))
+
+    @pytest.mark.requiredtool('fsck.vfat')
+    def test_fat2(self, u_boot_console, fs_obj_fat):
+        """
+        Test Case 2 - the FSInfo free count matches the FAT after writing
+        and removing files
+        """
+        fs_type,fs_img = fs_obj_fat
+        with u_boot_console.log.section('Test Case 2a - after write'):
+            fsck(fs_img)
+
+        with u_boot_console.log.section('Test Case 2b - after rm'):
+            output = u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                '%srm host 0:0 /gap.bin' % fs_type])
+            assert('Error' not in ''.join(output))
+            fsck(fs_img)
+
+        with u_boot_console.log.section('Test Case 2c - write after rm'):
+            output = u_boot_console.run_command_list([
+                'mw.b %x 5a %x' % (ADDR, 3 * FRAG_PIECE_SIZE),
+                '%swrite host 0:0 %x /holes.bin %x'
+                    % (fs_type, ADDR, 3 * FRAG_PIECE_SIZE)])
+            assert('Error' not in ''.join(output))
+            fsck(fs_img)
+
+    def test_fat3(self, u_boot_console, fs_obj_fat):
+        """
+        Test Case 3 - a write to a full volume fails with no space left
+        """
+        fs_type,fs_img = fs_obj_fat
+        with u_boot_console.log.section('Test Case 3 - no space left'):
+            u_boot_console.run_command_list([
+                'host bind 0 %s' % fs_img,
+                'mw.b %x 5a 1000000' % ADDR])
+            for i in range(8):
+                output = u_boot_console.run_command(
+                    '%swrite host 0:0 %x /fill%d.bin 1000000'
+                        % (fs_type, ADDR, i))
+                if 'no space left' in output:
+                    break
+            assert('no space left' in output)
+
+            # The failed write leaves the other files alone
+            u_boot_console.run_command(
+                '%sload host 0:0 %x /frag.bin' % (fs_type, ADDR))
+            check_md5(u_boot_console, ADDR, frag_data())
@@ -5,6 +5,7 @@
 # Test GPT manipulation commands.
 
 import os
+import re
 import pytest
 import u_boot_utils
 
@@ -173,3 +174,32 @@ def test_gpt_write(state_disk_image, u_boot_console):
     assert '0x00001000	0x00001bff	"second"' in output
     output = u_boot_console.run_command('gpt guid host 0')
     assert '375a56f7-d6c9-4e81-b5f0-09d41ca89efe' in output
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_gpt')
+@pytest.mark.buildconfigspec('cmd_gpt_rename')
+@pytest.mark.buildconfigspec('cmd_part')
+@pytest.mark.buildconfigspec('efi_partition_cache')
+@pytest.mark.requiredtool('sgdisk')
+def test_gpt_cache(state_disk_image, u_boot_console):
+    """Test that the GPT is cached until the disk is written."""
+
+    def cache_stats():
+        output = u_boot_console.run_command('part list host 0 -v')
+        m = re.search('GPT cache: (\d+) hits, (\d+) misses', output)
+        return int(m.group(1)), int(m.group(2))
+
+    u_boot_console.run_command('host bind 0 ' + state_disk_image.path)
+    hits, misses = cache_stats()
+    u_boot_console.run_command('part start host 0 second start')
+    output = u_boot_console.run_command('printenv start')
+    assert 'start=1000' in output
+    # The name lookup and 'part list' itself are served from the cache
+    assert cache_stats() == (hits + 2, misses)
+    u_boot_console.run_command('gpt rename host 0 2 third')
+    u_boot_console.run_command('part start host 0 third start')
+    output = u_boot_console.run_command('printenv start')
+    assert 'start=1000' in output
+    hits, new_misses = cache_stats()
+    assert new_misses > misses
+    u_boot_console.run_command('gpt rename host 0 2 second')